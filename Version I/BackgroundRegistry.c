@@ -0,0 +1,322 @@
+//
+//  BackgroundRegistry.c
+//  Project
+//
+//  The cameras are found through a hash table on their id.  Each loaded
+//  background remembers the time of its last use and the identity of the
+//  file it was read from (inode, size, modification time), checked with
+//  one stat() at each use.  Eviction unloads the least recently used
+//  backgrounds, but keeps their camera and file path.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+//
+#include "BackgroundRegistry.h"
+
+//	End of a hash chain
+#define NO_ENTRY	0xFFFFFFFFU
+
+typedef struct BackgroundEntry
+{
+	char* cameraId;
+	char* filePath;
+
+	//	next entry of the same hash bucket
+	unsigned int next;
+
+	//	raster NULL when not loaded
+	ImageStruct grey;
+
+	//	the file the grey plane was read from
+	ino_t inode;
+	off_t fileSize;
+	struct timespec modified;
+
+	uint64_t lastUse;
+
+} BackgroundEntry;
+
+struct BackgroundRegistry
+{
+	size_t memoryBudget, memoryUsed;
+	GreyFormula formula;
+	ThreadPool* pool;
+
+	BackgroundEntry* entries;
+	unsigned int nbEntries, capacity;
+
+	//	first entry of each bucket; the number of buckets is a power of two
+	//	at least equal to the number of entries
+	unsigned int* buckets;
+	unsigned int nbBuckets;
+
+	uint64_t clock;
+	unsigned long nbHits, nbLoads, nbReloads, nbEvictions;
+};
+
+static void* allocateOrDie(size_t size) {
+	void* p = malloc(size);
+	if (p == NULL) {
+		printf("Unable to allocate the background registry\n");
+		exit(190);
+	}
+	return p;
+}
+
+static char* copyString(const char* s) {
+	char* copy = (char*) allocateOrDie(strlen(s) + 1);
+	strcpy(copy, s);
+	return copy;
+}
+
+static unsigned int hashId(const char* id) {
+	uint32_t hash = 2166136261u;
+	for (; *id != '\0'; id++) {
+		hash = (hash ^ (unsigned char) *id) * 16777619u;
+	}
+	return hash;
+}
+
+static size_t planeBytes(const ImageStruct* grey) {
+	return (size_t) abs(grey->bytesPerRow) * grey->nbRows;
+}
+
+//-----------------------------------------------------------
+//	Creation
+//-----------------------------------------------------------
+BackgroundRegistry* newBackgroundRegistry(size_t memoryBudget, GreyFormula formula, ThreadPool* pool) {
+	BackgroundRegistry* registry = (BackgroundRegistry*) allocateOrDie(sizeof(BackgroundRegistry));
+	memset(registry, 0, sizeof(BackgroundRegistry));
+	registry->memoryBudget = memoryBudget;
+	registry->formula = formula;
+	registry->pool = pool;
+	return registry;
+}
+
+//-----------------------------------------------------------
+//	Lookup
+//-----------------------------------------------------------
+static BackgroundEntry* findEntry(const BackgroundRegistry* registry, const char* cameraId) {
+	if (registry->nbBuckets == 0) {
+		return NULL;
+	}
+	unsigned int k = registry->buckets[hashId(cameraId) & (registry->nbBuckets - 1)];
+	while (k != NO_ENTRY) {
+		if (strcmp(registry->entries[k].cameraId, cameraId) == 0) {
+			return registry->entries + k;
+		}
+		k = registry->entries[k].next;
+	}
+	return NULL;
+}
+
+//	Doubles the number of buckets and puts the entries back in them
+static void growBuckets(BackgroundRegistry* registry) {
+	free(registry->buckets);
+	registry->nbBuckets = (registry->nbBuckets > 0) ? 2*registry->nbBuckets : 16;
+	registry->buckets = (unsigned int*) allocateOrDie(registry->nbBuckets * sizeof(unsigned int));
+	memset(registry->buckets, 0xFF, registry->nbBuckets * sizeof(unsigned int));
+	for (unsigned int k=0; k<registry->nbEntries; k++) {
+		unsigned int bucket = hashId(registry->entries[k].cameraId) & (registry->nbBuckets - 1);
+		registry->entries[k].next = registry->buckets[bucket];
+		registry->buckets[bucket] = k;
+	}
+}
+
+static void unloadEntry(BackgroundRegistry* registry, BackgroundEntry* entry) {
+	if (entry->grey.raster != NULL) {
+		registry->memoryUsed -= planeBytes(&entry->grey);
+		deleteImageStruct(&entry->grey);
+	}
+}
+
+//-----------------------------------------------------------
+//	Registration
+//-----------------------------------------------------------
+int registerBackground(BackgroundRegistry* registry, const char* cameraId, const char* filePath) {
+	struct stat fileInfo;
+	if (stat(filePath, &fileInfo) != 0) {
+		return 11;
+	}
+
+	BackgroundEntry* entry = findEntry(registry, cameraId);
+	if (entry != NULL) {
+		if (strcmp(entry->filePath, filePath) != 0) {
+			unloadEntry(registry, entry);
+			free(entry->filePath);
+			entry->filePath = copyString(filePath);
+		}
+		return 0;
+	}
+
+	if (registry->nbEntries == registry->capacity) {
+		registry->capacity = (registry->capacity > 0) ? 2*registry->capacity : 16;
+		registry->entries = (BackgroundEntry*) realloc(registry->entries,
+													   registry->capacity * sizeof(BackgroundEntry));
+		if (registry->entries == NULL) {
+			printf("Unable to allocate the background registry\n");
+			exit(190);
+		}
+	}
+	entry = registry->entries + registry->nbEntries++;
+	memset(entry, 0, sizeof(BackgroundEntry));
+	entry->cameraId = copyString(cameraId);
+	entry->filePath = copyString(filePath);
+
+	if (registry->nbEntries > registry->nbBuckets) {
+		growBuckets(registry);
+	}
+	else {
+		unsigned int bucket = hashId(cameraId) & (registry->nbBuckets - 1);
+		entry->next = registry->buckets[bucket];
+		registry->buckets[bucket] = registry->nbEntries - 1;
+	}
+	return 0;
+}
+
+int registerBackgroundList(BackgroundRegistry* registry, const char* listPath) {
+	FILE* file = fopen(listPath, "r");
+	if (file == NULL) {
+		return 11;
+	}
+	char line[4096];
+	int err = 0;
+	while (err == 0 && fgets(line, sizeof(line), file) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		char* id = line + strspn(line, " \t");
+		if (*id == '\0' || *id == '#') {
+			continue;
+		}
+		char* path = id + strcspn(id, " \t");
+		if (*path == '\0') {
+			err = 12;
+			break;
+		}
+		*path++ = '\0';
+		path += strspn(path, " \t");
+		err = registerBackground(registry, id, path);
+	}
+	fclose(file);
+	return err;
+}
+
+//-----------------------------------------------------------
+//	Reads the file of an entry into its grey plane, in place when
+//	the size did not change.  Returns 0 if all went well.
+//-----------------------------------------------------------
+static int loadEntry(BackgroundRegistry* registry, BackgroundEntry* entry, const struct stat* fileInfo) {
+	ImageStruct image;
+	int err = tryReadImageFile(entry->filePath, registry->pool, &image);
+	if (err != 0) {
+		return err;
+	}
+
+	if (entry->grey.raster == NULL || entry->grey.nbRows != image.nbRows ||
+		entry->grey.nbCols != image.nbCols) {
+		unloadEntry(registry, entry);
+		entry->grey = newImageStruct(GRAY_RASTER, image.nbRows, image.nbCols);
+		registry->memoryUsed += planeBytes(&entry->grey);
+	}
+	for (unsigned int i=0; i<image.nbRows; i++) {
+		convertRowToGrey(image.type, registry->formula, imageRow(&image, i), image.nbCols,
+						 imageRow(&entry->grey, i));
+	}
+	deleteImageStruct(&image);
+
+	entry->inode = fileInfo->st_ino;
+	entry->fileSize = fileInfo->st_size;
+	entry->modified = fileInfo->st_mtim;
+	return 0;
+}
+
+static int fileChanged(const BackgroundEntry* entry, const struct stat* fileInfo) {
+	return entry->inode != fileInfo->st_ino || entry->fileSize != fileInfo->st_size ||
+		   entry->modified.tv_sec != fileInfo->st_mtim.tv_sec ||
+		   entry->modified.tv_nsec != fileInfo->st_mtim.tv_nsec;
+}
+
+//	Unloads the least recently used backgrounds, except the one in use,
+//	until the budget is met
+static void enforceBudget(BackgroundRegistry* registry, const BackgroundEntry* inUse) {
+	while (registry->memoryUsed > registry->memoryBudget) {
+		BackgroundEntry* oldest = NULL;
+		for (unsigned int k=0; k<registry->nbEntries; k++) {
+			BackgroundEntry* entry = registry->entries + k;
+			if (entry != inUse && entry->grey.raster != NULL &&
+				(oldest == NULL || entry->lastUse < oldest->lastUse)) {
+				oldest = entry;
+			}
+		}
+		if (oldest == NULL) {
+			return;
+		}
+		unloadEntry(registry, oldest);
+		registry->nbEvictions++;
+	}
+}
+
+//-----------------------------------------------------------
+//	Background of a camera
+//-----------------------------------------------------------
+const ImageStruct* acquireBackground(BackgroundRegistry* registry, const char* cameraId) {
+	BackgroundEntry* entry = findEntry(registry, cameraId);
+	if (entry == NULL) {
+		return NULL;
+	}
+
+	struct stat fileInfo;
+	int found = (stat(entry->filePath, &fileInfo) == 0);
+	if (entry->grey.raster == NULL) {
+		if (!found || loadEntry(registry, entry, &fileInfo) != 0) {
+			return NULL;
+		}
+		registry->nbLoads++;
+	}
+	//	a file that disappeared, or that cannot be read yet because it is
+	//	being written, leaves the background as it was
+	else if (found && fileChanged(entry, &fileInfo)) {
+		if (loadEntry(registry, entry, &fileInfo) == 0) {
+			registry->nbReloads++;
+		}
+	}
+	else {
+		registry->nbHits++;
+	}
+
+	entry->lastUse = ++registry->clock;
+	enforceBudget(registry, entry);
+	return &entry->grey;
+}
+
+//-----------------------------------------------------------
+//	Statistics
+//-----------------------------------------------------------
+void printBackgroundRegistryStats(const BackgroundRegistry* registry) {
+	unsigned int nbLoaded = 0;
+	for (unsigned int k=0; k<registry->nbEntries; k++) {
+		nbLoaded += (registry->entries[k].grey.raster != NULL);
+	}
+	printf("Backgrounds: %u cameras, %u loaded (%.1f of %.1f MB); %lu hits, %lu loads, "
+		   "%lu reloads, %lu evictions\n",
+		   registry->nbEntries, nbLoaded, registry->memoryUsed / 1048576.0,
+		   registry->memoryBudget / 1048576.0, registry->nbHits, registry->nbLoads,
+		   registry->nbReloads, registry->nbEvictions);
+}
+
+//-----------------------------------------------------------
+//	Cleanup
+//-----------------------------------------------------------
+void deleteBackgroundRegistry(BackgroundRegistry* registry) {
+	for (unsigned int k=0; k<registry->nbEntries; k++) {
+		unloadEntry(registry, registry->entries + k);
+		free(registry->entries[k].cameraId);
+		free(registry->entries[k].filePath);
+	}
+	free(registry->entries);
+	free(registry->buckets);
+	free(registry);
+}
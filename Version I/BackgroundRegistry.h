@@ -0,0 +1,70 @@
+//-----------------------------------------------------------------
+//	Backgrounds of several cameras, kept as grey planes ready for
+//	the subtraction, under a memory budget
+//-----------------------------------------------------------------
+
+#ifndef BACKGROUND_REGISTRY_H
+#define BACKGROUND_REGISTRY_H
+
+#include <stddef.h>
+#include "fileIO.h"
+#include "Subtraction.h"
+#include "ThreadPool.h"
+
+/**	The registry is only manipulated through pointers, its content is private
+ */
+typedef struct BackgroundRegistry BackgroundRegistry;
+
+/**	Creates an empty registry
+ *	@param	memoryBudget	largest number of bytes of grey planes kept loaded
+ *							(the background in use is kept even if it alone
+ *							exceeds the budget)
+ *	@param	formula			grey formula of color background files
+ *	@param	pool			workers that decode large TGA files (NULL for none)
+ *	@return	the registry
+ */
+BackgroundRegistry* newBackgroundRegistry(size_t memoryBudget, GreyFormula formula, ThreadPool* pool);
+
+/**	Associates a camera with a background file.  The file is only read when
+ *	the background is first needed.  Registering a camera again replaces its
+ *	file.
+ *	@param	registry	the registry
+ *	@param	cameraId	id of the camera
+ *	@param	filePath	path to the background image
+ *	@return	0 if all went well, an error code if the file does not exist
+ */
+int registerBackground(BackgroundRegistry* registry, const char* cameraId, const char* filePath);
+
+/**	Registers the cameras listed in a text file, one "ID PATH" line per
+ *	camera (the path is the rest of the line; empty lines and lines starting
+ *	with # are skipped)
+ *	@param	registry	the registry
+ *	@param	listPath	path to the list
+ *	@return	0 if all went well, an error code otherwise
+ */
+int registerBackgroundList(BackgroundRegistry* registry, const char* listPath);
+
+/**	Returns the grey plane of the background of a camera, loading it if it
+ *	is not loaded yet, or reloading it in place if its file changed on disk
+ *	since it was loaded.  The least recently used backgrounds are then
+ *	unloaded until the budget is met.
+ *	@param	registry	the registry
+ *	@param	cameraId	id of the camera
+ *	@return	the grey plane (a GRAY_RASTER image), valid until the next call
+ *			on the registry, or NULL if the camera is unknown or its file
+ *			cannot be read
+ */
+const ImageStruct* acquireBackground(BackgroundRegistry* registry, const char* cameraId);
+
+/**	Prints the number of cameras, the memory used and the counts of hits,
+ *	loads, reloads and evictions
+ *	@param	registry	the registry
+ */
+void printBackgroundRegistryStats(const BackgroundRegistry* registry);
+
+/**	Delete a registry (frees all heap memory allocated to store it)
+ *	@param	registry	the registry
+ */
+void deleteBackgroundRegistry(BackgroundRegistry* registry);
+
+#endif	//	BACKGROUND_REGISTRY_H
@@ -0,0 +1,112 @@
+//
+//  BitMask.c
+//  Project
+//
+//  Bit-packed binary mask used as output of the threshold stage and
+//  input of the blob labeling.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+//
+#include "BitMask.h"
+
+//-----------------------------------------------------------
+//	Produces a new mask with all its bits cleared
+//-----------------------------------------------------------
+BitMask newBitMask(unsigned int nbRows, unsigned int nbCols) {
+	BitMask mask;
+	mask.nbRows = nbRows;
+	mask.nbCols = nbCols;
+	mask.wordsPerRow = (nbCols + MASK_WORD_BITS - 1) / MASK_WORD_BITS;
+	size_t nbWords = (size_t) nbRows * mask.wordsPerRow;
+	mask.bits = (uint64_t*) calloc(nbWords > 0 ? nbWords : 1, sizeof(uint64_t));
+	if (mask.bits == NULL) {
+		printf("Failed to allocate mask in newBitMask\n");
+		exit(90);
+	}
+
+	return mask;
+}
+
+//-----------------------------------------------------------
+//	Clears all the bits of one row of a mask
+//-----------------------------------------------------------
+void clearBitMaskRow(BitMask* mask, unsigned int row) {
+	memset(bitMaskRow(mask, row), 0, mask->wordsPerRow * sizeof(uint64_t));
+}
+
+//-----------------------------------------------------------
+//	Counts the foreground pixels of a mask row
+//-----------------------------------------------------------
+unsigned int countRowPixels(const uint64_t* rowBits, unsigned int wordsPerRow) {
+	unsigned int count = 0;
+	for (unsigned int w=0; w<wordsPerRow; w++) {
+		count += __builtin_popcountll(rowBits[w]);
+	}
+	return count;
+}
+
+//-----------------------------------------------------------
+//	Counts the runs of a mask row.  A run starts at every set
+//	bit whose left neighbor is clear.
+//-----------------------------------------------------------
+unsigned int countRowRuns(const uint64_t* rowBits, unsigned int wordsPerRow) {
+	unsigned int count = 0;
+	uint64_t carry = 0;
+	for (unsigned int w=0; w<wordsPerRow; w++) {
+		uint64_t word = rowBits[w];
+		uint64_t starts = word & ~((word << 1) | carry);
+		count += __builtin_popcountll(starts);
+		carry = word >> (MASK_WORD_BITS - 1);
+	}
+	return count;
+}
+
+//-----------------------------------------------------------
+//	Finds the next run of a mask row at or after column x
+//-----------------------------------------------------------
+int nextRowRun(const uint64_t* rowBits, unsigned int wordsPerRow, unsigned int nbCols,
+			   unsigned int x, unsigned int* xL, unsigned int* xR)
+{
+	if (x >= nbCols) {
+		return 0;
+	}
+
+	//	Look for the next set bit, skipping words of 0s
+	unsigned int w = x / MASK_WORD_BITS;
+	uint64_t word = rowBits[w] & (~0ULL << (x % MASK_WORD_BITS));
+	while (word == 0) {
+		w++;
+		if (w >= wordsPerRow) {
+			return 0;
+		}
+		word = rowBits[w];
+	}
+	unsigned int start = w*MASK_WORD_BITS + __builtin_ctzll(word);
+
+	//	Look for the next cleared bit, skipping words of 1s.  The padding
+	//	bits past nbCols are 0, so the run always ends within the row.
+	uint64_t inv = ~rowBits[w] & (~0ULL << (start % MASK_WORD_BITS));
+	while (inv == 0) {
+		w++;
+		if (w >= wordsPerRow) {
+			break;
+		}
+		inv = ~rowBits[w];
+	}
+	unsigned int end = (w < wordsPerRow) ? w*MASK_WORD_BITS + __builtin_ctzll(inv) : nbCols;
+
+	*xL = start;
+	*xR = (end > nbCols ? nbCols : end) - 1;
+	return 1;
+}
+
+//-----------------------------------------------------------
+//	Delete a mask
+//-----------------------------------------------------------
+void deleteBitMask(BitMask* mask) {
+	free(mask->bits);
+	mask->bits = NULL;
+}
@@ -0,0 +1,96 @@
+//-----------------------------------------------------------------
+//	Bit-packed binary mask (1 bit per pixel) and run extraction
+//-----------------------------------------------------------------
+
+#ifndef BIT_MASK_H
+#define BIT_MASK_H
+
+#include <stdint.h>
+
+/**	Number of pixels stored in one word of a mask row
+ */
+#define MASK_WORD_BITS	64
+
+/**	A binary mask stored one bit per pixel.  Bit k of word w of a row stands
+ *	for column MASK_WORD_BITS*w + k.  Every row starts on a word boundary, so
+ *	threads working on different rows never write to the same word, and the
+ *	padding bits past the last column of a row are always 0.
+ */
+typedef struct BitMask
+{
+	/**	Number of rows (height) of the mask
+	 */
+	unsigned int nbRows;
+
+	/**	Number of columns (width) of the mask
+	 */
+	unsigned int nbCols;
+
+	/**	Number of 64-bit words per row
+	 */
+	unsigned int wordsPerRow;
+
+	/**	The bits proper, nbRows*wordsPerRow words
+	 */
+	uint64_t* bits;
+
+} BitMask;
+
+/**	Produces a new mask with all its bits cleared
+ *	@param	nbRows	number of rows of the mask
+ *	@param	nbCols	number of columns of the mask
+ *	@return	a new mask properly initialized
+ */
+BitMask newBitMask(unsigned int nbRows, unsigned int nbCols);
+
+/**	Returns a pointer to the first word of a row of a mask
+ *	@param	mask	the mask to access
+ *	@param	row		index of the row
+ *	@return	pointer to the wordsPerRow words of that row
+ */
+static inline uint64_t* bitMaskRow(const BitMask* mask, unsigned int row)
+{
+	return mask->bits + (uint64_t) row * mask->wordsPerRow;
+}
+
+/**	Clears all the bits of one row of a mask
+ *	@param	mask	the mask to modify
+ *	@param	row		index of the row to clear
+ */
+void clearBitMaskRow(BitMask* mask, unsigned int row);
+
+/**	Counts the foreground pixels of a mask row
+ *	@param	rowBits		pointer to the words of the row
+ *	@param	wordsPerRow	number of words in the row
+ *	@return	number of bits set in the row
+ */
+unsigned int countRowPixels(const uint64_t* rowBits, unsigned int wordsPerRow);
+
+/**	Counts the runs (maximal horizontal segments of set bits) of a mask row,
+ *	without extracting them
+ *	@param	rowBits		pointer to the words of the row
+ *	@param	wordsPerRow	number of words in the row
+ *	@return	number of runs in the row
+ */
+unsigned int countRowRuns(const uint64_t* rowBits, unsigned int wordsPerRow);
+
+/**	Finds the next run of a mask row that starts at or after a given column.
+ *	Whole words of 0s or 1s are skipped in one step, so the cost is proportional
+ *	to the number of words and runs, not to the number of pixels.
+ *	@param	rowBits		pointer to the words of the row
+ *	@param	wordsPerRow	number of words in the row
+ *	@param	nbCols		number of columns of the mask
+ *	@param	x			column at which to start the search
+ *	@param	xL			on success, receives the left endpoint of the run
+ *	@param	xR			on success, receives the right endpoint of the run
+ *	@return	1 if a run was found, 0 if there are no more runs in the row
+ */
+int nextRowRun(const uint64_t* rowBits, unsigned int wordsPerRow, unsigned int nbCols,
+			   unsigned int x, unsigned int* xL, unsigned int* xR);
+
+/**	Delete a mask (frees all heap memory allocated to store it)
+ *	@param	mask	pointer to the mask to delete
+ */
+void deleteBitMask(BitMask* mask);
+
+#endif	//	BIT_MASK_H
@@ -9,10 +9,59 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
 //
 #include "Blob.h"
 #include "gl_frontEnd.h"
 
+//	Allocations of blob storage since counting was turned on, and their bytes
+static int countingAllocations = 0;
+static atomic_ulong nbAllocations, nbAllocatedBytes;
+
+//-----------------------------------------------------------
+//	Allocation of blob storage
+//-----------------------------------------------------------
+void* blobMalloc(size_t size) {
+	if (countingAllocations) {
+		atomic_fetch_add_explicit(&nbAllocations, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&nbAllocatedBytes, size, memory_order_relaxed);
+	}
+	return malloc(size);
+}
+
+void* blobCalloc(size_t count, size_t size) {
+	if (countingAllocations) {
+		atomic_fetch_add_explicit(&nbAllocations, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&nbAllocatedBytes, count*size, memory_order_relaxed);
+	}
+	return calloc(count, size);
+}
+
+void* blobRealloc(void* ptr, size_t oldSize, size_t size) {
+	if (countingAllocations) {
+		if (ptr == NULL) {
+			atomic_fetch_add_explicit(&nbAllocations, 1, memory_order_relaxed);
+		}
+		if (size >= oldSize) {
+			atomic_fetch_add_explicit(&nbAllocatedBytes, size - oldSize, memory_order_relaxed);
+		}
+		else {
+			atomic_fetch_sub_explicit(&nbAllocatedBytes, oldSize - size, memory_order_relaxed);
+		}
+	}
+	return realloc(ptr, size);
+}
+
+void countBlobAllocations(int on) {
+	countingAllocations = on;
+}
+
+void blobAllocationCounts(unsigned long* count, unsigned long* bytes) {
+	*count = atomic_load_explicit(&nbAllocations, memory_order_relaxed);
+	*bytes = atomic_load_explicit(&nbAllocatedBytes, memory_order_relaxed);
+}
+
 //-----------------------------------------------------------
 //	Add a segment to a segment list (part of a blob)
 //-----------------------------------------------------------
@@ -35,7 +84,7 @@ int addExtentToList(ExtentList* list, Extent seg) {
 		}
 		
 		//	Allocate a new list, one bigger than the current one
-		Extent* newSegList = (Extent*) calloc(list->nbSegs+1, sizeof(Extent));
+		Extent* newSegList = (Extent*) blobCalloc(list->nbSegs+1, sizeof(Extent));
 
 		if (newSegList == NULL) {
 			printf("Failed to allocate segment list in addExtentToList\n");
@@ -59,7 +108,7 @@ int addExtentToList(ExtentList* list, Extent seg) {
 		ok = 1;
 	}
 	else if (list->nbSegs==0) {
-		list->segList = (Extent*) calloc(1, sizeof(Extent));
+		list->segList = (Extent*) blobCalloc(1, sizeof(Extent));
 		if (list->segList == NULL) {
 			printf("Failed to allocate segment list in addExtentToList\n");
 			exit(85);
@@ -78,7 +127,7 @@ ExtentStack newExtentStack(void) {
 	ExtentStack newStack;
 	newStack.stackTop = 0;
 	newStack.storageSize = STACK_STORAGE_INCR;
-	newStack.stack = (Extent*) calloc(STACK_STORAGE_INCR, sizeof(Extent));
+	newStack.stack = (Extent*) blobCalloc(STACK_STORAGE_INCR, sizeof(Extent));
 	if (newStack.stack == NULL) {
 		printf("Allocation of resized stack failed in newExtentStack\n");
 		exit(40);
@@ -95,7 +144,7 @@ int addExtentToStack(ExtentStack* eStack, Extent seg) {
 	eStack->stackTop++;
 	if (eStack->stackTop == eStack->storageSize) {
 		//	allocate a larger array to store the stack
-		Extent* newStack = (Extent*) calloc(eStack->storageSize + STACK_STORAGE_INCR,
+		Extent* newStack = (Extent*) blobCalloc(eStack->storageSize + STACK_STORAGE_INCR,
 											sizeof(Extent));
 		if (newStack == NULL) {
 			printf("Allocation of resized stack failed in addExtentToStack\n");
@@ -147,7 +196,7 @@ Extent popStack(ExtentStack* eStack) {
 		//	the stack, we reduce the size
 		if (eStack->storageSize >= eStack->stackTop + 2*STACK_STORAGE_INCR) {
 			//	alllocate a smaller storage array
-			Extent* newStack = (Extent*) calloc(eStack->stackTop + STACK_STORAGE_INCR,
+			Extent* newStack = (Extent*) blobCalloc(eStack->stackTop + STACK_STORAGE_INCR,
 											sizeof(Extent));
 			if (newStack == NULL) {
 				printf("Allocation of resized stack failed in addExtentToStack\n");
@@ -210,7 +259,7 @@ int addExtentToBlob(Blob* blob, Extent seg) {
 		}
 		else if (seg.y == blob->yTop - 1) {
 			//	We need to allocate a new deque (array of ExtentList)
-			ExtentList* newDeque = (ExtentList*) malloc((blobHeight + 1)*sizeof(ExtentList));
+			ExtentList* newDeque = (ExtentList*) blobMalloc((blobHeight + 1)*sizeof(ExtentList));
 			if (newDeque == NULL) {
 				printf("Failed to allocate deque in addExtentToBlob\n");
 				exit(83);
@@ -227,7 +276,7 @@ int addExtentToBlob(Blob* blob, Extent seg) {
 		}
 		else if (seg.y == blob->yBottom + 1) {
 			//	We need to allocate a new deque (array of ExtentList)
-			ExtentList* newDeque = (ExtentList*) malloc((blobHeight + 1)*sizeof(ExtentList));
+			ExtentList* newDeque = (ExtentList*) blobMalloc((blobHeight + 1)*sizeof(ExtentList));
 			if (newDeque == NULL) {
 				printf("Failed to allocate deque in addExtentToBlob\n");
 				exit(82);
@@ -244,7 +293,7 @@ int addExtentToBlob(Blob* blob, Extent seg) {
 		}
 	}
 	else {
-		blob->deque = (ExtentList*) malloc(1*sizeof(ExtentList));
+		blob->deque = (ExtentList*) blobMalloc(1*sizeof(ExtentList));
 		if (blob->deque == NULL) {
 			printf("Failed to allocate deque in addExtentToBlob\n");
 			exit(81);
@@ -294,10 +343,138 @@ void printoutBlob(Blob* blob) {
 	}
 }
 
+//-----------------------------------------------------------
+//	Compute the features of a blob
+//-----------------------------------------------------------
+BlobFeatures computeBlobFeatures(const Blob* blob) {
+	BlobFeatures features;
+	features.area = blob->nbPixels;
+	features.nbSegs = blob->nbSegs;
+	features.yTop = blob->yTop;
+	features.yBottom = blob->yBottom;
+	features.xMin = features.xMax = 0;
+	features.centroidX = features.centroidY = 0.f;
+	if (blob->nbSegs == 0) {
+		return features;
+	}
+
+	double sumX = 0., sumY = 0.;
+	features.xMin = ~0U;
+	const unsigned int blobHeight = blob->yBottom - blob->yTop + 1;
+	for (unsigned int i=0; i<blobHeight; i++) {
+		const ExtentList* list = blob->deque + i;
+		if (list->nbSegs == 0) {
+			continue;
+		}
+		//	the extents of a row are sorted left to right
+		if (list->segList[0].xL < features.xMin) {
+			features.xMin = list->segList[0].xL;
+		}
+		if (list->segList[list->nbSegs-1].xR > features.xMax) {
+			features.xMax = list->segList[list->nbSegs-1].xR;
+		}
+		for (unsigned int j=0; j<list->nbSegs; j++) {
+			const Extent* seg = list->segList + j;
+			const double length = seg->xR - seg->xL + 1;
+			sumX += length * (seg->xL + seg->xR) / 2.;
+			sumY += length * seg->y;
+		}
+	}
+	features.centroidX = (float) (sumX / blob->nbPixels);
+	features.centroidY = (float) (sumY / blob->nbPixels);
+	return features;
+}
+
+//-----------------------------------------------------------
+//	Deep copy of a blob
+//-----------------------------------------------------------
+Blob copyBlob(const Blob* blob) {
+	Blob copy = *blob;
+	if (blob->deque == NULL) {
+		return copy;
+	}
+	const unsigned int blobHeight = blob->yBottom - blob->yTop + 1;
+	copy.deque = (ExtentList*) blobCalloc(blobHeight, sizeof(ExtentList));
+	if (copy.deque == NULL) {
+		printf("Failed to allocate deque in copyBlob\n");
+		exit(87);
+	}
+	for (unsigned int i=0; i<blobHeight; i++) {
+		const ExtentList* list = blob->deque + i;
+		if (list->nbSegs > 0) {
+			copy.deque[i].segList = (Extent*) blobMalloc(list->nbSegs*sizeof(Extent));
+			if (copy.deque[i].segList == NULL) {
+				printf("Failed to allocate segment list in copyBlob\n");
+				exit(88);
+			}
+			memcpy(copy.deque[i].segList, list->segList, list->nbSegs*sizeof(Extent));
+			copy.deque[i].nbSegs = list->nbSegs;
+		}
+	}
+	return copy;
+}
+
+//-----------------------------------------------------------
+//	Scales a blob up, each pixel becoming a square of pixels
+//-----------------------------------------------------------
+Blob upscaleBlob(const Blob* blob, unsigned int factor, unsigned int nbRows, unsigned int nbCols) {
+	Blob big = *blob;
+	big.nbPixels = 0;
+	big.yTop = blob->yTop * factor;
+	big.yBottom = (blob->yBottom + 1) * factor - 1;
+	if (big.yBottom >= (int) nbRows) {
+		big.yBottom = nbRows - 1;
+	}
+	if (blob->deque == NULL) {
+		return big;
+	}
+	const unsigned int bigHeight = big.yBottom - big.yTop + 1;
+	big.deque = (ExtentList*) blobCalloc(bigHeight, sizeof(ExtentList));
+	if (big.deque == NULL) {
+		printf("Failed to allocate deque in upscaleBlob\n");
+		exit(86);
+	}
+	for (unsigned int i=0; i<bigHeight; i++) {
+		const ExtentList* list = blob->deque + i / factor;
+		if (list->nbSegs == 0) {
+			continue;
+		}
+		ExtentList* bigList = big.deque + i;
+		bigList->segList = (Extent*) blobMalloc(list->nbSegs*sizeof(Extent));
+		if (bigList->segList == NULL) {
+			printf("Failed to allocate segment list in upscaleBlob\n");
+			exit(89);
+		}
+		for (unsigned int j=0; j<list->nbSegs; j++) {
+			Extent seg = {list->segList[j].xL * factor, (list->segList[j].xR + 1) * factor - 1,
+						  big.yTop + i};
+			if (seg.xR >= nbCols) {
+				seg.xR = nbCols - 1;
+			}
+			bigList->segList[j] = seg;
+			big.nbPixels += seg.xR - seg.xL + 1;
+		}
+		bigList->nbSegs = list->nbSegs;
+	}
+	big.nbSegs = 0;
+	for (unsigned int i=0; i<bigHeight; i++) {
+		big.nbSegs += big.deque[i].nbSegs;
+	}
+	return big;
+}
+
 //-----------------------------------------------------------
 //	Delete a blob
 //-----------------------------------------------------------
 void deleteBlob(Blob* blob) {
+	if (blob->nbSegs > 0) {
+		const unsigned int blobHeight = blob->yBottom - blob->yTop + 1;
+		for (unsigned int i=0; i<blobHeight; i++) {
+			free(blob->deque[i].segList);
+		}
+	}
 	free(blob->deque);
+	blob->deque = NULL;
+	blob->nbSegs = blob->nbPixels = 0;
 }
 
@@ -6,6 +6,8 @@
 #ifndef BLOB_H
 #define BLOB_H
 
+#include <stddef.h>
+
 /**	An extent is simply a horizontal segment
  */
 typedef struct Extent
@@ -86,6 +88,28 @@ typedef struct Blob
 } Blob;
 
 
+/**	Summary of a blob: what most consumers of the detections need,
+ *	without the extents
+ */
+typedef struct BlobFeatures
+{
+	/**	Number of pixels and of extents of the blob
+	 */
+	unsigned int area;
+	unsigned int nbSegs;
+
+	/**	Bounding box (inclusive)
+	 */
+	unsigned int xMin, xMax;
+	unsigned int yTop, yBottom;
+
+	/**	Centroid of the pixels (pixel (x, y) has its center at (x, y))
+	 */
+	float centroidX, centroidY;
+
+} BlobFeatures;
+
+
 #define STACK_STORAGE_INCR	10
 
 /**	Implementation of a stack of Extent structs
@@ -220,6 +244,66 @@ void renderBlob(Blob* blob);
 void printoutBlob(Blob* blob);
 
 
+/**	Computes the features of a blob
+ *	@param	blob	pointer to the blob
+ *	@return	the area, bounding box and centroid of the blob
+ */
+BlobFeatures computeBlobFeatures(const Blob* blob);
+
+
+/**	Copies a blob and all its extent lists
+ *	@param	blob	pointer to the blob to copy
+ *	@return	a blob that does not share any storage with the original
+ */
+Blob copyBlob(const Blob* blob);
+
+
+/**	Scales up a blob found on a mask sampled one pixel out of factor (see
+ *	SampledSubtractionJob): each pixel becomes a square of factor x factor
+ *	pixels, clipped to the image
+ *	@param	blob	pointer to the blob to scale
+ *	@param	factor	sampling step of the mask
+ *	@param	nbRows	number of rows of the image
+ *	@param	nbCols	number of columns of the image
+ *	@return	a blob that does not share any storage with the original
+ */
+Blob upscaleBlob(const Blob* blob, unsigned int factor, unsigned int nbRows, unsigned int nbCols);
+
+
+//----------------------------------------------------------
+//	Allocation of blob storage
+//----------------------------------------------------------
+
+/**	Allocate the storage of blobs (blob arrays, deques, extent lists and
+ *	stacks), like malloc and calloc, counting the allocations when counting
+ *	is on.  The storage is freed with free.
+ */
+void* blobMalloc(size_t size);
+void* blobCalloc(size_t count, size_t size);
+
+/**	Resizes blob storage like realloc.  Only the change of size is counted,
+ *	and a new allocation when ptr is NULL, so that an array grown in steps
+ *	then trimmed counts as one allocation of its final size.
+ *	@param	ptr		the storage to resize (NULL for none yet)
+ *	@param	oldSize	its current size in bytes (0 when ptr is NULL)
+ *	@param	size	the new size in bytes
+ *	@return	the resized storage, NULL on failure
+ */
+void* blobRealloc(void* ptr, size_t oldSize, size_t size);
+
+/**	Turns the counting of the allocations of blob storage on or off (it is
+ *	off at start, and then costs one test per allocation)
+ *	@param	on	1 to count, 0 to stop counting
+ */
+void countBlobAllocations(int on);
+
+/**	Allocations of blob storage counted so far
+ *	@param	count	receives the number of allocations
+ *	@param	bytes	receives their total size
+ */
+void blobAllocationCounts(unsigned long* count, unsigned long* bytes);
+
+
 /**	Delete a blob (frees all heap memory allocated to store it)
  *	@param blob 	pointer to the blob to delete
  */
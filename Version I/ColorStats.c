@@ -0,0 +1,173 @@
+//
+//  ColorStats.c
+//  Project
+//
+//  Each extent is a contiguous run of pixels of a frame row.  The sums of
+//  the channels and of their squares are taken in integers, in a loop with
+//  no other work so that the compiler vectorizes it; the histogram is
+//  filled in a second loop over the same run, still in the cache.
+//
+
+#include <stdlib.h>
+#include <stdatomic.h>
+//
+#include "ColorStats.h"
+
+typedef struct ColorSums
+{
+	uint64_t sum[3], sumSquares[3];
+	uint64_t nbPixels;
+
+} ColorSums;
+
+//	Bin of the color histogram of a pixel
+static inline unsigned int colorBin(unsigned int red, unsigned int green, unsigned int blue) {
+	return ((red >> 6) << 4) | ((green >> 6) << 2) | (blue >> 6);
+}
+
+//-----------------------------------------------------------
+//	One extent, per pixel format
+//-----------------------------------------------------------
+static void addRGBAExtent(const unsigned char* p, unsigned int n, ColorSums* sums,
+						  unsigned int* histogram)
+{
+	uint64_t r = 0, g = 0, b = 0, rr = 0, gg = 0, bb = 0;
+	for (unsigned int j=0; j<n; j++) {
+		const unsigned int red = p[4*j], green = p[4*j+1], blue = p[4*j+2];
+		r += red;
+		g += green;
+		b += blue;
+		rr += red*red;
+		gg += green*green;
+		bb += blue*blue;
+	}
+	for (unsigned int j=0; j<n; j++) {
+		histogram[colorBin(p[4*j], p[4*j+1], p[4*j+2])]++;
+	}
+	sums->sum[0] += r;
+	sums->sum[1] += g;
+	sums->sum[2] += b;
+	sums->sumSquares[0] += rr;
+	sums->sumSquares[1] += gg;
+	sums->sumSquares[2] += bb;
+}
+
+static void addGreyExtent(const unsigned char* p, unsigned int n, ColorSums* sums,
+						  unsigned int* histogram)
+{
+	uint64_t s = 0, ss = 0;
+	for (unsigned int j=0; j<n; j++) {
+		s += p[j];
+		ss += (unsigned int) p[j] * p[j];
+	}
+	for (unsigned int j=0; j<n; j++) {
+		histogram[colorBin(p[j], p[j], p[j])]++;
+	}
+	for (int c=0; c<3; c++) {
+		sums->sum[c] += s;
+		sums->sumSquares[c] += ss;
+	}
+}
+
+static void addFloatExtent(const float* p, unsigned int n, ColorSums* sums,
+						   unsigned int* histogram)
+{
+	uint64_t s = 0, ss = 0;
+	for (unsigned int j=0; j<n; j++) {
+		const unsigned int value = floatToByte(p[j]);
+		s += value;
+		ss += value * value;
+		histogram[colorBin(value, value, value)]++;
+	}
+	for (int c=0; c<3; c++) {
+		sums->sum[c] += s;
+		sums->sumSquares[c] += ss;
+	}
+}
+
+//-----------------------------------------------------------
+//	One blob
+//-----------------------------------------------------------
+BlobColors computeBlobColors(const Blob* blob, const ImageStruct* frame) {
+	BlobColors colors = {{0}};
+	if (blob->deque == NULL) {
+		return colors;
+	}
+
+	ColorSums sums = {{0}};
+	const unsigned int blobHeight = blob->yBottom - blob->yTop + 1;
+	for (unsigned int i=0; i<blobHeight; i++) {
+		const ExtentList* list = blob->deque + i;
+		const unsigned char* row = imageRow(frame, blob->yTop + i);
+		for (unsigned int k=0; k<list->nbSegs; k++) {
+			const Extent* seg = list->segList + k;
+			const unsigned int n = seg->xR - seg->xL + 1;
+			switch (frame->type) {
+				case RGBA32_RASTER:
+					addRGBAExtent(row + 4*seg->xL, n, &sums, colors.histogram);
+					break;
+
+				case FLOAT_RASTER:
+					addFloatExtent((const float*) row + seg->xL, n, &sums, colors.histogram);
+					break;
+
+				case GRAY_RASTER:
+				case MASK_RASTER:
+				default:
+					addGreyExtent(row + seg->xL, n, &sums, colors.histogram);
+					break;
+			}
+			sums.nbPixels += n;
+		}
+	}
+
+	if (sums.nbPixels > 0) {
+		for (int c=0; c<3; c++) {
+			const double mean = (double) sums.sum[c] / sums.nbPixels;
+			colors.mean[c] = (float) mean;
+			colors.variance[c] = (float) ((double) sums.sumSquares[c] / sums.nbPixels - mean*mean);
+		}
+	}
+	return colors;
+}
+
+//-----------------------------------------------------------
+//	All the blobs of a frame
+//-----------------------------------------------------------
+typedef struct ColorJob
+{
+	const Blob* blobs;
+	unsigned int nbBlobs;
+	const ImageStruct* frame;
+	BlobColors* colors;
+
+	//	next blob to take
+	atomic_uint next;
+
+} ColorJob;
+
+static void colorWorker(void* arg, unsigned int first, unsigned int end, unsigned int worker) {
+	ColorJob* job = (ColorJob*) arg;
+	unsigned int k;
+	while ((k = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed)) < job->nbBlobs) {
+		job->colors[k] = computeBlobColors(job->blobs + k, job->frame);
+	}
+	(void) first;
+	(void) end;
+	(void) worker;
+}
+
+void computeAllBlobColors(ThreadPool* pool, const Blob* blobs, unsigned int nbBlobs,
+						  const ImageStruct* frame, BlobColors* colors)
+{
+	ColorJob job;
+	job.blobs = blobs;
+	job.nbBlobs = nbBlobs;
+	job.frame = frame;
+	job.colors = colors;
+	atomic_init(&job.next, 0);
+
+	//	one item per worker: each takes blobs until none is left
+	unsigned int nbWorkers = threadPoolSize(pool);
+	runParallelRange(pool, (nbBlobs < nbWorkers) ? nbBlobs : nbWorkers, colorWorker, &job);
+}
@@ -0,0 +1,56 @@
+//-----------------------------------------------------------------
+//	Color statistics of the blobs, read from the frame raster along
+//	their extents, for classification by appearance
+//-----------------------------------------------------------------
+
+#ifndef COLOR_STATS_H
+#define COLOR_STATS_H
+
+#include "fileIO.h"
+#include "Blob.h"
+#include "ThreadPool.h"
+
+/**	Number of bins of the color histogram of a blob: 4 levels per channel,
+ *	bin (red/64)*16 + (green/64)*4 + blue/64
+ */
+#define COLOR_HISTOGRAM_BINS	64
+
+/**	Colors of the pixels of a blob.  The pixels of grey and float frames
+ *	have the same value in the three channels.
+ */
+typedef struct BlobColors
+{
+	/**	Mean of red, green and blue
+	 */
+	float mean[3];
+
+	/**	Variance of red, green and blue (over the pixels, not a sample)
+	 */
+	float variance[3];
+
+	/**	Number of pixels in each bin of colors
+	 */
+	unsigned int histogram[COLOR_HISTOGRAM_BINS];
+
+} BlobColors;
+
+/**	Computes the colors of a blob
+ *	@param	blob	the blob
+ *	@param	frame	the frame the blob was detected in
+ *	@return	the colors of its pixels (all 0 for a blob without pixels)
+ */
+BlobColors computeBlobColors(const Blob* blob, const ImageStruct* frame);
+
+/**	Computes the colors of the blobs of a frame on a pool.  The workers take
+ *	the blobs one at a time, so a few large blobs do not keep the others
+ *	waiting.
+ *	@param	pool	the pool (NULL for the caller alone)
+ *	@param	blobs	array of blobs
+ *	@param	nbBlobs	number of blobs in the array
+ *	@param	frame	the frame they were detected in
+ *	@param	colors	receives the colors of each blob (nbBlobs entries)
+ */
+void computeAllBlobColors(ThreadPool* pool, const Blob* blobs, unsigned int nbBlobs,
+						  const ImageStruct* frame, BlobColors* colors);
+
+#endif	//	COLOR_STATS_H
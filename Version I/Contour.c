@@ -0,0 +1,372 @@
+//
+//  Contour.c
+//  Project
+//
+//  Boundary tracing on the extent lists of a blob.  The horizontal
+//  edges of a row are the parts of its extents not covered by the
+//  row above (top edges) or below (bottom edges); the vertical edges
+//  are the ends of the extents.  Every edge is directed so that the
+//  blob is on its right, then the edges are linked into loops.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+//
+#include "Contour.h"
+
+typedef struct CrackEdge
+{
+	int x0, y0, x1, y1;
+	unsigned char dir;
+	unsigned char used;
+
+} CrackEdge;
+
+typedef struct EdgeList
+{
+	unsigned int size, capacity;
+	CrackEdge* edges;
+
+} EdgeList;
+
+static void addEdge(EdgeList* list, int x0, int y0, int x1, int y1, ChainDirection dir) {
+	if (list->size == list->capacity) {
+		list->capacity = (list->capacity > 0) ? 2*list->capacity : 64;
+		list->edges = (CrackEdge*) realloc(list->edges, list->capacity*sizeof(CrackEdge));
+		if (list->edges == NULL) {
+			printf("Failed to allocate edge list in traceBlobContours\n");
+			exit(160);
+		}
+	}
+	CrackEdge edge = {x0, y0, x1, y1, (unsigned char) dir, 0};
+	list->edges[list->size++] = edge;
+}
+
+//	Edge of the pixels a..b along the grid line y, in direction dir
+static void addHorizontalEdge(EdgeList* list, int a, int b, int y, ChainDirection dir) {
+	if (dir == CHAIN_EAST) {
+		addEdge(list, a, y, b + 1, y, CHAIN_EAST);
+	}
+	else {
+		addEdge(list, b + 1, y, a, y, CHAIN_WEST);
+	}
+}
+
+//-----------------------------------------------------------
+//	Adds the edges along the grid line y where the extents of
+//	row are not covered by those of other (the row above for top
+//	edges, below for bottom edges).  Both lists are sorted.
+//-----------------------------------------------------------
+static void addUncoveredEdges(EdgeList* list, const ExtentList* row, const ExtentList* other,
+							  int y, ChainDirection dir)
+{
+	const unsigned int nbOther = (other != NULL) ? other->nbSegs : 0;
+	unsigned int j = 0;
+	for (unsigned int k=0; k<row->nbSegs; k++) {
+		const Extent* seg = row->segList + k;
+		int x = seg->xL;
+		while (j < nbOther && (int) other->segList[j].xR < x) {
+			j++;
+		}
+		for (unsigned int m=j; m<nbOther && (int) other->segList[m].xL <= (int) seg->xR; m++) {
+			const Extent* cover = other->segList + m;
+			if ((int) cover->xL > x) {
+				addHorizontalEdge(list, x, cover->xL - 1, y, dir);
+			}
+			if ((int) cover->xR + 1 > x) {
+				x = cover->xR + 1;
+			}
+		}
+		if (x <= (int) seg->xR) {
+			addHorizontalEdge(list, x, seg->xR, y, dir);
+		}
+	}
+}
+
+//	Edges sorted by starting point, row first
+static int compareEdges(const void* a, const void* b) {
+	const CrackEdge* edgeA = (const CrackEdge*) a;
+	const CrackEdge* edgeB = (const CrackEdge*) b;
+	if (edgeA->y0 != edgeB->y0) {
+		return edgeA->y0 < edgeB->y0 ? -1 : 1;
+	}
+	return edgeA->x0 < edgeB->x0 ? -1 : (edgeA->x0 > edgeB->x0);
+}
+
+//	Index of the first edge that starts at (x, y)
+static unsigned int findEdge(const CrackEdge* edges, unsigned int nbEdges, int x, int y) {
+	unsigned int low = 0, high = nbEdges;
+	while (low < high) {
+		unsigned int mid = (low + high) / 2;
+		if (edges[mid].y0 < y || (edges[mid].y0 == y && edges[mid].x0 < x)) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+static void addPoint(Contour* contour, unsigned int* capacity, int x, int y) {
+	if (contour->nbPoints == *capacity) {
+		*capacity = (*capacity > 0) ? 2*(*capacity) : 16;
+		contour->points = (ContourPoint*) realloc(contour->points, (*capacity)*sizeof(ContourPoint));
+		if (contour->points == NULL) {
+			printf("Failed to allocate contour in traceBlobContours\n");
+			exit(161);
+		}
+	}
+	contour->points[contour->nbPoints].x = x;
+	contour->points[contour->nbPoints].y = y;
+	contour->nbPoints++;
+}
+
+//-----------------------------------------------------------
+//	Follows the edges from a first one until the loop closes,
+//	keeping the corners only.  Where two loops touch (two pixels
+//	of the blob meet by a corner) the left turn is taken, which
+//	keeps diagonal pixels on the same outer contour.
+//-----------------------------------------------------------
+static Contour traceLoop(CrackEdge* edges, unsigned int nbEdges, unsigned int first) {
+	Contour contour = {0, 0, 0, NULL};
+	unsigned int capacity = 0;
+	addPoint(&contour, &capacity, edges[first].x0, edges[first].y0);
+
+	unsigned int e = first;
+	for (;;) {
+		CrackEdge* edge = edges + e;
+		edge->used = 1;
+		unsigned int next = findEdge(edges, nbEdges, edge->x1, edge->y1);
+		if (next + 1 < nbEdges && edges[next+1].x0 == edge->x1 && edges[next+1].y0 == edge->y1 &&
+			edges[next+1].dir == ((edge->dir + 3) & 3)) {
+			next++;
+		}
+		if (next == first) {
+			//	Back at the start point, which is only a corner if the
+			//	direction changes there
+			if (edges[first].dir == edge->dir) {
+				contour.nbPoints--;
+				memmove(contour.points, contour.points + 1, contour.nbPoints*sizeof(ContourPoint));
+			}
+			break;
+		}
+		if (edges[next].dir != edge->dir) {
+			addPoint(&contour, &capacity, edge->x1, edge->y1);
+		}
+		e = next;
+	}
+
+	//	Shoelace formula on the corners
+	long twiceArea = 0;
+	for (unsigned int k=0; k<contour.nbPoints; k++) {
+		const ContourPoint* p = contour.points + k;
+		const ContourPoint* q = contour.points + (k + 1) % contour.nbPoints;
+		twiceArea += (long) p->x * q->y - (long) q->x * p->y;
+	}
+	contour.area = twiceArea / 2;
+	contour.isHole = (contour.area < 0);
+	return contour;
+}
+
+//-----------------------------------------------------------
+//	Traces the contours of a blob
+//-----------------------------------------------------------
+BlobContours traceBlobContours(const Blob* blob) {
+	BlobContours result = {0, NULL};
+	if (blob->nbSegs == 0) {
+		return result;
+	}
+
+	EdgeList list = {0, 0, NULL};
+	const unsigned int blobHeight = blob->yBottom - blob->yTop + 1;
+	for (unsigned int i=0; i<blobHeight; i++) {
+		const ExtentList* row = blob->deque + i;
+		const int y = blob->yTop + i;
+		for (unsigned int k=0; k<row->nbSegs; k++) {
+			const Extent* seg = row->segList + k;
+			addEdge(&list, seg->xL, y + 1, seg->xL, y, CHAIN_NORTH);
+			addEdge(&list, seg->xR + 1, y, seg->xR + 1, y + 1, CHAIN_SOUTH);
+		}
+		addUncoveredEdges(&list, row, (i > 0) ? row - 1 : NULL, y, CHAIN_EAST);
+		addUncoveredEdges(&list, row, (i + 1 < blobHeight) ? row + 1 : NULL, y + 1, CHAIN_WEST);
+	}
+	qsort(list.edges, list.size, sizeof(CrackEdge), compareEdges);
+
+	unsigned int capacity = 0;
+	for (unsigned int e=0; e<list.size; e++) {
+		if (list.edges[e].used) {
+			continue;
+		}
+		if (result.nbContours == capacity) {
+			capacity = (capacity > 0) ? 2*capacity : 2;
+			result.contours = (Contour*) realloc(result.contours, capacity*sizeof(Contour));
+			if (result.contours == NULL) {
+				printf("Failed to allocate contour list in traceBlobContours\n");
+				exit(162);
+			}
+		}
+		result.contours[result.nbContours++] = traceLoop(list.edges, list.size, e);
+	}
+	free(list.edges);
+
+	//	The outer contour goes first
+	for (unsigned int k=1; k<result.nbContours; k++) {
+		if (!result.contours[k].isHole) {
+			Contour outer = result.contours[k];
+			result.contours[k] = result.contours[0];
+			result.contours[0] = outer;
+			break;
+		}
+	}
+	return result;
+}
+
+//-----------------------------------------------------------
+//	Douglas-Peucker simplification
+//-----------------------------------------------------------
+
+//	Squared distance from p to the segment [a, b]
+static double segmentDistance2(ContourPoint p, ContourPoint a, ContourPoint b) {
+	const double dx = b.x - a.x, dy = b.y - a.y;
+	double px = p.x - a.x, py = p.y - a.y;
+	const double length2 = dx*dx + dy*dy;
+	if (length2 > 0.) {
+		double t = (px*dx + py*dy) / length2;
+		if (t > 1.) {
+			t = 1.;
+		}
+		else if (t < 0.) {
+			t = 0.;
+		}
+		px -= t*dx;
+		py -= t*dy;
+	}
+	return px*px + py*py;
+}
+
+//	Index of the point of (first, last) farthest from the segment between
+//	them, indices taken modulo n (last may be n, for the first point)
+static unsigned int farthestPoint(const ContourPoint* points, unsigned int n, unsigned int first,
+								  unsigned int last, double* distance2)
+{
+	unsigned int farthest = first;
+	*distance2 = -1.;
+	for (unsigned int k=first+1; k<last; k++) {
+		double d2 = segmentDistance2(points[k], points[first], points[last % n]);
+		if (d2 > *distance2) {
+			*distance2 = d2;
+			farthest = k;
+		}
+	}
+	return farthest;
+}
+
+void simplifyContour(Contour* contour, float tolerance) {
+	const unsigned int n = contour->nbPoints;
+	if (n <= 3 || tolerance <= 0.f) {
+		return;
+	}
+	const double tolerance2 = (double) tolerance * tolerance;
+
+	unsigned char* keep = (unsigned char*) calloc(n, 1);
+	unsigned int* stack = (unsigned int*) malloc(4*(n + 1)*sizeof(unsigned int));
+	if (keep == NULL || stack == NULL) {
+		printf("Failed to allocate storage in simplifyContour\n");
+		exit(163);
+	}
+
+	//	The loop is cut at its first point and at the point farthest from it
+	unsigned int split = 0;
+	double best = -1.;
+	for (unsigned int k=1; k<n; k++) {
+		const double dx = contour->points[k].x - contour->points[0].x;
+		const double dy = contour->points[k].y - contour->points[0].y;
+		if (dx*dx + dy*dy > best) {
+			best = dx*dx + dy*dy;
+			split = k;
+		}
+	}
+	keep[0] = keep[split] = 1;
+
+	unsigned int top = 0;
+	stack[top++] = 0;
+	stack[top++] = split;
+	stack[top++] = split;
+	stack[top++] = n;
+	while (top > 0) {
+		unsigned int last = stack[--top];
+		unsigned int first = stack[--top];
+		double distance2;
+		unsigned int k = farthestPoint(contour->points, n, first, last, &distance2);
+		if (k != first && distance2 > tolerance2) {
+			keep[k] = 1;
+			stack[top++] = first;
+			stack[top++] = k;
+			stack[top++] = k;
+			stack[top++] = last;
+		}
+	}
+
+	//	A polygon needs at least three points
+	unsigned int nbKept = 0;
+	for (unsigned int k=0; k<n; k++) {
+		nbKept += keep[k];
+	}
+	if (nbKept < 3) {
+		double d2a, d2b;
+		unsigned int a = farthestPoint(contour->points, n, 0, split, &d2a);
+		unsigned int b = farthestPoint(contour->points, n, split, n, &d2b);
+		keep[(d2a >= d2b) ? a : b] = 1;
+	}
+
+	unsigned int m = 0;
+	for (unsigned int k=0; k<n; k++) {
+		if (keep[k]) {
+			contour->points[m++] = contour->points[k];
+		}
+	}
+	contour->nbPoints = m;
+
+	free(stack);
+	free(keep);
+}
+
+//-----------------------------------------------------------
+//	Chain code of a traced contour
+//-----------------------------------------------------------
+unsigned int contourChainCode(const Contour* contour, unsigned char* codes) {
+	unsigned int nbCodes = 0;
+	for (unsigned int k=0; k<contour->nbPoints; k++) {
+		const ContourPoint* p = contour->points + k;
+		const ContourPoint* q = contour->points + (k + 1) % contour->nbPoints;
+		int length;
+		unsigned char dir;
+		if (q->y == p->y) {
+			length = abs(q->x - p->x);
+			dir = (q->x > p->x) ? CHAIN_EAST : CHAIN_WEST;
+		}
+		else {
+			length = abs(q->y - p->y);
+			dir = (q->y > p->y) ? CHAIN_SOUTH : CHAIN_NORTH;
+		}
+		if (codes != NULL) {
+			memset(codes + nbCodes, dir, length);
+		}
+		nbCodes += length;
+	}
+	return nbCodes;
+}
+
+//-----------------------------------------------------------
+//	Delete the contours of a blob
+//-----------------------------------------------------------
+void deleteBlobContours(BlobContours* contours) {
+	for (unsigned int k=0; k<contours->nbContours; k++) {
+		free(contours->contours[k].points);
+	}
+	free(contours->contours);
+	contours->contours = NULL;
+	contours->nbContours = 0;
+}
@@ -0,0 +1,102 @@
+//-----------------------------------------------------------------
+//	Boundaries of blobs, traced from their extent lists along the
+//	pixel edges ("crack" edges), as polygons or chain codes
+//-----------------------------------------------------------------
+
+#ifndef CONTOUR_H
+#define CONTOUR_H
+
+#include "Blob.h"
+
+/**	A corner of a contour.  Contours run along the edges of the pixels:
+ *	point (x, y) is the top-left corner of pixel (x, y).
+ */
+typedef struct ContourPoint
+{
+	int x, y;
+
+} ContourPoint;
+
+/**	A closed contour.  The blob is on the right of the direction of travel
+ *	(with y pointing down), so an outer contour turns clockwise on screen and
+ *	a hole counterclockwise.
+ */
+typedef struct Contour
+{
+	/**	1 if the contour is the boundary of a hole
+	 */
+	int isHole;
+
+	/**	Signed area enclosed, in pixels: positive for the outer contour,
+	 *	negative for a hole
+	 */
+	long area;
+
+	/**	Number of points.  The last point is joined to the first one.
+	 */
+	unsigned int nbPoints;
+
+	/**	The points proper.  As traced, these are the corners of the contour
+	 *	only, so consecutive points are on the same row or column.
+	 */
+	ContourPoint* points;
+
+} Contour;
+
+/**	All the contours of a blob
+ */
+typedef struct BlobContours
+{
+	/**	Number of contours: the outer one, then one per hole
+	 */
+	unsigned int nbContours;
+
+	Contour* contours;
+
+} BlobContours;
+
+/**	Directions of the steps of a chain code (y pointing down)
+ */
+typedef enum ChainDirection
+{
+	CHAIN_EAST = 0,
+	CHAIN_SOUTH,
+	CHAIN_WEST,
+	CHAIN_NORTH
+
+} ChainDirection;
+
+/**	Traces the outer contour and the holes of a blob.  Diagonal neighbors
+ *	belong to the same blob (8-connectivity), so where two pixels only touch
+ *	by a corner the outer contour goes around both, and a hole is only bounded
+ *	by 4-connected background pixels.  The cost is proportional to the number
+ *	of extents of the blob, not to its area.
+ *	@param	blob	the blob (one 8-connected component)
+ *	@return	the contours of the blob, the outer one first
+ */
+BlobContours traceBlobContours(const Blob* blob);
+
+/**	Simplifies a contour with the Douglas-Peucker algorithm: points are
+ *	dropped as long as no dropped point is farther than the tolerance from
+ *	the simplified polygon.  The area of the contour is left as traced.
+ *	@param	contour		the contour to simplify (modified in place)
+ *	@param	tolerance	largest distance allowed, in pixels
+ */
+void simplifyContour(Contour* contour, float tolerance);
+
+/**	Writes the chain code of a contour: one step of one pixel per code,
+ *	starting at the first point.  Only valid on a contour as traced (not
+ *	simplified).
+ *	@param	contour		the contour
+ *	@param	codes		receives the codes (ChainDirection values), or NULL
+ *						to only get their number
+ *	@return	number of codes, i.e. the perimeter of the contour in pixels
+ */
+unsigned int contourChainCode(const Contour* contour, unsigned char* codes);
+
+/**	Delete the contours of a blob (frees all heap memory allocated to store them)
+ *	@param	contours	pointer to the contours to delete
+ */
+void deleteBlobContours(BlobContours* contours);
+
+#endif	//	CONTOUR_H
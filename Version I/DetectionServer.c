@@ -0,0 +1,396 @@
+//
+//  DetectionServer.c
+//  Project
+//
+//  One client is served at a time: the listening socket is polled until
+//  a client connects, then the client until it hangs up.  Polls time out
+//  regularly so that the stop flag is seen even when nobody talks.
+//  Latencies are counted in power-of-two buckets of microseconds.
+//
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+//
+#include "DetectionServer.h"
+
+//	Time between two looks at the stop flag, in milliseconds
+#define POLL_MILLISECONDS	200
+
+//	Bucket k counts the latencies of [2^k, 2^(k+1)) microseconds (bucket 0
+//	also counts those under a microsecond, the last one those above)
+#define NB_LATENCY_BUCKETS	32
+
+typedef struct LatencyHistogram
+{
+	unsigned long counts[NB_LATENCY_BUCKETS];
+	unsigned long nbRequests, nbErrors;
+	double totalSeconds, maxSeconds;
+
+} LatencyHistogram;
+
+struct DetectionServer
+{
+	char* socketPath;
+	int listenFd;
+
+	//	the client being served (-1 if none), and what it sent that was
+	//	not parsed yet
+	int clientFd;
+	char input[MAX_REQUEST_LENGTH];
+	size_t inputSize;
+
+	//	request being served: kind and time it was read
+	RequestKind current;
+	double startTime;
+
+	LatencyHistogram histograms[NB_REQUEST_KINDS];
+};
+
+static const char* const REQUEST_NAMES[NB_REQUEST_KINDS] = {
+	"FRAME", "SHM", "BACKGROUND", "STATS", "QUIT"
+};
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+//-----------------------------------------------------------
+//	Creation
+//-----------------------------------------------------------
+DetectionServer* newDetectionServer(const char* socketPath) {
+	struct sockaddr_un address;
+	if (strlen(socketPath) >= sizeof(address.sun_path)) {
+		return NULL;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+	unlink(socketPath);
+	if (bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(fd, 16) != 0) {
+		close(fd);
+		return NULL;
+	}
+
+	DetectionServer* server = (DetectionServer*) calloc(1, sizeof(DetectionServer));
+	char* path = strdup(socketPath);
+	if (server == NULL || path == NULL) {
+		printf("Unable to allocate the detection server\n");
+		exit(180);
+	}
+	server->socketPath = path;
+	server->listenFd = fd;
+	server->clientFd = -1;
+	return server;
+}
+
+//-----------------------------------------------------------
+//	Sends the whole buffer.  Returns 0 if it was sent.
+//-----------------------------------------------------------
+static int sendAll(int fd, const void* data, size_t size) {
+	const char* bytes = (const char*) data;
+	while (size > 0) {
+		//	MSG_NOSIGNAL: a client that hung up must not kill the daemon
+		ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+		bytes += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static void closeClient(DetectionServer* server) {
+	close(server->clientFd);
+	server->clientFd = -1;
+	server->inputSize = 0;
+}
+
+//	Header and body of a reply; the client is dropped if it is gone
+static void sendMessage(DetectionServer* server, const char* header, const void* data, size_t size) {
+	if (sendAll(server->clientFd, header, strlen(header)) != 0 ||
+		(size > 0 && sendAll(server->clientFd, data, size) != 0)) {
+		closeClient(server);
+	}
+}
+
+//-----------------------------------------------------------
+//	Latency of the current request
+//-----------------------------------------------------------
+static void recordLatency(DetectionServer* server, int failed) {
+	double seconds = now() - server->startTime;
+	LatencyHistogram* histogram = server->histograms + server->current;
+
+	unsigned int bucket = 0;
+	for (double limit = 2e-6; seconds >= limit && bucket < NB_LATENCY_BUCKETS-1; limit *= 2) {
+		bucket++;
+	}
+	histogram->counts[bucket]++;
+	histogram->nbRequests++;
+	histogram->nbErrors += failed;
+	histogram->totalSeconds += seconds;
+	if (seconds > histogram->maxSeconds) {
+		histogram->maxSeconds = seconds;
+	}
+}
+
+//	Upper bound of the bucket holding the given fraction of the requests, in microseconds
+static double latencyPercentile(const LatencyHistogram* histogram, double fraction) {
+	unsigned long rank = (unsigned long) (fraction * histogram->nbRequests + 0.5), seen = 0;
+	for (unsigned int k=0; k<NB_LATENCY_BUCKETS; k++) {
+		seen += histogram->counts[k];
+		if (seen >= rank && seen > 0) {
+			return (double) (2UL << k);
+		}
+	}
+	return 1e6*histogram->maxSeconds;
+}
+
+//-----------------------------------------------------------
+//	Text of the histograms.  Returns its length (the text is cut at
+//	capacity - 1 characters).
+//-----------------------------------------------------------
+static size_t formatServerStats(const DetectionServer* server, char* text, size_t capacity) {
+	size_t length = 0;
+	#define APPEND(...)	do { \
+			int n = snprintf(text + length, capacity - length, __VA_ARGS__); \
+			if (n > 0) length = (length + n < capacity) ? length + n : capacity - 1; \
+		} while (0)
+
+	for (unsigned int kind=0; kind<NB_REQUEST_KINDS; kind++) {
+		const LatencyHistogram* histogram = server->histograms + kind;
+		if (histogram->nbRequests == 0) {
+			continue;
+		}
+		APPEND("%s: %lu requests (%lu failed), mean %.0f us, p50 < %.0f us, p99 < %.0f us, max %.0f us\n",
+			   REQUEST_NAMES[kind], histogram->nbRequests, histogram->nbErrors,
+			   1e6*histogram->totalSeconds/histogram->nbRequests,
+			   latencyPercentile(histogram, 0.5), latencyPercentile(histogram, 0.99),
+			   1e6*histogram->maxSeconds);
+		for (unsigned int k=0; k<NB_LATENCY_BUCKETS; k++) {
+			if (histogram->counts[k] > 0) {
+				APPEND("  < %10lu us: %lu\n", 2UL << k, histogram->counts[k]);
+			}
+		}
+	}
+	if (length == 0) {
+		APPEND("no request served\n");
+	}
+	#undef APPEND
+	return length;
+}
+
+void printServerStats(DetectionServer* server) {
+	char text[8192];
+	formatServerStats(server, text, sizeof(text));
+	fputs(text, stdout);
+}
+
+//-----------------------------------------------------------
+//	Splits a line into words, in place.  Returns the number of words,
+//	or maxWords + 1 if there are more (or a quote is not closed).
+//-----------------------------------------------------------
+static unsigned int splitWords(char* line, char** words, unsigned int maxWords) {
+	unsigned int nbWords = 0;
+	char* p = line;
+	while (1) {
+		while (*p == ' ' || *p == '\t' || *p == '\r') {
+			p++;
+		}
+		if (*p == '\0') {
+			return nbWords;
+		}
+		if (nbWords == maxWords) {
+			return maxWords + 1;
+		}
+		char* end;
+		if (*p == '"') {
+			words[nbWords++] = ++p;
+			end = strchr(p, '"');
+			if (end == NULL) {
+				return maxWords + 1;
+			}
+		}
+		else {
+			words[nbWords++] = p;
+			end = p + strcspn(p, " \t\r");
+		}
+		p = (*end != '\0') ? end + 1 : end;
+		*end = '\0';
+	}
+}
+
+//-----------------------------------------------------------
+//	Parses a request line.  Returns 0 if the request is valid.
+//-----------------------------------------------------------
+static int parseRequest(char* line, DetectionRequest* request) {
+	char* words[3];
+	unsigned int nbWords = splitWords(line, words, 3);
+	if (nbWords == 0 || nbWords > 3) {
+		return 1;
+	}
+
+	unsigned int kind = 0;
+	while (kind < NB_REQUEST_KINDS && strcmp(words[0], REQUEST_NAMES[kind]) != 0) {
+		kind++;
+	}
+	request->kind = (RequestKind) kind;
+	request->argument[0] = '\0';
+	strcpy(request->backgroundId, "default");
+
+	switch (kind) {
+		case FRAME_REQUEST:
+		case SHM_REQUEST:
+			if (nbWords < 2 || nbWords > 3) {
+				return 1;
+			}
+			strcpy(request->argument, words[1]);
+			if (nbWords == 3) {
+				strcpy(request->backgroundId, words[2]);
+			}
+			return 0;
+
+		case BACKGROUND_REQUEST:
+			if (nbWords != 3) {
+				return 1;
+			}
+			strcpy(request->backgroundId, words[1]);
+			strcpy(request->argument, words[2]);
+			return 0;
+
+		case STATS_REQUEST:
+		case QUIT_REQUEST:
+			return (nbWords != 1);
+
+		default:
+			return 1;
+	}
+}
+
+//-----------------------------------------------------------
+//	Takes a complete line from the input, if there is one
+//-----------------------------------------------------------
+static int takeLine(DetectionServer* server, char* line) {
+	char* end = memchr(server->input, '\n', server->inputSize);
+	if (end == NULL) {
+		return 0;
+	}
+	size_t length = end - server->input;
+	memcpy(line, server->input, length);
+	line[length] = '\0';
+	server->inputSize -= length + 1;
+	memmove(server->input, end + 1, server->inputSize);
+	return 1;
+}
+
+//-----------------------------------------------------------
+//	Waits for a client, or for more input from the client
+//-----------------------------------------------------------
+static void waitForInput(DetectionServer* server) {
+	struct pollfd poller;
+	poller.fd = (server->clientFd >= 0) ? server->clientFd : server->listenFd;
+	poller.events = POLLIN;
+	if (poll(&poller, 1, POLL_MILLISECONDS) <= 0) {
+		return;
+	}
+
+	if (server->clientFd < 0) {
+		server->clientFd = accept4(server->listenFd, NULL, NULL, SOCK_CLOEXEC);
+		server->inputSize = 0;
+		return;
+	}
+	ssize_t n = read(server->clientFd, server->input + server->inputSize,
+					 MAX_REQUEST_LENGTH - server->inputSize);
+	if (n > 0) {
+		server->inputSize += n;
+	}
+	else if (n == 0 || errno != EINTR) {
+		closeClient(server);
+	}
+}
+
+//-----------------------------------------------------------
+//	Next request
+//-----------------------------------------------------------
+int nextRequest(DetectionServer* server, DetectionRequest* request, volatile sig_atomic_t* stop) {
+	char line[MAX_REQUEST_LENGTH + 1];
+	while (!*stop) {
+		if (server->clientFd < 0 || !takeLine(server, line)) {
+			if (server->clientFd >= 0 && server->inputSize == MAX_REQUEST_LENGTH) {
+				sendMessage(server, "ERR request too long\n", NULL, 0);
+				if (server->clientFd >= 0) {
+					closeClient(server);
+				}
+			}
+			waitForInput(server);
+			continue;
+		}
+
+		if (parseRequest(line, request) != 0) {
+			sendMessage(server, "ERR invalid request\n", NULL, 0);
+			continue;
+		}
+		server->current = request->kind;
+		server->startTime = now();
+		if (request->kind == STATS_REQUEST) {
+			char text[8192];
+			size_t length = formatServerStats(server, text, sizeof(text));
+			sendReply(server, text, length);
+			continue;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------
+//	Replies
+//-----------------------------------------------------------
+void sendReply(DetectionServer* server, const void* data, size_t size) {
+	char header[32];
+	snprintf(header, sizeof(header), "OK %zu\n", size);
+	if (server->clientFd >= 0) {
+		sendMessage(server, header, data, size);
+	}
+	recordLatency(server, 0);
+}
+
+void sendError(DetectionServer* server, const char* message) {
+	char header[MAX_REQUEST_LENGTH];
+	snprintf(header, sizeof(header), "ERR %s\n", message);
+	if (server->clientFd >= 0) {
+		sendMessage(server, header, NULL, 0);
+	}
+	recordLatency(server, 1);
+}
+
+//-----------------------------------------------------------
+//	Cleanup
+//-----------------------------------------------------------
+void deleteDetectionServer(DetectionServer* server) {
+	if (server->clientFd >= 0) {
+		close(server->clientFd);
+	}
+	close(server->listenFd);
+	unlink(server->socketPath);
+	free(server->socketPath);
+	free(server);
+}
@@ -0,0 +1,112 @@
+//-----------------------------------------------------------------
+//	Request loop of the detection daemon: a Unix domain socket
+//	that takes one request per line and answers each with a
+//	length-prefixed reply, and the latency histograms of the
+//	requests served
+//-----------------------------------------------------------------
+
+#ifndef DETECTION_SERVER_H
+#define DETECTION_SERVER_H
+
+#include <stddef.h>
+#include <signal.h>
+
+/**	Protocol.  A client connects to the socket and sends requests, one per
+ *	line; each one gets a reply before the next one is read.  Clients are
+ *	served one at a time, in the order they connect.
+ *
+ *	Requests (words separated by spaces, or between double quotes when they
+ *	hold spaces; ID optional, "default" if absent)
+ *		FRAME PATH [ID]		detect the blobs of an image file against background ID
+ *		SHM NAME [ID]		detect the blobs of the next frame of the shared-memory
+ *							ring NAME (see FrameRing.h) against background ID
+ *		BACKGROUND ID PATH	set the background file of camera ID (read when first
+ *							needed, and again whenever it changes on disk)
+ *		STATS				latency histograms of the requests served so far
+ *		QUIT				stop the daemon
+ *	The "default" background is the background file given to the daemon on
+ *	its command line (see BackgroundRegistry.h).
+ *
+ *	Replies
+ *		"OK <size>\n" followed by size bytes: the serialized blobs (one
+ *		record of ResultWriter.h, in the format the daemon was started
+ *		with), or the text of the histograms for STATS
+ *		"ERR <message>\n" if the request failed
+ */
+typedef enum RequestKind
+{
+	FRAME_REQUEST = 0,
+	SHM_REQUEST,
+	BACKGROUND_REQUEST,
+	STATS_REQUEST,
+	QUIT_REQUEST,
+	//
+	NB_REQUEST_KINDS
+
+} RequestKind;
+
+/**	Longest request line, in bytes
+ */
+#define MAX_REQUEST_LENGTH	4096
+
+/**	A request, as parsed from its line
+ */
+typedef struct DetectionRequest
+{
+	RequestKind kind;
+
+	/**	Path of the image file, or name of the ring
+	 */
+	char argument[MAX_REQUEST_LENGTH];
+
+	/**	Background to subtract, or to load
+	 */
+	char backgroundId[MAX_REQUEST_LENGTH];
+
+} DetectionRequest;
+
+/**	The server is only manipulated through pointers, its content is private
+ */
+typedef struct DetectionServer DetectionServer;
+
+/**	Creates the socket (replacing a stale one at the same path) and listens
+ *	@param	socketPath	path of the socket
+ *	@return	the server, or NULL if the socket could not be created
+ */
+DetectionServer* newDetectionServer(const char* socketPath);
+
+/**	Waits for the next request.  STATS requests are answered here; any other
+ *	request must be answered with sendReply or sendError before the next call.
+ *	@param	server	the server
+ *	@param	request	receives the request
+ *	@param	stop	flag set (e.g. by a signal handler) to stop waiting
+ *	@return	1 if a request was received, 0 if stop was set
+ */
+int nextRequest(DetectionServer* server, DetectionRequest* request, volatile sig_atomic_t* stop);
+
+/**	Answers the current request, and records its latency (from the moment it
+ *	was read)
+ *	@param	server	the server
+ *	@param	data	the reply
+ *	@param	size	size of the reply, in bytes
+ */
+void sendReply(DetectionServer* server, const void* data, size_t size);
+
+/**	Answers the current request with an error (its latency is recorded too)
+ *	@param	server	the server
+ *	@param	message	one line of text
+ */
+void sendError(DetectionServer* server, const char* message);
+
+/**	Prints the latency histograms of the requests served, one per kind of
+ *	request
+ *	@param	server	the server
+ */
+void printServerStats(DetectionServer* server);
+
+/**	Closes the socket, removes it from the file system and frees the server
+ *	@param	server	the server
+ */
+void deleteDetectionServer(DetectionServer* server);
+
+#endif	//	DETECTION_SERVER_H
@@ -0,0 +1,227 @@
+//
+//  FrameRing.c
+//  Project
+//
+//  Single-producer, single-consumer ring of frames in POSIX shared
+//  memory.  The producer only writes the head index and the consumer
+//  only writes the tail index, so no lock is needed: each side
+//  publishes its index with a release store and reads the other's with
+//  an acquire load.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//
+#include "FrameRing.h"
+
+//	"FRMRING1", written last by the creator
+#define FRAME_RING_MAGIC	0x31474E49524D5246ULL
+
+//	Shared header, at the start of the mapping.  Each index lives on its
+//	own cache line so that the two processes do not false-share.
+typedef struct RingHeader
+{
+	_Atomic uint64_t magic;
+	uint32_t type;
+	uint32_t nbRows, nbCols;
+	uint32_t bytesPerRow;
+	uint32_t nbSlots;
+	uint64_t slotBytes;
+	uint64_t dataOffset;
+
+	//	number of frames published by the producer
+	_Alignas(ALIGNMENT_BYTES) _Atomic uint64_t head;
+
+	//	number of frames released by the consumer
+	_Alignas(ALIGNMENT_BYTES) _Atomic uint64_t tail;
+
+	//	set by the producer when it will not publish any more frames
+	_Alignas(ALIGNMENT_BYTES) _Atomic uint32_t closed;
+
+} RingHeader;
+
+struct FrameRing
+{
+	RingHeader* header;
+	size_t mapBytes;
+};
+
+#define ROUND_UP(n, m)	(((n) + (m) - 1) / (m) * (m))
+
+//	Maps a shared-memory object of a given size
+static FrameRing* mapRing(int fd, size_t mapBytes) {
+	void* mem = mmap(NULL, mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		return NULL;
+	}
+	FrameRing* ring = (FrameRing*) malloc(sizeof(FrameRing));
+	if (ring == NULL) {
+		printf("Unable to allocate a frame ring\n");
+		exit(130);
+	}
+	ring->header = (RingHeader*) mem;
+	ring->mapBytes = mapBytes;
+	return ring;
+}
+
+//	View on the pixels of a slot
+static ImageStruct slotView(const FrameRing* ring, uint64_t index) {
+	const RingHeader* header = ring->header;
+	unsigned char* pixels = (unsigned char*) header + header->dataOffset
+							+ (index % header->nbSlots) * header->slotBytes;
+	return imageView((ImageType) header->type, header->nbRows, header->nbCols,
+					 header->bytesPerRow, pixels);
+}
+
+//-----------------------------------------------------------
+//	Creation by the producer
+//-----------------------------------------------------------
+FrameRing* createFrameRing(const char* name, ImageType type, unsigned int nbRows,
+						   unsigned int nbCols, unsigned int nbSlots)
+{
+	if (nbSlots == 0) {
+		return NULL;
+	}
+	const unsigned int bytesPerRow = ROUND_UP(bytesPerPixelOfType(type)*nbCols, ALIGNMENT_BYTES);
+	const uint64_t slotBytes = ROUND_UP((uint64_t) nbRows*bytesPerRow, ALIGNMENT_BYTES);
+	const uint64_t dataOffset = ROUND_UP(sizeof(RingHeader), ALIGNMENT_BYTES);
+	const size_t mapBytes = dataOffset + nbSlots*slotBytes;
+
+	int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0600);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (ftruncate(fd, mapBytes) != 0) {
+		close(fd);
+		return NULL;
+	}
+	FrameRing* ring = mapRing(fd, mapBytes);
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	RingHeader* header = ring->header;
+	header->type = type;
+	header->nbRows = nbRows;
+	header->nbCols = nbCols;
+	header->bytesPerRow = bytesPerRow;
+	header->nbSlots = nbSlots;
+	header->slotBytes = slotBytes;
+	header->dataOffset = dataOffset;
+	atomic_init(&header->head, 0);
+	atomic_init(&header->tail, 0);
+	atomic_init(&header->closed, 0);
+	//	a consumer that sees the magic also sees the fields above
+	atomic_store_explicit(&header->magic, FRAME_RING_MAGIC, memory_order_release);
+	return ring;
+}
+
+//-----------------------------------------------------------
+//	Attachment by the consumer
+//-----------------------------------------------------------
+FrameRing* attachFrameRing(const char* name) {
+	int fd = shm_open(name, O_RDWR, 0600);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(RingHeader)) {
+		close(fd);
+		return NULL;
+	}
+	FrameRing* ring = mapRing(fd, info.st_size);
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	const RingHeader* header = ring->header;
+	if (atomic_load_explicit(&ring->header->magic, memory_order_acquire) != FRAME_RING_MAGIC ||
+		header->nbSlots == 0 ||
+		header->dataOffset + header->nbSlots*header->slotBytes > ring->mapBytes) {
+		detachFrameRing(ring);
+		return NULL;
+	}
+	return ring;
+}
+
+ImageStruct frameRingFormat(const FrameRing* ring) {
+	const RingHeader* header = ring->header;
+	return imageView((ImageType) header->type, header->nbRows, header->nbCols,
+					 header->bytesPerRow, NULL);
+}
+
+//-----------------------------------------------------------
+//	Producer side
+//-----------------------------------------------------------
+int acquireFrameSlot(FrameRing* ring, ImageStruct* frame) {
+	RingHeader* header = ring->header;
+	uint64_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+	uint64_t tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+	if (head - tail >= header->nbSlots) {
+		return 0;
+	}
+	*frame = slotView(ring, head);
+	return 1;
+}
+
+void publishFrame(FrameRing* ring) {
+	RingHeader* header = ring->header;
+	uint64_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+	atomic_store_explicit(&header->head, head + 1, memory_order_release);
+}
+
+void closeFrameRing(FrameRing* ring) {
+	atomic_store_explicit(&ring->header->closed, 1, memory_order_release);
+}
+
+//-----------------------------------------------------------
+//	Consumer side
+//-----------------------------------------------------------
+int peekFrame(FrameRing* ring, ImageStruct* frame, uint64_t* sequence) {
+	RingHeader* header = ring->header;
+	uint64_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+	uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+	if (tail == head) {
+		return 0;
+	}
+	*frame = slotView(ring, tail);
+	if (sequence != NULL) {
+		*sequence = tail;
+	}
+	return 1;
+}
+
+void releaseFrame(FrameRing* ring) {
+	RingHeader* header = ring->header;
+	uint64_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+	atomic_store_explicit(&header->tail, tail + 1, memory_order_release);
+}
+
+int frameRingFinished(FrameRing* ring) {
+	RingHeader* header = ring->header;
+	//	closed is read first: a frame published before closing is then seen
+	if (!atomic_load_explicit(&header->closed, memory_order_acquire)) {
+		return 0;
+	}
+	return atomic_load_explicit(&header->tail, memory_order_relaxed) ==
+		   atomic_load_explicit(&header->head, memory_order_acquire);
+}
+
+//-----------------------------------------------------------
+//	Cleanup
+//-----------------------------------------------------------
+void detachFrameRing(FrameRing* ring) {
+	munmap(ring->header, ring->mapBytes);
+	free(ring);
+}
+
+void unlinkFrameRing(const char* name) {
+	shm_unlink(name);
+}
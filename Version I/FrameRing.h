@@ -0,0 +1,92 @@
+//-----------------------------------------------------------------
+//	Ring buffer of fixed-size frames in POSIX shared memory, written
+//	by one producer process and read by one consumer process.
+//	The frames are used in place: the consumer gets an ImageStruct
+//	view on the shared pixels, nothing is copied.
+//-----------------------------------------------------------------
+
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stdint.h>
+#include "fileIO.h"
+
+/**	The ring is only manipulated through pointers, its content is private
+ */
+typedef struct FrameRing FrameRing;
+
+/**	Creates (or recreates) a shared-memory ring and maps it.  Called by the
+ *	producer.
+ *	@param	name	name of the shared-memory object ("/something")
+ *	@param	type	type of the frames
+ *	@param	nbRows	height of the frames
+ *	@param	nbCols	width of the frames
+ *	@param	nbSlots	number of frames the ring can hold
+ *	@return	the ring, or NULL if it could not be created
+ */
+FrameRing* createFrameRing(const char* name, ImageType type, unsigned int nbRows,
+						   unsigned int nbCols, unsigned int nbSlots);
+
+/**	Maps an existing shared-memory ring.  Called by the consumer.
+ *	@param	name	name of the shared-memory object
+ *	@return	the ring, or NULL if it does not exist or is not a frame ring
+ */
+FrameRing* attachFrameRing(const char* name);
+
+/**	Returns a view of the frames of a ring with no pixels, to check their
+ *	type and dimensions
+ *	@param	ring	the ring
+ *	@return	a view with a NULL raster
+ */
+ImageStruct frameRingFormat(const FrameRing* ring);
+
+/**	Gives the producer the next free slot, without waiting
+ *	@param	ring	the ring
+ *	@param	frame	receives a view on the slot's pixels
+ *	@return	1 if a slot was free, 0 if the ring is full
+ */
+int acquireFrameSlot(FrameRing* ring, ImageStruct* frame);
+
+/**	Makes the frame written in the slot given by acquireFrameSlot visible
+ *	to the consumer
+ *	@param	ring	the ring
+ */
+void publishFrame(FrameRing* ring);
+
+/**	Tells the consumer that no more frames will be published
+ *	@param	ring	the ring
+ */
+void closeFrameRing(FrameRing* ring);
+
+/**	Gives the consumer the oldest published frame, without waiting.  The
+ *	frame stays valid (and is not overwritten) until releaseFrame is called.
+ *	@param	ring		the ring
+ *	@param	frame		receives a view on the frame's pixels
+ *	@param	sequence	if not NULL, receives the index of the frame since
+ *						the ring was created
+ *	@return	1 if a frame was available, 0 if the ring is empty
+ */
+int peekFrame(FrameRing* ring, ImageStruct* frame, uint64_t* sequence);
+
+/**	Gives the slot of the frame returned by peekFrame back to the producer
+ *	@param	ring	the ring
+ */
+void releaseFrame(FrameRing* ring);
+
+/**	Tells whether the producer closed the ring and all its frames were read
+ *	@param	ring	the ring
+ *	@return	1 if no frame will ever be available again
+ */
+int frameRingFinished(FrameRing* ring);
+
+/**	Unmaps a ring (the shared-memory object itself stays, see unlinkFrameRing)
+ *	@param	ring	the ring
+ */
+void detachFrameRing(FrameRing* ring);
+
+/**	Removes a shared-memory ring from the system once all processes detach
+ *	@param	name	name of the shared-memory object
+ */
+void unlinkFrameRing(const char* name);
+
+#endif	//	FRAME_RING_H
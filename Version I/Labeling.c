@@ -0,0 +1,1140 @@
+//
+//  Labeling.c
+//  Project
+//
+//  Run-based connected-component labeling of a bit mask.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+//
+#include "Labeling.h"
+#include "Trace.h"
+
+//-----------------------------------------------------------
+//	Union-find on the labels of the runs
+//-----------------------------------------------------------
+static unsigned int findRoot(Run* runs, unsigned int k) {
+	while (runs[k].label != k) {
+		runs[k].label = runs[runs[k].label].label;
+		k = runs[k].label;
+	}
+	return k;
+}
+
+static void mergeRuns(Run* runs, unsigned int a, unsigned int b) {
+	unsigned int rootA = findRoot(runs, a);
+	unsigned int rootB = findRoot(runs, b);
+	//	Always keep the oldest run as root so that labels follow raster order
+	if (rootA < rootB) {
+		runs[rootB].label = rootA;
+	}
+	else if (rootB < rootA) {
+		runs[rootA].label = rootB;
+	}
+}
+
+//-----------------------------------------------------------
+//	Extracts all the runs of a mask and merges the ones that
+//	are 8-connected.  Returns the number of runs.
+//-----------------------------------------------------------
+static unsigned int extractAndMergeRuns(const BitMask* mask, Run** runsOut) {
+	//	First count the runs so that the array is allocated only once
+	unsigned int nbRuns = 0;
+	for (unsigned int i=0; i<mask->nbRows; i++) {
+		nbRuns += countRowRuns(bitMaskRow(mask, i), mask->wordsPerRow);
+	}
+	*runsOut = NULL;
+	if (nbRuns == 0) {
+		return 0;
+	}
+
+	Run* runs = (Run*) malloc(nbRuns*sizeof(Run));
+	if (runs == NULL) {
+		printf("Failed to allocate run list in labelBitMask\n");
+		exit(91);
+	}
+
+	unsigned int k = 0, prevStart = 0, prevEnd = 0;
+	for (unsigned int i=0; i<mask->nbRows; i++) {
+		const uint64_t* rowBits = bitMaskRow(mask, i);
+		unsigned int rowStart = k;
+		unsigned int x = 0, xL, xR;
+		unsigned int j = prevStart;
+
+		while (nextRowRun(rowBits, mask->wordsPerRow, mask->nbCols, x, &xL, &xR)) {
+			runs[k].xL = xL;
+			runs[k].xR = xR;
+			runs[k].y = i;
+			runs[k].label = k;
+
+			//	Skip the runs of the previous row that end before this one
+			//	(diagonal contact counts as a connection)
+			while (j < prevEnd && runs[j].xR + 1 < xL) {
+				j++;
+			}
+			for (unsigned int m=j; m<prevEnd && runs[m].xL <= xR + 1; m++) {
+				mergeRuns(runs, k, m);
+			}
+
+			k++;
+			x = xR + 2;
+		}
+
+		//	Rows with no run break the chain of adjacent rows
+		prevStart = rowStart;
+		prevEnd = k;
+	}
+
+	*runsOut = runs;
+	return nbRuns;
+}
+
+//-----------------------------------------------------------
+//	Size and bounding box of a component, computed from its
+//	runs before any blob is built
+//-----------------------------------------------------------
+typedef struct ComponentStats
+{
+	unsigned int nbPixels;
+	unsigned int nbRuns;
+	unsigned int xMin, xMax;
+	unsigned int yTop, yBottom;
+
+} ComponentStats;
+
+typedef struct AreaRank
+{
+	unsigned int nbPixels;
+	unsigned int component;
+
+} AreaRank;
+
+//	Adds a run to the statistics of its component (runs come in
+//	raster order)
+static void addRunToStats(ComponentStats* comp, const Run* run) {
+	if (comp->nbRuns == 0) {
+		comp->yTop = run->y;
+		comp->xMin = run->xL;
+		comp->xMax = run->xR;
+	}
+	if (run->xL < comp->xMin) {
+		comp->xMin = run->xL;
+	}
+	if (run->xR > comp->xMax) {
+		comp->xMax = run->xR;
+	}
+	comp->yBottom = run->y;
+	comp->nbRuns++;
+	comp->nbPixels += run->xR - run->xL + 1;
+}
+
+//	Larger areas first, raster order between equal areas
+static int compareAreaRanks(const void* a, const void* b) {
+	const AreaRank* rankA = (const AreaRank*) a;
+	const AreaRank* rankB = (const AreaRank*) b;
+	if (rankA->nbPixels != rankB->nbPixels) {
+		return rankA->nbPixels > rankB->nbPixels ? -1 : 1;
+	}
+	return rankA->component < rankB->component ? -1 : 1;
+}
+
+//-----------------------------------------------------------
+//	Labeling parameters that accept every component
+//-----------------------------------------------------------
+LabelParams defaultLabelParams(void) {
+	LabelParams params = {0, 0, 0, 0, 0};
+	return params;
+}
+
+//-----------------------------------------------------------
+//	Point every run directly to its root, then give consecutive
+//	labels to the roots in raster order.  Returns the number of
+//	components.
+//-----------------------------------------------------------
+static unsigned int resolveLabels(Run* runs, unsigned int nbRuns) {
+	for (unsigned int k=0; k<nbRuns; k++) {
+		runs[k].label = findRoot(runs, k);
+	}
+
+	//	A root always precedes the other runs of its tree, so it is
+	//	numbered before they are relabeled.
+	unsigned int* componentOf = (unsigned int*) malloc(nbRuns*sizeof(unsigned int));
+	if (componentOf == NULL) {
+		printf("Failed to allocate label table in labelBitMask\n");
+		exit(95);
+	}
+	unsigned int nbComponents = 0;
+	for (unsigned int k=0; k<nbRuns; k++) {
+		if (runs[k].label == k) {
+			componentOf[k] = nbComponents++;
+		}
+		runs[k].label = componentOf[runs[k].label];
+	}
+	free(componentOf);
+
+	return nbComponents;
+}
+
+//-----------------------------------------------------------
+//	Decides which components become blobs.  On return,
+//	blobIndex[c] is the index of the blob of component c, or -1
+//	if the component was rejected.  Returns the number of blobs.
+//-----------------------------------------------------------
+static unsigned int selectComponents(const ComponentStats* stats, unsigned int nbComponents,
+									 const LabelParams* params, int* blobIndex)
+{
+	unsigned int nbAccepted = 0;
+	for (unsigned int c=0; c<nbComponents; c++) {
+		const ComponentStats* comp = stats + c;
+		int ok = 1;
+		if (params != NULL) {
+			if (comp->nbPixels < params->minArea ||
+				(params->maxArea > 0 && comp->nbPixels > params->maxArea) ||
+				comp->xMax - comp->xMin + 1 < params->minWidth ||
+				comp->yBottom - comp->yTop + 1 < params->minHeight) {
+				ok = 0;
+			}
+		}
+		blobIndex[c] = ok ? 0 : -1;
+		nbAccepted += ok;
+	}
+
+	//	Too many blobs: only keep the largest ones
+	if (params != NULL && params->maxBlobs > 0 && nbAccepted > params->maxBlobs) {
+		AreaRank* ranks = (AreaRank*) malloc(nbAccepted*sizeof(AreaRank));
+		if (ranks == NULL) {
+			printf("Failed to allocate rank list in labelBitMask\n");
+			exit(96);
+		}
+		for (unsigned int c=0, k=0; c<nbComponents; c++) {
+			if (blobIndex[c] == 0) {
+				ranks[k].nbPixels = stats[c].nbPixels;
+				ranks[k].component = c;
+				k++;
+			}
+		}
+		qsort(ranks, nbAccepted, sizeof(AreaRank), compareAreaRanks);
+		for (unsigned int k=params->maxBlobs; k<nbAccepted; k++) {
+			blobIndex[ranks[k].component] = -1;
+		}
+		free(ranks);
+		nbAccepted = params->maxBlobs;
+	}
+
+	//	Number the blobs in raster order
+	unsigned int nbBlobs = 0;
+	for (unsigned int c=0; c<nbComponents; c++) {
+		if (blobIndex[c] == 0) {
+			blobIndex[c] = nbBlobs++;
+		}
+	}
+
+	return nbBlobs;
+}
+
+//-----------------------------------------------------------
+//	Builds the blobs of the accepted components.  Every extent
+//	list is allocated once, at its final size.
+//-----------------------------------------------------------
+static Blob* buildBlobs(const Run* runs, unsigned int nbRuns, const ComponentStats* stats,
+						unsigned int nbComponents, const int* blobIndex, unsigned int nbBlobs)
+{
+	Blob* blobs = (Blob*) blobMalloc(nbBlobs*sizeof(Blob));
+	if (blobs == NULL) {
+		printf("Failed to allocate blob list in labelBitMask\n");
+		exit(92);
+	}
+	for (unsigned int c=0; c<nbComponents; c++) {
+		if (blobIndex[c] < 0) {
+			continue;
+		}
+		Blob* blob = blobs + blobIndex[c];
+		*blob = newBlob();
+		//	blobs are rendered in red
+		blob->red = 0xFF;
+		blob->yTop = stats[c].yTop;
+		blob->yBottom = stats[c].yBottom;
+		blob->nbSegs = stats[c].nbRuns;
+		blob->nbPixels = stats[c].nbPixels;
+		blob->deque = (ExtentList*) blobCalloc(stats[c].yBottom - stats[c].yTop + 1, sizeof(ExtentList));
+		if (blob->deque == NULL) {
+			printf("Failed to allocate deque in labelBitMask\n");
+			exit(93);
+		}
+	}
+
+	//	Count the extents of each row of each blob, then allocate the lists
+	for (unsigned int k=0; k<nbRuns; k++) {
+		int b = blobIndex[runs[k].label];
+		if (b >= 0) {
+			blobs[b].deque[runs[k].y - blobs[b].yTop].nbSegs++;
+		}
+	}
+	for (unsigned int b=0; b<nbBlobs; b++) {
+		unsigned int blobHeight = blobs[b].yBottom - blobs[b].yTop + 1;
+		for (unsigned int i=0; i<blobHeight; i++) {
+			ExtentList* list = blobs[b].deque + i;
+			if (list->nbSegs > 0) {
+				list->segList = (Extent*) blobMalloc(list->nbSegs*sizeof(Extent));
+				if (list->segList == NULL) {
+					printf("Failed to allocate segment list in labelBitMask\n");
+					exit(94);
+				}
+				list->nbSegs = 0;
+			}
+		}
+	}
+
+	//	Runs of a row come left to right, so the lists end up sorted
+	for (unsigned int k=0; k<nbRuns; k++) {
+		int b = blobIndex[runs[k].label];
+		if (b >= 0) {
+			ExtentList* list = blobs[b].deque + (runs[k].y - blobs[b].yTop);
+			Extent seg = {runs[k].xL, runs[k].xR, runs[k].y};
+			list->segList[list->nbSegs++] = seg;
+		}
+	}
+
+	return blobs;
+}
+
+//-----------------------------------------------------------
+//	Label the components of a mask and build their blobs
+//-----------------------------------------------------------
+unsigned int labelBitMask(const BitMask* mask, const LabelParams* params, Blob** blobList) {
+	double traceStart = traceClock();
+	Run* runs;
+	unsigned int nbRuns = extractAndMergeRuns(mask, &runs);
+	traceSpan("extract runs", "label", traceStart);
+	*blobList = NULL;
+	if (nbRuns == 0) {
+		return 0;
+	}
+
+	traceStart = traceClock();
+	unsigned int nbComponents = resolveLabels(runs, nbRuns);
+	traceSpan("merge labels", "label", traceStart);
+
+	traceStart = traceClock();
+
+	//	Area and bounding box of each component (runs are in raster order)
+	ComponentStats* stats = (ComponentStats*) calloc(nbComponents, sizeof(ComponentStats));
+	int* blobIndex = (int*) malloc(nbComponents*sizeof(int));
+	if (stats == NULL || blobIndex == NULL) {
+		printf("Failed to allocate component table in labelBitMask\n");
+		exit(97);
+	}
+	for (unsigned int k=0; k<nbRuns; k++) {
+		addRunToStats(stats + runs[k].label, runs + k);
+	}
+
+	unsigned int nbBlobs = selectComponents(stats, nbComponents, params, blobIndex);
+	if (nbBlobs > 0) {
+		*blobList = buildBlobs(runs, nbRuns, stats, nbComponents, blobIndex, nbBlobs);
+	}
+
+	free(blobIndex);
+	free(stats);
+	free(runs);
+	traceSpan("build blobs", "label", traceStart);
+	return nbBlobs;
+}
+
+//===========================================================
+//	Stream labeling
+//===========================================================
+
+#define NO_COMPONENT	0xFFFFFFFFU
+
+//	A component that may still grow
+typedef struct OpenComponent
+{
+	//	union-find parent (slot index), own index for a root
+	unsigned int parent;
+	unsigned int nbPixels;
+	unsigned int xMin, xMax, yMin, yMax;
+	//	index of the last row that has a run of this component
+	unsigned int lastRow;
+	//	1 when the component grew past maxArea: its extents are dropped
+	int rejected;
+	int inUse;
+	unsigned int nbSegs, capacity;
+	Extent* segs;
+
+} OpenComponent;
+
+typedef struct RowRun
+{
+	unsigned int xL, xR;
+	unsigned int component;
+
+} RowRun;
+
+//	Growable array of unsigned int, used for the slot lists
+typedef struct IndexList
+{
+	unsigned int size, capacity;
+	unsigned int* items;
+
+} IndexList;
+
+struct StreamLabeler
+{
+	unsigned int nbCols, wordsPerRow;
+	LabelParams params;
+	BlobCallback emit;
+	void* arg;
+
+	//	number of rows pushed so far
+	unsigned int rowIndex;
+
+	OpenComponent* comps;
+	unsigned int nbSlots, slotCapacity;
+	IndexList freeSlots;
+	IndexList absorbed;
+
+	RowRun* prevRuns;
+	RowRun* curRuns;
+	unsigned int nbPrev, nbCur;
+	unsigned int prevCapacity, curCapacity;
+};
+
+static void* growArray(void* array, unsigned int* capacity, unsigned int needed, size_t itemSize) {
+	if (needed <= *capacity) {
+		return array;
+	}
+	unsigned int newCapacity = (*capacity > 0) ? *capacity : 8;
+	while (newCapacity < needed) {
+		newCapacity *= 2;
+	}
+	void* newArray = realloc(array, newCapacity*itemSize);
+	if (newArray == NULL) {
+		printf("Failed to grow labeler storage\n");
+		exit(98);
+	}
+	*capacity = newCapacity;
+	return newArray;
+}
+
+static void pushIndex(IndexList* list, unsigned int index) {
+	list->items = (unsigned int*) growArray(list->items, &list->capacity, list->size + 1,
+											sizeof(unsigned int));
+	list->items[list->size++] = index;
+}
+
+//-----------------------------------------------------------
+//	Creates a stream labeler
+//-----------------------------------------------------------
+StreamLabeler* newStreamLabeler(unsigned int nbCols, const LabelParams* params,
+								BlobCallback emit, void* arg)
+{
+	StreamLabeler* labeler = (StreamLabeler*) calloc(1, sizeof(StreamLabeler));
+	if (labeler == NULL) {
+		printf("Failed to allocate stream labeler\n");
+		exit(99);
+	}
+	labeler->nbCols = nbCols;
+	labeler->wordsPerRow = (nbCols + MASK_WORD_BITS - 1) / MASK_WORD_BITS;
+	labeler->params = (params != NULL) ? *params : defaultLabelParams();
+	labeler->emit = emit;
+	labeler->arg = arg;
+	return labeler;
+}
+
+static unsigned int findComponent(StreamLabeler* labeler, unsigned int c) {
+	OpenComponent* comps = labeler->comps;
+	while (comps[c].parent != c) {
+		comps[c].parent = comps[comps[c].parent].parent;
+		c = comps[c].parent;
+	}
+	return c;
+}
+
+static unsigned int allocComponent(StreamLabeler* labeler) {
+	unsigned int c;
+	if (labeler->freeSlots.size > 0) {
+		c = labeler->freeSlots.items[--labeler->freeSlots.size];
+	}
+	else {
+		labeler->comps = (OpenComponent*) growArray(labeler->comps, &labeler->slotCapacity,
+													labeler->nbSlots + 1, sizeof(OpenComponent));
+		c = labeler->nbSlots++;
+	}
+	OpenComponent* comp = labeler->comps + c;
+	comp->parent = c;
+	comp->nbPixels = 0;
+	comp->nbSegs = comp->capacity = 0;
+	comp->segs = NULL;
+	comp->rejected = 0;
+	comp->inUse = 1;
+	return c;
+}
+
+static void releaseComponent(StreamLabeler* labeler, unsigned int c) {
+	OpenComponent* comp = labeler->comps + c;
+	free(comp->segs);
+	comp->segs = NULL;
+	comp->inUse = 0;
+	pushIndex(&labeler->freeSlots, c);
+}
+
+static void rejectComponent(OpenComponent* comp) {
+	comp->rejected = 1;
+	free(comp->segs);
+	comp->segs = NULL;
+	comp->nbSegs = comp->capacity = 0;
+}
+
+static void addRunToComponent(StreamLabeler* labeler, unsigned int c, unsigned int xL,
+							  unsigned int xR, unsigned int y)
+{
+	OpenComponent* comp = labeler->comps + c;
+	if (comp->nbPixels == 0) {
+		comp->xMin = xL;
+		comp->xMax = xR;
+		comp->yMin = comp->yMax = y;
+	}
+	if (xL < comp->xMin) {
+		comp->xMin = xL;
+	}
+	if (xR > comp->xMax) {
+		comp->xMax = xR;
+	}
+	if (y < comp->yMin) {
+		comp->yMin = y;
+	}
+	if (y > comp->yMax) {
+		comp->yMax = y;
+	}
+	comp->nbPixels += xR - xL + 1;
+	comp->lastRow = labeler->rowIndex;
+
+	if (!comp->rejected && labeler->params.maxArea > 0 && comp->nbPixels > labeler->params.maxArea) {
+		rejectComponent(comp);
+	}
+	if (!comp->rejected) {
+		comp->segs = (Extent*) growArray(comp->segs, &comp->capacity, comp->nbSegs + 1, sizeof(Extent));
+		Extent seg = {xL, xR, y};
+		comp->segs[comp->nbSegs++] = seg;
+	}
+}
+
+//	Merges two open components; the one with more extents absorbs the other
+static unsigned int unionComponents(StreamLabeler* labeler, unsigned int a, unsigned int b) {
+	OpenComponent* comps = labeler->comps;
+	if (comps[b].nbSegs > comps[a].nbSegs) {
+		unsigned int tmp = a;
+		a = b;
+		b = tmp;
+	}
+	OpenComponent* root = comps + a;
+	OpenComponent* other = comps + b;
+
+	if (other->nbPixels > 0) {
+		if (root->nbPixels == 0) {
+			root->xMin = other->xMin;
+			root->xMax = other->xMax;
+			root->yMin = other->yMin;
+			root->yMax = other->yMax;
+		}
+		if (other->xMin < root->xMin) {
+			root->xMin = other->xMin;
+		}
+		if (other->xMax > root->xMax) {
+			root->xMax = other->xMax;
+		}
+		if (other->yMin < root->yMin) {
+			root->yMin = other->yMin;
+		}
+		if (other->yMax > root->yMax) {
+			root->yMax = other->yMax;
+		}
+	}
+	root->nbPixels += other->nbPixels;
+	if (other->lastRow > root->lastRow) {
+		root->lastRow = other->lastRow;
+	}
+
+	if (other->rejected || (labeler->params.maxArea > 0 && root->nbPixels > labeler->params.maxArea)) {
+		if (!root->rejected) {
+			rejectComponent(root);
+		}
+	}
+	else if (!root->rejected) {
+		root->segs = (Extent*) growArray(root->segs, &root->capacity, root->nbSegs + other->nbSegs,
+										 sizeof(Extent));
+		for (unsigned int k=0; k<other->nbSegs; k++) {
+			root->segs[root->nbSegs++] = other->segs[k];
+		}
+	}
+
+	free(other->segs);
+	other->segs = NULL;
+	other->nbSegs = other->capacity = 0;
+	other->parent = a;
+	pushIndex(&labeler->absorbed, b);
+	return a;
+}
+
+//	Extents ordered by row, then left to right
+static int compareExtents(const void* a, const void* b) {
+	const Extent* segA = (const Extent*) a;
+	const Extent* segB = (const Extent*) b;
+	if (segA->y != segB->y) {
+		return segA->y < segB->y ? -1 : 1;
+	}
+	return (segA->xL < segB->xL) ? -1 : (segA->xL > segB->xL);
+}
+
+//	Hands a completed component over to the callback if it passes the limits
+static void emitComponent(StreamLabeler* labeler, unsigned int c) {
+	OpenComponent* comp = labeler->comps + c;
+	const LabelParams* params = &labeler->params;
+
+	int ok = !comp->rejected && comp->nbPixels >= params->minArea &&
+			 comp->xMax - comp->xMin + 1 >= params->minWidth &&
+			 comp->yMax - comp->yMin + 1 >= params->minHeight;
+
+	if (ok) {
+		qsort(comp->segs, comp->nbSegs, sizeof(Extent), compareExtents);
+
+		Blob blob = newBlob();
+		//	blobs are rendered in red
+		blob.red = 0xFF;
+		blob.yTop = comp->yMin;
+		blob.yBottom = comp->yMax;
+		blob.nbSegs = comp->nbSegs;
+		blob.nbPixels = comp->nbPixels;
+		blob.deque = (ExtentList*) blobCalloc(comp->yMax - comp->yMin + 1, sizeof(ExtentList));
+		if (blob.deque == NULL) {
+			printf("Failed to allocate deque in stream labeler\n");
+			exit(93);
+		}
+
+		//	The sorted extents of a row are contiguous: each list gets its own copy
+		unsigned int k = 0;
+		while (k < comp->nbSegs) {
+			unsigned int end = k;
+			while (end < comp->nbSegs && comp->segs[end].y == comp->segs[k].y) {
+				end++;
+			}
+			ExtentList* list = blob.deque + (comp->segs[k].y - comp->yMin);
+			list->nbSegs = end - k;
+			list->segList = (Extent*) blobMalloc(list->nbSegs*sizeof(Extent));
+			if (list->segList == NULL) {
+				printf("Failed to allocate segment list in stream labeler\n");
+				exit(94);
+			}
+			for (unsigned int j=k; j<end; j++) {
+				list->segList[j-k] = comp->segs[j];
+			}
+			k = end;
+		}
+
+		labeler->emit(labeler->arg, blob);
+	}
+
+	releaseComponent(labeler, c);
+}
+
+//	Emits the components of the previous row that did not reach the current one
+static void emitCompletedComponents(StreamLabeler* labeler, int lastRow) {
+	for (unsigned int m=0; m<labeler->nbPrev; m++) {
+		unsigned int c = findComponent(labeler, labeler->prevRuns[m].component);
+		OpenComponent* comp = labeler->comps + c;
+		if (comp->inUse && (lastRow || comp->lastRow != labeler->rowIndex)) {
+			emitComponent(labeler, c);
+		}
+	}
+}
+
+//-----------------------------------------------------------
+//	Adds the next row of the mask
+//-----------------------------------------------------------
+void pushMaskRow(StreamLabeler* labeler, const uint64_t* rowBits, unsigned int y) {
+	unsigned int nbRuns = countRowRuns(rowBits, labeler->wordsPerRow);
+	labeler->curRuns = (RowRun*) growArray(labeler->curRuns, &labeler->curCapacity, nbRuns,
+										   sizeof(RowRun));
+	labeler->nbCur = 0;
+
+	unsigned int x = 0, xL, xR;
+	unsigned int j = 0;
+	while (nextRowRun(rowBits, labeler->wordsPerRow, labeler->nbCols, x, &xL, &xR)) {
+		unsigned int c = NO_COMPONENT;
+
+		//	Same 8-connectivity rule as labelBitMask
+		while (j < labeler->nbPrev && labeler->prevRuns[j].xR + 1 < xL) {
+			j++;
+		}
+		for (unsigned int m=j; m<labeler->nbPrev && labeler->prevRuns[m].xL <= xR + 1; m++) {
+			unsigned int other = findComponent(labeler, labeler->prevRuns[m].component);
+			if (c == NO_COMPONENT) {
+				c = other;
+			}
+			else if (other != c) {
+				c = unionComponents(labeler, c, other);
+			}
+		}
+		if (c == NO_COMPONENT) {
+			c = allocComponent(labeler);
+		}
+		addRunToComponent(labeler, c, xL, xR, y);
+
+		RowRun run = {xL, xR, c};
+		labeler->curRuns[labeler->nbCur++] = run;
+		x = xR + 2;
+	}
+
+	//	Components may have been merged after some runs of this row were
+	//	assigned to them
+	for (unsigned int k=0; k<labeler->nbCur; k++) {
+		labeler->curRuns[k].component = findComponent(labeler, labeler->curRuns[k].component);
+	}
+
+	emitCompletedComponents(labeler, 0);
+
+	for (unsigned int k=0; k<labeler->absorbed.size; k++) {
+		labeler->comps[labeler->absorbed.items[k]].inUse = 0;
+		pushIndex(&labeler->freeSlots, labeler->absorbed.items[k]);
+	}
+	labeler->absorbed.size = 0;
+
+	RowRun* tmp = labeler->prevRuns;
+	labeler->prevRuns = labeler->curRuns;
+	labeler->curRuns = tmp;
+	unsigned int tmpCapacity = labeler->prevCapacity;
+	labeler->prevCapacity = labeler->curCapacity;
+	labeler->curCapacity = tmpCapacity;
+	labeler->nbPrev = labeler->nbCur;
+	labeler->rowIndex++;
+}
+
+//-----------------------------------------------------------
+//	Emits the components still open
+//-----------------------------------------------------------
+void finishStreamLabeler(StreamLabeler* labeler) {
+	emitCompletedComponents(labeler, 1);
+	labeler->nbPrev = 0;
+}
+
+//-----------------------------------------------------------
+//	Frees a stream labeler
+//-----------------------------------------------------------
+void deleteStreamLabeler(StreamLabeler* labeler) {
+	for (unsigned int c=0; c<labeler->nbSlots; c++) {
+		free(labeler->comps[c].segs);
+	}
+	free(labeler->comps);
+	free(labeler->freeSlots.items);
+	free(labeler->absorbed.items);
+	free(labeler->prevRuns);
+	free(labeler->curRuns);
+	free(labeler);
+}
+
+//===========================================================
+//	Incremental labeling
+//===========================================================
+
+//	Flags of the rows of an incremental labeler
+#define ROW_DIRTY	0x1
+#define ROW_VISIT	0x2
+
+//	The runs of one row, labeled with the slot of their component
+typedef struct LabeledRow
+{
+	unsigned int nbRuns, capacity;
+	Run* runs;
+
+} LabeledRow;
+
+//	A component of the last frame labeled
+typedef struct TrackedComponent
+{
+	ComponentStats stats;
+	//	left endpoint of its first run, for the raster order
+	unsigned int firstX;
+	int inUse;
+	int affected;
+	//	built the first time the component is reported (deque NULL until then)
+	Blob blob;
+
+} TrackedComponent;
+
+//	Position of the first pixel of a component
+typedef struct RasterRank
+{
+	unsigned int y, x;
+	unsigned int slot;
+
+} RasterRank;
+
+struct IncrementalLabeler
+{
+	unsigned int nbRows;
+	LabelParams params;
+	int firstFrame;
+
+	uint64_t* rowHashes;
+	unsigned char* rowFlags;
+	LabeledRow* rows;
+
+	TrackedComponent* comps;
+	unsigned int nbSlots, slotCapacity;
+	IndexList freeSlots;
+	IndexList affected;
+
+	//	runs being relabeled, copied in raster order, and the row
+	//	runs they were copied from
+	Run* scratch;
+	Run** origin;
+	unsigned int scratchCapacity, originCapacity;
+
+	//	the blobs reported for the last frame
+	Blob* blobs;
+	unsigned int nbBlobs, blobCapacity;
+};
+
+static int compareRasterRanks(const void* a, const void* b) {
+	const RasterRank* rankA = (const RasterRank*) a;
+	const RasterRank* rankB = (const RasterRank*) b;
+	if (rankA->y != rankB->y) {
+		return rankA->y < rankB->y ? -1 : 1;
+	}
+	return rankA->x < rankB->x ? -1 : (rankA->x > rankB->x);
+}
+
+//	Hash of the words of a mask row
+static uint64_t hashMaskRow(const uint64_t* rowBits, unsigned int wordsPerRow) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (unsigned int w=0; w<wordsPerRow; w++) {
+		hash = (hash ^ rowBits[w]) * 0x100000001B3ULL;
+		hash ^= hash >> 29;
+	}
+	return hash;
+}
+
+//-----------------------------------------------------------
+//	Creates an incremental labeler
+//-----------------------------------------------------------
+IncrementalLabeler* newIncrementalLabeler(unsigned int nbRows, const LabelParams* params) {
+	IncrementalLabeler* labeler = (IncrementalLabeler*) calloc(1, sizeof(IncrementalLabeler));
+	if (labeler == NULL) {
+		printf("Failed to allocate incremental labeler\n");
+		exit(99);
+	}
+	labeler->nbRows = nbRows;
+	labeler->params = (params != NULL) ? *params : defaultLabelParams();
+	labeler->firstFrame = 1;
+	labeler->rowHashes = (uint64_t*) malloc(nbRows*sizeof(uint64_t));
+	labeler->rowFlags = (unsigned char*) calloc(nbRows, 1);
+	labeler->rows = (LabeledRow*) calloc(nbRows, sizeof(LabeledRow));
+	if (labeler->rowHashes == NULL || labeler->rowFlags == NULL || labeler->rows == NULL) {
+		printf("Failed to allocate row tables of incremental labeler\n");
+		exit(99);
+	}
+	return labeler;
+}
+
+static unsigned int allocTrackedComponent(IncrementalLabeler* labeler) {
+	unsigned int slot;
+	if (labeler->freeSlots.size > 0) {
+		slot = labeler->freeSlots.items[--labeler->freeSlots.size];
+	}
+	else {
+		labeler->comps = (TrackedComponent*) growArray(labeler->comps, &labeler->slotCapacity,
+													   labeler->nbSlots + 1, sizeof(TrackedComponent));
+		slot = labeler->nbSlots++;
+	}
+	TrackedComponent* comp = labeler->comps + slot;
+	memset(&comp->stats, 0, sizeof(ComponentStats));
+	comp->firstX = 0;
+	comp->inUse = 1;
+	comp->affected = 0;
+	comp->blob = newBlob();
+	return slot;
+}
+
+//-----------------------------------------------------------
+//	Drops the components that have a run in a changed row or in
+//	a row next to one: their runs may now connect differently.
+//	Every row they span is marked to be relabeled, and so are
+//	the changed rows.  The other components cannot touch a
+//	changed row, so they stay as they are.
+//-----------------------------------------------------------
+static void dropAffectedComponents(IncrementalLabeler* labeler) {
+	for (unsigned int i=0; i<labeler->nbRows; i++) {
+		if (!(labeler->rowFlags[i] & ROW_DIRTY)) {
+			continue;
+		}
+		labeler->rowFlags[i] |= ROW_VISIT;
+		unsigned int first = (i > 0) ? i - 1 : 0;
+		unsigned int last = (i + 1 < labeler->nbRows) ? i + 1 : i;
+		for (unsigned int y=first; y<=last; y++) {
+			const LabeledRow* row = labeler->rows + y;
+			for (unsigned int k=0; k<row->nbRuns; k++) {
+				TrackedComponent* comp = labeler->comps + row->runs[k].label;
+				if (!comp->affected) {
+					comp->affected = 1;
+					pushIndex(&labeler->affected, row->runs[k].label);
+				}
+			}
+		}
+	}
+
+	for (unsigned int k=0; k<labeler->affected.size; k++) {
+		unsigned int slot = labeler->affected.items[k];
+		TrackedComponent* comp = labeler->comps + slot;
+		for (unsigned int y=comp->stats.yTop; y<=comp->stats.yBottom; y++) {
+			labeler->rowFlags[y] |= ROW_VISIT;
+		}
+		deleteBlob(&comp->blob);
+		comp->inUse = 0;
+		comp->affected = 0;
+		pushIndex(&labeler->freeSlots, slot);
+	}
+	labeler->affected.size = 0;
+}
+
+//	Replaces the runs of a changed row by those of the new mask
+static void extractLabeledRow(IncrementalLabeler* labeler, const BitMask* mask, unsigned int y) {
+	LabeledRow* row = labeler->rows + y;
+	const uint64_t* rowBits = bitMaskRow(mask, y);
+	row->runs = (Run*) growArray(row->runs, &row->capacity,
+								 countRowRuns(rowBits, mask->wordsPerRow), sizeof(Run));
+	row->nbRuns = 0;
+
+	unsigned int x = 0, xL, xR;
+	while (nextRowRun(rowBits, mask->wordsPerRow, mask->nbCols, x, &xL, &xR)) {
+		Run run = {xL, xR, y, NO_COMPONENT};
+		row->runs[row->nbRuns++] = run;
+		x = xR + 2;
+	}
+}
+
+//-----------------------------------------------------------
+//	Labels the runs of the marked rows that do not belong to a
+//	kept component, exactly as labelBitMask would, and turns
+//	their components into new tracked components
+//-----------------------------------------------------------
+static void relabelMarkedRows(IncrementalLabeler* labeler, const BitMask* mask) {
+	unsigned int nbScratch = 0, prevStart = 0, prevEnd = 0;
+	for (unsigned int i=0; i<labeler->nbRows; i++) {
+		if (!(labeler->rowFlags[i] & ROW_VISIT)) {
+			prevStart = prevEnd = nbScratch;
+			continue;
+		}
+		if (labeler->rowFlags[i] & ROW_DIRTY) {
+			extractLabeledRow(labeler, mask, i);
+		}
+
+		LabeledRow* row = labeler->rows + i;
+		unsigned int rowStart = nbScratch;
+		unsigned int j = prevStart;
+		for (unsigned int k=0; k<row->nbRuns; k++) {
+			Run* run = row->runs + k;
+			if (run->label != NO_COMPONENT && labeler->comps[run->label].inUse) {
+				continue;
+			}
+			labeler->scratch = (Run*) growArray(labeler->scratch, &labeler->scratchCapacity,
+												nbScratch + 1, sizeof(Run));
+			labeler->origin = (Run**) growArray(labeler->origin, &labeler->originCapacity,
+												nbScratch + 1, sizeof(Run*));
+			Run* scratch = labeler->scratch;
+			scratch[nbScratch] = *run;
+			scratch[nbScratch].label = nbScratch;
+			labeler->origin[nbScratch] = run;
+
+			while (j < prevEnd && scratch[j].xR + 1 < run->xL) {
+				j++;
+			}
+			for (unsigned int m=j; m<prevEnd && scratch[m].xL <= run->xR + 1; m++) {
+				mergeRuns(scratch, nbScratch, m);
+			}
+			nbScratch++;
+		}
+		prevStart = rowStart;
+		prevEnd = nbScratch;
+	}
+	if (nbScratch == 0) {
+		return;
+	}
+
+	unsigned int nbComponents = resolveLabels(labeler->scratch, nbScratch);
+	unsigned int* slotOf = (unsigned int*) malloc(nbComponents*sizeof(unsigned int));
+	if (slotOf == NULL) {
+		printf("Failed to allocate slot table of incremental labeler\n");
+		exit(99);
+	}
+	for (unsigned int c=0; c<nbComponents; c++) {
+		slotOf[c] = allocTrackedComponent(labeler);
+	}
+	for (unsigned int k=0; k<nbScratch; k++) {
+		const Run* run = labeler->scratch + k;
+		TrackedComponent* comp = labeler->comps + slotOf[run->label];
+		if (comp->stats.nbRuns == 0) {
+			comp->firstX = run->xL;
+		}
+		addRunToStats(&comp->stats, run);
+		labeler->origin[k]->label = slotOf[run->label];
+	}
+	free(slotOf);
+}
+
+//	Builds the extent lists of a tracked component from its runs
+static void buildTrackedBlob(IncrementalLabeler* labeler, unsigned int slot) {
+	TrackedComponent* comp = labeler->comps + slot;
+	const ComponentStats* stats = &comp->stats;
+	Blob* blob = &comp->blob;
+	//	blobs are rendered in red
+	blob->red = 0xFF;
+	blob->yTop = stats->yTop;
+	blob->yBottom = stats->yBottom;
+	blob->nbSegs = stats->nbRuns;
+	blob->nbPixels = stats->nbPixels;
+	const unsigned int blobHeight = stats->yBottom - stats->yTop + 1;
+	blob->deque = (ExtentList*) blobCalloc(blobHeight, sizeof(ExtentList));
+	if (blob->deque == NULL) {
+		printf("Failed to allocate deque of incremental labeler\n");
+		exit(99);
+	}
+
+	for (unsigned int i=0; i<blobHeight; i++) {
+		const LabeledRow* row = labeler->rows + stats->yTop + i;
+		ExtentList* list = blob->deque + i;
+		//	runs are sorted: only look inside the bounding box
+		unsigned int first = 0, last = row->nbRuns;
+		while (first < last && row->runs[first].xR < stats->xMin) {
+			first++;
+		}
+		while (last > first && row->runs[last-1].xL > stats->xMax) {
+			last--;
+		}
+		for (unsigned int k=first; k<last; k++) {
+			list->nbSegs += (row->runs[k].label == slot);
+		}
+		if (list->nbSegs == 0) {
+			continue;
+		}
+		list->segList = (Extent*) blobMalloc(list->nbSegs*sizeof(Extent));
+		if (list->segList == NULL) {
+			printf("Failed to allocate segment list of incremental labeler\n");
+			exit(99);
+		}
+		list->nbSegs = 0;
+		for (unsigned int k=first; k<last; k++) {
+			if (row->runs[k].label == slot) {
+				Extent seg = {row->runs[k].xL, row->runs[k].xR, row->runs[k].y};
+				list->segList[list->nbSegs++] = seg;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------
+//	Applies the limits to the tracked components, in raster
+//	order, and gathers the blobs of the accepted ones.  Only the
+//	components reported for the first time get their extent
+//	lists built.
+//-----------------------------------------------------------
+static void reportTrackedComponents(IncrementalLabeler* labeler) {
+	unsigned int nbComponents = 0;
+	for (unsigned int slot=0; slot<labeler->nbSlots; slot++) {
+		nbComponents += labeler->comps[slot].inUse;
+	}
+	labeler->nbBlobs = 0;
+	if (nbComponents == 0) {
+		return;
+	}
+
+	RasterRank* ranks = (RasterRank*) malloc(nbComponents*sizeof(RasterRank));
+	ComponentStats* stats = (ComponentStats*) malloc(nbComponents*sizeof(ComponentStats));
+	int* blobIndex = (int*) malloc(nbComponents*sizeof(int));
+	if (ranks == NULL || stats == NULL || blobIndex == NULL) {
+		printf("Failed to allocate component table of incremental labeler\n");
+		exit(99);
+	}
+	for (unsigned int slot=0, c=0; slot<labeler->nbSlots; slot++) {
+		const TrackedComponent* comp = labeler->comps + slot;
+		if (comp->inUse) {
+			ranks[c].y = comp->stats.yTop;
+			ranks[c].x = comp->firstX;
+			ranks[c].slot = slot;
+			c++;
+		}
+	}
+	qsort(ranks, nbComponents, sizeof(RasterRank), compareRasterRanks);
+	for (unsigned int c=0; c<nbComponents; c++) {
+		stats[c] = labeler->comps[ranks[c].slot].stats;
+	}
+
+	unsigned int nbBlobs = selectComponents(stats, nbComponents, &labeler->params, blobIndex);
+	labeler->blobs = (Blob*) growArray(labeler->blobs, &labeler->blobCapacity, nbBlobs, sizeof(Blob));
+	for (unsigned int c=0; c<nbComponents; c++) {
+		if (blobIndex[c] >= 0) {
+			TrackedComponent* comp = labeler->comps + ranks[c].slot;
+			if (comp->blob.deque == NULL) {
+				buildTrackedBlob(labeler, ranks[c].slot);
+			}
+			labeler->blobs[blobIndex[c]] = comp->blob;
+		}
+	}
+	labeler->nbBlobs = nbBlobs;
+
+	free(blobIndex);
+	free(stats);
+	free(ranks);
+}
+
+//-----------------------------------------------------------
+//	Labels the next mask, starting from the previous one
+//-----------------------------------------------------------
+unsigned int relabelBitMask(IncrementalLabeler* labeler, const BitMask* mask, Blob** blobList) {
+	unsigned int nbDirty = 0;
+	for (unsigned int i=0; i<labeler->nbRows; i++) {
+		uint64_t hash = hashMaskRow(bitMaskRow(mask, i), mask->wordsPerRow);
+		labeler->rowFlags[i] = 0;
+		if (labeler->firstFrame || hash != labeler->rowHashes[i]) {
+			labeler->rowHashes[i] = hash;
+			labeler->rowFlags[i] = ROW_DIRTY;
+			nbDirty++;
+		}
+	}
+	labeler->firstFrame = 0;
+
+	//	Nothing changed: the blobs of the last frame still hold
+	if (nbDirty > 0) {
+		dropAffectedComponents(labeler);
+		relabelMarkedRows(labeler, mask);
+		reportTrackedComponents(labeler);
+	}
+
+	*blobList = (labeler->nbBlobs > 0) ? labeler->blobs : NULL;
+	return labeler->nbBlobs;
+}
+
+//-----------------------------------------------------------
+//	Frees an incremental labeler and its blobs
+//-----------------------------------------------------------
+void deleteIncrementalLabeler(IncrementalLabeler* labeler) {
+	for (unsigned int slot=0; slot<labeler->nbSlots; slot++) {
+		if (labeler->comps[slot].inUse) {
+			deleteBlob(&labeler->comps[slot].blob);
+		}
+	}
+	for (unsigned int i=0; i<labeler->nbRows; i++) {
+		free(labeler->rows[i].runs);
+	}
+	free(labeler->comps);
+	free(labeler->freeSlots.items);
+	free(labeler->affected.items);
+	free(labeler->scratch);
+	free(labeler->origin);
+	free(labeler->blobs);
+	free(labeler->rows);
+	free(labeler->rowFlags);
+	free(labeler->rowHashes);
+	free(labeler);
+}
@@ -0,0 +1,159 @@
+//-----------------------------------------------------------------
+//	Connected-component labeling of a bit mask into blobs
+//-----------------------------------------------------------------
+
+#ifndef LABELING_H
+#define LABELING_H
+
+#include "BitMask.h"
+#include "Blob.h"
+
+/**	A run is a maximal horizontal segment of foreground pixels in one row
+ *	of a mask, tagged with the label of the component it belongs to.
+ */
+typedef struct Run
+{
+	/**	x (column) coordinate of the run's left endpoint
+	 */
+	unsigned int xL;
+
+	/**	x (column) coordinate of the run's right endpoint
+	 */
+	unsigned int xR;
+
+	/**	y (row) coordinate of the run
+	 */
+	unsigned int y;
+
+	/**	Label of the run.  While labeling is in progress this is the index of
+	 *	the run's parent in the union-find forest.
+	 */
+	unsigned int label;
+
+} Run;
+
+/**	Limits applied to the components found by the labeling.  Components that
+ *	fail them are rejected before any of their extent lists are allocated.
+ *	A value of 0 disables the corresponding limit.
+ */
+typedef struct LabelParams
+{
+	/**	Smallest number of pixels of a blob
+	 */
+	unsigned int minArea;
+
+	/**	Largest number of pixels of a blob
+	 */
+	unsigned int maxArea;
+
+	/**	Smallest width of the bounding box of a blob
+	 */
+	unsigned int minWidth;
+
+	/**	Smallest height of the bounding box of a blob
+	 */
+	unsigned int minHeight;
+
+	/**	Largest number of blobs reported.  When more components pass the
+	 *	other limits, the ones with the largest areas are kept.
+	 */
+	unsigned int maxBlobs;
+
+} LabelParams;
+
+/**	Produces labeling parameters that accept every component
+ *	@return	labeling parameters with all limits disabled
+ */
+LabelParams defaultLabelParams(void);
+
+/**	Finds the 8-connected components of the foreground of a mask and stores
+ *	each one that passes the limits as a blob.  Runs are extracted word by
+ *	word from the mask and merged with the overlapping runs of the previous
+ *	row.  The area and bounding box of every component are then computed from
+ *	its runs, and only the accepted components get their extent lists
+ *	allocated, at their final size.
+ *	@param	mask		the mask to label
+ *	@param	params		limits on the blobs to report (NULL for none)
+ *	@param	blobList	receives a newly allocated array of blobs, in raster
+ *						order of their first pixel (NULL if no blob was found)
+ *	@return	the number of blobs found
+ */
+unsigned int labelBitMask(const BitMask* mask, const LabelParams* params, Blob** blobList);
+
+/**	Function receiving the blobs completed by a stream labeler.  The blob's
+ *	storage now belongs to the function (free it with deleteBlob).
+ *	@param	arg		the argument given to newStreamLabeler
+ *	@param	blob	the completed blob
+ */
+typedef void (*BlobCallback)(void* arg, Blob blob);
+
+/**	A labeler that receives the rows of a mask one at a time and only keeps
+ *	the runs of the previous row and the components they belong to.  A
+ *	component that has no run in the latest row cannot grow any more, so it
+ *	is emitted right away.  Its content is private.
+ */
+typedef struct StreamLabeler StreamLabeler;
+
+/**	Creates a stream labeler
+ *	@param	nbCols	number of columns of the mask rows
+ *	@param	params	limits on the blobs to report (NULL for none).  maxBlobs
+ *					is not enforced here since it depends on blobs not seen yet:
+ *					that is up to the callback.  Components that grow past
+ *					maxArea stop storing their extents.
+ *	@param	emit	function called on every completed blob
+ *	@param	arg		argument passed to emit
+ *	@return	a new stream labeler
+ */
+StreamLabeler* newStreamLabeler(unsigned int nbCols, const LabelParams* params,
+								BlobCallback emit, void* arg);
+
+/**	Adds the next row of the mask.  Rows must be pushed in order of their y
+ *	coordinate, either increasing or decreasing.
+ *	@param	labeler		the stream labeler
+ *	@param	rowBits		the bits of the row (as in a BitMask row)
+ *	@param	y			y coordinate of the row
+ */
+void pushMaskRow(StreamLabeler* labeler, const uint64_t* rowBits, unsigned int y);
+
+/**	Emits the components still open after the last row
+ *	@param	labeler		the stream labeler
+ */
+void finishStreamLabeler(StreamLabeler* labeler);
+
+/**	Frees a stream labeler
+ *	@param	labeler		the stream labeler to delete
+ */
+void deleteStreamLabeler(StreamLabeler* labeler);
+
+/**	A labeler for the successive masks of a video.  It keeps the runs of
+ *	the last mask, labeled with their components, and a hash of each of its
+ *	rows.  The components that have a run in a row that changed, or in a
+ *	row next to one, are labeled again; all the others and their blobs are
+ *	kept as they are.  Its content is private.
+ */
+typedef struct IncrementalLabeler IncrementalLabeler;
+
+/**	Creates an incremental labeler
+ *	@param	nbRows	number of rows of the masks
+ *	@param	params	limits on the blobs to report (NULL for none)
+ *	@return	a new incremental labeler
+ */
+IncrementalLabeler* newIncrementalLabeler(unsigned int nbRows, const LabelParams* params);
+
+/**	Labels the next mask.  The blobs are the same, in the same order, as
+ *	those labelBitMask would find, but they belong to the labeler: they stay
+ *	valid until the next call and must not be deleted (use copyBlob to keep
+ *	one).  Rows are compared through 64-bit hashes.
+ *	@param	labeler		the incremental labeler
+ *	@param	mask		the mask to label (always of the same size)
+ *	@param	blobList	receives the array of blobs (NULL if no blob was found)
+ *	@return	the number of blobs found
+ */
+unsigned int relabelBitMask(IncrementalLabeler* labeler, const BitMask* mask, Blob** blobList);
+
+/**	Frees an incremental labeler and the blobs it reported
+ *	@param	labeler		the incremental labeler to delete
+ */
+void deleteIncrementalLabeler(IncrementalLabeler* labeler);
+
+#endif	//	LABELING_H
@@ -0,0 +1,123 @@
+//
+//  LatencyBudget.c
+//  Project
+//
+//  The time of each level is predicted by an exponential moving average of
+//  the frames processed at that level.  A probe of the level above the
+//  current one replaces its prediction instead of averaging into it, since
+//  the old value describes a load that may be gone.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+//
+#include "LatencyBudget.h"
+
+//	Weight of the last frame in the moving averages
+#define SMOOTHING		0.25
+
+//	Frames at a lower level before the level above is tried again
+#define PROBE_INTERVAL	32
+
+static const char* const QUALITY_NAMES[NB_QUALITY_LEVELS] = {
+	"full", "features", "downsampled"
+};
+
+typedef struct LevelStats
+{
+	double predictedSeconds;
+	unsigned long nbFrames, nbOverruns;
+	double totalSeconds;
+
+} LevelStats;
+
+struct LatencyBudget
+{
+	double budgetSeconds;
+	LevelStats levels[NB_QUALITY_LEVELS];
+
+	//	level of the last frame, and frames since it was lowered or probed
+	QualityLevel current;
+	unsigned int framesSinceProbe;
+	int probing;
+};
+
+const char* qualityName(QualityLevel level) {
+	return QUALITY_NAMES[level];
+}
+
+//-----------------------------------------------------------
+//	Creation
+//-----------------------------------------------------------
+LatencyBudget* newLatencyBudget(double budgetSeconds) {
+	LatencyBudget* budget = (LatencyBudget*) calloc(1, sizeof(LatencyBudget));
+	if (budget == NULL) {
+		printf("Unable to allocate the latency budget\n");
+		exit(230);
+	}
+	budget->budgetSeconds = budgetSeconds;
+	return budget;
+}
+
+//-----------------------------------------------------------
+//	Choice of a level
+//-----------------------------------------------------------
+static int fits(const LatencyBudget* budget, QualityLevel level) {
+	const LevelStats* stats = budget->levels + level;
+	return stats->nbFrames == 0 || stats->predictedSeconds <= budget->budgetSeconds;
+}
+
+QualityLevel chooseQuality(LatencyBudget* budget) {
+	QualityLevel level = FULL_QUALITY;
+	while (level + 1 < NB_QUALITY_LEVELS && !fits(budget, level)) {
+		level++;
+	}
+
+	budget->probing = 0;
+	if (level > FULL_QUALITY && level == budget->current &&
+		++budget->framesSinceProbe >= PROBE_INTERVAL) {
+		budget->framesSinceProbe = 0;
+		budget->probing = 1;
+		level--;
+	}
+	else if (level != budget->current) {
+		budget->framesSinceProbe = 0;
+	}
+	budget->current = level;
+	return level;
+}
+
+void recordFrameTime(LatencyBudget* budget, QualityLevel level, double seconds) {
+	LevelStats* stats = budget->levels + level;
+	if (stats->nbFrames == 0 || budget->probing) {
+		stats->predictedSeconds = seconds;
+	}
+	else {
+		stats->predictedSeconds += SMOOTHING * (seconds - stats->predictedSeconds);
+	}
+	stats->nbFrames++;
+	stats->totalSeconds += seconds;
+	if (seconds > budget->budgetSeconds) {
+		stats->nbOverruns++;
+	}
+}
+
+//-----------------------------------------------------------
+//	Statistics
+//-----------------------------------------------------------
+void printLatencyBudgetStats(const LatencyBudget* budget) {
+	printf("Budget of %.2f ms per frame:\n", 1e3 * budget->budgetSeconds);
+	for (int k=0; k<NB_QUALITY_LEVELS; k++) {
+		const LevelStats* stats = budget->levels + k;
+		printf("  %-12s %lu frames, mean %.2f ms, %lu over budget\n", QUALITY_NAMES[k],
+			   stats->nbFrames, (stats->nbFrames > 0) ? 1e3 * stats->totalSeconds / stats->nbFrames : 0.,
+			   stats->nbOverruns);
+	}
+}
+
+//-----------------------------------------------------------
+//	Cleanup
+//-----------------------------------------------------------
+void deleteLatencyBudget(LatencyBudget* budget) {
+	free(budget);
+}
@@ -0,0 +1,71 @@
+//-----------------------------------------------------------------
+//	Choice of the quality level of each frame of a live feed, so
+//	that its detection fits in a time budget
+//-----------------------------------------------------------------
+
+#ifndef LATENCY_BUDGET_H
+#define LATENCY_BUDGET_H
+
+/**	Quality levels, from the best to the cheapest.  Each level drops what
+ *	the previous one dropped.
+ */
+typedef enum QualityLevel
+{
+	FULL_QUALITY = 0,		//	as configured
+	FEATURES_QUALITY,		//	blob features only: no extents nor contours in the results
+	DOWNSAMPLED_QUALITY,	//	subtraction and labeling on one pixel out of 2 in
+							//	each direction, blobs scaled back to the frame
+	NB_QUALITY_LEVELS
+
+} QualityLevel;
+
+/**	Sampling step of DOWNSAMPLED_QUALITY
+ */
+#define DOWNSAMPLE_FACTOR	2
+
+/**	The budget is only manipulated through pointers, its content is private
+ */
+typedef struct LatencyBudget LatencyBudget;
+
+/**	Name of a quality level ("full", "features" or "downsampled")
+ *	@param	level	the level
+ *	@return	its name
+ */
+const char* qualityName(QualityLevel level);
+
+/**	Creates a budget
+ *	@param	budgetSeconds	time allowed for the detection of a frame
+ *	@return	the budget
+ */
+LatencyBudget* newLatencyBudget(double budgetSeconds);
+
+/**	Picks the quality level of the next frame: the best level whose time
+ *	predicted by the previous frames fits in the budget (the cheapest one if
+ *	none does).  A level not run yet is expected to fit.  After a while at a
+ *	lower level, the level above is tried again once, so that the quality
+ *	comes back when the load drops.
+ *	@param	budget	the budget
+ *	@return	the level
+ */
+QualityLevel chooseQuality(LatencyBudget* budget);
+
+/**	Records the time a frame took at a level, which updates the prediction
+ *	of the level
+ *	@param	budget	the budget
+ *	@param	level	the level the frame was processed at
+ *	@param	seconds	time of its detection
+ */
+void recordFrameTime(LatencyBudget* budget, QualityLevel level, double seconds);
+
+/**	Prints the frames processed at each level, their mean time and the
+ *	overruns of the budget
+ *	@param	budget	the budget
+ */
+void printLatencyBudgetStats(const LatencyBudget* budget);
+
+/**	Delete a budget (frees all heap memory allocated to store it)
+ *	@param	budget	the budget
+ */
+void deleteLatencyBudget(LatencyBudget* budget);
+
+#endif	//	LATENCY_BUDGET_H
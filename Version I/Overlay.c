@@ -0,0 +1,266 @@
+//
+//  Overlay.c
+//  Project
+//
+//  Draws blobs (extents, bounding boxes and IDs) into a copy of a frame
+//  on the CPU.  Each worker copies and annotates its own band of rows,
+//  so no two workers ever write to the same pixel.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+//
+#include "Overlay.h"
+
+//	3x5 digit font, one byte per glyph row (top row first), 3 low bits used
+#define GLYPH_WIDTH		3
+#define GLYPH_HEIGHT	5
+static const unsigned char DIGIT_GLYPHS[10][GLYPH_HEIGHT] = {
+	{7, 5, 5, 5, 7},	//	0
+	{2, 6, 2, 2, 7},	//	1
+	{7, 1, 7, 4, 7},	//	2
+	{7, 1, 3, 1, 7},	//	3
+	{5, 5, 7, 1, 1},	//	4
+	{7, 4, 7, 1, 7},	//	5
+	{7, 4, 7, 5, 7},	//	6
+	{7, 1, 1, 1, 1},	//	7
+	{7, 5, 7, 5, 7},	//	8
+	{7, 5, 7, 1, 7}		//	9
+};
+
+//	Gap between the top of a bounding box and the bottom of its ID
+#define ID_OFFSET		2
+
+typedef struct BoundingBox
+{
+	int xMin, xMax, yTop, yBottom;
+
+} BoundingBox;
+
+typedef struct OverlayJob
+{
+	const ImageStruct* frame;
+	ImageStruct* out;
+	const Blob* blobs;
+	unsigned int nbBlobs;
+	BoundingBox* boxes;
+	const OverlayParams* params;
+
+} OverlayJob;
+
+//-----------------------------------------------------------
+//	Default overlay parameters
+//-----------------------------------------------------------
+OverlayParams defaultOverlayParams(void) {
+	OverlayParams params;
+	params.fillExtents = 1;
+	params.drawBoxes = 0;
+	params.drawIds = 0;
+	params.fillAlpha = 0xFF;
+	params.red = 0x00;
+	params.green = 0xFF;
+	params.blue = 0x00;
+	return params;
+}
+
+//-----------------------------------------------------------
+//	Span fill in one row of the output image, in a given color.
+//	The span is clipped to the row.
+//-----------------------------------------------------------
+static void fillSpan(ImageStruct* out, int y, int xL, int xR, unsigned char red,
+					 unsigned char green, unsigned char blue, unsigned char alpha)
+{
+	if (y < 0 || y >= (int) out->nbRows) {
+		return;
+	}
+	if (xL < 0) {
+		xL = 0;
+	}
+	if (xR >= (int) out->nbCols) {
+		xR = out->nbCols - 1;
+	}
+	if (xL > xR) {
+		return;
+	}
+
+	if (out->type == RGBA32_RASTER) {
+		uint32_t* row = imageRowRGBA(out, y);
+		if (alpha == 0xFF) {
+			uint32_t color = red | (green << 8) | (blue << 16) | 0xFF000000;
+			for (int x=xL; x<=xR; x++) {
+				row[x] = color;
+			}
+		}
+		else {
+			unsigned char* px = (unsigned char*) (row + xL);
+			for (int x=xL; x<=xR; x++, px+=4) {
+				px[0] = (unsigned char) ((red*alpha + px[0]*(255 - alpha)) / 255);
+				px[1] = (unsigned char) ((green*alpha + px[1]*(255 - alpha)) / 255);
+				px[2] = (unsigned char) ((blue*alpha + px[2]*(255 - alpha)) / 255);
+			}
+		}
+	}
+	else if (out->type == FLOAT_RASTER) {
+		float* row = imageRowFloat(out, y);
+		float grey = (red + green + blue) / 3.f;
+		float a = alpha / 255.f;
+		for (int x=xL; x<=xR; x++) {
+			row[x] = grey*a + row[x]*(1.f - a);
+		}
+	}
+	else {
+		unsigned char* row = imageRow(out, y);
+		unsigned char grey = (unsigned char) ((red + green + blue) / 3);
+		if (alpha == 0xFF) {
+			memset(row + xL, grey, xR - xL + 1);
+		}
+		else {
+			for (int x=xL; x<=xR; x++) {
+				row[x] = (unsigned char) ((grey*alpha + row[x]*(255 - alpha)) / 255);
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------
+//	Bounding boxes of a range of blobs
+//-----------------------------------------------------------
+static void computeBoxes(void* arg, unsigned int first, unsigned int end, unsigned int worker) {
+	OverlayJob* job = (OverlayJob*) arg;
+	for (unsigned int k=first; k<end; k++) {
+		const Blob* blob = job->blobs + k;
+		BoundingBox* box = job->boxes + k;
+		box->yTop = blob->yTop;
+		box->yBottom = blob->yBottom;
+		box->xMin = job->frame->nbCols;
+		box->xMax = -1;
+		const unsigned int blobHeight = blob->yBottom - blob->yTop + 1;
+		for (unsigned int i=0; i<blobHeight; i++) {
+			const ExtentList* list = blob->deque + i;
+			//	lists are sorted, so only the endpoints matter
+			if (list->nbSegs > 0) {
+				if ((int) list->segList[0].xL < box->xMin) {
+					box->xMin = list->segList[0].xL;
+				}
+				if ((int) list->segList[list->nbSegs-1].xR > box->xMax) {
+					box->xMax = list->segList[list->nbSegs-1].xR;
+				}
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------
+//	Writes the index of a blob, restricted to rows [yFirst, yEnd)
+//-----------------------------------------------------------
+static void drawBlobId(ImageStruct* out, unsigned int index, const BoundingBox* box,
+					   int yFirst, int yEnd, const OverlayParams* params)
+{
+	char digits[16];
+	int nbDigits = snprintf(digits, sizeof(digits), "%u", index);
+	int yBase = box->yBottom + ID_OFFSET;
+
+	for (int r=0; r<GLYPH_HEIGHT; r++) {
+		//	y goes up, glyph rows go down
+		int y = yBase + GLYPH_HEIGHT - 1 - r;
+		if (y < yFirst || y >= yEnd) {
+			continue;
+		}
+		for (int d=0; d<nbDigits; d++) {
+			unsigned char bits = DIGIT_GLYPHS[digits[d] - '0'][r];
+			int x0 = box->xMin + d*(GLYPH_WIDTH + 1);
+			for (int c=0; c<GLYPH_WIDTH; c++) {
+				if (bits & (1 << (GLYPH_WIDTH - 1 - c))) {
+					fillSpan(out, y, x0 + c, x0 + c, params->red, params->green,
+							 params->blue, 0xFF);
+				}
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------
+//	Copies and annotates one band of rows
+//-----------------------------------------------------------
+static void composeBand(void* arg, unsigned int first, unsigned int end, unsigned int worker) {
+	OverlayJob* job = (OverlayJob*) arg;
+	const OverlayParams* params = job->params;
+	ImageStruct* out = job->out;
+
+	const size_t rowBytes = (size_t) out->nbCols * out->bytesPerPixel;
+	for (unsigned int i=first; i<end; i++) {
+		memcpy(imageRow(out, i), imageRow(job->frame, i), rowBytes);
+	}
+
+	for (unsigned int k=0; k<job->nbBlobs; k++) {
+		const Blob* blob = job->blobs + k;
+		const BoundingBox* box = job->boxes + k;
+		int yFirst = (box->yTop > (int) first) ? box->yTop : (int) first;
+		int yLast = (box->yBottom < (int) end - 1) ? box->yBottom : (int) end - 1;
+
+		if (params->fillExtents) {
+			for (int y=yFirst; y<=yLast; y++) {
+				const ExtentList* list = blob->deque + (y - blob->yTop);
+				for (unsigned int j=0; j<list->nbSegs; j++) {
+					fillSpan(out, y, list->segList[j].xL, list->segList[j].xR,
+							 blob->red, blob->green, blob->blue, params->fillAlpha);
+				}
+			}
+		}
+
+		if (params->drawBoxes && box->xMax >= box->xMin) {
+			for (int y=yFirst; y<=yLast; y++) {
+				if (y == box->yTop || y == box->yBottom) {
+					fillSpan(out, y, box->xMin, box->xMax, params->red, params->green,
+							 params->blue, 0xFF);
+				}
+				else {
+					fillSpan(out, y, box->xMin, box->xMin, params->red, params->green,
+							 params->blue, 0xFF);
+					fillSpan(out, y, box->xMax, box->xMax, params->red, params->green,
+							 params->blue, 0xFF);
+				}
+			}
+		}
+
+		if (params->drawIds && box->xMax >= box->xMin) {
+			drawBlobId(out, k, box, first, end, params);
+		}
+	}
+}
+
+//-----------------------------------------------------------
+//	Draws blobs into a copy of a frame
+//-----------------------------------------------------------
+ImageStruct composeOverlay(const ImageStruct* frame, const Blob* blobs, unsigned int nbBlobs,
+						   const OverlayParams* params, ThreadPool* pool)
+{
+	//	rows are copied by the bands, so each worker touches its own rows first
+	ImageStruct out = newImageStruct(frame->type, frame->nbRows, frame->nbCols);
+
+	OverlayJob job;
+	job.frame = frame;
+	job.out = &out;
+	job.blobs = blobs;
+	job.nbBlobs = nbBlobs;
+	job.params = params;
+	job.boxes = (BoundingBox*) malloc((nbBlobs > 0 ? nbBlobs : 1) * sizeof(BoundingBox));
+	if (job.boxes == NULL) {
+		printf("Unable to allocate memory in composeOverlay\n");
+		exit(111);
+	}
+
+	runParallelRange(pool, nbBlobs, computeBoxes, &job);
+	runParallelRange(pool, frame->nbRows, composeBand, &job);
+
+	free(job.boxes);
+	return out;
+}
+
+//-----------------------------------------------------------
+//	Frees an image produced by composeOverlay
+//-----------------------------------------------------------
+void deleteOverlay(ImageStruct* image) {
+	deleteImageStruct(image);
+}
@@ -0,0 +1,63 @@
+//-----------------------------------------------------------------
+//	CPU compositor that draws blobs into a copy of a frame, for
+//	annotated output without an OpenGL window
+//-----------------------------------------------------------------
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "fileIO.h"
+#include "Blob.h"
+#include "ThreadPool.h"
+
+/**	What the compositor draws on top of the frame
+ */
+typedef struct OverlayParams
+{
+	/**	1 to fill the extents of each blob in the blob's color
+	 */
+	int fillExtents;
+
+	/**	1 to outline the bounding box of each blob
+	 */
+	int drawBoxes;
+
+	/**	1 to write the index of each blob above its bounding box
+	 */
+	int drawIds;
+
+	/**	Opacity of the extent fill, from 0 (invisible) to 255 (opaque)
+	 */
+	unsigned char fillAlpha;
+
+	/**	Color of the boxes and IDs
+	 */
+	unsigned char red, green, blue;
+
+} OverlayParams;
+
+/**	Produces overlay parameters that fill the extents only, opaque, as
+ *	renderBlob does
+ *	@return	default overlay parameters
+ */
+OverlayParams defaultOverlayParams(void);
+
+/**	Draws blobs into a copy of a frame.  The frame is split into row bands,
+ *	one per worker of the pool, and each worker fills the extents, boxes and
+ *	IDs that fall in its band, one horizontal span at a time.
+ *	@param	frame	the frame to annotate (any image type)
+ *	@param	blobs	array of blobs to draw
+ *	@param	nbBlobs	number of blobs in the array
+ *	@param	params	what to draw
+ *	@param	pool	workers to use (NULL to do everything on the caller)
+ *	@return	a new image of the same type and size as the frame
+ */
+ImageStruct composeOverlay(const ImageStruct* frame, const Blob* blobs, unsigned int nbBlobs,
+						   const OverlayParams* params, ThreadPool* pool);
+
+/**	Frees the rasters of an image produced by composeOverlay
+ *	@param	image	the image to free
+ */
+void deleteOverlay(ImageStruct* image);
+
+#endif	//	OVERLAY_H
@@ -0,0 +1,87 @@
+//
+//  RegionMask.c
+//  Project
+//
+//  The spans are maximal runs of words with a kept pixel, so a kept area
+//  costs one span per row however wide it is.  An excluded area only
+//  splits a row into two spans where it covers a whole 64-bit word
+//  (columns 64k to 64k+63): always from 127 columns on, and from 64 to
+//  126 columns only if it happens to hold an aligned word.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+//
+#include "RegionMask.h"
+
+//-----------------------------------------------------------
+//	Creation
+//-----------------------------------------------------------
+RegionMask newRegionMask(const ImageStruct* roi, const ImageStruct* exclusion,
+						 unsigned int nbRows, unsigned int nbCols)
+{
+	RegionMask region;
+	region.kept = newBitMask(nbRows, nbCols);
+	region.nbKept = 0;
+	region.rowSpans = (unsigned int*) malloc((nbRows + 1) * sizeof(unsigned int));
+	unsigned int capacity = nbRows + 1;
+	region.spans = (WordSpan*) malloc(capacity * sizeof(WordSpan));
+	if (region.rowSpans == NULL || region.spans == NULL) {
+		printf("Failed to allocate spans in newRegionMask\n");
+		exit(240);
+	}
+
+	unsigned int nbSpans = 0;
+	for (unsigned int i=0; i<nbRows; i++) {
+		const unsigned char* roiRow = (roi != NULL) ? imageRow(roi, i) : NULL;
+		const unsigned char* exclusionRow = (exclusion != NULL) ? imageRow(exclusion, i) : NULL;
+		uint64_t* keptRow = bitMaskRow(&region.kept, i);
+		region.rowSpans[i] = nbSpans;
+
+		for (unsigned int w=0; w<region.kept.wordsPerRow; w++) {
+			unsigned int jStart = w*MASK_WORD_BITS;
+			unsigned int jEnd = (jStart + MASK_WORD_BITS < nbCols) ? jStart + MASK_WORD_BITS : nbCols;
+			uint64_t word = 0;
+			for (unsigned int j=jStart; j<jEnd; j++) {
+				int kept = (roiRow == NULL || roiRow[j] != 0) && (exclusionRow == NULL || exclusionRow[j] == 0);
+				word |= (uint64_t) kept << (j - jStart);
+			}
+			keptRow[w] = word;
+			if (word == 0) {
+				continue;
+			}
+			region.nbKept += __builtin_popcountll(word);
+
+			//	extend the last span of the row, or start one
+			if (nbSpans > region.rowSpans[i] && region.spans[nbSpans-1].end == w) {
+				region.spans[nbSpans-1].end = w + 1;
+			}
+			else {
+				if (nbSpans == capacity) {
+					capacity *= 2;
+					region.spans = (WordSpan*) realloc(region.spans, capacity * sizeof(WordSpan));
+					if (region.spans == NULL) {
+						printf("Failed to allocate spans in newRegionMask\n");
+						exit(241);
+					}
+				}
+				region.spans[nbSpans].first = w;
+				region.spans[nbSpans].end = w + 1;
+				nbSpans++;
+			}
+		}
+	}
+	region.rowSpans[nbRows] = nbSpans;
+	return region;
+}
+
+//-----------------------------------------------------------
+//	Cleanup
+//-----------------------------------------------------------
+void deleteRegionMask(RegionMask* region) {
+	deleteBitMask(&region->kept);
+	free(region->spans);
+	free(region->rowSpans);
+	region->spans = NULL;
+	region->rowSpans = NULL;
+}
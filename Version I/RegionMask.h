@@ -0,0 +1,74 @@
+//-----------------------------------------------------------------
+//	Static mask of the pixels where blobs are looked for, built
+//	from a region of interest and/or an exclusion image, with the
+//	spans of each row that hold such pixels
+//-----------------------------------------------------------------
+
+#ifndef REGION_MASK_H
+#define REGION_MASK_H
+
+#include "fileIO.h"
+#include "BitMask.h"
+
+/**	A span of words of a mask row: words first to end-1
+ */
+typedef struct WordSpan
+{
+	unsigned int first, end;
+
+} WordSpan;
+
+/**	The pixels kept and, for each row, the spans of words that hold at
+ *	least one of them.  Rows and words out of every span are skipped
+ *	outright by the subtraction.
+ */
+typedef struct RegionMask
+{
+	/**	1 for the pixels kept, 0 for the pixels excluded
+	 */
+	BitMask kept;
+
+	/**	Spans of words of the rows: those of row i are spans[rowSpans[i]]
+	 *	to spans[rowSpans[i+1]-1] (nbRows+1 offsets)
+	 */
+	WordSpan* spans;
+	unsigned int* rowSpans;
+
+	/**	Number of pixels kept
+	 */
+	unsigned long nbKept;
+
+} RegionMask;
+
+/**	Builds a region mask.  A pixel is kept when it is inside the region of
+ *	interest (nonzero there) and not excluded (zero in the exclusion image).
+ *	@param	roi			grey plane of the region of interest, or NULL for the
+ *						whole image
+ *	@param	exclusion	grey plane of the excluded pixels, or NULL for none
+ *	@param	nbRows		number of rows of the images
+ *	@param	nbCols		number of columns of the images
+ *	@return	the mask, to be freed with deleteRegionMask
+ */
+RegionMask newRegionMask(const ImageStruct* roi, const ImageStruct* exclusion,
+						 unsigned int nbRows, unsigned int nbCols);
+
+/**	Spans of a row
+ *	@param	region	the mask
+ *	@param	row		index of the row
+ *	@param	nbSpans	receives the number of spans of the row (0 if it is
+ *					excluded whole)
+ *	@return	pointer to the first span of the row
+ */
+static inline const WordSpan* regionRowSpans(const RegionMask* region, unsigned int row,
+											 unsigned int* nbSpans)
+{
+	*nbSpans = region->rowSpans[row + 1] - region->rowSpans[row];
+	return region->spans + region->rowSpans[row];
+}
+
+/**	Delete a region mask (frees all heap memory allocated to store it)
+ *	@param	region	pointer to the mask to delete
+ */
+void deleteRegionMask(RegionMask* region);
+
+#endif	//	REGION_MASK_H
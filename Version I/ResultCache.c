@@ -0,0 +1,521 @@
+//
+//  ResultCache.c
+//  Project
+//
+//  A result file holds a header, one fixed-size record per blob, then
+//  the extents of all the blobs as Extent structs, in the byte order of
+//  the host (the cache is local).  A hit maps the file and rebuilds the
+//  blobs from it.  Files are written under a temporary name and renamed,
+//  so a reader never sees half a file; a hit touches the file, so that
+//  its modification time tells which files were used least recently.
+//
+//  The hash is XXH64, which runs at memory speed.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//
+#include "ResultCache.h"
+
+#define CACHE_MAGIC		"BLBC"
+#define CACHE_VERSION	1
+#define CACHE_SUFFIX	".blobs"
+
+//	After an eviction, the cache is brought down to this fraction of its limit
+#define EVICTION_TARGET	0.9
+
+typedef struct CacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t threshold;
+	uint32_t nbBlobs;
+	uint64_t nbExtents;
+
+} CacheHeader;
+
+typedef struct CachedBlob
+{
+	uint32_t nbPixels, nbSegs;
+	int32_t yTop, yBottom;
+	uint8_t red, green, blue, unused;
+
+} CachedBlob;
+
+struct ResultCache
+{
+	char* directory;
+	size_t sizeLimit, size;
+	unsigned long nbHits, nbMisses, nbStores, nbFailedStores, nbEvictions;
+};
+
+//===========================================================
+//	XXH64
+//===========================================================
+
+#define PRIME1	0x9E3779B185EBCA87ULL
+#define PRIME2	0xC2B2AE3D27D4EB4FULL
+#define PRIME3	0x165667B19E3779F9ULL
+#define PRIME4	0x85EBCA77C2B2AE63ULL
+#define PRIME5	0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotateLeft(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char* p) {
+	uint64_t x;
+	memcpy(&x, p, 8);
+	return x;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+	uint32_t x;
+	memcpy(&x, p, 4);
+	return x;
+}
+
+static inline uint64_t hashRound(uint64_t acc, uint64_t input) {
+	acc += input * PRIME2;
+	return rotateLeft(acc, 31) * PRIME1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t lane) {
+	acc ^= hashRound(0, lane);
+	return acc * PRIME1 + PRIME4;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+	const unsigned char* p = (const unsigned char*) data;
+	const unsigned char* end = p + size;
+	uint64_t hash;
+
+	if (size >= 32) {
+		uint64_t v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+		for (; p + 32 <= end; p += 32) {
+			v1 = hashRound(v1, read64(p));
+			v2 = hashRound(v2, read64(p + 8));
+			v3 = hashRound(v3, read64(p + 16));
+			v4 = hashRound(v4, read64(p + 24));
+		}
+		hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+		hash = mergeRound(hash, v1);
+		hash = mergeRound(hash, v2);
+		hash = mergeRound(hash, v3);
+		hash = mergeRound(hash, v4);
+	}
+	else {
+		hash = seed + PRIME5;
+	}
+	hash += size;
+
+	for (; p + 8 <= end; p += 8) {
+		hash ^= hashRound(0, read64(p));
+		hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+	}
+	if (p + 4 <= end) {
+		hash ^= read32(p) * PRIME1;
+		hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		hash ^= *p * PRIME5;
+		hash = rotateLeft(hash, 11) * PRIME1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+int hashFileBytes(const char* filePath, uint64_t seed, uint64_t* hash) {
+	int fd = open(filePath, O_RDONLY);
+	if (fd < 0) {
+		return 11;
+	}
+	struct stat fileInfo;
+	if (fstat(fd, &fileInfo) != 0) {
+		close(fd);
+		return 11;
+	}
+	if (fileInfo.st_size == 0) {
+		close(fd);
+		*hash = hashBytes(NULL, 0, seed);
+		return 0;
+	}
+	void* bytes = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (bytes == MAP_FAILED) {
+		return 11;
+	}
+	madvise(bytes, fileInfo.st_size, MADV_SEQUENTIAL);
+	*hash = hashBytes(bytes, fileInfo.st_size, seed);
+	munmap(bytes, fileInfo.st_size);
+	return 0;
+}
+
+//===========================================================
+//	Cache files
+//===========================================================
+
+static void resultFilePath(const ResultCache* cache, uint64_t key, char* path, size_t capacity) {
+	snprintf(path, capacity, "%s/%016llx" CACHE_SUFFIX, cache->directory, (unsigned long long) key);
+}
+
+static int isResultFile(const char* name) {
+	size_t length = strlen(name), suffixLength = strlen(CACHE_SUFFIX);
+	return length > suffixLength && strcmp(name + length - suffixLength, CACHE_SUFFIX) == 0;
+}
+
+//	A result file of the directory, for the eviction
+typedef struct CacheFile
+{
+	char name[64];
+	size_t size;
+	struct timespec modified;
+
+} CacheFile;
+
+static int compareAges(const void* a, const void* b) {
+	const struct timespec* ta = &((const CacheFile*) a)->modified;
+	const struct timespec* tb = &((const CacheFile*) b)->modified;
+	if (ta->tv_sec != tb->tv_sec) {
+		return (ta->tv_sec < tb->tv_sec) ? -1 : 1;
+	}
+	return (ta->tv_nsec < tb->tv_nsec) ? -1 : (ta->tv_nsec > tb->tv_nsec);
+}
+
+//-----------------------------------------------------------
+//	Lists the result files of the directory.  Returns their number
+//	(the array is allocated) and their total size.
+//-----------------------------------------------------------
+static unsigned int listResultFiles(const ResultCache* cache, CacheFile** files, size_t* totalSize) {
+	unsigned int nbFiles = 0, capacity = 0;
+	*files = NULL;
+	*totalSize = 0;
+	DIR* dir = opendir(cache->directory);
+	if (dir == NULL) {
+		return 0;
+	}
+	struct dirent* item;
+	while ((item = readdir(dir)) != NULL) {
+		if (!isResultFile(item->d_name) || strlen(item->d_name) >= sizeof((*files)->name)) {
+			continue;
+		}
+		char path[4096];
+		struct stat fileInfo;
+		snprintf(path, sizeof(path), "%s/%s", cache->directory, item->d_name);
+		if (stat(path, &fileInfo) != 0) {
+			continue;
+		}
+		if (nbFiles == capacity) {
+			capacity = (capacity > 0) ? 2*capacity : 64;
+			*files = (CacheFile*) realloc(*files, capacity * sizeof(CacheFile));
+			if (*files == NULL) {
+				printf("Unable to allocate the list of cache files\n");
+				exit(200);
+			}
+		}
+		strcpy((*files)[nbFiles].name, item->d_name);
+		(*files)[nbFiles].size = fileInfo.st_size;
+		(*files)[nbFiles].modified = fileInfo.st_mtim;
+		*totalSize += fileInfo.st_size;
+		nbFiles++;
+	}
+	closedir(dir);
+	return nbFiles;
+}
+
+//-----------------------------------------------------------
+//	Removes the files used least recently until the cache is back
+//	under its target size
+//-----------------------------------------------------------
+static void evictResults(ResultCache* cache) {
+	CacheFile* files;
+	unsigned int nbFiles = listResultFiles(cache, &files, &cache->size);
+	qsort(files, nbFiles, sizeof(CacheFile), compareAges);
+
+	const size_t target = (size_t) (EVICTION_TARGET * cache->sizeLimit);
+	for (unsigned int k=0; k<nbFiles && cache->size > target; k++) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", cache->directory, files[k].name);
+		if (unlink(path) == 0) {
+			cache->size -= files[k].size;
+			cache->nbEvictions++;
+		}
+	}
+	free(files);
+}
+
+//-----------------------------------------------------------
+//	Opening
+//-----------------------------------------------------------
+ResultCache* openResultCache(const char* directory, size_t sizeLimit) {
+	struct stat dirInfo;
+	if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+		return NULL;
+	}
+	if (stat(directory, &dirInfo) != 0 || !S_ISDIR(dirInfo.st_mode)) {
+		return NULL;
+	}
+
+	ResultCache* cache = (ResultCache*) calloc(1, sizeof(ResultCache));
+	char* path = strdup(directory);
+	if (cache == NULL || path == NULL) {
+		printf("Unable to allocate the result cache\n");
+		exit(200);
+	}
+	cache->directory = path;
+	cache->sizeLimit = sizeLimit;
+
+	CacheFile* files;
+	listResultFiles(cache, &files, &cache->size);
+	free(files);
+	if (cache->size > cache->sizeLimit) {
+		evictResults(cache);
+	}
+	return cache;
+}
+
+//-----------------------------------------------------------
+//	Rebuilds the blobs of a mapped result file.  Returns 0 if the
+//	file is consistent.
+//-----------------------------------------------------------
+static int readResultFile(const unsigned char* bytes, size_t size, uint64_t key,
+						  Blob** blobList, unsigned int* nbBlobs, unsigned int* threshold)
+{
+	CacheHeader header;
+	if (size < sizeof(CacheHeader)) {
+		return 1;
+	}
+	memcpy(&header, bytes, sizeof(CacheHeader));
+	if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION ||
+		header.key != key ||
+		size != sizeof(CacheHeader) + header.nbBlobs*sizeof(CachedBlob) + header.nbExtents*sizeof(Extent)) {
+		return 1;
+	}
+	const CachedBlob* records = (const CachedBlob*) (bytes + sizeof(CacheHeader));
+	const Extent* extents = (const Extent*) (records + header.nbBlobs);
+
+	//	check everything before allocating anything
+	uint64_t nbExtents = 0;
+	for (unsigned int b=0; b<header.nbBlobs; b++) {
+		const CachedBlob* record = records + b;
+		if (record->nbSegs > header.nbExtents - nbExtents ||
+			(record->nbSegs > 0 && record->yBottom < record->yTop)) {
+			return 1;
+		}
+		for (unsigned int k=0; k<record->nbSegs; k++) {
+			const Extent* extent = extents + nbExtents + k;
+			if ((int) extent->y < record->yTop || (int) extent->y > record->yBottom || extent->xR < extent->xL ||
+				(k > 0 && extent->y < extent[-1].y)) {
+				return 1;
+			}
+		}
+		nbExtents += record->nbSegs;
+	}
+	if (nbExtents != header.nbExtents) {
+		return 1;
+	}
+
+	Blob* blobs = NULL;
+	if (header.nbBlobs > 0) {
+		blobs = (Blob*) blobMalloc(header.nbBlobs * sizeof(Blob));
+		if (blobs == NULL) {
+			printf("Unable to allocate the cached blobs\n");
+			exit(200);
+		}
+	}
+	const Extent* extent = extents;
+	for (unsigned int b=0; b<header.nbBlobs; b++) {
+		const CachedBlob* record = records + b;
+		Blob* blob = blobs + b;
+		*blob = newBlob();
+		blob->nbPixels = record->nbPixels;
+		blob->nbSegs = record->nbSegs;
+		blob->yTop = record->yTop;
+		blob->yBottom = record->yBottom;
+		blob->red = record->red;
+		blob->green = record->green;
+		blob->blue = record->blue;
+		if (record->nbSegs == 0) {
+			continue;
+		}
+
+		const unsigned int blobHeight = record->yBottom - record->yTop + 1;
+		blob->deque = (ExtentList*) blobCalloc(blobHeight, sizeof(ExtentList));
+		if (blob->deque == NULL) {
+			printf("Unable to allocate the cached blobs\n");
+			exit(200);
+		}
+		for (unsigned int k=0; k<record->nbSegs; ) {
+			unsigned int first = k;
+			while (k < record->nbSegs && extent[k].y == extent[first].y) {
+				k++;
+			}
+			ExtentList* list = blob->deque + (extent[first].y - record->yTop);
+			list->nbSegs = k - first;
+			list->segList = (Extent*) blobMalloc(list->nbSegs * sizeof(Extent));
+			if (list->segList == NULL) {
+				printf("Unable to allocate the cached blobs\n");
+				exit(200);
+			}
+			memcpy(list->segList, extent + first, list->nbSegs * sizeof(Extent));
+		}
+		extent += record->nbSegs;
+	}
+
+	*blobList = blobs;
+	*nbBlobs = header.nbBlobs;
+	*threshold = header.threshold;
+	return 0;
+}
+
+//-----------------------------------------------------------
+//	Lookup
+//-----------------------------------------------------------
+int lookupResults(ResultCache* cache, uint64_t key, Blob** blobList, unsigned int* nbBlobs,
+				  unsigned int* threshold)
+{
+	char path[4096];
+	resultFilePath(cache, key, path, sizeof(path));
+	int fd = open(path, O_RDONLY);
+	struct stat fileInfo;
+	if (fd < 0 || fstat(fd, &fileInfo) != 0 || fileInfo.st_size == 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		cache->nbMisses++;
+		return 0;
+	}
+	void* bytes = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	int err = (bytes == MAP_FAILED) ||
+			  readResultFile(bytes, fileInfo.st_size, key, blobList, nbBlobs, threshold) != 0;
+	if (bytes != MAP_FAILED) {
+		munmap(bytes, fileInfo.st_size);
+	}
+	if (err) {
+		//	a damaged file (or a collision) is dropped
+		if (unlink(path) == 0) {
+			cache->size -= fileInfo.st_size;
+		}
+		cache->nbMisses++;
+		return 0;
+	}
+
+	//	the file was just used
+	utimensat(AT_FDCWD, path, NULL, 0);
+	cache->nbHits++;
+	return 1;
+}
+
+//-----------------------------------------------------------
+//	Store
+//-----------------------------------------------------------
+void storeResults(ResultCache* cache, uint64_t key, const Blob* blobs, unsigned int nbBlobs,
+				  unsigned int threshold)
+{
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	header.key = key;
+	header.threshold = threshold;
+	header.nbBlobs = nbBlobs;
+	for (unsigned int b=0; b<nbBlobs; b++) {
+		header.nbExtents += blobs[b].nbSegs;
+	}
+
+	const size_t size = sizeof(CacheHeader) + nbBlobs*sizeof(CachedBlob) + header.nbExtents*sizeof(Extent);
+	unsigned char* bytes = (unsigned char*) malloc(size);
+	if (bytes == NULL) {
+		printf("Unable to allocate a cached result\n");
+		exit(200);
+	}
+	memcpy(bytes, &header, sizeof(header));
+	CachedBlob* records = (CachedBlob*) (bytes + sizeof(CacheHeader));
+	Extent* extent = (Extent*) (records + nbBlobs);
+	for (unsigned int b=0; b<nbBlobs; b++) {
+		const Blob* blob = blobs + b;
+		CachedBlob* record = records + b;
+		memset(record, 0, sizeof(CachedBlob));
+		record->nbPixels = blob->nbPixels;
+		record->nbSegs = blob->nbSegs;
+		record->yTop = blob->yTop;
+		record->yBottom = blob->yBottom;
+		record->red = blob->red;
+		record->green = blob->green;
+		record->blue = blob->blue;
+		if (blob->nbSegs == 0) {
+			continue;
+		}
+		const unsigned int blobHeight = blob->yBottom - blob->yTop + 1;
+		for (unsigned int i=0; i<blobHeight; i++) {
+			memcpy(extent, blob->deque[i].segList, blob->deque[i].nbSegs * sizeof(Extent));
+			extent += blob->deque[i].nbSegs;
+		}
+	}
+
+	char path[4096], temporaryPath[4096 + 32];
+	resultFilePath(cache, key, path, sizeof(path));
+	snprintf(temporaryPath, sizeof(temporaryPath), "%s.%d.tmp", path, (int) getpid());
+	int fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	size_t done = 0;
+	while (fd >= 0 && done < size) {
+		ssize_t n = write(fd, bytes + done, size - done);
+		if (n < 0 && errno != EINTR) {
+			break;
+		}
+		done += (n > 0) ? n : 0;
+	}
+	free(bytes);
+	if (fd >= 0) {
+		close(fd);
+	}
+	struct stat previous;
+	int replaces = (stat(path, &previous) == 0);
+	if (done != size || rename(temporaryPath, path) != 0) {
+		unlink(temporaryPath);
+		cache->nbFailedStores++;
+		return;
+	}
+	if (replaces) {
+		cache->size -= previous.st_size;
+	}
+
+	cache->nbStores++;
+	cache->size += size;
+	if (cache->size > cache->sizeLimit) {
+		evictResults(cache);
+	}
+}
+
+//-----------------------------------------------------------
+//	Statistics
+//-----------------------------------------------------------
+void printResultCacheStats(const ResultCache* cache) {
+	printf("Result cache: %lu hits, %lu misses, %lu stores (%lu failed), %lu evictions, "
+		   "%.1f of %.1f MB\n",
+		   cache->nbHits, cache->nbMisses, cache->nbStores, cache->nbFailedStores,
+		   cache->nbEvictions, cache->size / 1048576.0, cache->sizeLimit / 1048576.0);
+}
+
+//-----------------------------------------------------------
+//	Cleanup
+//-----------------------------------------------------------
+void closeResultCache(ResultCache* cache) {
+	free(cache->directory);
+	free(cache);
+}
@@ -0,0 +1,74 @@
+//-----------------------------------------------------------------
+//	On-disk cache of detection results, keyed by a hash of the
+//	input bytes and of the detection parameters
+//-----------------------------------------------------------------
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Blob.h"
+
+/**	The cache is only manipulated through pointers, its content is private
+ */
+typedef struct ResultCache ResultCache;
+
+/**	Hashes bytes (64-bit, not cryptographic)
+ *	@param	data	the bytes
+ *	@param	size	number of bytes
+ *	@param	seed	hash of what came before (0 to start)
+ *	@return	the hash, to be passed as the seed of the next call to chain them
+ */
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed);
+
+/**	Hashes the content of a file, which is mapped, not read
+ *	@param	filePath	path to the file
+ *	@param	seed		hash of what came before
+ *	@param	hash		receives the hash
+ *	@return	0 if all went well, an error code if the file cannot be read
+ */
+int hashFileBytes(const char* filePath, uint64_t seed, uint64_t* hash);
+
+/**	Opens (and creates if needed) a cache directory.  Each result is stored
+ *	in a file named after its key; the files used least recently are removed
+ *	when the directory grows past the size limit.
+ *	@param	directory	path to the directory
+ *	@param	sizeLimit	largest total size of the result files, in bytes
+ *	@return	the cache, or NULL if the directory cannot be used
+ */
+ResultCache* openResultCache(const char* directory, size_t sizeLimit);
+
+/**	Looks a result up
+ *	@param	cache		the cache
+ *	@param	key			hash of the inputs and parameters of the detection
+ *	@param	blobList	receives a newly allocated array of blobs (NULL if
+ *						there is none), on a hit
+ *	@param	nbBlobs		receives the number of blobs, on a hit
+ *	@param	threshold	receives the threshold that was applied, on a hit
+ *	@return	1 on a hit, 0 on a miss
+ */
+int lookupResults(ResultCache* cache, uint64_t key, Blob** blobList, unsigned int* nbBlobs,
+				  unsigned int* threshold);
+
+/**	Stores a result (failures to write are only counted)
+ *	@param	cache		the cache
+ *	@param	key			hash of the inputs and parameters of the detection
+ *	@param	blobs		the blobs detected
+ *	@param	nbBlobs		number of blobs
+ *	@param	threshold	the threshold that was applied
+ */
+void storeResults(ResultCache* cache, uint64_t key, const Blob* blobs, unsigned int nbBlobs,
+				  unsigned int threshold);
+
+/**	Prints the hit, miss, store and eviction counts and the size of the cache
+ *	@param	cache	the cache
+ */
+void printResultCacheStats(const ResultCache* cache);
+
+/**	Closes a cache (the files stay) and frees it
+ *	@param	cache	the cache
+ */
+void closeResultCache(ResultCache* cache);
+
+#endif	//	RESULT_CACHE_H
@@ -0,0 +1,434 @@
+//
+//  ResultWriter.c
+//  Project
+//
+//  Binary and JSON-lines output of the detected blobs.  A frame is
+//  formatted into a buffer that is kept from one frame to the next,
+//  then written in one system call.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+//
+#include "ResultWriter.h"
+#include "Contour.h"
+#include "Trace.h"
+
+#define RESULT_MAGIC	"BLBF"
+
+//	Size of the header of a binary frame record
+#define HEADER_BYTES	24
+
+struct ResultWriter
+{
+	int fd;
+	int ownsFd;
+	ResultFormat format;
+	int writeExtents;
+
+	//	contours: none, polygons or chain codes
+	int writeContours, chainCodes;
+	float tolerance;
+	unsigned char* codes;
+	unsigned int codeCapacity;
+
+	//	quality level of the frame (-1 if it is not told)
+	int quality;
+
+	//	colors of the blobs of the frame, if any
+	const BlobColors* colors;
+
+	//	the frame being formatted
+	unsigned char* buffer;
+	size_t size, capacity;
+};
+
+//	Makes room for n more bytes in the buffer
+static void reserve(ResultWriter* writer, size_t n) {
+	if (writer->size + n > writer->capacity) {
+		while (writer->size + n > writer->capacity) {
+			writer->capacity = (writer->capacity > 0) ? 2*writer->capacity : 4096;
+		}
+		writer->buffer = (unsigned char*) realloc(writer->buffer, writer->capacity);
+		if (writer->buffer == NULL) {
+			printf("Unable to allocate the result buffer\n");
+			exit(140);
+		}
+	}
+}
+
+static void putU16(ResultWriter* writer, unsigned int value) {
+	reserve(writer, 2);
+	writer->buffer[writer->size++] = value & 0xFF;
+	writer->buffer[writer->size++] = (value >> 8) & 0xFF;
+}
+
+static void putU32(ResultWriter* writer, uint32_t value) {
+	reserve(writer, 4);
+	for (int k=0; k<4; k++) {
+		writer->buffer[writer->size++] = (value >> (8*k)) & 0xFF;
+	}
+}
+
+static void putU64(ResultWriter* writer, uint64_t value) {
+	putU32(writer, (uint32_t) value);
+	putU32(writer, (uint32_t) (value >> 32));
+}
+
+static void putFloat(ResultWriter* writer, float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	putU32(writer, bits);
+}
+
+static void putVarint(ResultWriter* writer, uint32_t value) {
+	reserve(writer, 5);
+	while (value >= 0x80) {
+		writer->buffer[writer->size++] = (unsigned char) (value | 0x80);
+		value >>= 7;
+	}
+	writer->buffer[writer->size++] = (unsigned char) value;
+}
+
+//	Zigzag encoding: small negative values stay small
+static void putSignedVarint(ResultWriter* writer, int value) {
+	putVarint(writer, ((uint32_t) value << 1) ^ (uint32_t) (value >> 31));
+}
+
+//	printf into the buffer
+static void putText(ResultWriter* writer, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+
+	reserve(writer, length + 1);
+	va_start(args, format);
+	vsnprintf((char*) writer->buffer + writer->size, length + 1, format, args);
+	va_end(args);
+	writer->size += length;
+}
+
+//	Writes the whole buffer, even if the system call writes less
+static int flushBuffer(ResultWriter* writer) {
+	double traceStart = traceClock();
+	size_t done = 0;
+	while (done < writer->size) {
+		ssize_t n = write(writer->fd, writer->buffer + done, writer->size - done);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 31;
+		}
+		done += n;
+	}
+	writer->size = 0;
+	traceSpan("write results", "io", traceStart);
+	return 0;
+}
+
+//-----------------------------------------------------------
+//	Creation
+//-----------------------------------------------------------
+ResultWriter* newResultWriter(const char* filePath, ResultFormat format, int writeExtents) {
+	int fd;
+	if (filePath == NULL) {
+		fd = -1;
+	}
+	else if (strcmp(filePath, "-") == 0) {
+		fd = STDOUT_FILENO;
+	}
+	else {
+		fd = open(filePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			return NULL;
+		}
+	}
+
+	ResultWriter* writer = (ResultWriter*) calloc(1, sizeof(ResultWriter));
+	if (writer == NULL) {
+		printf("Unable to allocate a result writer\n");
+		exit(140);
+	}
+	writer->fd = fd;
+	writer->ownsFd = (fd >= 0 && fd != STDOUT_FILENO);
+	writer->format = format;
+	writer->writeExtents = writeExtents && (format == BINARY_RESULTS);
+	writer->quality = -1;
+	return writer;
+}
+
+//-----------------------------------------------------------
+//	Contours of a blob, as polygons or chain codes
+//-----------------------------------------------------------
+static BlobContours blobContours(ResultWriter* writer, const Blob* blob) {
+	BlobContours contours = traceBlobContours(blob);
+	if (!writer->chainCodes) {
+		for (unsigned int k=0; k<contours.nbContours; k++) {
+			simplifyContour(contours.contours + k, writer->tolerance);
+		}
+	}
+	return contours;
+}
+
+//	Chain code of a contour, in the writer's code buffer
+static unsigned int chainCode(ResultWriter* writer, const Contour* contour) {
+	unsigned int nbCodes = contourChainCode(contour, NULL);
+	if (nbCodes > writer->codeCapacity) {
+		writer->codeCapacity = nbCodes;
+		writer->codes = (unsigned char*) realloc(writer->codes, nbCodes);
+		if (writer->codes == NULL) {
+			printf("Unable to allocate the chain code buffer\n");
+			exit(140);
+		}
+	}
+	return contourChainCode(contour, writer->codes);
+}
+
+static void putBinaryContours(ResultWriter* writer, const Blob* blob) {
+	BlobContours contours = blobContours(writer, blob);
+	putVarint(writer, contours.nbContours);
+	for (unsigned int k=0; k<contours.nbContours; k++) {
+		const Contour* contour = contours.contours + k;
+		if (writer->chainCodes) {
+			unsigned int nbCodes = chainCode(writer, contour);
+			putVarint(writer, 2*nbCodes + contour->isHole);
+			putVarint(writer, contour->points[0].x);
+			putVarint(writer, contour->points[0].y);
+			reserve(writer, (nbCodes + 3) / 4);
+			for (unsigned int c=0; c<nbCodes; c+=4) {
+				unsigned char byte = 0;
+				for (unsigned int b=0; b<4 && c+b<nbCodes; b++) {
+					byte |= writer->codes[c+b] << (2*b);
+				}
+				writer->buffer[writer->size++] = byte;
+			}
+		}
+		else {
+			putVarint(writer, 2*contour->nbPoints + contour->isHole);
+			putVarint(writer, contour->points[0].x);
+			putVarint(writer, contour->points[0].y);
+			for (unsigned int p=1; p<contour->nbPoints; p++) {
+				putSignedVarint(writer, contour->points[p].x - contour->points[p-1].x);
+				putSignedVarint(writer, contour->points[p].y - contour->points[p-1].y);
+			}
+		}
+	}
+	deleteBlobContours(&contours);
+}
+
+static void putJSONContours(ResultWriter* writer, const Blob* blob) {
+	BlobContours contours = blobContours(writer, blob);
+	putText(writer, ",\"contours\":[");
+	for (unsigned int k=0; k<contours.nbContours; k++) {
+		const Contour* contour = contours.contours + k;
+		putText(writer, "%s{\"hole\":%s,", (k > 0) ? "," : "", contour->isHole ? "true" : "false");
+		if (writer->chainCodes) {
+			unsigned int nbCodes = chainCode(writer, contour);
+			putText(writer, "\"start\":[%d,%d],\"chain\":\"", contour->points[0].x, contour->points[0].y);
+			reserve(writer, nbCodes);
+			for (unsigned int c=0; c<nbCodes; c++) {
+				writer->buffer[writer->size++] = '0' + writer->codes[c];
+			}
+			putText(writer, "\"}");
+		}
+		else {
+			putText(writer, "\"points\":[");
+			for (unsigned int p=0; p<contour->nbPoints; p++) {
+				putText(writer, "%s%d,%d", (p > 0) ? "," : "", contour->points[p].x, contour->points[p].y);
+			}
+			putText(writer, "]}");
+		}
+	}
+	putText(writer, "]");
+	deleteBlobContours(&contours);
+}
+
+//	Colors of a blob in JSON
+static void putJSONColors(ResultWriter* writer, const BlobColors* colors) {
+	putText(writer, ",\"colors\":{\"mean\":[%.2f,%.2f,%.2f],\"variance\":[%.2f,%.2f,%.2f],\"histogram\":[",
+			colors->mean[0], colors->mean[1], colors->mean[2],
+			colors->variance[0], colors->variance[1], colors->variance[2]);
+	for (int b=0; b<COLOR_HISTOGRAM_BINS; b++) {
+		putText(writer, "%s%u", (b > 0) ? "," : "", colors->histogram[b]);
+	}
+	putText(writer, "]}");
+}
+
+//	Binary record of a frame
+static void formatBinary(ResultWriter* writer, uint64_t frameIndex, unsigned int threshold,
+						 const Blob* blobs, unsigned int nbBlobs)
+{
+	reserve(writer, HEADER_BYTES);
+	memcpy(writer->buffer, RESULT_MAGIC, 4);
+	writer->size = 8;		//	the record size is filled in last
+	putU64(writer, frameIndex);
+	putU32(writer, nbBlobs);
+	putU16(writer, threshold);
+	const int details = (writer->quality <= FULL_QUALITY);
+	const int writeExtents = writer->writeExtents && details;
+	const int writeContours = writer->writeContours && details;
+	unsigned int flags = writeExtents ? RESULT_EXTENTS : 0;
+	if (writeContours) {
+		flags |= RESULT_CONTOURS | (writer->chainCodes ? RESULT_CHAIN_CODES : 0);
+	}
+	if (writer->quality >= 0) {
+		flags |= (writer->quality + 1) << RESULT_QUALITY_SHIFT;
+	}
+	if (writer->colors != NULL) {
+		flags |= RESULT_COLORS;
+	}
+	putU16(writer, flags);
+
+	for (unsigned int k=0; k<nbBlobs; k++) {
+		BlobFeatures features = computeBlobFeatures(blobs + k);
+		putU32(writer, features.area);
+		putU32(writer, features.nbSegs);
+		putU32(writer, features.xMin);
+		putU32(writer, features.xMax);
+		putU32(writer, features.yTop);
+		putU32(writer, features.yBottom);
+		putFloat(writer, features.centroidX);
+		putFloat(writer, features.centroidY);
+	}
+
+	if (writeExtents) {
+		for (unsigned int k=0; k<nbBlobs; k++) {
+			const Blob* blob = blobs + k;
+			if (blob->nbSegs == 0) {
+				continue;
+			}
+			const unsigned int xMin = computeBlobFeatures(blob).xMin;
+			const unsigned int blobHeight = blob->yBottom - blob->yTop + 1;
+			for (unsigned int i=0; i<blobHeight; i++) {
+				const ExtentList* list = blob->deque + i;
+				putVarint(writer, list->nbSegs);
+				unsigned int x = xMin;
+				for (unsigned int j=0; j<list->nbSegs; j++) {
+					putVarint(writer, list->segList[j].xL - x);
+					putVarint(writer, list->segList[j].xR - list->segList[j].xL);
+					x = list->segList[j].xR + 1;
+				}
+			}
+		}
+	}
+
+	if (writeContours) {
+		for (unsigned int k=0; k<nbBlobs; k++) {
+			putBinaryContours(writer, blobs + k);
+		}
+	}
+
+	if (writer->colors != NULL) {
+		for (unsigned int k=0; k<nbBlobs; k++) {
+			const BlobColors* colors = writer->colors + k;
+			for (int c=0; c<3; c++) {
+				putFloat(writer, colors->mean[c]);
+			}
+			for (int c=0; c<3; c++) {
+				putFloat(writer, colors->variance[c]);
+			}
+			for (int b=0; b<COLOR_HISTOGRAM_BINS; b++) {
+				putVarint(writer, colors->histogram[b]);
+			}
+		}
+	}
+
+	const uint32_t recordBytes = (uint32_t) writer->size;
+	for (int k=0; k<4; k++) {
+		writer->buffer[4 + k] = (recordBytes >> (8*k)) & 0xFF;
+	}
+}
+
+//	JSON line of a frame
+static void formatJSON(ResultWriter* writer, uint64_t frameIndex, unsigned int threshold,
+					   const Blob* blobs, unsigned int nbBlobs)
+{
+	putText(writer, "{\"frame\":%llu,\"threshold\":%u,", (unsigned long long) frameIndex, threshold);
+	if (writer->quality >= 0) {
+		putText(writer, "\"quality\":\"%s\",", qualityName(writer->quality));
+	}
+	putText(writer, "\"blobs\":[");
+	const int writeContours = writer->writeContours && writer->quality <= FULL_QUALITY;
+	for (unsigned int k=0; k<nbBlobs; k++) {
+		BlobFeatures features = computeBlobFeatures(blobs + k);
+		putText(writer, "%s{\"area\":%u,\"segments\":%u,\"box\":[%u,%u,%u,%u],\"centroid\":[%.2f,%.2f]",
+				(k > 0) ? "," : "", features.area, features.nbSegs, features.xMin,
+				features.yTop, features.xMax, features.yBottom,
+				features.centroidX, features.centroidY);
+		if (writeContours) {
+			putJSONContours(writer, blobs + k);
+		}
+		if (writer->colors != NULL) {
+			putJSONColors(writer, writer->colors + k);
+		}
+		putText(writer, "}");
+	}
+	putText(writer, "]}\n");
+}
+
+//-----------------------------------------------------------
+//	Contour output
+//-----------------------------------------------------------
+void setResultContours(ResultWriter* writer, int chainCodes, float tolerance) {
+	writer->writeContours = 1;
+	writer->chainCodes = chainCodes;
+	writer->tolerance = tolerance;
+}
+
+//-----------------------------------------------------------
+//	Quality of the next frames
+//-----------------------------------------------------------
+void setResultQuality(ResultWriter* writer, QualityLevel level) {
+	writer->quality = level;
+}
+
+//-----------------------------------------------------------
+//	Colors of the next frame
+//-----------------------------------------------------------
+void setResultColors(ResultWriter* writer, const BlobColors* colors) {
+	writer->colors = colors;
+}
+
+//-----------------------------------------------------------
+//	Output of one frame
+//-----------------------------------------------------------
+const unsigned char* formatFrameResults(ResultWriter* writer, uint64_t frameIndex, unsigned int threshold,
+										const Blob* blobs, unsigned int nbBlobs, size_t* size)
+{
+	writer->size = 0;
+	if (writer->format == BINARY_RESULTS) {
+		formatBinary(writer, frameIndex, threshold, blobs, nbBlobs);
+	}
+	else {
+		formatJSON(writer, frameIndex, threshold, blobs, nbBlobs);
+	}
+	*size = writer->size;
+	return writer->buffer;
+}
+
+int writeFrameResults(ResultWriter* writer, uint64_t frameIndex, unsigned int threshold,
+					  const Blob* blobs, unsigned int nbBlobs)
+{
+	size_t size;
+	formatFrameResults(writer, frameIndex, threshold, blobs, nbBlobs, &size);
+	return flushBuffer(writer);
+}
+
+//-----------------------------------------------------------
+//	Cleanup
+//-----------------------------------------------------------
+void deleteResultWriter(ResultWriter* writer) {
+	if (writer->ownsFd) {
+		close(writer->fd);
+	}
+	free(writer->codes);
+	free(writer->buffer);
+	free(writer);
+}
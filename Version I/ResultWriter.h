@@ -0,0 +1,150 @@
+//-----------------------------------------------------------------
+//	Serialization of the blobs detected in each frame, for programs
+//	downstream of the detector.  Each frame is formatted in memory
+//	and written with a single write() call.
+//-----------------------------------------------------------------
+
+#ifndef RESULT_WRITER_H
+#define RESULT_WRITER_H
+
+#include <stdint.h>
+#include "Blob.h"
+#include "LatencyBudget.h"
+#include "ColorStats.h"
+
+/**	Output formats.
+ *
+ *	BINARY_RESULTS: one record per frame, all integers little-endian
+ *		header	"BLBF" magic (4 bytes), record size in bytes including the
+ *				header (u32), frame index (u64), number of blobs (u32),
+ *				threshold (u16), flags (u16, RESULT_EXTENTS if the extents follow;
+ *				in RESULT_QUALITY_MASK, 0 without a latency budget, otherwise 1
+ *				for full, 2 for features and 3 for downsampled quality)
+ *		blobs	for each blob: area, number of extents, xMin, xMax, yTop,
+ *				yBottom (u32 each), centroid x and y (IEEE float32 each)
+ *		extents	(optional) for each blob, for each row from yTop to yBottom:
+ *				the number of extents of the row, then for each extent the gap
+ *				since the end of the previous extent (or since xMin for the
+ *				first one) and its length minus 1, all as LEB128 varints
+ *		contours (optional) for each blob: the number of contours (varint), then
+ *				for each contour, outer one first:
+ *				- polygons (RESULT_CONTOURS): number of points times 2, plus 1
+ *				  for a hole (varint), the first point (x, y varints), then the
+ *				  difference to the previous point for the others (x, y as
+ *				  zigzag varints)
+ *				- chain codes (RESULT_CONTOURS | RESULT_CHAIN_CODES): number of
+ *				  codes times 2, plus 1 for a hole (varint), the first point
+ *				  (x, y varints), then the codes packed 4 per byte, first code in
+ *				  the low bits (0 east, 1 south, 2 west, 3 north, y pointing down)
+ *				Points are pixel corners: (x, y) is the top-left corner of pixel (x, y).
+ *		colors	(optional, RESULT_COLORS) for each blob: the mean then the variance
+ *				of red, green and blue (IEEE float32 each), then the
+ *				COLOR_HISTOGRAM_BINS counts of its color histogram (varints)
+ *
+ *	JSON_RESULTS: one line per frame, features only
+ *		{"frame":0,"threshold":70,"blobs":[{"area":12,"segments":3,
+ *		 "box":[xMin,yTop,xMax,yBottom],"centroid":[x,y]},...]}
+ *	with a latency budget, "quality":"full", "features" or "downsampled"
+ *	follows the threshold
+ *	with contours, each blob also gets
+ *		"contours":[{"hole":false,"points":[x0,y0,x1,y1,...]},...]
+ *	or, for chain codes,
+ *		"contours":[{"hole":false,"start":[x,y],"chain":"0001122233"},...]
+ *	with colors, each blob also gets
+ *		"colors":{"mean":[r,g,b],"variance":[r,g,b],"histogram":[n0,...,n63]}
+ */
+typedef enum ResultFormat
+{
+	BINARY_RESULTS,
+	JSON_RESULTS
+
+} ResultFormat;
+
+/**	Flag of a binary frame record that carries the extents of its blobs
+ */
+#define RESULT_EXTENTS	0x1
+
+/**	Flags of a binary frame record that carries the contours of its blobs,
+ *	as polygons or as chain codes
+ */
+#define RESULT_CONTOURS		0x2
+#define RESULT_CHAIN_CODES	0x4
+
+/**	Bits of the flags of a binary frame record that hold its quality level
+ *	(see LatencyBudget.h) plus 1, or 0 when no quality is set (no latency
+ *	budget), so that a full-quality frame under a budget can be told apart
+ */
+#define RESULT_QUALITY_SHIFT	3
+#define RESULT_QUALITY_MASK		0x18
+#define RESULT_NO_QUALITY		0
+
+/**	Flag of a binary frame record that carries the colors of its blobs
+ */
+#define RESULT_COLORS	0x20
+
+/**	The writer is only manipulated through pointers, its content is private
+ */
+typedef struct ResultWriter ResultWriter;
+
+/**	Opens a result output
+ *	@param	filePath		path to the file to create ("-" for the standard output,
+ *							NULL for a writer that only formats, see formatFrameResults)
+ *	@param	format			output format
+ *	@param	writeExtents	1 to add the extents to the binary records
+ *	@return	the writer, or NULL if the file could not be created
+ */
+ResultWriter* newResultWriter(const char* filePath, ResultFormat format, int writeExtents);
+
+/**	Adds the contours of the blobs to the output (both formats).  They are
+ *	traced from the extents and usually much smaller than them.
+ *	@param	writer		the writer
+ *	@param	chainCodes	1 to write chain codes, 0 to write polygons
+ *	@param	tolerance	for polygons, largest distance (in pixels) between the
+ *						contour traced and the polygon written (0 to write
+ *						every corner of the contour)
+ */
+void setResultContours(ResultWriter* writer, int chainCodes, float tolerance);
+
+/**	Sets the quality level of the next frames, which their records then
+ *	tell.  Below FULL_QUALITY, the extents and the contours are left out.
+ *	@param	writer	the writer
+ *	@param	level	quality level of the next frames
+ */
+void setResultQuality(ResultWriter* writer, QualityLevel level);
+
+/**	Sets the colors of the blobs of the next frame written or formatted
+ *	(both formats).  The array is read when the frame is, not copied.
+ *	@param	writer	the writer
+ *	@param	colors	colors of each blob of the frame, or NULL for none
+ */
+void setResultColors(ResultWriter* writer, const BlobColors* colors);
+
+/**	Writes the blobs detected in a frame
+ *	@param	writer		the writer
+ *	@param	frameIndex	index of the frame
+ *	@param	threshold	threshold applied to the frame
+ *	@param	blobs		array of blobs
+ *	@param	nbBlobs		number of blobs in the array
+ *	@return	0 if the record was written, an error code otherwise
+ */
+int writeFrameResults(ResultWriter* writer, uint64_t frameIndex, unsigned int threshold,
+					  const Blob* blobs, unsigned int nbBlobs);
+
+/**	Formats the blobs detected in a frame without writing them
+ *	@param	writer		the writer
+ *	@param	frameIndex	index of the frame
+ *	@param	threshold	threshold applied to the frame
+ *	@param	blobs		array of blobs
+ *	@param	nbBlobs		number of blobs in the array
+ *	@param	size		receives the size of the record, in bytes
+ *	@return	the record, valid until the next call on the writer
+ */
+const unsigned char* formatFrameResults(ResultWriter* writer, uint64_t frameIndex, unsigned int threshold,
+										const Blob* blobs, unsigned int nbBlobs, size_t* size);
+
+/**	Closes a result output and frees the writer
+ *	@param	writer	the writer
+ */
+void deleteResultWriter(ResultWriter* writer);
+
+#endif	//	RESULT_WRITER_H
@@ -0,0 +1,257 @@
+//
+//  StageMetrics.c
+//  Project
+//
+//  Wall times are read on the monotonic clock, CPU times on the clock of
+//  the process, which includes the time of the workers.  The reports are
+//  formatted in a buffer and written with one write() when possible.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+//
+#include "StageMetrics.h"
+
+typedef enum FrameCount
+{
+	PIXEL_COUNT = 0,
+	FOREGROUND_COUNT,
+	RUN_COUNT,
+	BLOB_COUNT,
+	EXTENT_COUNT,
+	ALLOCATION_COUNT,
+	ALLOCATED_BYTES,
+	NB_FRAME_COUNTS
+
+} FrameCount;
+
+static const char* const STAGE_NAMES[NB_STAGES] = {
+	"decode", "grey", "absdiff", "threshold", "label", "colors", "render", "encode"
+};
+
+static const char* const COUNT_NAMES[NB_FRAME_COUNTS] = {
+	"pixels", "foreground", "runs", "blobs", "extents", "blob_allocations", "blob_bytes"
+};
+
+typedef struct StageTimes
+{
+	double wallSeconds, cpuSeconds;
+	unsigned long nbCalls;
+
+} StageTimes;
+
+struct StageMetrics
+{
+	int fd, perFrame;
+
+	//	start of each stage being timed
+	double wallStart[NB_STAGES], cpuStart[NB_STAGES];
+
+	//	current frame, and whole run
+	StageTimes frame[NB_STAGES], total[NB_STAGES];
+	unsigned long long frameCounts[NB_FRAME_COUNTS], totalCounts[NB_FRAME_COUNTS];
+	unsigned long nbFrames;
+
+	//	blob allocations counted at the end of the previous frame
+	unsigned long nbAllocations, nbAllocatedBytes;
+
+	double (*kernelTimes)[2];
+	unsigned int nbKernelTimes;
+};
+
+static double clockSeconds(clockid_t clock) {
+	struct timespec t;
+	clock_gettime(clock, &t);
+	return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+//-----------------------------------------------------------
+//	Creation
+//-----------------------------------------------------------
+StageMetrics* newStageMetrics(int fd, int perFrame) {
+	StageMetrics* metrics = (StageMetrics*) calloc(1, sizeof(StageMetrics));
+	if (metrics == NULL) {
+		printf("Unable to allocate the stage metrics\n");
+		exit(210);
+	}
+	metrics->fd = fd;
+	metrics->perFrame = perFrame;
+	countBlobAllocations(1);
+	blobAllocationCounts(&metrics->nbAllocations, &metrics->nbAllocatedBytes);
+	return metrics;
+}
+
+//-----------------------------------------------------------
+//	Timing
+//-----------------------------------------------------------
+void startStage(StageMetrics* metrics, Stage stage) {
+	if (metrics == NULL) {
+		return;
+	}
+	metrics->wallStart[stage] = clockSeconds(CLOCK_MONOTONIC);
+	metrics->cpuStart[stage] = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+//	Adds the time since the start of a stage, times share, to another one
+static void addStageTime(StageMetrics* metrics, Stage started, Stage stage, double share) {
+	StageTimes* times = metrics->frame + stage;
+	times->wallSeconds += share * (clockSeconds(CLOCK_MONOTONIC) - metrics->wallStart[started]);
+	times->cpuSeconds += share * (clockSeconds(CLOCK_PROCESS_CPUTIME_ID) - metrics->cpuStart[started]);
+	times->nbCalls++;
+}
+
+void stopStage(StageMetrics* metrics, Stage stage) {
+	if (metrics == NULL) {
+		return;
+	}
+	addStageTime(metrics, stage, stage, 1.0);
+}
+
+double (*subtractionKernelTimes(StageMetrics* metrics, unsigned int nbWorkers))[2] {
+	if (metrics == NULL) {
+		return NULL;
+	}
+	if (nbWorkers > metrics->nbKernelTimes) {
+		free(metrics->kernelTimes);
+		metrics->kernelTimes = calloc(nbWorkers, sizeof(*metrics->kernelTimes));
+		if (metrics->kernelTimes == NULL) {
+			printf("Unable to allocate the stage metrics\n");
+			exit(210);
+		}
+		metrics->nbKernelTimes = nbWorkers;
+	}
+	memset(metrics->kernelTimes, 0, metrics->nbKernelTimes * sizeof(*metrics->kernelTimes));
+	return metrics->kernelTimes;
+}
+
+void stopSubtractionStages(StageMetrics* metrics) {
+	if (metrics == NULL) {
+		return;
+	}
+	double greySeconds = 0, differenceSeconds = 0;
+	for (unsigned int k=0; k<metrics->nbKernelTimes; k++) {
+		greySeconds += metrics->kernelTimes[k][0];
+		differenceSeconds += metrics->kernelTimes[k][1];
+	}
+	//	grey frames need no conversion: everything goes to the differences
+	double greyShare = (greySeconds > 0) ? greySeconds / (greySeconds + differenceSeconds) : 0;
+	if (greyShare > 0) {
+		addStageTime(metrics, ABSDIFF_STAGE, GREY_STAGE, greyShare);
+	}
+	addStageTime(metrics, ABSDIFF_STAGE, ABSDIFF_STAGE, 1.0 - greyShare);
+}
+
+//-----------------------------------------------------------
+//	Counts
+//-----------------------------------------------------------
+void countMask(StageMetrics* metrics, const BitMask* mask, unsigned int nbRows) {
+	if (metrics == NULL) {
+		return;
+	}
+	unsigned long long nbForeground = 0, nbRuns = 0;
+	for (unsigned int i=0; i<nbRows; i++) {
+		nbForeground += countRowPixels(bitMaskRow(mask, i), mask->wordsPerRow);
+		nbRuns += countRowRuns(bitMaskRow(mask, i), mask->wordsPerRow);
+	}
+	metrics->frameCounts[PIXEL_COUNT] += (unsigned long long) nbRows * mask->nbCols;
+	metrics->frameCounts[FOREGROUND_COUNT] += nbForeground;
+	metrics->frameCounts[RUN_COUNT] += nbRuns;
+}
+
+void countBlobs(StageMetrics* metrics, const Blob* blobs, unsigned int nbBlobs) {
+	if (metrics == NULL) {
+		return;
+	}
+	metrics->frameCounts[BLOB_COUNT] += nbBlobs;
+	for (unsigned int k=0; k<nbBlobs; k++) {
+		metrics->frameCounts[EXTENT_COUNT] += blobs[k].nbSegs;
+	}
+}
+
+//-----------------------------------------------------------
+//	Reports
+//-----------------------------------------------------------
+static void writeAll(int fd, const char* data, size_t size) {
+	while (size > 0) {
+		ssize_t n = write(fd, data, size);
+		if (n <= 0) {
+			return;
+		}
+		data += n;
+		size -= n;
+	}
+}
+
+//	One JSON line: the opening given, then the stages and the counts
+static void writeReport(int fd, const char* opening, const StageTimes* times,
+						const unsigned long long* counts) {
+	char line[2048];
+	int length = snprintf(line, sizeof(line), "{%s,\"stages\":{", opening);
+	for (int s=0; s<NB_STAGES; s++) {
+		length += snprintf(line + length, sizeof(line) - length,
+						   "%s\"%s\":{\"calls\":%lu,\"wall_us\":%.1f,\"cpu_us\":%.1f}",
+						   (s > 0) ? "," : "", STAGE_NAMES[s], times[s].nbCalls,
+						   1e6 * times[s].wallSeconds, 1e6 * times[s].cpuSeconds);
+	}
+	length += snprintf(line + length, sizeof(line) - length, "},\"counts\":{");
+	for (int c=0; c<NB_FRAME_COUNTS; c++) {
+		length += snprintf(line + length, sizeof(line) - length, "%s\"%s\":%llu",
+						   (c > 0) ? "," : "", COUNT_NAMES[c], counts[c]);
+	}
+	length += snprintf(line + length, sizeof(line) - length, "}}\n");
+	writeAll(fd, line, length);
+}
+
+void endFrameMetrics(StageMetrics* metrics, uint64_t frameIndex) {
+	if (metrics == NULL) {
+		return;
+	}
+	unsigned long nbAllocations, nbBytes;
+	blobAllocationCounts(&nbAllocations, &nbBytes);
+	metrics->frameCounts[ALLOCATION_COUNT] = nbAllocations - metrics->nbAllocations;
+	metrics->frameCounts[ALLOCATED_BYTES] = nbBytes - metrics->nbAllocatedBytes;
+	metrics->nbAllocations = nbAllocations;
+	metrics->nbAllocatedBytes = nbBytes;
+
+	if (metrics->perFrame) {
+		char opening[64];
+		snprintf(opening, sizeof(opening), "\"frame\":%llu", (unsigned long long) frameIndex);
+		writeReport(metrics->fd, opening, metrics->frame, metrics->frameCounts);
+	}
+
+	for (int s=0; s<NB_STAGES; s++) {
+		metrics->total[s].wallSeconds += metrics->frame[s].wallSeconds;
+		metrics->total[s].cpuSeconds += metrics->frame[s].cpuSeconds;
+		metrics->total[s].nbCalls += metrics->frame[s].nbCalls;
+	}
+	for (int c=0; c<NB_FRAME_COUNTS; c++) {
+		metrics->totalCounts[c] += metrics->frameCounts[c];
+	}
+	memset(metrics->frame, 0, sizeof(metrics->frame));
+	memset(metrics->frameCounts, 0, sizeof(metrics->frameCounts));
+	metrics->nbFrames++;
+}
+
+void writeMetricsReport(StageMetrics* metrics) {
+	if (metrics == NULL || metrics->perFrame) {
+		return;
+	}
+	char opening[64];
+	snprintf(opening, sizeof(opening), "\"frames\":%lu", metrics->nbFrames);
+	writeReport(metrics->fd, opening, metrics->total, metrics->totalCounts);
+}
+
+//-----------------------------------------------------------
+//	Cleanup
+//-----------------------------------------------------------
+void deleteStageMetrics(StageMetrics* metrics) {
+	if (metrics == NULL) {
+		return;
+	}
+	countBlobAllocations(0);
+	free(metrics->kernelTimes);
+	free(metrics);
+}
@@ -0,0 +1,107 @@
+//-----------------------------------------------------------------
+//	Wall and CPU time of the stages of the detection, counts of
+//	what went through them, written as JSON reports
+//-----------------------------------------------------------------
+
+#ifndef STAGE_METRICS_H
+#define STAGE_METRICS_H
+
+#include <stdint.h>
+#include "BitMask.h"
+#include "Blob.h"
+
+/**	Stages of the detection of a frame
+ */
+typedef enum Stage
+{
+	DECODE_STAGE = 0,	//	reading the image files
+	GREY_STAGE,			//	conversion of color rows to grey
+	ABSDIFF_STAGE,		//	differences, thresholded on the fly with a known threshold
+	THRESHOLD_STAGE,	//	threshold of the stored differences (automatic threshold)
+	LABEL_STAGE,		//	connected components of the mask
+	COLOR_STAGE,		//	color statistics of the blobs
+	RENDER_STAGE,		//	drawing the overlay
+	ENCODE_STAGE,		//	serializing the results, writing the overlay file
+	NB_STAGES
+
+} Stage;
+
+/**	The metrics are only manipulated through pointers, their content is private
+ */
+typedef struct StageMetrics StageMetrics;
+
+/**	Creates the metrics of a run.  Every function below does nothing when
+ *	its metrics are NULL, so that the calls stay in place when the metrics
+ *	are off.  Creating metrics turns the counting of blob allocations on
+ *	(see countBlobAllocations).
+ *	@param	fd			descriptor the reports are written to (not closed)
+ *	@param	perFrame	1 to write a report at the end of each frame, 0 to
+ *						write one for the whole run (see writeMetricsReport)
+ *	@return	the metrics
+ */
+StageMetrics* newStageMetrics(int fd, int perFrame);
+
+/**	Starts timing a stage (stages may overlap)
+ *	@param	metrics	the metrics
+ *	@param	stage	the stage
+ */
+void startStage(StageMetrics* metrics, Stage stage);
+
+/**	Ends the timing of a stage and adds the time to the current frame
+ *	@param	metrics	the metrics
+ *	@param	stage	the stage
+ */
+void stopStage(StageMetrics* metrics, Stage stage);
+
+/**	Per-worker kernel times for a subtraction pass (see SubtractionJob),
+ *	cleared
+ *	@param	metrics		the metrics
+ *	@param	nbWorkers	number of workers of the pass
+ *	@return	nbWorkers pairs of seconds, valid until the next call, or NULL
+ *			when metrics is NULL
+ */
+double (*subtractionKernelTimes(StageMetrics* metrics, unsigned int nbWorkers))[2];
+
+/**	Ends a subtraction pass started as ABSDIFF_STAGE.  The grey conversion
+ *	and the differences are interleaved row by row, so the time of the pass
+ *	is shared between GREY_STAGE and ABSDIFF_STAGE in proportion of the
+ *	kernel times the workers measured.
+ *	@param	metrics	the metrics
+ */
+void stopSubtractionStages(StageMetrics* metrics);
+
+/**	Adds the pixels, the foreground pixels and the runs of rows of a mask to
+ *	the current frame
+ *	@param	metrics	the metrics
+ *	@param	mask	the mask
+ *	@param	nbRows	number of rows counted, from the first
+ */
+void countMask(StageMetrics* metrics, const BitMask* mask, unsigned int nbRows);
+
+/**	Adds blobs and their extents to the current frame
+ *	@param	metrics	the metrics
+ *	@param	blobs	the blobs
+ *	@param	nbBlobs	number of blobs
+ */
+void countBlobs(StageMetrics* metrics, const Blob* blobs, unsigned int nbBlobs);
+
+/**	Ends a frame: its times and counts, and the blob allocations made since
+ *	the previous frame, go to the totals of the run, and are reported if
+ *	the report is per frame
+ *	@param	metrics		the metrics
+ *	@param	frameIndex	index of the frame
+ */
+void endFrameMetrics(StageMetrics* metrics, uint64_t frameIndex);
+
+/**	Writes the report of the whole run, unless the report is per frame:
+ *	number of frames, total times per stage and total counts
+ *	@param	metrics	the metrics
+ */
+void writeMetricsReport(StageMetrics* metrics);
+
+/**	Delete the metrics (frees all heap memory allocated to store them)
+ *	@param	metrics	the metrics
+ */
+void deleteStageMetrics(StageMetrics* metrics);
+
+#endif	//	STAGE_METRICS_H
@@ -0,0 +1,450 @@
+//
+//  StreamDetection.c
+//  Project
+//
+//  Band-by-band detection for images too large to be loaded whole, and
+//  for loaded images whose bands are labeled while the next ones are
+//  still being subtracted.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <stdatomic.h>
+//
+#include "StreamDetection.h"
+#include "fileIO_TGA.h"
+#include "Subtraction.h"
+#include "Trace.h"
+
+//	Blobs received from the stream labeler
+typedef struct BlobSink
+{
+	Blob* blobs;
+	unsigned int nbBlobs, capacity;
+	unsigned int maxBlobs;
+
+} BlobSink;
+
+//	Raster order of the first pixel of the blobs
+static int compareBlobs(const void* a, const void* b) {
+	const Blob* blobA = (const Blob*) a;
+	const Blob* blobB = (const Blob*) b;
+	if (blobA->yTop != blobB->yTop) {
+		return blobA->yTop < blobB->yTop ? -1 : 1;
+	}
+	unsigned int xA = blobA->deque[0].segList[0].xL;
+	unsigned int xB = blobB->deque[0].segList[0].xL;
+	return (xA < xB) ? -1 : (xA > xB);
+}
+
+//	Whether a blob ranks below another one for a limited number of
+//	blobs: smaller, or as large and later in raster order, as in
+//	labelBitMask
+static int ranksBelow(const Blob* a, const Blob* b) {
+	if (a->nbPixels != b->nbPixels) {
+		return a->nbPixels < b->nbPixels;
+	}
+	return compareBlobs(a, b) > 0;
+}
+
+//	Moves a blob of the heap of kept blobs down to its place: each blob
+//	ranks below its children, so the root is the first one to drop
+static void siftDown(BlobSink* sink, unsigned int k) {
+	Blob* heap = sink->blobs;
+	while (1) {
+		unsigned int lowest = k, child = 2*k + 1;
+		for (unsigned int c=child; c<child+2 && c<sink->nbBlobs; c++) {
+			if (ranksBelow(heap + c, heap + lowest)) {
+				lowest = c;
+			}
+		}
+		if (lowest == k) {
+			return;
+		}
+		Blob tmp = heap[k];
+		heap[k] = heap[lowest];
+		heap[lowest] = tmp;
+		k = lowest;
+	}
+}
+
+static void siftUp(BlobSink* sink, unsigned int k) {
+	Blob* heap = sink->blobs;
+	while (k > 0 && ranksBelow(heap + k, heap + (k-1)/2)) {
+		Blob tmp = heap[k];
+		heap[k] = heap[(k-1)/2];
+		heap[(k-1)/2] = tmp;
+		k = (k-1)/2;
+	}
+}
+
+//-----------------------------------------------------------
+//	Keeps the blobs emitted by the labeler.  When the number of
+//	blobs is limited, the blobs kept form a min-heap on their rank,
+//	and a new blob replaces the root if it ranks above it.
+//-----------------------------------------------------------
+static void collectBlob(void* arg, Blob blob) {
+	BlobSink* sink = (BlobSink*) arg;
+
+	if (sink->maxBlobs > 0 && sink->nbBlobs == sink->maxBlobs) {
+		if (ranksBelow(sink->blobs, &blob)) {
+			deleteBlob(sink->blobs);
+			sink->blobs[0] = blob;
+			siftDown(sink, 0);
+		}
+		else {
+			deleteBlob(&blob);
+		}
+		return;
+	}
+
+	if (sink->nbBlobs == sink->capacity) {
+		unsigned int capacity = (sink->capacity > 0) ? 2*sink->capacity : 16;
+		sink->blobs = (Blob*) blobRealloc(sink->blobs, sink->capacity*sizeof(Blob), capacity*sizeof(Blob));
+		sink->capacity = capacity;
+		if (sink->blobs == NULL) {
+			printf("Failed to allocate blob list in detectBlobsStreaming\n");
+			exit(120);
+		}
+	}
+	sink->blobs[sink->nbBlobs++] = blob;
+	if (sink->maxBlobs > 0) {
+		siftUp(sink, sink->nbBlobs - 1);
+	}
+}
+
+//	Gives the unused end of the blob array back, so that the array counts
+//	as the blob allocations of labelBitMask do
+static void trimSink(BlobSink* sink) {
+	if (sink->nbBlobs > 0 && sink->nbBlobs < sink->capacity) {
+		sink->blobs = (Blob*) blobRealloc(sink->blobs, sink->capacity*sizeof(Blob),
+										  sink->nbBlobs*sizeof(Blob));
+		sink->capacity = sink->nbBlobs;
+		if (sink->blobs == NULL) {
+			printf("Failed to allocate blob list in detectBlobsStreaming\n");
+			exit(121);
+		}
+	}
+}
+
+//	Opens both images and checks that they can be compared
+static int openStreams(const char* backgroundPath, const char* framePath,
+					   TGAStream* oldStream, TGAStream* newStream)
+{
+	int err = openTGAStream(backgroundPath, oldStream);
+	if (err != 0) {
+		return err;
+	}
+	err = openTGAStream(framePath, newStream);
+	if (err != 0) {
+		closeTGAStream(oldStream);
+		return err;
+	}
+	if (oldStream->nbRows != newStream->nbRows || oldStream->nbCols != newStream->nbCols ||
+		oldStream->type != newStream->type || oldStream->topDown != newStream->topDown) {
+		printf("The background and the frame do not have the same size and layout\n");
+		closeTGAStream(oldStream);
+		closeTGAStream(newStream);
+		return 15;
+	}
+	return 0;
+}
+
+//	Reads the next band of both images; returns the number of rows read
+static unsigned int readBands(TGAStream* oldStream, TGAStream* newStream, ImageStruct* oldBand, ImageStruct* newBand)
+{
+	unsigned int nbOld = readTGAStreamRows(oldStream, oldBand);
+	unsigned int nbNew = readTGAStreamRows(newStream, newBand);
+	return (nbOld < nbNew) ? nbOld : nbNew;
+}
+
+//	The same, timed as the decode stage
+static unsigned int readMeasuredBands(StageMetrics* metrics, TGAStream* oldStream, TGAStream* newStream,
+									  ImageStruct* oldBand, ImageStruct* newBand)
+{
+	double traceStart = traceClock();
+	startStage(metrics, DECODE_STAGE);
+	unsigned int nbRead = readBands(oldStream, newStream, oldBand, newBand);
+	stopStage(metrics, DECODE_STAGE);
+	traceSpan("read bands", "io", traceStart);
+	return nbRead;
+}
+
+//	Subtraction of the rows of a band, timed as the grey and absdiff stages
+static void subtractMeasuredBand(StageMetrics* metrics, ThreadPool* pool, unsigned int nbRows,
+								 SubtractionJob* job)
+{
+	double traceStart = traceClock();
+	job->kernelTimes = subtractionKernelTimes(metrics, threadPoolSize(pool));
+	startStage(metrics, ABSDIFF_STAGE);
+	runParallelRange(pool, nbRows, subtractRows, job);
+	stopSubtractionStages(metrics);
+	traceSpan("subtract band", "subtract", traceStart);
+}
+
+//-----------------------------------------------------------
+//	Streaming detection
+//-----------------------------------------------------------
+int detectBlobsStreaming(const char* backgroundPath, const char* framePath,
+						 const StreamParams* params, ThreadPool* pool,
+						 Blob** blobList, unsigned int* nbBlobs, unsigned int* thresholdUsed)
+{
+	TGAStream oldStream, newStream;
+	int err = openStreams(backgroundPath, framePath, &oldStream, &newStream);
+	if (err != 0) {
+		return err;
+	}
+
+	unsigned int bandRows = (params->bandRows > 0) ? params->bandRows : 1;
+	unsigned int nbThreads = threadPoolSize(pool);
+	ImageStruct oldBand = newImageStruct(oldStream.type, bandRows, oldStream.nbCols);
+	ImageStruct newBand = newImageStruct(newStream.type, bandRows, newStream.nbCols);
+	ImageStruct oldGrey = newGreyPlane(&oldBand);
+	ImageStruct newGrey = newGreyPlane(&newBand);
+	BitMask bandMask = newBitMask(bandRows, oldStream.nbCols);
+
+	SubtractionJob job;
+	job.background = &oldBand;
+	job.frame = &newBand;
+	job.backgroundGrey = &oldGrey;
+	job.frameGrey = &newGrey;
+	job.mask = &bandMask;
+	job.difference = NULL;
+	job.histograms = NULL;
+	job.threshold = params->threshold;
+	job.formula = params->formula;
+	job.thresholdMap = NULL;
+	job.region = NULL;
+	job.kernelTimes = NULL;
+
+	//	Automatic threshold: a first pass over both files for the histogram
+	if (params->thresholdMode == OTSU_THRESHOLD) {
+		job.histograms = calloc(nbThreads, sizeof(*job.histograms));
+		if (job.histograms == NULL) {
+			printf("Unable to allocate histograms\n");
+			exit(122);
+		}
+		unsigned int nbRead;
+		while ((nbRead = readMeasuredBands(params->metrics, &oldStream, &newStream, &oldBand, &newBand)) > 0) {
+			subtractMeasuredBand(params->metrics, pool, nbRead, &job);
+		}
+		unsigned long histogram[NB_GREY_LEVELS] = {0};
+		for (unsigned int k=0; k<nbThreads; k++) {
+			addHistogram(histogram, job.histograms[k]);
+		}
+		free(job.histograms);
+		job.histograms = NULL;
+		job.threshold = otsuThreshold(histogram);
+
+		closeTGAStream(&oldStream);
+		closeTGAStream(&newStream);
+		err = openStreams(backgroundPath, framePath, &oldStream, &newStream);
+		if (err != 0) {
+			deleteImageStruct(&oldGrey);
+			deleteImageStruct(&newGrey);
+			deleteImageStruct(&oldBand);
+			deleteImageStruct(&newBand);
+			deleteBitMask(&bandMask);
+			return err;
+		}
+	}
+
+	BlobSink sink = {NULL, 0, 0, params->labelParams.maxBlobs};
+	StreamLabeler* labeler = newStreamLabeler(oldStream.nbCols, &params->labelParams,
+											  collectBlob, &sink);
+	unsigned int fileRow = 0, nbRead;
+	while ((nbRead = readMeasuredBands(params->metrics, &oldStream, &newStream, &oldBand, &newBand)) > 0) {
+		subtractMeasuredBand(params->metrics, pool, nbRead, &job);
+		countMask(params->metrics, &bandMask, nbRead);
+		double traceStart = traceClock();
+		startStage(params->metrics, LABEL_STAGE);
+		for (unsigned int k=0; k<nbRead; k++, fileRow++) {
+			pushMaskRow(labeler, bitMaskRow(&bandMask, k), tgaStreamRowY(&oldStream, fileRow));
+		}
+		stopStage(params->metrics, LABEL_STAGE);
+		traceRange("label band", "label", traceStart, fileRow - nbRead, fileRow);
+	}
+	startStage(params->metrics, LABEL_STAGE);
+	finishStreamLabeler(labeler);
+	stopStage(params->metrics, LABEL_STAGE);
+	deleteStreamLabeler(labeler);
+
+	if (fileRow < oldStream.nbRows) {
+		fprintf(stderr, "Warning: the images were truncated after %u rows\n", fileRow);
+	}
+
+	closeTGAStream(&oldStream);
+	closeTGAStream(&newStream);
+	deleteImageStruct(&oldGrey);
+	deleteImageStruct(&newGrey);
+	deleteImageStruct(&oldBand);
+	deleteImageStruct(&newBand);
+	deleteBitMask(&bandMask);
+
+	if (sink.nbBlobs > 0) {
+		qsort(sink.blobs, sink.nbBlobs, sizeof(Blob), compareBlobs);
+	}
+	trimSink(&sink);
+	*blobList = sink.blobs;
+	*nbBlobs = sink.nbBlobs;
+	*thresholdUsed = job.threshold;
+	return 0;
+}
+
+//-----------------------------------------------------------
+//	Pipelined detection of a loaded image
+//-----------------------------------------------------------
+
+//	Bands of the image, subtracted by the workers in order
+typedef struct BandJob
+{
+	SubtractionJob* job;
+	unsigned int nbRows, bandRows, nbBands;
+
+	//	next band to take, and 1 for each band whose mask rows are written
+	atomic_uint nextBand;
+	atomic_int* bandDone;
+
+} BandJob;
+
+//	Takes bands in order until none is left; the range is ignored
+static void subtractBands(void* arg, unsigned int first, unsigned int end, unsigned int worker) {
+	BandJob* bands = (BandJob*) arg;
+	unsigned int b;
+	while ((b = atomic_fetch_add_explicit(&bands->nextBand, 1, memory_order_relaxed)) < bands->nbBands) {
+		unsigned int firstRow = b * bands->bandRows;
+		unsigned int endRow = (firstRow + bands->bandRows < bands->nbRows) ? firstRow + bands->bandRows : bands->nbRows;
+		double traceStart = traceClock();
+		subtractRows(bands->job, firstRow, endRow, worker);
+		traceRange("subtract band", "subtract", traceStart, firstRow, endRow);
+		atomic_store_explicit(bands->bandDone + b, 1, memory_order_release);
+	}
+	(void) first;
+	(void) end;
+}
+
+//	Same order as compareAreaRanks in Labeling.c: largest first, then
+//	raster order
+typedef struct BlobRank
+{
+	unsigned long nbPixels;
+	unsigned int index;
+
+} BlobRank;
+
+static int compareBlobRanks(const void* a, const void* b) {
+	const BlobRank* rankA = (const BlobRank*) a;
+	const BlobRank* rankB = (const BlobRank*) b;
+	if (rankA->nbPixels != rankB->nbPixels) {
+		return rankA->nbPixels > rankB->nbPixels ? -1 : 1;
+	}
+	return rankA->index < rankB->index ? -1 : 1;
+}
+
+//	Keeps the maxBlobs largest blobs of a list in raster order, as
+//	labelBitMask does; returns the number of blobs kept
+static unsigned int keepLargestBlobs(Blob* blobs, unsigned int nbBlobs, unsigned int maxBlobs) {
+	if (maxBlobs == 0 || nbBlobs <= maxBlobs) {
+		return nbBlobs;
+	}
+	BlobRank* ranks = (BlobRank*) malloc(nbBlobs * sizeof(BlobRank));
+	if (ranks == NULL) {
+		printf("Failed to allocate rank list in detectBlobsPipelined\n");
+		exit(125);
+	}
+	for (unsigned int k=0; k<nbBlobs; k++) {
+		ranks[k].nbPixels = blobs[k].nbPixels;
+		ranks[k].index = k;
+	}
+	qsort(ranks, nbBlobs, sizeof(BlobRank), compareBlobRanks);
+	for (unsigned int k=maxBlobs; k<nbBlobs; k++) {
+		deleteBlob(blobs + ranks[k].index);
+	}
+	free(ranks);
+
+	unsigned int nbKept = 0;
+	for (unsigned int k=0; k<nbBlobs; k++) {
+		if (blobs[k].deque != NULL) {
+			blobs[nbKept++] = blobs[k];
+		}
+	}
+	return nbKept;
+}
+
+unsigned int detectBlobsPipelined(SubtractionJob* job, unsigned int bandRows,
+								  const LabelParams* params, ThreadPool* pool,
+								  StageMetrics* metrics, Blob** blobList)
+{
+	BlobSink sink = {NULL, 0, 0, 0};
+	BitMask* mask = job->mask;
+	const unsigned int nbRows = mask->nbRows;
+
+	BandJob bands;
+	bands.job = job;
+	bands.nbRows = nbRows;
+	bands.bandRows = (bandRows > 0) ? bandRows : 1;
+	bands.nbBands = (nbRows + bands.bandRows - 1) / bands.bandRows;
+	atomic_init(&bands.nextBand, 0);
+	bands.bandDone = (atomic_int*) malloc((bands.nbBands > 0 ? bands.nbBands : 1) * sizeof(atomic_int));
+	if (bands.bandDone == NULL) {
+		printf("Failed to allocate band flags in detectBlobsPipelined\n");
+		exit(126);
+	}
+	for (unsigned int b=0; b<bands.nbBands; b++) {
+		atomic_init(bands.bandDone + b, 0);
+	}
+
+	//	one item per worker: each takes bands until none is left
+	unsigned int nbWorkers = threadPoolSize(pool);
+	job->kernelTimes = subtractionKernelTimes(metrics, nbWorkers);
+	startStage(metrics, ABSDIFF_STAGE);
+	startParallelRange(pool, (bands.nbBands < nbWorkers) ? bands.nbBands : nbWorkers, subtractBands, &bands);
+
+	//	The rows of a band are pushed as soon as it is written.  A blob that
+	//	ends in band k is emitted with the first row of band k+1.  As in
+	//	streaming mode, the label stage is timed band by band, without the
+	//	waits for the workers.
+	StreamLabeler* labeler = newStreamLabeler(mask->nbCols, params, collectBlob, &sink);
+	for (unsigned int b=0; b<bands.nbBands; b++) {
+		double traceStart = traceClock();
+		while (!atomic_load_explicit(bands.bandDone + b, memory_order_acquire)) {
+			sched_yield();
+		}
+		traceSpan("wait band", "pool", traceStart);
+		if (b == bands.nbBands - 1) {
+			waitParallelRange(pool);
+			stopSubtractionStages(metrics);
+		}
+
+		traceStart = traceClock();
+		startStage(metrics, LABEL_STAGE);
+		unsigned int firstRow = b * bands.bandRows;
+		unsigned int endRow = (firstRow + bands.bandRows < nbRows) ? firstRow + bands.bandRows : nbRows;
+		for (unsigned int i=firstRow; i<endRow; i++) {
+			pushMaskRow(labeler, bitMaskRow(mask, i), i);
+		}
+		stopStage(metrics, LABEL_STAGE);
+		traceRange("label band", "label", traceStart, firstRow, endRow);
+	}
+	if (bands.nbBands == 0) {
+		waitParallelRange(pool);
+		stopSubtractionStages(metrics);
+	}
+	double traceStart = traceClock();
+	startStage(metrics, LABEL_STAGE);
+	finishStreamLabeler(labeler);
+	deleteStreamLabeler(labeler);
+	free(bands.bandDone);
+
+	if (sink.nbBlobs > 0) {
+		qsort(sink.blobs, sink.nbBlobs, sizeof(Blob), compareBlobs);
+	}
+	sink.nbBlobs = keepLargestBlobs(sink.blobs, sink.nbBlobs, (params != NULL) ? params->maxBlobs : 0);
+	trimSink(&sink);
+	stopStage(metrics, LABEL_STAGE);
+	traceSpan("label end", "label", traceStart);
+	*blobList = sink.blobs;
+	return sink.nbBlobs;
+}
@@ -0,0 +1,92 @@
+//-----------------------------------------------------------------
+//	Blob detection on images read a band of rows at a time, with
+//	memory that does not depend on the image height
+//-----------------------------------------------------------------
+
+#ifndef STREAM_DETECTION_H
+#define STREAM_DETECTION_H
+
+#include "Blob.h"
+#include "Labeling.h"
+#include "StageMetrics.h"
+#include "Subtraction.h"
+#include "Threshold.h"
+#include "ThreadPool.h"
+
+/**	Parameters of a streaming detection
+ */
+typedef struct StreamParams
+{
+	/**	Number of rows read, subtracted and labeled at a time
+	 */
+	unsigned int bandRows;
+
+	/**	How the threshold is chosen.  The automatic mode reads both images
+	 *	twice: once for the histogram, once for the detection.
+	 */
+	ThresholdMode thresholdMode;
+
+	/**	The threshold, in FIXED_THRESHOLD mode
+	 */
+	unsigned int threshold;
+
+	/**	Grey formula of color images
+	 */
+	GreyFormula formula;
+
+	/**	Limits on the blobs reported.  With maxBlobs set, only the largest
+	 *	blobs seen so far are kept while the image is processed.
+	 */
+	LabelParams labelParams;
+
+	/**	Receives the times of the stages and the counts of the mask (NULL
+	 *	for none); the frame is not ended
+	 */
+	StageMetrics* metrics;
+
+} StreamParams;
+
+/**	Detects the blobs of a frame against a background, both read from
+ *	uncompressed TGA files one band of rows at a time.  Each band is subtracted
+ *	on the pool, then its mask rows are passed to a stream labeler, which
+ *	emits the blobs as soon as they are complete.  Peak memory is two bands
+ *	of pixels, a band of mask, and the blobs still open.
+ *	@param	backgroundPath	path to the background image
+ *	@param	framePath		path to the frame image
+ *	@param	params			detection parameters
+ *	@param	pool			workers for the subtraction (NULL for none)
+ *	@param	blobList		receives a newly allocated array of blobs, in
+ *							raster order (NULL if no blob was found)
+ *	@param	nbBlobs			receives the number of blobs
+ *	@param	thresholdUsed	receives the threshold applied
+ *	@return	0 if all went well, an error code otherwise
+ */
+int detectBlobsStreaming(const char* backgroundPath, const char* framePath,
+						 const StreamParams* params, ThreadPool* pool,
+						 Blob** blobList, unsigned int* nbBlobs, unsigned int* thresholdUsed);
+
+/**	Detects the blobs of a loaded frame band by band, with the subtraction
+ *	and the labeling overlapped.  The workers take the bands of rows in
+ *	order and flag each one when its mask rows are written; the caller
+ *	pushes the rows of each flagged band to a stream labeler right away,
+ *	so that it labels band k while the workers subtract the following ones.
+ *	The threshold must be known beforehand (fixed, or a threshold map).
+ *	@param	job			the subtraction, over whole images (histograms NULL);
+ *						its kernelTimes are replaced
+ *	@param	bandRows	number of rows of a band
+ *	@param	params		limits on the blobs to report (NULL for none)
+ *	@param	pool		workers for the subtraction (NULL for none: the
+ *						whole subtraction is done before the labeling)
+ *	@param	metrics		receives the times of the subtraction and labeling
+ *						stages, which overlap; the labeling is timed band by
+ *						band, without the waits for the workers (NULL for none)
+ *	@param	blobList	receives a newly allocated array of blobs, in raster
+ *						order, the same as labelBitMask gives (NULL if no blob
+ *						was found)
+ *	@return	number of blobs
+ */
+unsigned int detectBlobsPipelined(SubtractionJob* job, unsigned int bandRows,
+								  const LabelParams* params, ThreadPool* pool,
+								  StageMetrics* metrics, Blob** blobList);
+
+#endif	//	STREAM_DETECTION_H
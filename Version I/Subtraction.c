@@ -0,0 +1,471 @@
+//
+//  Subtraction.c
+//  Project
+//
+//  Kernels for the grey-level background subtraction.  They work on
+//  8-bit grey planes, so the inner loops only read and write bytes.
+//  The conversion and threshold kernels are specialized at compile time.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+//
+#include "Subtraction.h"
+
+//===========================================================
+//	The kernels are generated by the macros below, one per pixel
+//	format and grey formula, and one per threshold mode, so that
+//	their inner loops hold no test on the format or the mode.
+//	They are picked once per band of rows.
+//===========================================================
+
+//	Grey kernel reading STEP values of type PIXEL per pixel, at p
+#define DEFINE_GREY_KERNEL(NAME, PIXEL, STEP, GREY)							\
+	static void NAME(const unsigned char* row, unsigned int nbCols,			\
+					 unsigned char* greyRow)								\
+	{																		\
+		const PIXEL* p = (const PIXEL*) row;								\
+		for (unsigned int j=0; j<nbCols; j++, p+=STEP) {					\
+			greyRow[j] = (unsigned char) (GREY);							\
+		}																	\
+	}
+
+DEFINE_GREY_KERNEL(greyRGBAMean, unsigned char, 4, (p[0] + p[1] + p[2]) / 3)
+DEFINE_GREY_KERNEL(greyRGBALuma, unsigned char, 4, (77*p[0] + 150*p[1] + 29*p[2]) >> 8)
+DEFINE_GREY_KERNEL(greyFloat, float, 1, floatToByte(p[0]))
+
+//	Grey and mask rows are already grey levels
+static void greyCopy(const unsigned char* row, unsigned int nbCols, unsigned char* greyRow) {
+	if (greyRow != row) {
+		memcpy(greyRow, row, nbCols);
+	}
+}
+
+//	Packs MASK_WORD_BITS bytes that are 0 or 0xFF into a mask word, bit k
+//	for byte k.  Each group of 8 bytes is packed with one multiply, as a
+//	movemask instruction would: keeping bit k of byte k lines the bits up
+//	so that the multiply sums them, without carries, into the top byte.
+static inline uint64_t packMaskBytes(const unsigned char* bytes) {
+	uint64_t word = 0;
+	for (unsigned int k=0; k<MASK_WORD_BITS/8; k++) {
+		uint64_t group;
+		memcpy(&group, bytes + 8*k, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		group = __builtin_bswap64(group);
+#endif
+		word |= (((group & 0x8040201008040201ULL) * 0x0101010101010101ULL) >> 56) << (8*k);
+	}
+	return word;
+}
+
+//	Stores, for the COUNT columns of the word starting at jStart, 0xFF in
+//	bytes where ON holds and 0 elsewhere.  With COUNT = MASK_WORD_BITS the
+//	loop has a fixed trip count and the compiler vectorizes it.
+#define COMPARE_WORD_BYTES(COUNT, ON)										\
+	for (unsigned int k=0; k<(COUNT); k++) {								\
+		unsigned int j = jStart + k;										\
+		bytes[k] = (ON) ? 0xFF : 0;											\
+	}
+
+//	Loop over the words of a row: the comparisons of a word are stored as
+//	bytes, then packed into the mask word, and OUTPUT (if not NULL) gets
+//	the same bytes.  The last word may be partial.
+#define THRESHOLD_WORDS(ON, OUTPUT)											\
+	unsigned char bytes[MASK_WORD_BITS];									\
+	const unsigned int nbFull = nbCols / MASK_WORD_BITS;					\
+	for (unsigned int w=0; w<nbFull; w++) {									\
+		unsigned int jStart = w*MASK_WORD_BITS;								\
+		COMPARE_WORD_BYTES(MASK_WORD_BITS, ON)								\
+		maskRow[w] = packMaskBytes(bytes);									\
+		if ((OUTPUT) != NULL) {												\
+			memcpy((OUTPUT) + jStart, bytes, MASK_WORD_BITS);				\
+		}																	\
+	}																		\
+	if (nbFull*MASK_WORD_BITS < nbCols) {									\
+		unsigned int jStart = nbFull*MASK_WORD_BITS, n = nbCols - jStart;	\
+		COMPARE_WORD_BYTES(n, ON)											\
+		memset(bytes + n, 0, MASK_WORD_BITS - n);							\
+		maskRow[nbFull] = packMaskBytes(bytes);								\
+		if ((OUTPUT) != NULL) {												\
+			memcpy((OUTPUT) + jStart, bytes, n);							\
+		}																	\
+	}
+
+//	Threshold kernel comparing the difference at column j to THRESHOLD;
+//	the difference row, if any, gets the bytes of the mask
+#define DEFINE_THRESHOLD_KERNEL(NAME, THRESHOLD)								\
+	static void NAME(const unsigned char* oldGrey, const unsigned char* newGrey,	\
+					 unsigned int nbCols, unsigned int threshold,					\
+					 const unsigned char* thresholdRow, uint64_t* maskRow,			\
+					 unsigned char* differenceRow)									\
+	{																				\
+		THRESHOLD_WORDS(abs(oldGrey[j] - newGrey[j]) >= (int) (THRESHOLD), differenceRow)	\
+	}
+
+DEFINE_THRESHOLD_KERNEL(thresholdFixedRow, threshold)
+DEFINE_THRESHOLD_KERNEL(thresholdMappedRow, thresholdRow[j])
+
+//	Same, on differences stored by differenceGreyRows (replaced by the mask)
+#define DEFINE_STORED_THRESHOLD_KERNEL(NAME, THRESHOLD)						\
+	static void NAME(unsigned char* differenceRow, unsigned int nbCols,		\
+					 unsigned int threshold, const unsigned char* thresholdRow,	\
+					 uint64_t* maskRow)										\
+	{																		\
+		THRESHOLD_WORDS(differenceRow[j] >= (unsigned int) (THRESHOLD), differenceRow)	\
+	}
+
+DEFINE_STORED_THRESHOLD_KERNEL(thresholdStoredFixedRow, threshold)
+DEFINE_STORED_THRESHOLD_KERNEL(thresholdStoredMappedRow, thresholdRow[j])
+
+typedef void (*StoredThresholdKernel)(unsigned char* differenceRow, unsigned int nbCols,
+									  unsigned int threshold, const unsigned char* thresholdRow,
+									  uint64_t* maskRow);
+
+//-----------------------------------------------------------
+//	Kernel selection
+//-----------------------------------------------------------
+GreyRowKernel greyRowKernel(ImageType type, GreyFormula formula) {
+	switch (type) {
+		case RGBA32_RASTER:
+			return (formula == GREY_LUMA) ? greyRGBALuma : greyRGBAMean;
+
+		case FLOAT_RASTER:
+			return greyFloat;
+
+		case GRAY_RASTER:
+		case MASK_RASTER:
+		default:
+			return greyCopy;
+	}
+}
+
+ThresholdRowKernel thresholdRowKernel(int perPixel) {
+	return perPixel ? thresholdMappedRow : thresholdFixedRow;
+}
+
+//-----------------------------------------------------------
+//	Grey levels of one row
+//-----------------------------------------------------------
+void convertRowToGrey(ImageType type, GreyFormula formula, const unsigned char* row,
+					  unsigned int nbCols, unsigned char* greyRow)
+{
+	greyRowKernel(type, formula)(row, nbCols, greyRow);
+}
+
+//-----------------------------------------------------------
+//	Thresholded difference of two grey rows
+//-----------------------------------------------------------
+void thresholdGreyRows(const unsigned char* oldGrey, const unsigned char* newGrey,
+					   unsigned int nbCols, unsigned int threshold, uint64_t* maskRow,
+					   unsigned char* differenceRow)
+{
+	thresholdFixedRow(oldGrey, newGrey, nbCols, threshold, NULL, maskRow, differenceRow);
+}
+
+//-----------------------------------------------------------
+//	Difference of two grey rows, stored and/or counted
+//-----------------------------------------------------------
+void differenceGreyRows(const unsigned char* oldGrey, const unsigned char* newGrey,
+						unsigned int nbCols, unsigned char* differenceRow,
+						unsigned long* histogram)
+{
+	if (differenceRow != NULL) {
+		for (unsigned int j=0; j<nbCols; j++) {
+			differenceRow[j] = (unsigned char) abs(oldGrey[j] - newGrey[j]);
+		}
+		if (histogram != NULL) {
+			for (unsigned int j=0; j<nbCols; j++) {
+				histogram[differenceRow[j]]++;
+			}
+		}
+	}
+	else if (histogram != NULL) {
+		for (unsigned int j=0; j<nbCols; j++) {
+			histogram[abs(oldGrey[j] - newGrey[j])]++;
+		}
+	}
+}
+
+//-----------------------------------------------------------
+//	Threshold of stored differences
+//-----------------------------------------------------------
+void thresholdDifferenceRow(unsigned char* differenceRow, unsigned int nbCols,
+							unsigned int threshold, uint64_t* maskRow)
+{
+	thresholdStoredFixedRow(differenceRow, nbCols, threshold, NULL, maskRow);
+}
+
+//-----------------------------------------------------------
+//	Grey plane of an image
+//-----------------------------------------------------------
+ImageStruct newGreyPlane(const ImageStruct* image) {
+	if (image->type == GRAY_RASTER) {
+		return imageView(GRAY_RASTER, image->nbRows, image->nbCols, image->bytesPerRow,
+						 image->raster);
+	}
+	return newImageStruct(GRAY_RASTER, image->nbRows, image->nbCols);
+}
+
+//-----------------------------------------------------------
+//	Region mask: spans of words of a row
+//-----------------------------------------------------------
+
+//	Spans of row i, or a single span over the whole row without region
+static const WordSpan* rowSpans(const RegionMask* region, unsigned int i, unsigned int nbCols,
+								WordSpan* wholeRow, unsigned int* nbSpans)
+{
+	if (region == NULL) {
+		wholeRow->first = 0;
+		wholeRow->end = (nbCols + MASK_WORD_BITS - 1) / MASK_WORD_BITS;
+		*nbSpans = 1;
+		return wholeRow;
+	}
+	return regionRowSpans(region, i, nbSpans);
+}
+
+//	Columns of a span, clipped to the row
+static unsigned int spanStart(const WordSpan* span) {
+	return span->first * MASK_WORD_BITS;
+}
+
+static unsigned int spanEnd(const WordSpan* span, unsigned int nbCols) {
+	unsigned int jEnd = span->end * MASK_WORD_BITS;
+	return (jEnd < nbCols) ? jEnd : nbCols;
+}
+
+//	Clears the mask words and the difference bytes of a row out of its spans
+static void clearOutsideSpans(const WordSpan* spans, unsigned int nbSpans, unsigned int nbCols,
+							  uint64_t* maskRow, unsigned char* differenceRow)
+{
+	const unsigned int wordsPerRow = (nbCols + MASK_WORD_BITS - 1) / MASK_WORD_BITS;
+	unsigned int w = 0;
+	for (unsigned int k=0; k<=nbSpans; k++) {
+		unsigned int wEnd = (k < nbSpans) ? spans[k].first : wordsPerRow;
+		if (wEnd > w) {
+			memset(maskRow + w, 0, (wEnd - w) * sizeof(uint64_t));
+			if (differenceRow != NULL) {
+				unsigned int jEnd = (wEnd * MASK_WORD_BITS < nbCols) ? wEnd * MASK_WORD_BITS : nbCols;
+				memset(differenceRow + w*MASK_WORD_BITS, 0, jEnd - w*MASK_WORD_BITS);
+			}
+		}
+		if (k < nbSpans) {
+			w = spans[k].end;
+		}
+	}
+}
+
+//	ANDs the mask words of a span with the pixels kept, and clears the
+//	difference bytes of the pixels excluded
+static void keepSpanPixels(const uint64_t* keptRow, const WordSpan* span, unsigned int nbCols,
+						   uint64_t* maskRow, unsigned char* differenceRow)
+{
+	for (unsigned int w=span->first; w<span->end; w++) {
+		maskRow[w] &= keptRow[w];
+		if (differenceRow != NULL && ~keptRow[w] != 0) {
+			unsigned int jEnd = ((w+1) * MASK_WORD_BITS < nbCols) ? (w+1) * MASK_WORD_BITS : nbCols;
+			for (unsigned int j=w*MASK_WORD_BITS; j<jEnd; j++) {
+				if (!((keptRow[w] >> (j % MASK_WORD_BITS)) & 1)) {
+					differenceRow[j] = 0;
+				}
+			}
+		}
+	}
+}
+
+//	Takes the pixels of a span that are excluded back out of a histogram
+static void uncountExcludedPixels(const uint64_t* keptRow, const WordSpan* span, unsigned int nbCols,
+								  const unsigned char* oldGrey, const unsigned char* newGrey,
+								  unsigned long* histogram)
+{
+	for (unsigned int w=span->first; w<span->end; w++) {
+		if (~keptRow[w] == 0) {
+			continue;
+		}
+		unsigned int jEnd = ((w+1) * MASK_WORD_BITS < nbCols) ? (w+1) * MASK_WORD_BITS : nbCols;
+		for (unsigned int j=w*MASK_WORD_BITS; j<jEnd; j++) {
+			if (!((keptRow[w] >> (j % MASK_WORD_BITS)) & 1)) {
+				histogram[abs(oldGrey[j] - newGrey[j])]--;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------
+//	Subtraction of a range of rows
+//-----------------------------------------------------------
+static double kernelClock(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+void subtractRows(void* arg, unsigned int first, unsigned int end, unsigned int worker) {
+	SubtractionJob* job = (SubtractionJob*) arg;
+	const unsigned int nbCols = job->frame->nbCols;
+
+	//	no conversion when the grey plane is a view of the image itself
+	GreyRowKernel greyBackground = (job->backgroundGrey->raster != job->background->raster) ?
+								   greyRowKernel(job->background->type, job->formula) : NULL;
+	GreyRowKernel greyFrame = (job->frameGrey->raster != job->frame->raster) ?
+							  greyRowKernel(job->frame->type, job->formula) : NULL;
+	ThresholdRowKernel threshold = thresholdRowKernel(job->thresholdMap != NULL);
+
+	//	the clock is only read when the metrics want the kernel times
+	double greySeconds = 0, differenceSeconds = 0, t0 = 0, t1 = 0;
+
+	for (unsigned int i=first; i<end; i++) {
+		unsigned char* oldGrey = imageRow(job->backgroundGrey, i);
+		unsigned char* newGrey = imageRow(job->frameGrey, i);
+		unsigned char* differenceRow = (job->difference != NULL) ? imageRow(job->difference, i) : NULL;
+		uint64_t* maskRow = bitMaskRow(job->mask, i);
+		const unsigned char* thresholdRow = (job->thresholdMap != NULL) ? imageRow(job->thresholdMap, i) : NULL;
+
+		//	the kernels only run over the spans of the region mask, if any
+		WordSpan wholeRow;
+		unsigned int nbSpans;
+		const WordSpan* spans = rowSpans(job->region, i, nbCols, &wholeRow, &nbSpans);
+		const uint64_t* keptRow = (job->region != NULL) ? bitMaskRow(&job->region->kept, i) : NULL;
+		if (job->region != NULL && job->histograms == NULL) {
+			clearOutsideSpans(spans, nbSpans, nbCols, maskRow, differenceRow);
+		}
+
+		for (unsigned int k=0; k<nbSpans; k++) {
+			const unsigned int j0 = spanStart(spans + k), n = spanEnd(spans + k, nbCols) - j0;
+			if (job->kernelTimes != NULL) {
+				t0 = kernelClock();
+			}
+			if (greyBackground != NULL) {
+				greyBackground(imageRow(job->background, i) + (size_t) j0 * job->background->bytesPerPixel,
+							   n, oldGrey + j0);
+			}
+			if (greyFrame != NULL) {
+				greyFrame(imageRow(job->frame, i) + (size_t) j0 * job->frame->bytesPerPixel, n, newGrey + j0);
+			}
+			if (job->kernelTimes != NULL) {
+				t1 = kernelClock();
+				greySeconds += t1 - t0;
+			}
+
+			if (job->histograms != NULL) {
+				differenceGreyRows(oldGrey + j0, newGrey + j0, n,
+								   (differenceRow != NULL) ? differenceRow + j0 : NULL, job->histograms[worker]);
+				if (keptRow != NULL) {
+					uncountExcludedPixels(keptRow, spans + k, nbCols, oldGrey, newGrey, job->histograms[worker]);
+				}
+			}
+			else {
+				threshold(oldGrey + j0, newGrey + j0, n, job->threshold,
+						  (thresholdRow != NULL) ? thresholdRow + j0 : NULL, maskRow + spans[k].first,
+						  (differenceRow != NULL) ? differenceRow + j0 : NULL);
+				if (keptRow != NULL) {
+					keepSpanPixels(keptRow, spans + k, nbCols, maskRow, differenceRow);
+				}
+			}
+			if (job->kernelTimes != NULL) {
+				differenceSeconds += kernelClock() - t1;
+			}
+		}
+	}
+
+	if (job->kernelTimes != NULL) {
+		job->kernelTimes[worker][0] += greySeconds;
+		job->kernelTimes[worker][1] += differenceSeconds;
+	}
+}
+
+//-----------------------------------------------------------
+//	Threshold of a range of stored differences
+//-----------------------------------------------------------
+void thresholdRows(void* arg, unsigned int first, unsigned int end, unsigned int worker) {
+	SubtractionJob* job = (SubtractionJob*) arg;
+	StoredThresholdKernel threshold = (job->thresholdMap != NULL) ? thresholdStoredMappedRow :
+																	  thresholdStoredFixedRow;
+	const unsigned int nbCols = job->difference->nbCols;
+	for (unsigned int i=first; i<end; i++) {
+		const unsigned char* thresholdRow = (job->thresholdMap != NULL) ? imageRow(job->thresholdMap, i) : NULL;
+		unsigned char* differenceRow = imageRow(job->difference, i);
+		uint64_t* maskRow = bitMaskRow(job->mask, i);
+		if (job->region == NULL) {
+			threshold(differenceRow, nbCols, job->threshold, thresholdRow, maskRow);
+			continue;
+		}
+
+		unsigned int nbSpans;
+		const WordSpan* spans = regionRowSpans(job->region, i, &nbSpans);
+		clearOutsideSpans(spans, nbSpans, nbCols, maskRow, differenceRow);
+		for (unsigned int k=0; k<nbSpans; k++) {
+			const unsigned int j0 = spanStart(spans + k);
+			threshold(differenceRow + j0, spanEnd(spans + k, nbCols) - j0, job->threshold,
+					  (thresholdRow != NULL) ? thresholdRow + j0 : NULL, maskRow + spans[k].first);
+			keepSpanPixels(bitMaskRow(&job->region->kept, i), spans + k, nbCols, maskRow, differenceRow);
+		}
+	}
+}
+
+//-----------------------------------------------------------
+//	Sampled subtraction
+//-----------------------------------------------------------
+
+//	One grey level out of factor of a row, converted first if it is not grey
+static void sampleGreyRow(const ImageStruct* image, GreyFormula formula, unsigned int i,
+						  unsigned int factor, unsigned char* greyRow, unsigned char* samples)
+{
+	const unsigned char* row = imageRow(image, i);
+	if (image->type != GRAY_RASTER && image->type != MASK_RASTER) {
+		greyRowKernel(image->type, formula)(row, image->nbCols, greyRow);
+		row = greyRow;
+	}
+	for (unsigned int j=0, k=0; j<image->nbCols; j+=factor, k++) {
+		samples[k] = row[j];
+	}
+}
+
+void subtractSampledRows(void* arg, unsigned int first, unsigned int end, unsigned int worker) {
+	SampledSubtractionJob* job = (SampledSubtractionJob*) arg;
+	const unsigned int nbCols = job->frame->nbCols;
+	const unsigned int nbSamples = job->mask->nbCols;
+	ThresholdRowKernel threshold = thresholdRowKernel(job->thresholdMap != NULL);
+
+	//	a full grey row, then the samples of both images and of the map
+	unsigned char* scratch = (unsigned char*) malloc(nbCols + 3*nbSamples);
+	if (scratch == NULL) {
+		printf("Failed to allocate sample rows in subtractSampledRows\n");
+		exit(124);
+	}
+	unsigned char* oldSamples = scratch + nbCols;
+	unsigned char* newSamples = oldSamples + nbSamples;
+	unsigned char* thresholdSamples = newSamples + nbSamples;
+
+	for (unsigned int i=first; i<end; i++) {
+		const unsigned int imageRowIndex = i * job->factor;
+		uint64_t* maskRow = bitMaskRow(job->mask, i);
+		unsigned int nbSpans = 1;
+		if (job->region != NULL) {
+			regionRowSpans(job->region, imageRowIndex, &nbSpans);
+		}
+		if (nbSpans == 0) {
+			memset(maskRow, 0, job->mask->wordsPerRow * sizeof(uint64_t));
+			continue;
+		}
+		sampleGreyRow(job->background, job->formula, imageRowIndex, job->factor, scratch, oldSamples);
+		sampleGreyRow(job->frame, job->formula, imageRowIndex, job->factor, scratch, newSamples);
+		if (job->thresholdMap != NULL) {
+			sampleGreyRow(job->thresholdMap, job->formula, imageRowIndex, job->factor, scratch,
+						  thresholdSamples);
+		}
+		threshold(oldSamples, newSamples, nbSamples, job->threshold, thresholdSamples, maskRow, NULL);
+		if (job->region != NULL) {
+			const uint64_t* keptRow = bitMaskRow(&job->region->kept, imageRowIndex);
+			for (unsigned int k=0; k<nbSamples; k++) {
+				const unsigned int j = k * job->factor;
+				if (!((keptRow[j / MASK_WORD_BITS] >> (j % MASK_WORD_BITS)) & 1)) {
+					maskRow[k / MASK_WORD_BITS] &= ~((uint64_t) 1 << (k % MASK_WORD_BITS));
+				}
+			}
+		}
+	}
+	free(scratch);
+	(void) worker;
+}
@@ -0,0 +1,242 @@
+//-----------------------------------------------------------------
+//	Background subtraction kernels.  Both images are first converted
+//	to 8-bit grey planes, then compared one row at a time.
+//-----------------------------------------------------------------
+
+#ifndef SUBTRACTION_H
+#define SUBTRACTION_H
+
+#include <stdint.h>
+#include "fileIO.h"
+#include "BitMask.h"
+#include "RegionMask.h"
+#include "Threshold.h"
+
+/**	How color pixels are turned into grey levels
+ */
+typedef enum GreyFormula
+{
+	/**	(red + green + blue) / 3
+	 */
+	GREY_MEAN,
+
+	/**	Weighted luma of Rec. 601, (77 red + 150 green + 29 blue) / 256
+	 */
+	GREY_LUMA
+
+} GreyFormula;
+
+/**	Kernel that converts a row of pixels of one format to grey levels
+ *	@param	row			the row to convert
+ *	@param	nbCols		number of pixels in the row
+ *	@param	greyRow		the grey row to write (nbCols bytes)
+ */
+typedef void (*GreyRowKernel)(const unsigned char* row, unsigned int nbCols, unsigned char* greyRow);
+
+/**	Kernel that thresholds the absolute difference of two grey rows into a
+ *	mask row (see thresholdGreyRows)
+ *	@param	oldGrey			grey row of the background
+ *	@param	newGrey			grey row of the frame
+ *	@param	nbCols			number of pixels in the rows
+ *	@param	threshold		threshold of every pixel (fixed threshold kernel)
+ *	@param	thresholdRow	threshold of each pixel (per-pixel threshold kernel)
+ *	@param	maskRow			the mask row to write (see BitMask)
+ *	@param	differenceRow	if not NULL, receives the mask as bytes (0 or 255)
+ */
+typedef void (*ThresholdRowKernel)(const unsigned char* oldGrey, const unsigned char* newGrey,
+								   unsigned int nbCols, unsigned int threshold,
+								   const unsigned char* thresholdRow, uint64_t* maskRow,
+								   unsigned char* differenceRow);
+
+/**	Returns the grey kernel of a pixel format and formula (the formula only
+ *	matters for color pixels)
+ *	@param	type		pixel type of the rows
+ *	@param	formula		grey formula of color pixels
+ *	@return	the kernel
+ */
+GreyRowKernel greyRowKernel(ImageType type, GreyFormula formula);
+
+/**	Returns the threshold kernel of a threshold mode
+ *	@param	perPixel	1 for a threshold per pixel, 0 for a fixed threshold
+ *	@return	the kernel
+ */
+ThresholdRowKernel thresholdRowKernel(int perPixel);
+
+/**	Converts a row of pixels to grey levels.  Color pixels are converted with
+ *	the formula given, float pixels are rounded and clamped to [0, 255].
+ *	@param	type		pixel type of the row
+ *	@param	formula		grey formula of color pixels
+ *	@param	row			the row to convert
+ *	@param	nbCols		number of pixels in the row
+ *	@param	greyRow		the grey row to write (nbCols bytes)
+ */
+void convertRowToGrey(ImageType type, GreyFormula formula, const unsigned char* row,
+					  unsigned int nbCols, unsigned char* greyRow);
+
+/**	Thresholds the absolute difference of two grey rows into a mask row.
+ *	A pixel is foreground when the difference is at least the threshold.
+ *	@param	oldGrey			grey row of the background
+ *	@param	newGrey			grey row of the frame
+ *	@param	nbCols			number of pixels in the rows
+ *	@param	threshold		threshold on the grey-level difference
+ *	@param	maskRow			the mask row to write (see BitMask)
+ *	@param	differenceRow	if not NULL, receives the mask as bytes (0 or 255)
+ */
+void thresholdGreyRows(const unsigned char* oldGrey, const unsigned char* newGrey,
+					   unsigned int nbCols, unsigned int threshold, uint64_t* maskRow,
+					   unsigned char* differenceRow);
+
+/**	Computes the absolute difference of two grey rows, counts it in a
+ *	histogram and/or stores it
+ *	@param	oldGrey			grey row of the background
+ *	@param	newGrey			grey row of the frame
+ *	@param	nbCols			number of pixels in the rows
+ *	@param	differenceRow	if not NULL, receives the differences
+ *	@param	histogram		if not NULL, the histogram (NB_GREY_LEVELS counts)
+ *							to add the differences to
+ */
+void differenceGreyRows(const unsigned char* oldGrey, const unsigned char* newGrey,
+						unsigned int nbCols, unsigned char* differenceRow,
+						unsigned long* histogram);
+
+/**	Thresholds a row of differences stored by differenceGreyRows
+ *	@param	differenceRow	the differences; they are replaced by the mask as
+ *							bytes (0 or 255)
+ *	@param	nbCols			number of pixels in the row
+ *	@param	threshold		threshold on the grey-level difference
+ *	@param	maskRow			the mask row to write (see BitMask)
+ */
+void thresholdDifferenceRow(unsigned char* differenceRow, unsigned int nbCols,
+							unsigned int threshold, uint64_t* maskRow);
+
+/**	Makes the grey plane of an image: the image itself (a view) if it is
+ *	already a GRAY_RASTER, otherwise a new GRAY_RASTER image of the same size,
+ *	to be filled by subtractRows
+ *	@param	image	the image
+ *	@return	its grey plane, to be freed with deleteImageStruct
+ */
+ImageStruct newGreyPlane(const ImageStruct* image);
+
+/**	One background subtraction over images (or bands of images) of the same
+ *	size, run on a ThreadPool with subtractRows and thresholdRows
+ */
+typedef struct SubtractionJob
+{
+	/**	The background and the frame
+	 */
+	const ImageStruct* background;
+	const ImageStruct* frame;
+
+	/**	Their grey planes (see newGreyPlane)
+	 */
+	ImageStruct* backgroundGrey;
+	ImageStruct* frameGrey;
+
+	/**	Grey formula of color images
+	 */
+	GreyFormula formula;
+
+	/**	Threshold applied by subtractRows when histograms is NULL, and
+	 *	by thresholdRows
+	 */
+	unsigned int threshold;
+
+	/**	If not NULL, a GRAY_RASTER image of the size of the frame that holds
+	 *	the threshold of each pixel, used instead of threshold
+	 */
+	const ImageStruct* thresholdMap;
+
+	/**	If not NULL, only the pixels it keeps can be foreground: the words of
+	 *	a row out of its spans are neither converted nor compared, and the
+	 *	others are ANDed with it.  The histograms only count the pixels kept.
+	 */
+	const RegionMask* region;
+
+	/**	Receives the thresholded difference, one bit per pixel
+	 */
+	BitMask* mask;
+
+	/**	If not NULL, receives the difference as a MASK_RASTER image (0 or 255);
+	 *	in histogram mode it holds the raw differences until thresholdRows runs
+	 */
+	ImageStruct* difference;
+
+	/**	If not NULL, subtractRows only counts the differences in the
+	 *	histogram of its worker (the threshold is not known yet)
+	 */
+	unsigned long (*histograms)[NB_GREY_LEVELS];
+
+	/**	If not NULL, subtractRows adds to the pair of its worker the seconds
+	 *	spent converting rows to grey ([0]) and in the difference kernels
+	 *	([1]), for the stage metrics
+	 */
+	double (*kernelTimes)[2];
+
+} SubtractionJob;
+
+/**	RangeFunction that converts a range of rows of both images to grey and
+ *	either thresholds or counts their differences
+ *	@param	arg		the SubtractionJob
+ *	@param	first	index of the first row
+ *	@param	end		index one past the last row
+ *	@param	worker	index of the worker (selects its histogram)
+ */
+void subtractRows(void* arg, unsigned int first, unsigned int end, unsigned int worker);
+
+/**	RangeFunction that thresholds the differences stored by subtractRows in
+ *	histogram mode
+ *	@param	arg		the SubtractionJob
+ *	@param	first	index of the first row
+ *	@param	end		index one past the last row
+ *	@param	worker	index of the worker
+ */
+void thresholdRows(void* arg, unsigned int first, unsigned int end, unsigned int worker);
+
+/**	A subtraction on a grid of one pixel out of factor in each direction,
+ *	which gives a mask factor times smaller in both directions.  Pixel (i, j)
+ *	of the mask stands for pixel (factor*i, factor*j) of the images.
+ */
+typedef struct SampledSubtractionJob
+{
+	/**	The background and the frame, of the same size, in any pixel format
+	 */
+	const ImageStruct* background;
+	const ImageStruct* frame;
+
+	/**	Grey formula of color images
+	 */
+	GreyFormula formula;
+
+	/**	Threshold, or a threshold per pixel of the images if thresholdMap
+	 *	is not NULL
+	 */
+	unsigned int threshold;
+	const ImageStruct* thresholdMap;
+
+	/**	If not NULL, only the pixels it keeps can be foreground (pixel
+	 *	(factor*i, factor*j) for pixel (i, j) of the mask)
+	 */
+	const RegionMask* region;
+
+	/**	Sampling step, in pixels
+	 */
+	unsigned int factor;
+
+	/**	Receives the thresholded differences: (nbRows + factor-1) / factor
+	 *	rows of (nbCols + factor-1) / factor columns
+	 */
+	BitMask* mask;
+
+} SampledSubtractionJob;
+
+/**	RangeFunction that thresholds the sampled differences of a range of rows
+ *	of the mask.  Color rows are converted to grey whole, then sampled, so a
+ *	factor of 2 halves the conversion and quarters the differences.
+ *	@param	arg		the SampledSubtractionJob
+ *	@param	first	index of the first row of the mask
+ *	@param	end		index one past the last row of the mask
+ *	@param	worker	index of the worker
+ */
+void subtractSampledRows(void* arg, unsigned int first, unsigned int end, unsigned int worker);
+
+#endif	//	SUBTRACTION_H
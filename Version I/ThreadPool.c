@@ -0,0 +1,310 @@
+//
+//  ThreadPool.c
+//  Project
+//
+//  Persistent worker threads.  The workers sleep on a condition variable
+//  between jobs, so a job costs two wake-ups instead of thread creations.
+//  Pinned workers are spread over the processors node by node, so that
+//  consecutive bands of a range are processed on the same NUMA node.
+//
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+//
+#include "ThreadPool.h"
+#include "Trace.h"
+
+typedef struct WorkerInfo
+{
+	pthread_t threadID;
+	unsigned int index;
+	ThreadPool* pool;
+
+	//	processor the worker is pinned to (-1 if it is not) and its node
+	int cpu;
+	unsigned int node;
+
+	//	items processed and time spent on them, written by the worker only
+	unsigned long nbItems;
+	double busySeconds;
+
+} WorkerInfo;
+
+struct ThreadPool
+{
+	unsigned int nbThreads;
+	WorkerInfo* workers;
+	unsigned int nbNodes;
+
+	//	Only one job runs at a time; other callers wait on submitLock
+	pthread_mutex_t submitLock;
+	pthread_mutex_t lock;
+	pthread_cond_t jobReady;
+	pthread_cond_t jobDone;
+
+	//	Current job.  A new job is signaled by a change of generation.
+	unsigned long generation;
+	unsigned int nbItems;
+	RangeFunction func;
+	void* arg;
+	unsigned int nbPending;
+	int quit;
+};
+
+//-----------------------------------------------------------
+//	Band of [0, nbItems) processed by a given worker
+//-----------------------------------------------------------
+static void workerBand(unsigned int nbItems, unsigned int nbWorkers, unsigned int worker,
+					   unsigned int* first, unsigned int* end)
+{
+	*first = (unsigned int) (((unsigned long) nbItems * worker) / nbWorkers);
+	*end = (unsigned int) (((unsigned long) nbItems * (worker+1)) / nbWorkers);
+}
+
+static double elapsedSeconds(const struct timespec* start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + 1.e-9 * (now.tv_nsec - start->tv_nsec);
+}
+
+static void* workerFunc(void* arg) {
+	WorkerInfo* info = (WorkerInfo*) arg;
+	ThreadPool* pool = info->pool;
+	unsigned long seenGeneration = 0;
+
+	if (info->cpu >= 0) {
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(info->cpu, &cpuSet);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0) {
+			fprintf(stderr, "Could not pin worker %u to processor %d\n", info->index, info->cpu);
+		}
+	}
+
+	char threadName[32];
+	snprintf(threadName, sizeof(threadName), "worker %u", info->index);
+	nameTraceThread(threadName);
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		double waitStart = traceClock();
+		while (!pool->quit && pool->generation == seenGeneration) {
+			pthread_cond_wait(&pool->jobReady, &pool->lock);
+		}
+		if (pool->quit) {
+			break;
+		}
+		seenGeneration = pool->generation;
+		unsigned int nbItems = pool->nbItems;
+		RangeFunction func = pool->func;
+		void* funcArg = pool->arg;
+		pthread_mutex_unlock(&pool->lock);
+		traceSpan("wait", "pool", waitStart);
+
+		unsigned int first, end;
+		workerBand(nbItems, pool->nbThreads, info->index, &first, &end);
+		if (first < end) {
+			double traceStart = traceClock();
+			struct timespec start;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			func(funcArg, first, end, info->index);
+			info->busySeconds += elapsedSeconds(&start);
+			info->nbItems += end - first;
+			traceRange("rows", "pool", traceStart, first, end);
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		pool->nbPending--;
+		if (pool->nbPending == 0) {
+			pthread_cond_signal(&pool->jobDone);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+//-----------------------------------------------------------
+//	Creates a pool and starts its workers, pinned if a topology
+//	is given
+//-----------------------------------------------------------
+static ThreadPool* createThreadPool(unsigned int nbThreads, const CpuTopology* topology) {
+	if (nbThreads == 0) {
+		long nbProcs = (topology != NULL) ? (long) topology->nbCpus : sysconf(_SC_NPROCESSORS_ONLN);
+		nbThreads = (nbProcs > 0) ? (unsigned int) nbProcs : 1;
+	}
+
+	ThreadPool* pool = (ThreadPool*) calloc(1, sizeof(ThreadPool));
+	if (pool == NULL) {
+		printf("Failed to allocate pool in newThreadPool\n");
+		exit(100);
+	}
+	pool->workers = (WorkerInfo*) calloc(nbThreads, sizeof(WorkerInfo));
+	if (pool->workers == NULL) {
+		printf("Failed to allocate workers in newThreadPool\n");
+		exit(101);
+	}
+	pool->nbThreads = nbThreads;
+	pool->nbNodes = 1;
+	pthread_mutex_init(&pool->submitLock, NULL);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->jobReady, NULL);
+	pthread_cond_init(&pool->jobDone, NULL);
+
+	for (unsigned int k=0; k<nbThreads; k++) {
+		pool->workers[k].index = k;
+		pool->workers[k].pool = pool;
+		pool->workers[k].cpu = -1;
+		if (topology != NULL && topology->nbCpus > 0) {
+			unsigned int slot = (unsigned int) (((unsigned long) k * topology->nbCpus) / nbThreads);
+			pool->workers[k].cpu = (int) topology->cpus[slot];
+			pool->workers[k].node = topology->cpuNodes[slot];
+			if (k > 0 && pool->workers[k].node != pool->workers[k-1].node) {
+				pool->nbNodes++;
+			}
+		}
+		int errCode = pthread_create(&pool->workers[k].threadID, NULL, workerFunc,
+									 pool->workers + k);
+		if (errCode != 0) {
+			printf("Failed to create worker thread in newThreadPool\n");
+			exit(102);
+		}
+	}
+
+	return pool;
+}
+
+ThreadPool* newThreadPool(unsigned int nbThreads) {
+	return createThreadPool(nbThreads, NULL);
+}
+
+ThreadPool* newPinnedThreadPool(unsigned int nbThreads, const CpuTopology* topology) {
+	return createThreadPool(nbThreads, topology);
+}
+
+//-----------------------------------------------------------
+//	Number of NUMA nodes the workers run on
+//-----------------------------------------------------------
+unsigned int threadPoolNodes(const ThreadPool* pool) {
+	return (pool != NULL) ? pool->nbNodes : 1;
+}
+
+//-----------------------------------------------------------
+//	Items processed on each node and their rate
+//-----------------------------------------------------------
+void printThreadPoolStats(const ThreadPool* pool) {
+	if (pool == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&((ThreadPool*) pool)->lock);
+	unsigned int k = 0;
+	while (k < pool->nbThreads) {
+		const unsigned int node = pool->workers[k].node;
+		unsigned int nbWorkers = 0;
+		unsigned long nbItems = 0;
+		double busySeconds = 0.;
+		for (; k<pool->nbThreads && pool->workers[k].node==node; k++) {
+			nbWorkers++;
+			nbItems += pool->workers[k].nbItems;
+			busySeconds += pool->workers[k].busySeconds;
+		}
+		printf("node %u: %u worker%s, %lu items in %.3f s of work (%.0f items/s per worker)\n",
+			   node, nbWorkers, (nbWorkers > 1) ? "s" : "", nbItems, busySeconds,
+			   (busySeconds > 0.) ? nbItems / busySeconds : 0.);
+	}
+	pthread_mutex_unlock(&((ThreadPool*) pool)->lock);
+}
+
+//-----------------------------------------------------------
+//	Number of workers of a pool
+//-----------------------------------------------------------
+unsigned int threadPoolSize(const ThreadPool* pool) {
+	return (pool != NULL) ? pool->nbThreads : 1;
+}
+
+//-----------------------------------------------------------
+//	Processes a range in parallel, without waiting for completion
+//-----------------------------------------------------------
+void startParallelRange(ThreadPool* pool, unsigned int nbItems, RangeFunction func, void* arg) {
+	if (pool == NULL) {
+		if (nbItems > 0) {
+			double traceStart = traceClock();
+			func(arg, 0, nbItems, 0);
+			traceRange("rows", "pool", traceStart, 0, nbItems);
+		}
+		return;
+	}
+
+	//	submitLock is held until waitParallelRange, so that the job ends
+	//	before another one starts
+	pthread_mutex_lock(&pool->submitLock);
+	pthread_mutex_lock(&pool->lock);
+	pool->nbItems = nbItems;
+	pool->func = func;
+	pool->arg = arg;
+	pool->nbPending = pool->nbThreads;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->jobReady);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void waitParallelRange(ThreadPool* pool) {
+	if (pool == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	while (pool->nbPending > 0) {
+		pthread_cond_wait(&pool->jobDone, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	pthread_mutex_unlock(&pool->submitLock);
+}
+
+//-----------------------------------------------------------
+//	Processes a range in parallel and waits for completion
+//-----------------------------------------------------------
+void runParallelRange(ThreadPool* pool, unsigned int nbItems, RangeFunction func, void* arg) {
+	if (nbItems == 0) {
+		return;
+	}
+	if (pool == NULL) {
+		startParallelRange(NULL, nbItems, func, arg);
+		return;
+	}
+
+	//	the caller only waits: its span shows how long the slowest worker took
+	double traceStart = traceClock();
+	startParallelRange(pool, nbItems, func, arg);
+	waitParallelRange(pool);
+	traceRange("join", "pool", traceStart, 0, nbItems);
+}
+
+//-----------------------------------------------------------
+//	Stops the workers and frees the pool
+//-----------------------------------------------------------
+void deleteThreadPool(ThreadPool* pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->jobReady);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (unsigned int k=0; k<pool->nbThreads; k++) {
+		pthread_join(pool->workers[k].threadID, NULL);
+	}
+
+	pthread_mutex_destroy(&pool->submitLock);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->jobReady);
+	pthread_cond_destroy(&pool->jobDone);
+	free(pool->workers);
+	free(pool);
+}
@@ -0,0 +1,92 @@
+//-----------------------------------------------------------------
+//	A pool of persistent worker threads that process ranges of
+//	rows (or of any other kind of item) in parallel
+//-----------------------------------------------------------------
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "Topology.h"
+
+/**	Function run by a worker on its share of a range.
+ *	@param	arg		the argument passed to runParallelRange
+ *	@param	first	index of the first item to process
+ *	@param	end		index one past the last item to process
+ *	@param	worker	index of the worker running the function, in
+ *					[0, number of workers of the pool)
+ */
+typedef void (*RangeFunction)(void* arg, unsigned int first, unsigned int end,
+							  unsigned int worker);
+
+/**	The pool is only manipulated through pointers, its content is private
+ */
+typedef struct ThreadPool ThreadPool;
+
+/**	Creates a pool and starts its workers
+ *	@param	nbThreads	number of workers (0 to use one per online processor)
+ *	@return	a new pool
+ */
+ThreadPool* newThreadPool(unsigned int nbThreads);
+
+/**	Creates a pool whose workers are each pinned to one processor.  The
+ *	workers are spread evenly over the processors of the topology, which
+ *	come node by node, so the workers of a node get consecutive bands of
+ *	every range.  Memory first written by a worker is placed on its node.
+ *	@param	nbThreads	number of workers (0 to use one per processor of the topology)
+ *	@param	topology	the processors to use
+ *	@return	a new pool
+ */
+ThreadPool* newPinnedThreadPool(unsigned int nbThreads, const CpuTopology* topology);
+
+/**	Returns the number of NUMA nodes the workers of a pool are pinned on
+ *	@param	pool	the pool (NULL, or not pinned: 1)
+ *	@return	number of nodes
+ */
+unsigned int threadPoolNodes(const ThreadPool* pool);
+
+/**	Prints, for each node, the number of items the workers pinned on it
+ *	processed since the pool was created and how fast
+ *	@param	pool	the pool
+ */
+void printThreadPoolStats(const ThreadPool* pool);
+
+/**	Returns the number of workers of a pool
+ *	@param	pool	the pool (NULL stands for "no pool": 1 worker, the caller)
+ *	@return	number of workers of the pool
+ */
+unsigned int threadPoolSize(const ThreadPool* pool);
+
+/**	Splits [0, nbItems) into one contiguous band per worker and waits until
+ *	all the bands have been processed.  Worker k always receives the k-th
+ *	band, so repeated calls on the same range give each worker the same items.
+ *	Jobs submitted from several threads are run one after the other.  A job
+ *	must not submit another job to the same pool.
+ *	@param	pool	the pool to use (NULL runs the whole range on the caller)
+ *	@param	nbItems	number of items to process
+ *	@param	func	function run by each worker on its band
+ *	@param	arg		argument passed to func
+ */
+void runParallelRange(ThreadPool* pool, unsigned int nbItems, RangeFunction func, void* arg);
+
+/**	Starts a job like runParallelRange but returns at once, so the caller
+ *	can work on the items already processed while the workers go on.  The
+ *	pool takes no other job until waitParallelRange is called.
+ *	@param	pool	the pool to use (NULL runs the whole range on the caller
+ *					before returning)
+ *	@param	nbItems	number of items to process
+ *	@param	func	function run by each worker on its band
+ *	@param	arg		argument passed to func
+ */
+void startParallelRange(ThreadPool* pool, unsigned int nbItems, RangeFunction func, void* arg);
+
+/**	Waits until the job started by startParallelRange is done
+ *	@param	pool	the pool passed to startParallelRange
+ */
+void waitParallelRange(ThreadPool* pool);
+
+/**	Stops the workers of a pool and frees it
+ *	@param	pool	the pool to delete
+ */
+void deleteThreadPool(ThreadPool* pool);
+
+#endif	//	THREAD_POOL_H
@@ -0,0 +1,52 @@
+//
+//  Threshold.c
+//  Project
+//
+//  Otsu's threshold selection on the histogram of grey-level differences.
+//
+
+#include "Threshold.h"
+
+//-----------------------------------------------------------
+//	Adds a histogram into another one
+//-----------------------------------------------------------
+void addHistogram(unsigned long* total, const unsigned long* partial) {
+	for (int k=0; k<NB_GREY_LEVELS; k++) {
+		total[k] += partial[k];
+	}
+}
+
+//-----------------------------------------------------------
+//	Otsu's method.  For each candidate split [0, t] / [t+1, 255]
+//	the between-class variance is w0*w1*(m0 - m1)^2; it is
+//	computed from running sums, so a single pass suffices.
+//-----------------------------------------------------------
+unsigned int otsuThreshold(const unsigned long* histogram) {
+	double total = 0.0, sumAll = 0.0;
+	for (int k=0; k<NB_GREY_LEVELS; k++) {
+		total += histogram[k];
+		sumAll += (double) k * histogram[k];
+	}
+
+	double weight0 = 0.0, sum0 = 0.0;
+	double bestVariance = 0.0;
+	unsigned int best = NB_GREY_LEVELS;
+
+	for (int t=0; t<NB_GREY_LEVELS-1; t++) {
+		weight0 += histogram[t];
+		sum0 += (double) t * histogram[t];
+		double weight1 = total - weight0;
+		if (weight0 == 0.0 || weight1 == 0.0) {
+			continue;
+		}
+		double mean0 = sum0 / weight0;
+		double mean1 = (sumAll - sum0) / weight1;
+		double variance = weight0 * weight1 * (mean0 - mean1) * (mean0 - mean1);
+		if (variance > bestVariance) {
+			bestVariance = variance;
+			best = t + 1;
+		}
+	}
+
+	return best;
+}
@@ -0,0 +1,44 @@
+//-----------------------------------------------------------------
+//	Histogram of grey-level differences and automatic threshold
+//	selection
+//-----------------------------------------------------------------
+
+#ifndef THRESHOLD_H
+#define THRESHOLD_H
+
+/**	Number of grey levels of a difference (8-bit)
+ */
+#define NB_GREY_LEVELS	256
+
+/**	How the threshold applied to the grey-level difference is chosen
+ */
+typedef enum ThresholdMode
+{
+		/**	The same threshold, given by the user, for every frame
+		 */
+		FIXED_THRESHOLD,
+
+		/**	Computed for each frame from the histogram of the differences
+		 *	(Otsu's method)
+		 */
+		OTSU_THRESHOLD
+
+} ThresholdMode;
+
+/**	Adds a histogram into another one (used to reduce the per-thread
+ *	histograms of a frame)
+ *	@param	total		the histogram to add to
+ *	@param	partial		the histogram to add
+ */
+void addHistogram(unsigned long* total, const unsigned long* partial);
+
+/**	Picks the threshold that maximizes the between-class variance of a
+ *	histogram of differences (Otsu's method)
+ *	@param	histogram	counts of each difference level (NB_GREY_LEVELS entries)
+ *	@return	the threshold t such that differences >= t are foreground.  If
+ *			the histogram has a single non-empty level, no difference
+ *			reaches the returned value.
+ */
+unsigned int otsuThreshold(const unsigned long* histogram);
+
+#endif	//	THRESHOLD_H
@@ -0,0 +1,153 @@
+//
+//  Topology.c
+//  Project
+//
+//  Each node directory of /sys/devices/system/node has a cpulist file,
+//  e.g. "0-7,16-23".  Processors outside the affinity mask of the process
+//  (taskset, cgroups) are left out.
+//
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+//
+#include "Topology.h"
+
+#define NODE_PATH	"/sys/devices/system/node"
+
+//	Largest node id looked for
+#define MAX_NODES	64
+
+static void addCpu(CpuTopology* topology, unsigned int cpu, unsigned int node) {
+	topology->cpus[topology->nbCpus] = cpu;
+	topology->cpuNodes[topology->nbCpus] = node;
+	topology->nbCpus++;
+}
+
+//-----------------------------------------------------------
+//	Adds the allowed processors of a cpulist file.  Returns the
+//	number of processors added.
+//-----------------------------------------------------------
+static unsigned int readCpuList(CpuTopology* topology, FILE* file, unsigned int node,
+								const cpu_set_t* allowed, unsigned char* seen)
+{
+	unsigned int nbAdded = 0, first, last;
+	int c;
+	while (fscanf(file, "%u", &first) == 1) {
+		last = first;
+		c = fgetc(file);
+		if (c == '-') {
+			if (fscanf(file, "%u", &last) != 1) {
+				break;
+			}
+			c = fgetc(file);
+		}
+		for (unsigned int cpu=first; cpu<=last && cpu<CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, allowed) && !seen[cpu]) {
+				seen[cpu] = 1;
+				addCpu(topology, cpu, node);
+				nbAdded++;
+			}
+		}
+		if (c != ',') {
+			break;
+		}
+	}
+	return nbAdded;
+}
+
+//-----------------------------------------------------------
+//	Stable insertion sort of the processors by node, so that the
+//	unlisted processors added to node 0 join its group
+//-----------------------------------------------------------
+static void sortByNode(CpuTopology* topology) {
+	for (unsigned int k=1; k<topology->nbCpus; k++) {
+		unsigned int cpu = topology->cpus[k], node = topology->cpuNodes[k];
+		unsigned int i = k;
+		for (; i>0 && topology->cpuNodes[i-1]>node; i--) {
+			topology->cpus[i] = topology->cpus[i-1];
+			topology->cpuNodes[i] = topology->cpuNodes[i-1];
+		}
+		topology->cpus[i] = cpu;
+		topology->cpuNodes[i] = node;
+	}
+}
+
+//-----------------------------------------------------------
+//	Reads the topology of the host
+//-----------------------------------------------------------
+CpuTopology readCpuTopology(void) {
+	CpuTopology topology = {0, 0, NULL, NULL};
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		CPU_ZERO(&allowed);
+		for (unsigned int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+			CPU_SET(cpu, &allowed);
+		}
+	}
+	unsigned int nbAllowed = CPU_COUNT(&allowed);
+
+	topology.cpus = (unsigned int*) malloc(nbAllowed*sizeof(unsigned int));
+	topology.cpuNodes = (unsigned int*) malloc(nbAllowed*sizeof(unsigned int));
+	unsigned char* seen = (unsigned char*) calloc(CPU_SETSIZE, 1);
+	if (topology.cpus == NULL || topology.cpuNodes == NULL || seen == NULL) {
+		printf("Failed to allocate topology in readCpuTopology\n");
+		exit(170);
+	}
+
+	for (unsigned int node=0; node<MAX_NODES; node++) {
+		char path[64];
+		snprintf(path, sizeof(path), NODE_PATH "/node%u/cpulist", node);
+		FILE* file = fopen(path, "r");
+		if (file == NULL) {
+			continue;
+		}
+		readCpuList(&topology, file, node, &allowed, seen);
+		fclose(file);
+	}
+
+	//	No NUMA information (or processors it does not list): node 0
+	for (unsigned int cpu=0; cpu<CPU_SETSIZE && topology.nbCpus<nbAllowed; cpu++) {
+		if (CPU_ISSET(cpu, &allowed) && !seen[cpu]) {
+			addCpu(&topology, cpu, 0);
+		}
+	}
+	sortByNode(&topology);
+
+	for (unsigned int k=0; k<topology.nbCpus; k++) {
+		if (k == 0 || topology.cpuNodes[k] != topology.cpuNodes[k-1]) {
+			topology.nbNodes++;
+		}
+	}
+
+	free(seen);
+	return topology;
+}
+
+//-----------------------------------------------------------
+//	Prints the processors of each node
+//-----------------------------------------------------------
+void printCpuTopology(const CpuTopology* topology) {
+	printf("%u processors on %u NUMA node%s\n", topology->nbCpus, topology->nbNodes,
+		   (topology->nbNodes > 1) ? "s" : "");
+	unsigned int k = 0;
+	while (k < topology->nbCpus) {
+		unsigned int node = topology->cpuNodes[k];
+		printf("  node %u: cpus", node);
+		for (; k<topology->nbCpus && topology->cpuNodes[k]==node; k++) {
+			printf(" %u", topology->cpus[k]);
+		}
+		printf("\n");
+	}
+}
+
+//-----------------------------------------------------------
+//	Delete a topology
+//-----------------------------------------------------------
+void deleteCpuTopology(CpuTopology* topology) {
+	free(topology->cpus);
+	free(topology->cpuNodes);
+	topology->cpus = topology->cpuNodes = NULL;
+	topology->nbCpus = topology->nbNodes = 0;
+}
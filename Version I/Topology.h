@@ -0,0 +1,49 @@
+//-----------------------------------------------------------------
+//	NUMA topology of the host: which processors belong to which
+//	memory node, as listed in /sys/devices/system/node
+//-----------------------------------------------------------------
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+/**	The processors this process may run on, grouped by NUMA node
+ */
+typedef struct CpuTopology
+{
+	/**	Number of nodes that have at least one of the processors
+	 */
+	unsigned int nbNodes;
+
+	/**	Number of processors
+	 */
+	unsigned int nbCpus;
+
+	/**	Processor ids, node by node (all the processors of the first node,
+	 *	then those of the second one, etc.)
+	 */
+	unsigned int* cpus;
+
+	/**	Node id of each processor of cpus
+	 */
+	unsigned int* cpuNodes;
+
+} CpuTopology;
+
+/**	Reads the topology of the host, restricted to the processors the
+ *	process is allowed to run on.  Without NUMA information, all the
+ *	processors are on node 0.
+ *	@return	the topology
+ */
+CpuTopology readCpuTopology(void);
+
+/**	Prints a one-line-per-node summary of a topology
+ *	@param	topology	the topology to print
+ */
+void printCpuTopology(const CpuTopology* topology);
+
+/**	Delete a topology (frees all heap memory allocated to store it)
+ *	@param	topology	pointer to the topology to delete
+ */
+void deleteCpuTopology(CpuTopology* topology);
+
+#endif	//	TOPOLOGY_H
@@ -0,0 +1,194 @@
+//
+//  Trace.c
+//  Project
+//
+//  Each thread appends its spans to a buffer of its own, found through a
+//  thread-local pointer, so recording takes no lock; the lock is only
+//  taken when a thread records its first span, to register its buffer.
+//  A buffer stops growing at MAX_THREAD_EVENTS spans; the spans past
+//  that are counted as dropped.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+//
+#include "Trace.h"
+
+#define MAX_THREAD_EVENTS	(1U << 20)
+
+typedef struct TraceEvent
+{
+	const char* name;
+	const char* category;
+	double start, end;
+
+	//	range of items, if hasRange
+	unsigned int first, last;
+	int hasRange;
+
+} TraceEvent;
+
+typedef struct TraceBuffer
+{
+	unsigned int threadId;
+	char threadName[32];
+
+	TraceEvent* events;
+	unsigned int nbEvents, capacity;
+	unsigned long nbDropped;
+
+	struct TraceBuffer* next;
+
+} TraceBuffer;
+
+volatile int tracingOn = 0;
+
+static struct timespec traceOrigin;
+static pthread_mutex_t buffersLock = PTHREAD_MUTEX_INITIALIZER;
+static TraceBuffer* buffers = NULL;
+static unsigned int nbThreads = 0;
+static __thread TraceBuffer* threadBuffer = NULL;
+
+//-----------------------------------------------------------
+//	Start and clock
+//-----------------------------------------------------------
+void startTracing(void) {
+	clock_gettime(CLOCK_MONOTONIC, &traceOrigin);
+	tracingOn = 1;
+}
+
+double traceClock(void) {
+	if (!tracingOn) {
+		return 0;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - traceOrigin.tv_sec) + 1.e-9 * (now.tv_nsec - traceOrigin.tv_nsec);
+}
+
+//-----------------------------------------------------------
+//	Buffer of the calling thread, registered on first use
+//-----------------------------------------------------------
+static TraceBuffer* ownBuffer(void) {
+	if (threadBuffer == NULL) {
+		TraceBuffer* buffer = (TraceBuffer*) calloc(1, sizeof(TraceBuffer));
+		if (buffer == NULL) {
+			printf("Unable to allocate a trace buffer\n");
+			exit(220);
+		}
+		pthread_mutex_lock(&buffersLock);
+		buffer->threadId = ++nbThreads;
+		snprintf(buffer->threadName, sizeof(buffer->threadName), "thread %u", buffer->threadId);
+		buffer->next = buffers;
+		buffers = buffer;
+		pthread_mutex_unlock(&buffersLock);
+		threadBuffer = buffer;
+	}
+	return threadBuffer;
+}
+
+static void recordEvent(const char* name, const char* category, double start,
+						unsigned int first, unsigned int end, int hasRange)
+{
+	if (!tracingOn) {
+		return;
+	}
+	double now = traceClock();
+	TraceBuffer* buffer = ownBuffer();
+	if (buffer->nbEvents == buffer->capacity) {
+		if (buffer->capacity == MAX_THREAD_EVENTS) {
+			buffer->nbDropped++;
+			return;
+		}
+		unsigned int capacity = (buffer->capacity > 0) ? 2*buffer->capacity : 1024;
+		TraceEvent* events = (TraceEvent*) realloc(buffer->events, capacity * sizeof(TraceEvent));
+		if (events == NULL) {
+			printf("Unable to allocate a trace buffer\n");
+			exit(220);
+		}
+		buffer->events = events;
+		buffer->capacity = capacity;
+	}
+	TraceEvent* event = buffer->events + buffer->nbEvents++;
+	event->name = name;
+	event->category = category;
+	event->start = start;
+	event->end = now;
+	event->first = first;
+	event->last = end;
+	event->hasRange = hasRange;
+}
+
+//-----------------------------------------------------------
+//	Recording
+//-----------------------------------------------------------
+void traceSpan(const char* name, const char* category, double start) {
+	recordEvent(name, category, start, 0, 0, 0);
+}
+
+void traceRange(const char* name, const char* category, double start,
+				unsigned int first, unsigned int end)
+{
+	recordEvent(name, category, start, first, end, 1);
+}
+
+void nameTraceThread(const char* name) {
+	if (!tracingOn) {
+		return;
+	}
+	TraceBuffer* buffer = ownBuffer();
+	snprintf(buffer->threadName, sizeof(buffer->threadName), "%s", name);
+}
+
+//-----------------------------------------------------------
+//	Output
+//-----------------------------------------------------------
+int writeTrace(const char* filePath) {
+	tracingOn = 0;
+	FILE* file = fopen(filePath, "w");
+
+	pthread_mutex_lock(&buffersLock);
+	int err = 0;
+	if (file == NULL) {
+		err = 11;
+	}
+	else {
+		const char* separator = "";
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		for (TraceBuffer* buffer=buffers; buffer!=NULL; buffer=buffer->next) {
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+					"\"args\":{\"name\":\"%s\"}}", separator, buffer->threadId, buffer->threadName);
+			separator = ",\n";
+			for (unsigned int k=0; k<buffer->nbEvents; k++) {
+				const TraceEvent* event = buffer->events + k;
+				fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+						"\"ts\":%.3f,\"dur\":%.3f", event->name, event->category, buffer->threadId,
+						1e6 * event->start, 1e6 * (event->end - event->start));
+				if (event->hasRange) {
+					fprintf(file, ",\"args\":{\"first\":%u,\"end\":%u}", event->first, event->last);
+				}
+				fprintf(file, "}");
+			}
+			if (buffer->nbDropped > 0) {
+				fprintf(stderr, "Trace: %lu spans of %s were dropped\n", buffer->nbDropped, buffer->threadName);
+			}
+		}
+		fprintf(file, "\n]}\n");
+		if (fclose(file) != 0) {
+			err = 12;
+		}
+	}
+
+	//	the thread-local pointers are left dangling: tracing stays off
+	while (buffers != NULL) {
+		TraceBuffer* next = buffers->next;
+		free(buffers->events);
+		free(buffers);
+		buffers = next;
+	}
+	pthread_mutex_unlock(&buffersLock);
+	return err;
+}
@@ -0,0 +1,56 @@
+//-----------------------------------------------------------------
+//	Timeline of what each thread does, recorded in per-thread
+//	buffers and written in the trace-event format of Chrome and
+//	Perfetto
+//-----------------------------------------------------------------
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/**	Nonzero while tracing is on.  Read it before traceClock() so that a
+ *	span costs a single test when tracing is off.
+ */
+extern volatile int tracingOn;
+
+/**	Turns tracing on.  It can only be turned on once per process.
+ */
+void startTracing(void);
+
+/**	Time of the start of a span
+ *	@return	seconds since tracing started (0 when tracing is off)
+ */
+double traceClock(void);
+
+/**	Records a span of the calling thread, from a start read with traceClock()
+ *	to now.  Nothing is recorded when tracing is off.
+ *	@param	name		name of the span (a string that stays valid, e.g. a literal)
+ *	@param	category	category of the span (same)
+ *	@param	start		start of the span
+ */
+void traceSpan(const char* name, const char* category, double start);
+
+/**	Records a span over a range of items (rows, bands...), whose bounds are
+ *	shown as its arguments
+ *	@param	name		name of the span (a string that stays valid)
+ *	@param	category	category of the span (same)
+ *	@param	start		start of the span
+ *	@param	first		first item of the range
+ *	@param	end			one past the last item of the range
+ */
+void traceRange(const char* name, const char* category, double start,
+				unsigned int first, unsigned int end);
+
+/**	Names the calling thread in the trace (the name is copied)
+ *	@param	name	name of the thread
+ */
+void nameTraceThread(const char* name);
+
+/**	Turns tracing off and writes the spans of all the threads to a JSON file
+ *	(one "X" event per span, and the names of the threads), then frees the
+ *	buffers.  No thread may record spans meanwhile.
+ *	@param	filePath	path to the file
+ *	@return	0 if all went well, an error code if the file cannot be written
+ */
+int writeTrace(const char* filePath);
+
+#endif	//	TRACE_H
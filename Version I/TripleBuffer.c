@@ -0,0 +1,84 @@
+//
+//  TripleBuffer.c
+//  Project
+//
+//  The writer owns one slot, the reader another, and the third one sits
+//  in the middle.  Publishing swaps the writer's slot with the middle
+//  one and marks it fresh; reading swaps the reader's slot with the
+//  middle one if it is fresh.  Both swaps are a single atomic exchange.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+//
+#include "TripleBuffer.h"
+
+//	The middle word holds a slot index and this bit when it is fresh
+#define FRESH_BIT	0x4U
+#define INDEX_MASK	0x3U
+
+struct TripleBuffer
+{
+	void* slots[3];
+
+	//	index of the middle slot, with FRESH_BIT if it was published
+	//	and not yet taken by the reader
+	_Atomic unsigned int middle;
+
+	//	only touched by the writer
+	unsigned int back;
+
+	//	only touched by the reader
+	unsigned int front;
+};
+
+TripleBuffer* newTripleBuffer(void* slot0, void* slot1, void* slot2) {
+	TripleBuffer* buffer = (TripleBuffer*) malloc(sizeof(TripleBuffer));
+	if (buffer == NULL) {
+		printf("Unable to allocate a triple buffer\n");
+		exit(150);
+	}
+	buffer->slots[0] = slot0;
+	buffer->slots[1] = slot1;
+	buffer->slots[2] = slot2;
+	buffer->back = 0;
+	buffer->front = 1;
+	atomic_init(&buffer->middle, 2);
+	return buffer;
+}
+
+void* writeSlot(TripleBuffer* buffer) {
+	return buffer->slots[buffer->back];
+}
+
+void* publishWriteSlot(TripleBuffer* buffer) {
+	//	release: the reader that takes the slot sees what was written in it
+	unsigned int previous = atomic_exchange_explicit(&buffer->middle, buffer->back | FRESH_BIT,
+													 memory_order_acq_rel);
+	buffer->back = previous & INDEX_MASK;
+	return buffer->slots[buffer->back];
+}
+
+int tripleBufferHasNews(TripleBuffer* buffer) {
+	return (atomic_load_explicit(&buffer->middle, memory_order_relaxed) & FRESH_BIT) != 0;
+}
+
+int updateReadSlot(TripleBuffer* buffer) {
+	if (!tripleBufferHasNews(buffer)) {
+		return 0;
+	}
+	//	acquire: pairs with the release of publishWriteSlot
+	unsigned int previous = atomic_exchange_explicit(&buffer->middle, buffer->front,
+													 memory_order_acq_rel);
+	buffer->front = previous & INDEX_MASK;
+	return 1;
+}
+
+void* readSlot(TripleBuffer* buffer) {
+	return buffer->slots[buffer->front];
+}
+
+void deleteTripleBuffer(TripleBuffer* buffer) {
+	free(buffer);
+}
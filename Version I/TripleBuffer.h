@@ -0,0 +1,59 @@
+//-----------------------------------------------------------------
+//	Lock-free triple buffer: one thread keeps producing values, another
+//	keeps consuming the latest one, and neither ever waits for the other
+//-----------------------------------------------------------------
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+/**	The buffer is only manipulated through pointers, its content is private
+ */
+typedef struct TripleBuffer TripleBuffer;
+
+/**	Creates a triple buffer over three slots allocated by the caller.  The
+ *	writer starts with the first slot and the reader with the second.
+ *	@param	slot0, slot1, slot2		the three slots
+ *	@return	a new triple buffer
+ */
+TripleBuffer* newTripleBuffer(void* slot0, void* slot1, void* slot2);
+
+/**	Returns the slot the writer fills.  It belongs to the writer until it
+ *	calls publishWriteSlot.
+ *	@param	buffer	the triple buffer
+ *	@return	the writer's slot
+ */
+void* writeSlot(TripleBuffer* buffer);
+
+/**	Publishes the writer's slot and gives the writer another one (the
+ *	slot published before, if the reader did not take it, or the one the
+ *	reader released).  Never waits.
+ *	@param	buffer	the triple buffer
+ *	@return	the writer's new slot
+ */
+void* publishWriteSlot(TripleBuffer* buffer);
+
+/**	Tells whether a slot was published since the reader last took one
+ *	@param	buffer	the triple buffer
+ *	@return	1 if updateReadSlot would change the reader's slot
+ */
+int tripleBufferHasNews(TripleBuffer* buffer);
+
+/**	Gives the reader the latest published slot, if there is one it has not
+ *	seen yet.  Never waits.
+ *	@param	buffer	the triple buffer
+ *	@return	1 if the reader's slot changed, 0 otherwise
+ */
+int updateReadSlot(TripleBuffer* buffer);
+
+/**	Returns the slot the reader currently holds
+ *	@param	buffer	the triple buffer
+ *	@return	the reader's slot
+ */
+void* readSlot(TripleBuffer* buffer);
+
+/**	Frees a triple buffer (not its slots)
+ *	@param	buffer	the triple buffer
+ */
+void deleteTripleBuffer(TripleBuffer* buffer);
+
+#endif	//	TRIPLE_BUFFER_H
@@ -0,0 +1,151 @@
+/*
+ **********************************************************************************
+ * File: detectClient.c
+ *..................................................................................
+ * Minimal client of the detection daemon (main --serve=PATH), for testing:
+ *  sends requests to the daemon and writes the replies to the standard output.
+ *
+ *  detectClient SOCKET [--repeat=N] [--quiet] REQUEST [REQUEST ...]
+ *
+ * Each REQUEST is one request line of the protocol of DetectionServer.h, e.g.
+ *  'FRAME "../Data/Part I/frame02.tga"' or 'SHM /ring cam1' or STATS.  The list
+ *  is sent N times (default once).  With --quiet, the replies are not written.
+ *  Errors and the round-trip times seen by the client go to the standard error.
+ *=====================================================================================
+ *  gcc -Wall detectClient.c -o detectClient
+ *
+ **********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static int sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0)
+            return 1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int readAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n <= 0)
+            return 1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Reads the header line of a reply, one byte at a time (it is short)
+static int readLine(int fd, char* line, size_t capacity) {
+    size_t length = 0;
+    while (length + 1 < capacity) {
+        if (read(fd, line + length, 1) != 1)
+            return 1;
+        if (line[length] == '\n') {
+            line[length] = '\0';
+            return 0;
+        }
+        length++;
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    unsigned long nbRepeats = 1;
+    int quiet = 0;
+    const char* requests[256];
+    unsigned int nbRequests = 0;
+
+    if (argc < 3) {
+        printf("Usage: %s SOCKET [--repeat=N] [--quiet] REQUEST [REQUEST ...]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        if (strncmp(argv[i], "--repeat=", 9) == 0)
+            nbRepeats = strtoul(argv[i] + 9, NULL, 10);
+        else if (strcmp(argv[i], "--quiet") == 0)
+            quiet = 1;
+        else if (nbRequests < 256)
+            requests[nbRequests++] = argv[i];
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        fprintf(stderr, "Cannot connect to %s\n", argv[1]);
+        return 1;
+    }
+
+    char* payload = NULL;
+    size_t capacity = 0;
+    unsigned long nbSent = 0, nbFailed = 0;
+    double totalSeconds = 0, maxSeconds = 0;
+    for (unsigned long r = 0; r < nbRepeats; r++) {
+        for (unsigned int k = 0; k < nbRequests; k++) {
+            double start = now();
+            char header[4096];
+            if (sendAll(fd, requests[k], strlen(requests[k])) != 0 || sendAll(fd, "\n", 1) != 0 ||
+                readLine(fd, header, sizeof(header)) != 0) {
+                fprintf(stderr, "The daemon hung up\n");
+                return 1;
+            }
+
+            size_t size = 0;
+            if (sscanf(header, "OK %zu", &size) == 1) {
+                if (size > capacity) {
+                    capacity = size;
+                    payload = (char*) realloc(payload, capacity);
+                    if (payload == NULL) {
+                        fprintf(stderr, "Unable to allocate memory\n");
+                        return 1;
+                    }
+                }
+                if (readAll(fd, payload, size) != 0) {
+                    fprintf(stderr, "The daemon hung up\n");
+                    return 1;
+                }
+            }
+            else {
+                fprintf(stderr, "%s: %s\n", requests[k], header);
+                nbFailed++;
+            }
+
+            double seconds = now() - start;
+            totalSeconds += seconds;
+            if (seconds > maxSeconds)
+                maxSeconds = seconds;
+            nbSent++;
+            if (!quiet && size > 0)
+                fwrite(payload, 1, size, stdout);
+        }
+    }
+    fflush(stdout);
+
+    if (nbSent > 0)
+        fprintf(stderr, "%lu requests (%lu failed), round trip mean %.0f us, max %.0f us\n",
+                nbSent, nbFailed, 1e6 * totalSeconds / nbSent, 1e6 * maxSeconds);
+    free(payload);
+    close(fd);
+    return (nbFailed > 0);
+}
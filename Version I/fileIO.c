@@ -0,0 +1,173 @@
+//
+//  fileIO.c
+//  Project
+//
+//  Allocation of images with aligned rows, optionally on huge pages,
+//  and reading/writing of image files in the format of their extension.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+//
+#include "fileIO.h"
+#include "fileIO_TGA.h"
+#include "fileIO_PNM.h"
+#include "Trace.h"
+
+//	Size of a huge page; smaller rasters are simply left on the heap
+#define HUGE_PAGE_BYTES		(2UL*1024*1024)
+
+static int allocationFlags = 0;
+
+//-----------------------------------------------------------
+//	Pixel depth of an image type
+//-----------------------------------------------------------
+unsigned int bytesPerPixelOfType(ImageType type) {
+	switch (type) {
+		case RGBA32_RASTER:
+		case FLOAT_RASTER:
+			return 4;
+
+		case GRAY_RASTER:
+		case MASK_RASTER:
+		default:
+			return 1;
+	}
+}
+
+void setImageAllocationFlags(int flags) {
+	allocationFlags = flags;
+}
+
+//-----------------------------------------------------------
+//	Allocates an image with aligned rows
+//-----------------------------------------------------------
+ImageStruct newImageStruct(ImageType type, unsigned int nbRows, unsigned int nbCols) {
+	ImageStruct image;
+	image.type = type;
+	image.nbRows = nbRows;
+	image.nbCols = nbCols;
+	image.bytesPerPixel = bytesPerPixelOfType(type);
+	image.bytesPerRow = (image.bytesPerPixel*nbCols + ALIGNMENT_BYTES - 1) / ALIGNMENT_BYTES * ALIGNMENT_BYTES;
+	image.allocSize = (size_t) nbRows * image.bytesPerRow;
+	if (image.allocSize == 0) {
+		image.allocSize = ALIGNMENT_BYTES;
+	}
+	image.raster = NULL;
+	image.allocation = NULL;
+
+	if ((allocationFlags & IMAGE_HUGE_PAGES) && image.allocSize >= HUGE_PAGE_BYTES) {
+		image.allocSize = (image.allocSize + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+		void* mem = mmap(NULL, image.allocSize, PROT_READ | PROT_WRITE,
+						 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem != MAP_FAILED) {
+			#ifdef MADV_HUGEPAGE
+				madvise(mem, image.allocSize, MADV_HUGEPAGE);
+			#endif
+			image.raster = (unsigned char*) mem;
+			image.allocation = mem;
+			image.storage = IMAGE_MAPPED;
+		}
+	}
+
+	if (image.raster == NULL) {
+		void* mem = NULL;
+		if (posix_memalign(&mem, ALIGNMENT_BYTES, image.allocSize) != 0) {
+			printf("Unable to allocate memory for a %u x %u image\n", nbCols, nbRows);
+			exit(13);
+		}
+		image.raster = (unsigned char*) mem;
+		image.allocation = mem;
+		image.storage = IMAGE_HEAP;
+	}
+
+	return image;
+}
+
+//-----------------------------------------------------------
+//	First touch of the rows of an image by the workers that will
+//	process them
+//-----------------------------------------------------------
+static void touchRows(void* arg, unsigned int first, unsigned int end, unsigned int worker) {
+	ImageStruct* image = (ImageStruct*) arg;
+	memset(imageRow(image, first), 0, (size_t) (end - first) * image->bytesPerRow);
+}
+
+void placeImageRows(ImageStruct* image, ThreadPool* pool) {
+	if (image->storage != IMAGE_VIEW && threadPoolNodes(pool) > 1) {
+		runParallelRange(pool, image->nbRows, touchRows, image);
+	}
+}
+
+//-----------------------------------------------------------
+//	Makes a view on pixels owned by someone else
+//-----------------------------------------------------------
+ImageStruct imageView(ImageType type, unsigned int nbRows, unsigned int nbCols,
+					  int bytesPerRow, void* data)
+{
+	ImageStruct image;
+	image.type = type;
+	image.nbRows = nbRows;
+	image.nbCols = nbCols;
+	image.bytesPerPixel = bytesPerPixelOfType(type);
+	image.bytesPerRow = bytesPerRow;
+	image.raster = (unsigned char*) data;
+	image.storage = IMAGE_VIEW;
+	image.allocation = NULL;
+	image.allocSize = 0;
+	return image;
+}
+
+//-----------------------------------------------------------
+//	Allocates a copy of an image
+//-----------------------------------------------------------
+ImageStruct cloneImageStruct(const ImageStruct* image) {
+	ImageStruct copy = newImageStruct(image->type, image->nbRows, image->nbCols);
+	const size_t rowBytes = (size_t) image->nbCols * image->bytesPerPixel;
+	for (unsigned int i=0; i<image->nbRows; i++) {
+		memcpy(imageRow(&copy, i), imageRow(image, i), rowBytes);
+	}
+	return copy;
+}
+
+//-----------------------------------------------------------
+//	Reads or writes an image in the format given by its extension
+//-----------------------------------------------------------
+ImageStruct readImageFile(const char* filePath, ThreadPool* pool) {
+	double traceStart = traceClock();
+	ImageStruct image = isPNMFile(filePath) ? readPNM(filePath) : readTGAParallel(filePath, pool);
+	traceSpan("read image", "io", traceStart);
+	return image;
+}
+
+int tryReadImageFile(const char* filePath, ThreadPool* pool, ImageStruct* image) {
+	double traceStart = traceClock();
+	int err = isPNMFile(filePath) ? tryReadPNM(filePath, image) : tryReadTGA(filePath, pool, image);
+	traceSpan("read image", "io", traceStart);
+	return err;
+}
+
+int writeImageFile(const char* filePath, const ImageStruct* image) {
+	double traceStart = traceClock();
+	int err = isPNMFile(filePath) ? writePNM(filePath, image) : writeTGA(filePath, image);
+	traceSpan("write image", "io", traceStart);
+	return err;
+}
+
+//-----------------------------------------------------------
+//	Frees the raster of an image
+//-----------------------------------------------------------
+void deleteImageStruct(ImageStruct* image) {
+	if (image->storage == IMAGE_HEAP) {
+		free(image->allocation);
+	}
+	else if (image->storage == IMAGE_MAPPED) {
+		munmap(image->allocation, image->allocSize);
+	}
+	image->raster = NULL;
+	image->allocation = NULL;
+	image->allocSize = 0;
+	image->storage = IMAGE_VIEW;
+}
@@ -1,6 +1,10 @@
 #ifndef	FILE_IO_H
 #define	FILE_IO_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "ThreadPool.h"
+
 /**	This enumerated type is used by the image reading code.  You shouldn't have
  *	to touch this
  */
@@ -29,15 +33,49 @@ typedef enum ImageType
 		GRAY_RASTER,
 
 		/**	Monochrome image (either gray or one color channel of a color image)
-		 *	stored in a float raster
+		 *	stored in a float raster, with values in [0, 255]
+		 */
+		FLOAT_RASTER,
+
+		/**	Binary image with 1 byte per pixel: 0 (background) or 255 (foreground)
 		 */
-		FLOAT_RASTER
-			
+		MASK_RASTER
+
 } ImageType;
 
-/**	This is the data type to store all relevant information about an image.  After
- *	some thought, I have decided to store the 1D and 2D rasters as void* rather than
- *	having separate unsigned char and float pointers
+/**	Where the raster of an image comes from, which tells how to free it
+ */
+typedef enum ImageStorage
+{
+		/**	The image is a view on memory it does not own (a file mapping,
+		 *	a shared-memory frame, ...)
+		 */
+		IMAGE_VIEW,
+
+		/**	Allocated on the heap, aligned on ALIGNMENT_BYTES
+		 */
+		IMAGE_HEAP,
+
+		/**	Memory mapping: anonymous (backed by huge pages if the system
+		 *	allows) or of an image file
+		 */
+		IMAGE_MAPPED
+
+} ImageStorage;
+
+/**	Alignment of the raster and of every row of the images allocated by
+ *	newImageStruct (a cache line)
+ */
+#define ALIGNMENT_BYTES		64
+
+/**	Flag of setImageAllocationFlags: put large rasters on huge pages
+ */
+#define IMAGE_HUGE_PAGES	0x1
+
+/**	This is the data type to store all relevant information about an image.
+ *	The rows are stored one after the other, bytesPerRow apart, so row y starts
+ *	at raster + y*bytesPerRow.  Use the imageRow functions rather than computing
+ *	the address by hand.  Row 0 is the bottom row of the image, as in TGA files.
  */
 typedef	struct ImageStruct {
 	/**	Type of image stored
@@ -47,44 +85,159 @@ typedef	struct ImageStruct {
 	/**	Number of rows (height) of the image
 	 */
 	unsigned int nbRows;
-	
+
 	/**	Number of columns (width) of the image
 	 */
 	unsigned int nbCols;
-	
+
 	/**	Pixel depth
 	 */
 	unsigned int bytesPerPixel;
-	
-	/**	Number of bytes per row (which may be larger than
-	 *	bytesPerPixel * nbCols if rows are padded to a particular
-	 *	word length (e.g. multiple of 16 or 32))
+
+	/**	Number of bytes per row (the stride).  For the images allocated by
+	 *	newImageStruct it is bytesPerPixel * nbCols rounded up to a multiple of
+	 *	ALIGNMENT_BYTES, so that every row starts on a cache line.  A view on
+	 *	rows stored top row first (a mapped PGM file) has a negative stride.
 	 */
-	unsigned int bytesPerRow;
-	
-	/**	Pointer to the image data, cast to a void* pointer.  To
-	 *	access the data, you would have to cast the pointer to the
-	 *	proper type, e.g.
-	 *	<ul>
-	 *		<li><tt>(int*) raster</tt></li>
-	 *		<li><tt>(unsigned char*) raster</tt></li>
-	 *		<li><tt>(int*) raster</tt></li>
-	 *		<li><tt>(float*) raster</tt></li>
-	 *	</ul>
+	int bytesPerRow;
+
+	/**	Pointer to the first byte of row 0
 	 */
-	void* raster;
-	
-	/** Similarly here the 2D raster was cast to a void* pointer
-	 *  and would need to be cast back to the proper type to be used, e.g.
-	 *	<ul>
-	 *		<li><tt>(int**) raster</tt></li>
-	 *		<li><tt>(unsigned char**) raster</tt></li>
-	 *		<li><tt>(int**) raster</tt></li>
-	 *		<li><tt>(float**) raster</tt></li>
-	 *	</ul>
+	unsigned char* raster;
+
+	/**	How the raster was allocated
 	 */
-	void* raster2D;
+	ImageStorage storage;
+
+	/**	Start of the block allocated (or mapped) for the raster, which may
+	 *	precede row 0, e.g. when the pixels follow a file header (NULL for a view)
+	 */
+	void* allocation;
+
+	/**	Number of bytes allocated for the raster (0 for a view)
+	 */
+	size_t allocSize;
+
 } ImageStruct;
 
 
+/**	Pixel depth of an image type
+ *	@param	type	the image type
+ *	@return	the number of bytes of a pixel of that type
+ */
+unsigned int bytesPerPixelOfType(ImageType type);
+
+/**	Sets the flags applied to every subsequent newImageStruct allocation
+ *	@param	flags	0 or IMAGE_HUGE_PAGES
+ */
+void setImageAllocationFlags(int flags);
+
+/**	Allocates an image with aligned rows.  The content of the raster is
+ *	undefined; it is not touched, so its pages end up on the memory node of
+ *	the thread that first writes them.
+ *	@param	type	type of the image
+ *	@param	nbRows	number of rows
+ *	@param	nbCols	number of columns
+ *	@return	the new image (the function terminates execution on failure)
+ */
+ImageStruct newImageStruct(ImageType type, unsigned int nbRows, unsigned int nbCols);
+
+/**	Makes an image that refers to pixels it does not own
+ *	@param	type		type of the image
+ *	@param	nbRows		number of rows
+ *	@param	nbCols		number of columns
+ *	@param	bytesPerRow	distance in bytes between the starts of two rows
+ *						(negative when row 1 precedes row 0 in memory)
+ *	@param	data		address of the first pixel of row 0
+ *	@return	the view
+ */
+ImageStruct imageView(ImageType type, unsigned int nbRows, unsigned int nbCols,
+					  int bytesPerRow, void* data);
+
+/**	Writes every row of a newly allocated image from the worker that
+ *	processes that row in the parallel stages, so that its pages are placed
+ *	on the worker's NUMA node.  Does nothing unless the pool is pinned on
+ *	several nodes.  The pixels are cleared.
+ *	@param	image	the image, not written to yet
+ *	@param	pool	the pool that will process the image
+ */
+void placeImageRows(ImageStruct* image, ThreadPool* pool);
+
+/**	Allocates a copy of an image
+ *	@param	image	the image to copy
+ *	@return	a new image with the same type, size and pixels
+ */
+ImageStruct cloneImageStruct(const ImageStruct* image);
+
+/**	Reads an image file, in the format given by the extension of its name:
+ *	PGM/PPM (.pgm, .ppm, .pnm, see readPNM) or TGA (anything else, see
+ *	readTGAParallel)
+ *	@param	filePath	path to the file to read
+ *	@param	pool		workers that decode the rows of large TGA files (NULL
+ *						to decode on the calling thread)
+ *	@return	the image read (the function terminates execution on failure)
+ */
+ImageStruct readImageFile(const char* filePath, ThreadPool* pool);
+
+/**	Reads an image file like readImageFile, but returns instead of terminating
+ *	execution when the image cannot be read
+ *	@param	filePath	path to the file to read
+ *	@param	pool		workers that decode the rows of large TGA files
+ *	@param	image		receives the image read
+ *	@return	0 if the image was read, an error code otherwise
+ */
+int tryReadImageFile(const char* filePath, ThreadPool* pool, ImageStruct* image);
+
+/**	Writes an image file, in the format given by the extension of its name
+ *	@param	filePath	path to the file to write
+ *	@param	image		the image to write
+ *	@return	0 if the image was written, an error code otherwise
+ */
+int writeImageFile(const char* filePath, const ImageStruct* image);
+
+/**	Frees the raster of an image (does nothing for a view)
+ *	@param	image	the image to delete
+ */
+void deleteImageStruct(ImageStruct* image);
+
+/**	Returns the address of a row of an image
+ *	@param	image	the image
+ *	@param	y		index of the row
+ *	@return	address of the first byte of the row
+ */
+static inline unsigned char* imageRow(const ImageStruct* image, unsigned int y)
+{
+	return image->raster + (ptrdiff_t) y * image->bytesPerRow;
+}
+
+/**	Returns the address of a row of an RGBA32_RASTER image, as packed pixels
+ *	(red in the low byte)
+ *	@param	image	the image
+ *	@param	y		index of the row
+ *	@return	address of the first pixel of the row
+ */
+static inline uint32_t* imageRowRGBA(const ImageStruct* image, unsigned int y)
+{
+	return (uint32_t*) imageRow(image, y);
+}
+
+/**	Returns the address of a row of a FLOAT_RASTER image
+ *	@param	image	the image
+ *	@param	y		index of the row
+ *	@return	address of the first pixel of the row
+ */
+static inline float* imageRowFloat(const ImageStruct* image, unsigned int y)
+{
+	return (float*) imageRow(image, y);
+}
+
+/**	Converts the value of a FLOAT_RASTER pixel to a byte
+ *	@param	value	the value
+ *	@return	the value rounded and clamped to [0, 255]
+ */
+static inline unsigned char floatToByte(float value)
+{
+	return (value <= 0.f) ? 0 : (value >= 255.f) ? 255 : (unsigned char) (value + 0.5f);
+}
+
 #endif
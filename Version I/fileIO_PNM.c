@@ -0,0 +1,279 @@
+//
+//  fileIO_PNM.c
+//  Project
+//
+//  Binary PGM (P5) and PPM (P6) files.  Files are mapped rather than
+//  read, so an 8-bit P5 image can be handed to the kernels as it lies
+//  in the page cache.  The files store the top row first while row 0 of
+//  an image is the bottom row (as in TGA files), so the rows are taken
+//  and written in reverse order; the mapped P5 image starts at the last
+//  row of the file and steps back through it.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//
+#include "fileIO_PNM.h"
+
+//	Contents of a file, mapped or (for pipes and the like) read
+typedef struct FileBytes
+{
+	unsigned char* bytes;
+	size_t size;
+	int mapped;
+
+} FileBytes;
+
+//	Header of a P5/P6 file
+typedef struct PNMHeader
+{
+	int color;
+	unsigned int nbCols, nbRows, maxValue;
+	size_t dataOffset;
+
+} PNMHeader;
+
+//-----------------------------------------------------------
+//	File name test
+//-----------------------------------------------------------
+int isPNMFile(const char* filePath) {
+	const char* dot = strrchr(filePath, '.');
+	return dot != NULL && (strcasecmp(dot, ".pgm") == 0 || strcasecmp(dot, ".ppm") == 0 ||
+						   strcasecmp(dot, ".pnm") == 0);
+}
+
+//	Maps a whole file, or reads it when it cannot be mapped
+static int loadFile(const char* filePath, FileBytes* file) {
+	int fd = open(filePath, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	struct stat info;
+	file->mapped = 0;
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+		void* mem = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mem != MAP_FAILED) {
+			madvise(mem, info.st_size, MADV_SEQUENTIAL);
+			file->bytes = (unsigned char*) mem;
+			file->size = info.st_size;
+			file->mapped = 1;
+		}
+	}
+
+	if (!file->mapped) {
+		size_t capacity = 1 << 16;
+		file->bytes = (unsigned char*) malloc(capacity);
+		file->size = 0;
+		ssize_t nbRead;
+		while (file->bytes != NULL &&
+			   (nbRead = read(fd, file->bytes + file->size, capacity - file->size)) > 0) {
+			file->size += nbRead;
+			if (file->size == capacity) {
+				capacity *= 2;
+				file->bytes = (unsigned char*) realloc(file->bytes, capacity);
+			}
+		}
+		if (file->bytes == NULL) {
+			printf("Unable to allocate memory\n");
+			close(fd);
+			exit(13);
+		}
+	}
+	close(fd);
+	return 1;
+}
+
+static void unloadFile(FileBytes* file) {
+	if (file->mapped) {
+		munmap(file->bytes, file->size);
+	}
+	else {
+		free(file->bytes);
+	}
+}
+
+//	Reads one unsigned number of the header, skipping blanks and comments
+static int readHeaderNumber(const FileBytes* file, size_t* pos, unsigned int* value) {
+	while (*pos < file->size) {
+		if (file->bytes[*pos] == '#') {
+			while (*pos < file->size && file->bytes[*pos] != '\n') {
+				(*pos)++;
+			}
+		}
+		else if (isspace(file->bytes[*pos])) {
+			(*pos)++;
+		}
+		else {
+			break;
+		}
+	}
+	if (*pos >= file->size || !isdigit(file->bytes[*pos])) {
+		return 0;
+	}
+	unsigned long number = 0;
+	while (*pos < file->size && isdigit(file->bytes[*pos]) && number <= 0xFFFFFF) {
+		number = 10*number + (file->bytes[(*pos)++] - '0');
+	}
+	*value = (unsigned int) number;
+	return 1;
+}
+
+static int parseHeader(const FileBytes* file, PNMHeader* header) {
+	if (file->size < 2 || file->bytes[0] != 'P' || (file->bytes[1] != '5' && file->bytes[1] != '6')) {
+		return 0;
+	}
+	header->color = (file->bytes[1] == '6');
+	size_t pos = 2;
+	if (!readHeaderNumber(file, &pos, &header->nbCols) ||
+		!readHeaderNumber(file, &pos, &header->nbRows) ||
+		!readHeaderNumber(file, &pos, &header->maxValue)) {
+		return 0;
+	}
+	//	exactly one blank separates the header from the pixels
+	if (pos >= file->size || !isspace(file->bytes[pos])) {
+		return 0;
+	}
+	header->dataOffset = pos + 1;
+	return header->maxValue > 0;
+}
+
+//-----------------------------------------------------------
+//	Reads a P5 or P6 file
+//-----------------------------------------------------------
+ImageStruct readPNM(const char* filePath) {
+	ImageStruct image;
+	int err = tryReadPNM(filePath, &image);
+	if (err != 0) {
+		exit(err);
+	}
+	return image;
+}
+
+int tryReadPNM(const char* filePath, ImageStruct* result) {
+	FileBytes file;
+	if (!loadFile(filePath, &file)) {
+		printf("Cannot open image file %s\n", filePath);
+		return 11;
+	}
+
+	PNMHeader header;
+	if (!parseHeader(&file, &header) || header.maxValue > 255) {
+		printf("Unsupported PGM/PPM image %s: ", filePath);
+		printf("it must be binary (P5 or P6) with at most 8 bits per sample.\n");
+		unloadFile(&file);
+		return 12;
+	}
+	const unsigned int samplesPerPixel = header.color ? 3 : 1;
+	const size_t fileBytesPerRow = (size_t) samplesPerPixel * header.nbCols;
+	if (file.size - header.dataOffset < fileBytesPerRow * header.nbRows) {
+		printf("Image file %s is truncated\n", filePath);
+		unloadFile(&file);
+		return 14;
+	}
+	const unsigned char* data = file.bytes + header.dataOffset;
+
+	//	8-bit gray file: the image is the mapping itself, bottom row first
+	if (!header.color && header.maxValue == 255 && file.mapped) {
+		const unsigned char* bottomRow = data + (header.nbRows > 0 ? header.nbRows - 1 : 0) * fileBytesPerRow;
+		ImageStruct image = imageView(GRAY_RASTER, header.nbRows, header.nbCols,
+									  -(int) header.nbCols, (void*) bottomRow);
+		image.storage = IMAGE_MAPPED;
+		image.allocation = file.bytes;
+		image.allocSize = file.size;
+		*result = image;
+		return 0;
+	}
+
+	ImageStruct image = newImageStruct(header.color ? RGBA32_RASTER : GRAY_RASTER,
+									   header.nbRows, header.nbCols);
+	for (unsigned int i=0; i<header.nbRows; i++) {
+		const unsigned char* src = data + i*fileBytesPerRow;
+		const unsigned int y = header.nbRows - 1 - i;
+		unsigned char* dest = imageRow(&image, y);
+		if (header.color) {
+			for (unsigned int j=0; j<header.nbCols; j++, src+=3, dest+=4) {
+				dest[0] = src[0];
+				dest[1] = src[1];
+				dest[2] = src[2];
+				dest[3] = 0xFF;
+			}
+		}
+		else {
+			memcpy(dest, src, header.nbCols);
+		}
+		//	rescale the samples of a file with a smaller maximum value
+		if (header.maxValue != 255) {
+			dest = imageRow(&image, y);
+			for (unsigned int j=0; j<image.nbCols*image.bytesPerPixel; j++) {
+				if (!header.color || (j & 3) != 3) {
+					unsigned int sample = dest[j] <= header.maxValue ? dest[j] : header.maxValue;
+					dest[j] = (unsigned char) ((sample*255 + header.maxValue/2) / header.maxValue);
+				}
+			}
+		}
+	}
+
+	unloadFile(&file);
+	*result = image;
+	return 0;
+}
+
+//-----------------------------------------------------------
+//	Writes a P5 or P6 file
+//-----------------------------------------------------------
+int writePNM(const char* filePath, const ImageStruct* image) {
+	if (image->type != RGBA32_RASTER && image->type != GRAY_RASTER &&
+		image->type != MASK_RASTER && image->type != FLOAT_RASTER) {
+		printf("Image type not supported for output\n");
+		return 22;
+	}
+	FILE* out = fopen(filePath, "wb");
+	if (out == NULL) {
+		printf("Cannot create image file %s \n", filePath);
+		return 21;
+	}
+
+	const int color = (image->type == RGBA32_RASTER);
+	const size_t fileBytesPerRow = (size_t) (color ? 3 : 1) * image->nbCols;
+	unsigned char* rowBuffer = (unsigned char*) malloc(fileBytesPerRow > 0 ? fileBytesPerRow : 1);
+	if (rowBuffer == NULL) {
+		printf("Unable to allocate memory\n");
+		fclose(out);
+		return 23;
+	}
+
+	fprintf(out, "P%c\n%u %u\n255\n", color ? '6' : '5', image->nbCols, image->nbRows);
+	for (unsigned int i=0; i<image->nbRows; i++) {
+		const unsigned int y = image->nbRows - 1 - i;
+		const unsigned char* row = imageRow(image, y);
+		if (color) {
+			unsigned char* dest = rowBuffer;
+			for (unsigned int j=0; j<image->nbCols; j++, row+=4, dest+=3) {
+				dest[0] = row[0];
+				dest[1] = row[1];
+				dest[2] = row[2];
+			}
+			row = rowBuffer;
+		}
+		else if (image->type == FLOAT_RASTER) {
+			const float* src = imageRowFloat(image, y);
+			for (unsigned int j=0; j<image->nbCols; j++) {
+				rowBuffer[j] = floatToByte(src[j]);
+			}
+			row = rowBuffer;
+		}
+		fwrite(row, 1, fileBytesPerRow, out);
+	}
+
+	free(rowBuffer);
+	int err = ferror(out) ? 23 : 0;
+	fclose(out);
+	return err;
+}
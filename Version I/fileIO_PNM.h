@@ -0,0 +1,43 @@
+#ifndef	FILE_IO_PNM_H
+#define	FILE_IO_PNM_H
+
+#include "fileIO.h"
+
+/**	Tells whether a file name has a PGM/PPM extension (.pgm, .ppm or .pnm,
+ *	in any case)
+ *	@param	filePath	the file name
+ *	@return	1 for a PGM/PPM file name, 0 otherwise
+ */
+int isPNMFile(const char* filePath);
+
+/**	Reads an image file in the binary PGM (P5) or PPM (P6) format, with at most
+ *	8 bits per sample.  The file is mapped in memory.  An 8-bit P5 file with a
+ *	maximum value of 255 is not converted at all: the image returned is a
+ *	GRAY_RASTER that refers to the pixels of the mapping, read-only: its row 0
+ *	is the last row of the file and its stride is -nbCols.  Otherwise the rows
+ *	are copied in reverse order, so that row 0 is the bottom row as for a TGA
+ *	file.  A P6 file is expanded to RGBA32_RASTER.  If the image cannot be
+ *	read the function simply terminates execution.
+ *	@param	filePath	path to the file to read
+ *	@return	the image read, to be freed with deleteImageStruct
+ */
+ImageStruct readPNM(const char* filePath);
+
+/**	Reads a PGM/PPM file like readPNM, but returns instead of terminating
+ *	execution when the image cannot be read
+ *	@param	filePath	path to the file to read
+ *	@param	image		receives the image read
+ *	@return	0 if the image was read, an error code otherwise
+ */
+int tryReadPNM(const char* filePath, ImageStruct* image);
+
+/**	Writes an image in the binary PGM (P5) format for gray-level images, masks
+ *	and float rasters, or PPM (P6) for color images.  Row 0 of the image is
+ *	written last, at the bottom of the picture.
+ *	@param	filePath	path to the file to write
+ *	@param	image		the image to write
+ *	@return	0 if the image was written, an error code otherwise
+ */
+int writePNM(const char* filePath, const ImageStruct* image);
+
+#endif
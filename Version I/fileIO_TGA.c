@@ -17,45 +17,102 @@
 
 #include <stdlib.h>        
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "fileIO_TGA.h"
 
 
-void swapRGB(unsigned char* theData, int nbRows, int nbCols);
-void swapRGBA(unsigned char* theData, int nbRows, int nbCols);
-
-
 //----------------------------------------------------------------------
-//	Utility function for memory swapping
+//	Utility function for pixel conversion
 //	Used because TGA stores the RGB data in reverse order (BGR)
 //----------------------------------------------------------------------
-void swapRGB(unsigned char* theData, int nbRows, int nbCols)
+static void convertBGRRowToRGBA(const unsigned char* src, unsigned char* dest, unsigned int nbCols)
 {
-	int			imgSize;
-	unsigned char tmp;
-
-	imgSize = nbRows*nbCols;
-
-	for(int k = 0; k < imgSize; k++)
+	for (unsigned int j=0; j<nbCols; j++)
 	{
-		tmp = theData[k*3+2];
-		theData[k*3+2] = theData[k*3];
-		theData[k*3] = tmp;
+		dest[0] = src[2];
+		dest[1] = src[1];
+		dest[2] = src[0];
+		dest[3] = 0xFF;
+		dest += 4;
+		src += 3;
 	}
 }
 
-void swapRGBA(unsigned char* theData, int nbRows, int nbCols)
+//	Files smaller than this are decoded by the calling thread only
+#define PARALLEL_DECODE_BYTES	(1UL << 20)
+
+//	Size of the buffer of positional reads of a decoding worker
+#define DECODE_CHUNK_BYTES		(256UL << 10)
+
+//	A range of rows of a TGA file decoded by one worker
+typedef struct DecodeJob
+{
+	int fd;
+	off_t dataOffset;
+	size_t fileBytesPerRow;
+	int topDown;
+	ImageStruct* image;
+	int failed;
+
+} DecodeJob;
+
+//----------------------------------------------------------------------
+//	Decodes the file rows [first, end): they are read a chunk at a time
+//	with pread, then converted (and flipped) into their image rows
+//----------------------------------------------------------------------
+static void decodeRows(void* arg, unsigned int first, unsigned int end, unsigned int worker)
 {
-    int imgSize;
-    unsigned char temp;
-    
-    imgSize = nbRows*nbCols;
-    
-    for(int k=0; k<imgSize; k++){
-        temp = theData[k*4+2];
-        theData[k*4+2] = theData[k*4];
-        theData[k*4] = temp;
-    }
+	DecodeJob* job = (DecodeJob*) arg;
+	ImageStruct* image = job->image;
+	if (first >= end)
+		return;
+
+	unsigned int rowsPerChunk = DECODE_CHUNK_BYTES / job->fileBytesPerRow;
+	if (rowsPerChunk == 0)
+		rowsPerChunk = 1;
+	if (rowsPerChunk > end - first)
+		rowsPerChunk = end - first;
+	unsigned char* chunk = (unsigned char*) malloc(rowsPerChunk * job->fileBytesPerRow);
+	if (chunk == NULL)
+	{
+		job->failed = 13;
+		return;
+	}
+
+	for (unsigned int i=first; i<end; i+=rowsPerChunk)
+	{
+		unsigned int nbChunkRows = (end - i < rowsPerChunk) ? end - i : rowsPerChunk;
+		size_t nbBytes = nbChunkRows * job->fileBytesPerRow;
+		off_t offset = job->dataOffset + (off_t) i * job->fileBytesPerRow;
+		size_t done = 0;
+		while (done < nbBytes)
+		{
+			ssize_t n = pread(job->fd, chunk + done, nbBytes - done, offset + done);
+			if (n <= 0)
+			{
+				job->failed = 14;
+				free(chunk);
+				return;
+			}
+			done += n;
+		}
+
+		for (unsigned int k=0; k<nbChunkRows; k++)
+		{
+			unsigned int fileRow = i + k;
+			unsigned char* dest = imageRow(image, job->topDown ? image->nbRows - 1 - fileRow : fileRow);
+			const unsigned char* src = chunk + k * job->fileBytesPerRow;
+			if (image->type == RGBA32_RASTER)
+				convertBGRRowToRGBA(src, dest, image->nbCols);
+			else
+				memcpy(dest, src, image->nbCols);
+		}
+	}
+	free(chunk);
 }
 
 // ---------------------------------------------------------------------
@@ -63,134 +120,140 @@ void swapRGBA(unsigned char* theData, int nbRows, int nbCols)
 //	Description :
 //	
 //	This function reads an image of type TGA (8 or 24 bits, uncompressed
+//	into an image with aligned rows (see newImageStruct).
 //	
 //----------------------------------------------------------------------
 
 ImageStruct readTGA(const char* filePath)
+{
+	return readTGAParallel(filePath, NULL);
+}
+
+// ---------------------------------------------------------------------
+//	Function : readTGAParallel 
+//	Description :
+//	
+//	Since the file is uncompressed, the offset of every row is known
+//	from the header.  Large files are split into row ranges, each read
+//	with positional reads and converted by a different worker, which is
+//	also the first to touch its rows of the image.
+//	
+//----------------------------------------------------------------------
+
+ImageStruct readTGAParallel(const char* filePath, ThreadPool* pool)
 {
 	ImageStruct info;
+	int err = tryReadTGA(filePath, pool, &info);
+	if (err != 0)
+		exit(err);
+	return info;
+}
+
+// ---------------------------------------------------------------------
+//	Function : tryReadTGA 
+//	Description :
+//	
+//	The reader proper: same as readTGAParallel, but failures are
+//	returned to the caller.
+//	
+//----------------------------------------------------------------------
 
+int tryReadTGA(const char* filePath, ThreadPool* pool, ImageStruct* image)
+{
 	//--------------------------------
 	//	open TARGA input file
 	//--------------------------------
-	FILE* tga_in = fopen(filePath, "rb" );
-	if (tga_in == NULL)
+	int fd = open(filePath, O_RDONLY);
+	if (fd < 0)
 	{
 		printf("Cannot open image file %s\n", filePath);
-		exit(11);
+		return 11;
 	}
 
 	//--------------------------------
 	//	Read the header (TARGA file)
 	//--------------------------------
-	char	head[18] ;
-	fread( head, sizeof(char), 18, tga_in ) ;
+	unsigned char	head[18] ;
+	if (pread(fd, head, 18, 0) != 18)
+	{
+		printf("Cannot read the header of image file %s\n", filePath);
+		close(fd);
+		return 14;
+	}
 	/* Get the size of the image */
-	info.nbCols = (int)(((unsigned int)head[12]&0xFF) | (unsigned int)head[13]*256);
-	info.nbRows = (int)(((unsigned int)head[14]&0xFF) | (unsigned int)head[15]*256);
-	unsigned int imgSize = info.nbRows * info.nbCols;
+	unsigned int nbCols = head[12] | (head[13] << 8);
+	unsigned int nbRows = head[14] | (head[15] << 8);
 
-	unsigned char* data;
-	unsigned char** data2D;
+	ImageType type;
+	unsigned int fileBytesPerPixel;
 	if((head[2] == 2) && (head[16] == 24))
 	{
-		info.type = RGBA32_RASTER;
-		info.bytesPerPixel = 4;
-		info.bytesPerRow = 4*info.nbCols;
-		data = (unsigned char*) malloc(imgSize*4);
+		type = RGBA32_RASTER;
+		fileBytesPerPixel = 3;
 	}
 	else if((head[2] == 3) && (head[16] == 8))
 	{
-		info.type = GRAY_RASTER;
-		info.bytesPerPixel = 1;
-		info.bytesPerRow = info.nbCols;
-		data = (unsigned char*) malloc(imgSize);
+		type = GRAY_RASTER;
+		fileBytesPerPixel = 1;
 	}
 	else
 	{
 		printf("Unsuported TGA image: ");
 		printf("Its type is %d and it has %d bits per pixel.\n", head[2], head[16]);
 		printf("The image must be uncompressed while having 8 or 24 bits per pixel.\n");
-		fclose(tga_in);
-		exit(12);
+		close(fd);
+		return 12;
 	}
 
-	if(data == NULL)
-	{
-		printf("Unable to allocate memory\n");
-		fclose(tga_in);
-		exit(13);
-	}
-	
-	data2D = (unsigned char**) malloc(info.nbRows*sizeof(unsigned char*));
-	for (unsigned int i=0; i<info.nbRows; i++)
+	//	the pixels follow the header and the image ID field, if any
+	DecodeJob job;
+	job.fd = fd;
+	job.dataOffset = 18 + head[0];
+	job.fileBytesPerRow = (size_t) fileBytesPerPixel * nbCols;
+	//	If the image is mirrored vertically (a bit setting in the header), the
+	//	first row of the file is the top row of the image
+	job.topDown = (head[17] & 0x20) != 0;
+	job.failed = 0;
+
+	struct stat fileInfo;
+	size_t dataBytes = job.fileBytesPerRow * nbRows;
+	if (fstat(fd, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) &&
+		(size_t) fileInfo.st_size < job.dataOffset + dataBytes)
 	{
-		data2D[i] = data + i*info.bytesPerRow;
+		printf("Image file %s is truncated\n", filePath);
+		close(fd);
+		return 14;
 	}
 
-	info.raster = (void*) data;
-	info.raster2D = (void*) data2D;
-	
+	ImageStruct info = newImageStruct(type, nbRows, nbCols);
+	job.image = &info;
+
+	//	The bands decoded in parallel are first written by their workers
+	//	already; a small file decoded here still gets its rows placed
+	if (dataBytes < PARALLEL_DECODE_BYTES)
+		placeImageRows(&info, pool);
+
 	//--------------------------------
 	//	Read the pixel data
 	//--------------------------------
+	if (nbCols > 0)
+		runParallelRange(dataBytes >= PARALLEL_DECODE_BYTES ? pool : NULL, nbRows, decodeRows, &job);
+	close(fd);
 
-	//	Case of a color image
-	//------------------------	
-	if (info.type == kTGA_COLOR)
+	if (job.failed == 13)
 	{
-		//	First check if the image is mirrored vertically (a bit setting in the header)
-		if(head[17]&0x20)
-		{
-			unsigned char* ptr = data + imgSize*4 - info.bytesPerRow;
-			for(int i = 0; i < info.nbRows; i++)
-			{
-                for (int j=0; j<info.nbCols; j++)
-                {
-                    fread(ptr, 3*sizeof(char), 1, tga_in);
-					ptr -= 4;
-                }
-			}
-		}
-		else
-        {
-            unsigned char* dest = data;
-            for (int i=0; i<info.nbRows; i++)
-            {
-                for (int j=0; j<info.nbCols; j++)
-                {
-                    fread(dest, 3*sizeof(char), 1, tga_in);
-                    dest+=4;
-                }
-            }
-			
-        }
-        
-        //  tga files store color information in the order B-G-R
-        //  we need to swap the Red and Blue components
-    	swapRGBA(data, info.nbRows, info.nbCols);
+		printf("Unable to allocate memory\n");
+		deleteImageStruct(&info);
+		return 13;
 	}
-
-	//	Case of a gray-level image
-	//----------------------------	
-	else
+	else if (job.failed != 0)
 	{
-		//	First check if the image is mirrored vertically (a bit setting in the header)
-		if(head[17]&0x20)
-		{
-			unsigned char* ptr = data + imgSize - info.nbCols;
-			for(int i = 0; i < info.nbRows; i++)
-			{
-				fread( ptr, sizeof(char), info.nbCols, tga_in ) ;
-				ptr -= info.nbCols;
-			}
-		}
-		else
-			fread(data, sizeof(char), imgSize, tga_in);
+		printf("Image file %s is truncated\n", filePath);
+		deleteImageStruct(&info);
+		return 14;
 	}
-
-	fclose( tga_in) ;
-	return info;
+	*image = info;
+	return 0;
 }	
 
 
@@ -202,7 +265,7 @@ ImageStruct readTGA(const char* filePath)
 //	
 //	Return value: Error code (0 = no error)
 //----------------------------------------------------------------------*/ 
-int writeTGA(char* filePath, ImageStruct* info)
+int writeTGA(const char* filePath, const ImageStruct* info)
 {
 	//--------------------------------
 	// open TARGA output file 
@@ -243,25 +306,37 @@ int writeTGA(char* filePath, ImageStruct* info)
 		head[17] = 0 ;		  					// Image descriptor bits ;
 		fwrite( head, sizeof(char), 18, tga_out );
 
-		unsigned char* data  = (unsigned char*) info->raster;
-		for(int i = 0; i < info->nbRows; i++)
+		//	Each row is converted to B-G-R in a buffer and written in one call
+		unsigned char* rowBuffer = (unsigned char*) malloc(3*info->nbCols);
+		if (rowBuffer == NULL)
+		{
+			printf("Unable to allocate memory\n");
+			fclose(tga_out);
+			return 23;
+		}
+		for(unsigned int i = 0; i < info->nbRows; i++)
 		{
-			unsigned long offset = i*4*info->nbCols;
-			for(int j = 0; j < info->nbCols; j++)
+			const unsigned char* src = imageRow(info, i);
+			unsigned char* dest = rowBuffer;
+			for(unsigned int j = 0; j < info->nbCols; j++)
 			{
-				fwrite(&data[offset+2], sizeof(char), 1, tga_out);
-				fwrite(&data[offset+1], sizeof(char), 1, tga_out);
-				fwrite(&data[offset], sizeof(char), 1, tga_out);
-				offset+=4;
+				dest[0] = src[2];
+				dest[1] = src[1];
+				dest[2] = src[0];
+				dest += 3;
+				src += 4;
 			}
+			fwrite(rowBuffer, sizeof(char), 3*info->nbCols, tga_out);
 		}
+		free(rowBuffer);
 
 		fclose( tga_out ) ;
 	}
 	//------------------------------
 	//	Case of a gray-level image
+	//	(masks and float rasters are written as gray levels)
 	//------------------------------
-	else if (info->type == GRAY_RASTER)
+	else if (info->type == GRAY_RASTER || info->type == MASK_RASTER || info->type == FLOAT_RASTER)
 	{
 		//--------------------------------
 		// create the header (TARGA file)
@@ -283,11 +358,30 @@ int writeTGA(char* filePath, ImageStruct* info)
 		head[17] = 0 ;		  					// Image descriptor bits ;
 		fwrite( head, sizeof(char), 18, tga_out );
 
-		unsigned char* data  = (unsigned char*) info->raster;
-		for(int i = 0; i < info->nbRows; i++)
+		unsigned char* rowBuffer = NULL;
+		if (info->type == FLOAT_RASTER)
+		{
+			rowBuffer = (unsigned char*) malloc(info->nbCols);
+			if (rowBuffer == NULL)
+			{
+				printf("Unable to allocate memory\n");
+				fclose(tga_out);
+				return 23;
+			}
+		}
+		for(unsigned int i = 0; i < info->nbRows; i++)
 		{
-			fwrite(&data[i*info->nbCols], sizeof(char), info->nbCols, tga_out);
+			const unsigned char* row = imageRow(info, i);
+			if (info->type == FLOAT_RASTER)
+			{
+				const float* src = imageRowFloat(info, i);
+				for (unsigned int j = 0; j < info->nbCols; j++)
+					rowBuffer[j] = floatToByte(src[j]);
+				row = rowBuffer;
+			}
+			fwrite(row, sizeof(char), info->nbCols, tga_out);
 		}
+		free(rowBuffer);
 
 		fclose( tga_out ) ;
 	}
@@ -302,3 +396,104 @@ int writeTGA(char* filePath, ImageStruct* info)
 	return 0;
 }	
 
+
+
+//---------------------------------------------------------------------*
+//	Function : openTGAStream
+//	Description :
+//
+//	 Reads the header of a TGA file (8 or 24 bits, uncompressed) and
+//	 prepares to read its pixel data a band of rows at a time.
+//
+//	Return value: Error code (0 = no error)
+//----------------------------------------------------------------------*/
+int openTGAStream(const char* filePath, TGAStream* stream)
+{
+	stream->file = fopen(filePath, "rb");
+	if (stream->file == NULL)
+	{
+		printf("Cannot open image file %s\n", filePath);
+		return 11;
+	}
+
+	unsigned char head[18];
+	if (fread(head, sizeof(char), 18, stream->file) != 18)
+	{
+		printf("Cannot read the header of image file %s\n", filePath);
+		fclose(stream->file);
+		return 14;
+	}
+	stream->nbCols = head[12] | (head[13] << 8);
+	stream->nbRows = head[14] | (head[15] << 8);
+	stream->topDown = (head[17] & 0x20) != 0;
+	stream->rowsRead = 0;
+
+	if ((head[2] == 2) && (head[16] == 24))
+	{
+		stream->type = RGBA32_RASTER;
+		stream->fileBytesPerPixel = 3;
+	}
+	else if ((head[2] == 3) && (head[16] == 8))
+	{
+		stream->type = GRAY_RASTER;
+		stream->fileBytesPerPixel = 1;
+	}
+	else
+	{
+		printf("Unsuported TGA image: ");
+		printf("Its type is %d and it has %d bits per pixel.\n", head[2], head[16]);
+		fclose(stream->file);
+		return 12;
+	}
+
+	//	skip the image ID field, if any
+	if (head[0] != 0)
+		fseek(stream->file, head[0], SEEK_CUR);
+
+	stream->fileRow = (unsigned char*) malloc(stream->fileBytesPerPixel*stream->nbCols);
+	if (stream->fileRow == NULL)
+	{
+		printf("Unable to allocate memory\n");
+		fclose(stream->file);
+		return 13;
+	}
+
+	return 0;
+}
+
+unsigned int readTGAStreamRows(TGAStream* stream, ImageStruct* band)
+{
+	unsigned int nbRead = 0;
+	while (nbRead < band->nbRows && stream->rowsRead < stream->nbRows)
+	{
+		unsigned char* row = imageRow(band, nbRead);
+		if (stream->type == GRAY_RASTER)
+		{
+			if (fread(row, sizeof(char), stream->nbCols, stream->file) != stream->nbCols)
+				break;
+		}
+		else
+		{
+			if (fread(stream->fileRow, 3*sizeof(char), stream->nbCols, stream->file) != stream->nbCols)
+				break;
+			convertBGRRowToRGBA(stream->fileRow, row, stream->nbCols);
+		}
+		nbRead++;
+		stream->rowsRead++;
+	}
+
+	return nbRead;
+}
+
+unsigned int tgaStreamRowY(const TGAStream* stream, unsigned int fileRow)
+{
+	return stream->topDown ? stream->nbRows - 1 - fileRow : fileRow;
+}
+
+void closeTGAStream(TGAStream* stream)
+{
+	fclose(stream->file);
+	free(stream->fileRow);
+	stream->file = NULL;
+	stream->fileRow = NULL;
+}
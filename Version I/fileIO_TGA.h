@@ -1,7 +1,9 @@
 #ifndef	FILE_IO_TGA_H
 #define	FILE_IO_TGA_H
 
+#include <stdio.h>
 #include "fileIO.h"
+#include "ThreadPool.h"
 
 /**	No-frills function that reads an image file in the <b>uncompressed</b>, un-commented TARGA 
  *	(<tt>.tga</tt>) file format. If the image cannot be read (file not found, invalid format, etc.)
@@ -11,11 +13,94 @@
  */
 ImageStruct readTGA(const char* filePath);
 
+/**	Reads an <b>uncompressed</b> TARGA file like readTGA, but splits the rows of a large
+ *	file into one range per worker of a pool: each worker reads its rows with positional
+ *	reads and converts them (flipping them if the file is stored top to bottom).
+ *	@param	filePath	path to the file to read
+ *	@param	pool		workers to use (NULL to decode on the calling thread)
+ *	@return	 a properly initialized ImageStruct storing the image read
+ */
+ImageStruct readTGAParallel(const char* filePath, ThreadPool* pool);
+
+/**	Reads a TARGA file like readTGAParallel, but returns instead of terminating
+ *	execution when the image cannot be read
+ *	@param	filePath	path to the file to read
+ *	@param	pool		workers to use (NULL to decode on the calling thread)
+ *	@param	image		receives the image read
+ *	@return	0 if the image was read, an error code otherwise
+ */
+int tryReadTGA(const char* filePath, ThreadPool* pool, ImageStruct* image);
+
 /**	Writes an image file in the <b>uncompressed</b>, un-commented TARGA (<tt>.tga</tt>) file format.
  *	@param	filePath	path to the file to write
  *	@param  info		pointer to the ImageStruct of the image to write into a .tga file.
  *	@return 1 if the image was read successfully, 0 otherwise.
  */
-int writeTGA(char* filePath, ImageStruct* info);
+int writeTGA(const char* filePath, const ImageStruct* info);
+
+/**	State of a TGA file being read a few rows at a time (see openTGAStream)
+ */
+typedef struct TGAStream
+{
+	/**	The file being read
+	 */
+	FILE* file;
+
+	/**	Type of the rows returned (RGBA32_RASTER or GRAY_RASTER)
+	 */
+	ImageType type;
+
+	/**	Dimensions of the image
+	 */
+	unsigned int nbRows, nbCols;
+
+	/**	Number of bytes of a pixel in the file (3 or 1)
+	 */
+	unsigned int fileBytesPerPixel;
+
+	/**	1 if the file stores its rows top to bottom (bit 0x20 of the
+	 *	descriptor), in which case file row k is image row nbRows-1-k
+	 */
+	int topDown;
+
+	/**	Number of rows already read
+	 */
+	unsigned int rowsRead;
+
+	/**	Buffer for one row of the file
+	 */
+	unsigned char* fileRow;
+
+} TGAStream;
+
+/**	Opens an <b>uncompressed</b> TGA file to read its rows a band at a time, without
+ *	ever loading the whole image.
+ *	@param	filePath	path to the file to read
+ *	@param	stream		the stream to initialize
+ *	@return	0 if the file was opened, an error code otherwise
+ */
+int openTGAStream(const char* filePath, TGAStream* stream);
+
+/**	Reads the next rows of a TGA stream, in file order, converted to the layout
+ *	readTGA would produce (RGBA for color files).
+ *	@param	stream	the stream to read from
+ *	@param	band	image (of the stream's type and width) that receives the
+ *					rows, from its row 0; at most band->nbRows rows are read
+ *	@return	the number of rows read (0 at the end of the image)
+ */
+unsigned int readTGAStreamRows(TGAStream* stream, ImageStruct* band);
+
+/**	Returns the image row (y coordinate in the raster readTGA would produce) of
+ *	a row of the file.
+ *	@param	stream		the stream
+ *	@param	fileRow		index of the row in the file
+ *	@return	its y coordinate in the image
+ */
+unsigned int tgaStreamRowY(const TGAStream* stream, unsigned int fileRow);
+
+/**	Closes a TGA stream
+ *	@param	stream	the stream to close
+ */
+void closeTGAStream(TGAStream* stream);
 
 #endif
@@ -0,0 +1,219 @@
+/*
+ **********************************************************************************
+ * File: formatCheck.c
+ *..................................................................................
+ * Checks that an image gives the same pixels and the same blobs whether it
+ *  is read from a TGA file or from a PGM/PPM copy of it.
+ *
+ *  formatCheck BACKGROUND.tga FRAME.tga [DIR]
+ *
+ * Both images are written to DIR (default /tmp) as PPM and as PGM (their
+ *  grey planes), top row first as the formats store them, and read back:
+ *  every row must match the TGA image, whose row 0 is the bottom row, and
+ *  writePNM must give the same files.  The frame is then detected against
+ *  the background for each mix of formats, and the blobs must be those of
+ *  the two TGA files.  Prints one line per check and returns 1 on a
+ *  mismatch.
+ *=====================================================================================
+ *  gcc -O2 -Wall formatCheck.c Subtraction.c Labeling.c Blob.c StageMetrics.c \
+ *      fileIO.c fileIO_TGA.c fileIO_PNM.c BitMask.c Threshold.c ThreadPool.c \
+ *      Trace.c -lm -lGL -lpthread -o formatCheck
+ *
+ **********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//-----------------------
+#include "Subtraction.h"
+#include "Labeling.h"
+
+// Images of one file in each format
+typedef struct FormatSet {
+    ImageStruct tga, ppm, pgm;
+} FormatSet;
+
+static int nbFailures = 0;
+
+static void report(const char* what, int ok) {
+    printf("%-40s %s\n", what, ok ? "ok" : "MISMATCH");
+    nbFailures += !ok;
+}
+
+// Grey plane of a color image, with the grey formula of the detection
+static ImageStruct greyPlaneOf(const ImageStruct* image) {
+    ImageStruct grey = newImageStruct(GRAY_RASTER, image->nbRows, image->nbCols);
+    for (unsigned int i = 0; i < image->nbRows; i++)
+        convertRowToGrey(image->type, GREY_MEAN, imageRow(image, i), image->nbCols,
+                         imageRow(&grey, i));
+    return grey;
+}
+
+// Index of the first row that differs in the first bytesPerPixel bytes of
+//  each pixel (3 for color: the alpha of a PPM is always 255), or nbRows
+static unsigned int firstDifferentRow(const ImageStruct* a, const ImageStruct* b,
+                                      unsigned int bytesPerPixel) {
+    if (a->nbRows != b->nbRows || a->nbCols != b->nbCols)
+        return 0;
+    for (unsigned int i = 0; i < a->nbRows; i++) {
+        const unsigned char* rowA = imageRow(a, i);
+        const unsigned char* rowB = imageRow(b, i);
+        for (unsigned int j = 0; j < a->nbCols; j++)
+            if (memcmp(rowA + j * a->bytesPerPixel, rowB + j * b->bytesPerPixel, bytesPerPixel) != 0)
+                return i;
+    }
+    return a->nbRows;
+}
+
+// Writes an image as a PPM (color) or PGM file by hand, in the order of
+//  the format: top row first, i.e. row 0 of the image last
+static void writeReference(const char* path, const ImageStruct* image) {
+    FILE* out = fopen(path, "wb");
+    if (out == NULL) {
+        printf("Cannot create image file %s\n", path);
+        exit(1);
+    }
+    const int color = (image->type == RGBA32_RASTER);
+    fprintf(out, "P%c\n%u %u\n255\n", color ? '6' : '5', image->nbCols, image->nbRows);
+    for (unsigned int i = image->nbRows; i-- > 0; ) {
+        const unsigned char* row = imageRow(image, i);
+        for (unsigned int j = 0; j < image->nbCols; j++)
+            fwrite(row + j * image->bytesPerPixel, 1, color ? 3 : 1, out);
+    }
+    fclose(out);
+}
+
+static int sameFileBytes(const char* pathA, const char* pathB) {
+    FILE* a = fopen(pathA, "rb");
+    FILE* b = fopen(pathB, "rb");
+    int same = (a != NULL && b != NULL);
+    while (same) {
+        int c = fgetc(a);
+        same = (c == fgetc(b));
+        if (c == EOF)
+            break;
+    }
+    if (a != NULL)
+        fclose(a);
+    if (b != NULL)
+        fclose(b);
+    return same;
+}
+
+// Reads a PNM file written by writeReference and checks it against the
+//  image, then checks that writePNM gives the same file
+static ImageStruct checkFormat(const ImageStruct* image, const char* dir, const char* name,
+                               const char* ext, unsigned int bytesPerPixel) {
+    char path[1024], copyPath[1024], what[128];
+    snprintf(path, sizeof(path), "%s/%s.%s", dir, name, ext);
+    snprintf(copyPath, sizeof(copyPath), "%s/%s-written.%s", dir, name, ext);
+    writeReference(path, image);
+
+    ImageStruct read = readImageFile(path, NULL);
+    snprintf(what, sizeof(what), "%s: %s read", name, ext);
+    report(what, firstDifferentRow(image, &read, bytesPerPixel) == image->nbRows);
+
+    snprintf(what, sizeof(what), "%s: %s written", name, ext);
+    report(what, writeImageFile(copyPath, image) == 0 && sameFileBytes(path, copyPath));
+    return read;
+}
+
+static FormatSet loadFormats(const char* tgaPath, const char* dir, const char* name) {
+    FormatSet set;
+    set.tga = readImageFile(tgaPath, NULL);
+    ImageStruct grey = greyPlaneOf(&set.tga);
+    set.ppm = checkFormat(&set.tga, dir, name, "ppm", 3);
+    set.pgm = checkFormat(&grey, dir, name, "pgm", 1);
+    deleteImageStruct(&grey);
+    return set;
+}
+
+// Blobs of a frame against a background, on the caller
+static unsigned int detect(const ImageStruct* background, const ImageStruct* frame, Blob** blobs) {
+    ImageStruct backgroundGrey = newGreyPlane(background);
+    ImageStruct frameGrey = newGreyPlane(frame);
+    BitMask mask = newBitMask(frame->nbRows, frame->nbCols);
+
+    SubtractionJob job;
+    job.background = background;
+    job.frame = frame;
+    job.backgroundGrey = &backgroundGrey;
+    job.frameGrey = &frameGrey;
+    job.formula = GREY_MEAN;
+    job.threshold = 70;
+    job.thresholdMap = NULL;
+    job.region = NULL;
+    job.mask = &mask;
+    job.difference = NULL;
+    job.histograms = NULL;
+    job.kernelTimes = NULL;
+    subtractRows(&job, 0, frame->nbRows, 0);
+
+    LabelParams params = defaultLabelParams();
+    unsigned int count = labelBitMask(&mask, &params, blobs);
+
+    deleteBitMask(&mask);
+    deleteImageStruct(&frameGrey);
+    deleteImageStruct(&backgroundGrey);
+    return count;
+}
+
+static int sameBlobs(const Blob* a, unsigned int nbA, const Blob* b, unsigned int nbB) {
+    if (nbA != nbB)
+        return 0;
+    for (unsigned int k = 0; k < nbA; k++)
+        if (a[k].yTop != b[k].yTop || a[k].yBottom != b[k].yBottom ||
+            a[k].nbPixels != b[k].nbPixels || a[k].nbSegs != b[k].nbSegs ||
+            a[k].deque[0].segList[0].xL != b[k].deque[0].segList[0].xL)
+            return 0;
+    return 1;
+}
+
+static void freeBlobs(Blob* blobs, unsigned int count) {
+    for (unsigned int k = 0; k < count; k++)
+        deleteBlob(blobs + k);
+    free(blobs);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Usage: %s BACKGROUND.tga FRAME.tga [DIR]\n", argv[0]);
+        return 1;
+    }
+    const char* dir = (argc >= 4) ? argv[3] : "/tmp";
+
+    FormatSet background = loadFormats(argv[1], dir, "formatCheck-background");
+    FormatSet frame = loadFormats(argv[2], dir, "formatCheck-frame");
+
+    Blob* reference;
+    unsigned int nbReference = detect(&background.tga, &frame.tga, &reference);
+    printf("TGA background, TGA frame: %u blobs\n", nbReference);
+
+    const struct {
+        const char* name;
+        const ImageStruct *background, *frame;
+    } mixes[] = {
+        {"PPM background, TGA frame", &background.ppm, &frame.tga},
+        {"TGA background, PPM frame", &background.tga, &frame.ppm},
+        {"PPM background, PPM frame", &background.ppm, &frame.ppm},
+        {"PGM background, TGA frame", &background.pgm, &frame.tga},
+        {"TGA background, PGM frame", &background.tga, &frame.pgm},
+        {"PGM background, PGM frame", &background.pgm, &frame.pgm},
+    };
+    for (unsigned int m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+        Blob* blobs;
+        unsigned int count = detect(mixes[m].background, mixes[m].frame, &blobs);
+        report(mixes[m].name, sameBlobs(reference, nbReference, blobs, count));
+        freeBlobs(blobs, count);
+    }
+
+    freeBlobs(reference, nbReference);
+    FormatSet* sets[] = {&background, &frame};
+    for (unsigned int k = 0; k < 2; k++) {
+        deleteImageStruct(&sets[k]->tga);
+        deleteImageStruct(&sets[k]->ppm);
+        deleteImageStruct(&sets[k]->pgm);
+    }
+    return (nbFailures > 0) ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/*
+ **********************************************************************************
+ * File: frameProducer.c
+ *..................................................................................
+ * Stand-in for a capture process: publishes frames read from image files into
+ *  a shared-memory frame ring, for the --shm=NAME mode of the blob detector.
+ *
+ *  frameProducer NAME COUNT IMAGE [IMAGE ...] [--slots=N]
+ *
+ * The images (all of the same size and type) are published in turn until
+ *  COUNT frames were sent.  When the ring is full the producer waits for the
+ *  consumer; at the end it closes the ring, waits until every frame was read
+ *  and removes the shared-memory object.
+ *=====================================================================================
+ *  gcc -Wall frameProducer.c FrameRing.c fileIO.c fileIO_TGA.c fileIO_PNM.c ThreadPool.c \
+ *      Trace.c -lrt -lpthread -o frameProducer
+ *
+ **********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+//-----------------------
+#include "fileIO_TGA.h"
+#include "FrameRing.h"
+
+// Time between two checks of a full (or not yet drained) ring
+#define POLL_NANOSECONDS    1000000L
+
+static void waitABit(void) {
+    struct timespec delay = {0, POLL_NANOSECONDS};
+    nanosleep(&delay, NULL);
+}
+
+int main(int argc, char** argv) {
+    unsigned int nbSlots = 4;
+    const char* imagePaths[64];
+    unsigned int nbImages = 0;
+
+    if (argc < 4) {
+        printf("Usage: %s NAME COUNT IMAGE.tga [IMAGE.tga ...] [--slots=N]\n", argv[0]);
+        return 1;
+    }
+    const char* name = argv[1];
+    unsigned long nbFrames = strtoul(argv[2], NULL, 10);
+    for (int i = 3; i < argc; i++) {
+        if (strncmp(argv[i], "--slots=", 8) == 0)
+            nbSlots = (unsigned int) strtoul(argv[i] + 8, NULL, 10);
+        else if (nbImages < 64)
+            imagePaths[nbImages++] = argv[i];
+    }
+    if (nbImages == 0 || nbSlots == 0) {
+        printf("Nothing to publish\n");
+        return 1;
+    }
+
+    ImageStruct* images = (ImageStruct*) malloc(nbImages * sizeof(ImageStruct));
+    if (images == NULL) {
+        printf("Unable to allocate memory\n");
+        return 1;
+    }
+    for (unsigned int k = 0; k < nbImages; k++) {
+        images[k] = readImageFile(imagePaths[k], NULL);
+        if (images[k].type != images[0].type || images[k].nbRows != images[0].nbRows ||
+            images[k].nbCols != images[0].nbCols) {
+            printf("%s does not have the size and type of %s\n", imagePaths[k], imagePaths[0]);
+            return 1;
+        }
+    }
+
+    FrameRing* ring = createFrameRing(name, images[0].type, images[0].nbRows,
+                                      images[0].nbCols, nbSlots);
+    if (ring == NULL) {
+        printf("Cannot create the shared-memory ring %s\n", name);
+        return 1;
+    }
+
+    const size_t rowBytes = (size_t) images[0].nbCols * images[0].bytesPerPixel;
+    for (unsigned long n = 0; n < nbFrames; n++) {
+        ImageStruct slot;
+        while (!acquireFrameSlot(ring, &slot))
+            waitABit();
+
+        const ImageStruct* image = images + n % nbImages;
+        for (unsigned int i = 0; i < image->nbRows; i++)
+            memcpy(imageRow(&slot, i), imageRow(image, i), rowBytes);
+        publishFrame(ring);
+    }
+    closeFrameRing(ring);
+
+    while (!frameRingFinished(ring))
+        waitABit();
+    detachFrameRing(ring);
+    unlinkFrameRing(name);
+
+    printf("%lu frames published\n", nbFrames);
+    for (unsigned int k = 0; k < nbImages; k++)
+        deleteImageStruct(images + k);
+    free(images);
+    return 0;
+}
@@ -153,8 +153,13 @@ void myMouse(int button, int state, int x, int y)
 
 void myTimer(int d)
 {
-	//	Nothing to do but display the current output image
-    myDisplay();
+	//	Nothing to do but display the current output image, and only if
+	//	it changed since it was last drawn
+	if (displayNeedsRedraw())
+	{
+		glutSetWindow(gMainWindow);
+		glutPostRedisplay();
+	}
 
 	glutTimerFunc(msecs, myTimer, 0);
 }
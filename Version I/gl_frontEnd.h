@@ -69,6 +69,11 @@ void initializeFrontEnd(int argc, char** argv);
  */
 void myKeyboard(unsigned char c, int x, int y);
 
+/**	Tells whether the image or the blobs changed since they were last drawn
+ *	@return	1 if the display must be refreshed, 0 otherwise
+ */
+int displayNeedsRedraw(void);
+
 #if FOUR_QUADRANT_VERSION
 
 	/**	Rendering function for the upper-left quadrant
@@ -0,0 +1,133 @@
+/*
+ **********************************************************************************
+ * File: kernelBench.c
+ *..................................................................................
+ * Times the subtraction kernels of every pixel format, grey formula and
+ *  threshold mode on synthetic images, on one thread.
+ *
+ *  kernelBench [ROWS COLS] [REPEAT]
+ *
+ * Each line gives the time of one pass of subtractRows over the image
+ *  (grey conversion of both images, then threshold into the mask, and
+ *  into the difference image too for the "mask+diff" lines, as with a
+ *  display) and the throughput in millions of pixels per second.  The
+ *  grey formula only applies to color images.
+ *=====================================================================================
+ *  gcc -O2 -Wall kernelBench.c Subtraction.c fileIO.c fileIO_TGA.c fileIO_PNM.c \
+ *      BitMask.c Threshold.c ThreadPool.c Trace.c -lm -lpthread -o kernelBench
+ *
+ **********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+//-----------------------
+#include "Subtraction.h"
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// Pseudo-random bytes, the same on every run
+static unsigned int seed = 12345;
+static unsigned char randomByte(void) {
+    seed = seed * 1103515245u + 12345u;
+    return (unsigned char) (seed >> 16);
+}
+
+static ImageStruct syntheticImage(ImageType type, unsigned int nbRows, unsigned int nbCols) {
+    ImageStruct image = newImageStruct(type, nbRows, nbCols);
+    for (unsigned int i = 0; i < nbRows; i++) {
+        if (type == FLOAT_RASTER) {
+            float* row = imageRowFloat(&image, i);
+            for (unsigned int j = 0; j < nbCols; j++)
+                row[j] = (float) randomByte();
+        }
+        else {
+            unsigned char* row = imageRow(&image, i);
+            for (unsigned int j = 0; j < nbCols * image.bytesPerPixel; j++)
+                row[j] = randomByte();
+        }
+    }
+    return image;
+}
+
+static void benchmark(ImageType type, const char* typeName, GreyFormula formula,
+                      const ImageStruct* thresholdMap, int withDifference,
+                      unsigned int nbRows, unsigned int nbCols, unsigned int nbRepeats)
+{
+    ImageStruct background = syntheticImage(type, nbRows, nbCols);
+    ImageStruct frame = syntheticImage(type, nbRows, nbCols);
+    ImageStruct backgroundGrey = newGreyPlane(&background);
+    ImageStruct frameGrey = newGreyPlane(&frame);
+    BitMask mask = newBitMask(nbRows, nbCols);
+    ImageStruct difference = newImageStruct(MASK_RASTER, nbRows, nbCols);
+
+    SubtractionJob job;
+    job.background = &background;
+    job.frame = &frame;
+    job.backgroundGrey = &backgroundGrey;
+    job.frameGrey = &frameGrey;
+    job.formula = formula;
+    job.threshold = 70;
+    job.thresholdMap = thresholdMap;
+    job.region = NULL;
+    job.mask = &mask;
+    job.difference = withDifference ? &difference : NULL;
+    job.histograms = NULL;
+    job.kernelTimes = NULL;
+
+    // one pass to warm the caches and fault the pages in
+    subtractRows(&job, 0, nbRows, 0);
+    double start = now();
+    for (unsigned int k = 0; k < nbRepeats; k++)
+        subtractRows(&job, 0, nbRows, 0);
+    double seconds = (now() - start) / nbRepeats;
+
+    printf("%-8s %-6s %-10s %-10s %9.3f ms %9.1f Mpixel/s\n", typeName,
+           (type == RGBA32_RASTER) ? ((formula == GREY_LUMA) ? "luma" : "mean") : "-",
+           (thresholdMap != NULL) ? "per-pixel" : "fixed", withDifference ? "mask+diff" : "mask",
+           1e3 * seconds, (double) nbRows * nbCols / seconds * 1e-6);
+
+    deleteImageStruct(&difference);
+    deleteBitMask(&mask);
+    deleteImageStruct(&frameGrey);
+    deleteImageStruct(&backgroundGrey);
+    deleteImageStruct(&frame);
+    deleteImageStruct(&background);
+}
+
+int main(int argc, char** argv) {
+    unsigned int nbRows = 2048, nbCols = 2048, nbRepeats = 20;
+    if (argc >= 3) {
+        nbRows = (unsigned int) strtoul(argv[1], NULL, 10);
+        nbCols = (unsigned int) strtoul(argv[2], NULL, 10);
+    }
+    if (argc >= 4)
+        nbRepeats = (unsigned int) strtoul(argv[3], NULL, 10);
+    if (nbRows == 0 || nbCols == 0 || nbRepeats == 0) {
+        printf("Usage: %s [ROWS COLS] [REPEAT]\n", argv[0]);
+        return 1;
+    }
+
+    ImageStruct thresholdMap = syntheticImage(GRAY_RASTER, nbRows, nbCols);
+    printf("%u x %u pixels, %u passes\n", nbCols, nbRows, nbRepeats);
+    printf("%-8s %-6s %-10s %-10s %12s %19s\n", "format", "grey", "threshold", "output", "time",
+           "throughput");
+
+    for (int withDifference = 0; withDifference <= 1; withDifference++) {
+        for (int perPixel = 0; perPixel <= 1; perPixel++) {
+            const ImageStruct* map = perPixel ? &thresholdMap : NULL;
+            benchmark(RGBA32_RASTER, "RGBA32", GREY_MEAN, map, withDifference, nbRows, nbCols, nbRepeats);
+            benchmark(RGBA32_RASTER, "RGBA32", GREY_LUMA, map, withDifference, nbRows, nbCols, nbRepeats);
+            benchmark(GRAY_RASTER, "GRAY8", GREY_MEAN, map, withDifference, nbRows, nbCols, nbRepeats);
+            benchmark(FLOAT_RASTER, "FLOAT", GREY_MEAN, map, withDifference, nbRows, nbCols, nbRepeats);
+        }
+    }
+
+    deleteImageStruct(&thresholdMap);
+    return 0;
+}
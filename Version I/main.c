@@ -16,44 +16,81 @@
  *  image. 
  *=====================================================================================
  * This is how I compiled my program on Mac ->
- *  gcc -Wall main.c gl_frontEnd.c fileIO_TGA.c Blob.c -lm -framework OpenGL -framework GLUT -w -o blob
+ *  gcc -Wall main.c gl_frontEnd.c fileIO.c fileIO_TGA.c Blob.c BitMask.c Labeling.c ThreadPool.c Overlay.c Threshold.c \
+ *      Subtraction.c StreamDetection.c FrameRing.c fileIO_PNM.c \
+ *      ResultWriter.c TripleBuffer.c Contour.c Topology.c DetectionServer.c BackgroundRegistry.c \
+ *      ResultCache.c StageMetrics.c Trace.c LatencyBudget.c RegionMask.c ColorStats.c -lm -framework OpenGL -framework GLUT -w -o blob
  *
  **********************************************************************************
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
 //-----------------------
 #include "gl_frontEnd.h"
 #include "fileIO_TGA.h"
 #include "Blob.h"
-
-//==================================================================================
-// Thread data type
-//==================================================================================
-
-typedef struct ThreadInfo {
-    pthread_t threadID;
-    int index;
-    int row;
-} ThreadInfo;
+#include "BitMask.h"
+#include "Labeling.h"
+#include "ThreadPool.h"
+#include "Overlay.h"
+#include "Threshold.h"
+#include "StreamDetection.h"
+#include "Subtraction.h"
+#include "FrameRing.h"
+#include "fileIO_PNM.h"
+#include "ResultWriter.h"
+#include "TripleBuffer.h"
+#include "DetectionServer.h"
+#include "BackgroundRegistry.h"
+#include "ResultCache.h"
+#include "StageMetrics.h"
+#include "Trace.h"
+#include "LatencyBudget.h"
+#include "RegionMask.h"
+#include "ColorStats.h"
+#include "Topology.h"
 
 //==================================================================================
 // Function prototypes
 //==================================================================================
 
 void initializeApplication(void);
-void* threadFunction(void* arg);
-
-void convertRGBToGreyscale(ImageStruct oldImage, int** pixel2D, int row);
-void overrideImage(ImageStruct imageIn, int** pixel2D, int row);
-void computeAbsoluteValue(int** pixel2DOld, int** pixel2DNew, int** pixel2DDifference, int row);
-void detectBlobs(ImageStruct blobImage, int** imagePixels);
-int findLeft(int x, int y, int** imagePixels, int** isChecked);
-int findRight(int x, int y, int maxCol, int** imagePixels, int** isChecked);
-void* threadFunc(void* arg);
+void parseCommandLine(int argc, char** argv);
+void writeOverlay(void);
+int runStillDetection(void);
+int runStreamingDetection(void);
+int runSharedMemoryDetection(void);
+int runDetectionServer(void);
+uint64_t detectionParamsHash(void);
+void replaceBlobList(Blob* blobs, unsigned int count);
+int finishCachedDetection(Blob* blobs, unsigned int count);
+void stopServerHandler(int signalNumber);
+void endFrame(uint64_t frameIndex);
+void finishReports(void);
+void* detectorThreadFunc(void* arg);
+void writeResults(uint64_t frameIndex);
+void publishDetection(const ImageStruct* frame, uint64_t frameIndex);
+
+void uploadFrameTexture(const ImageStruct* image);
+void setPixelUnpacking(const ImageStruct* image);
+void prepareSubtraction(SubtractionJob* job);
+void subtractBackground(void);
+int loadThresholdMap(unsigned int nbRows, unsigned int nbCols);
+int loadRegionMask(unsigned int nbRows, unsigned int nbCols);
+void detectBlobs(const BitMask* mask);
+void detectFrameBlobs(void);
+void detectSampledBlobs(void);
+unsigned int scaleDownLimit(unsigned int limit, unsigned int divisor);
+void measureBlobColors(const ImageStruct* frame, ResultWriter* formatter);
+QualityLevel startBudgetedFrame(ResultWriter* formatter, double* startTime);
+void endBudgetedFrame(QualityLevel quality, double startTime);
 
 //==================================================================================
 // Application-level global variables
@@ -70,16 +107,163 @@ extern const int WINDOW_WIDTH, WINDOW_HEIGHT;
     extern int gSubwindow[4];
 #endif
 
-// read a single image file and use it as output.
-// The scale factors are computed so that the entore image is displayed
-//  fit to the window's dimensions.
+// Images of the detector.  With a display, they belong to the detector
+//  thread: the display only sees the copies published in the triple buffer.
 ImageStruct oldImage, newImage, differenceImage;
+
+// A frame and its blobs as handed to the display
+typedef struct DetectionResult {
+    ImageStruct frame;          // copy of the frame (raster NULL until first used)
+    ImageStruct background;     // grey copy of the background, made once per slot
+    Blob* blobs;
+    unsigned int nbBlobs;
+    uint64_t frameIndex;
+} DetectionResult;
+
+// The detector thread publishes each result through a lock-free triple
+//  buffer and the display takes the latest one, so that neither ever
+//  waits for the other
+DetectionResult detectionSlots[3];
+TripleBuffer* detectionBuffer = NULL;
+pthread_t detectorThread;
+
+// The scale factors are computed by the display so that the entire frame
+//  is displayed fit to the window's dimensions
 float scaleX, scaleY;
-int initDone = 0;
-int** pixel2DOld;
-int** pixel2DNew;
-int** pixel2DDifference;
-int** differencePixel;
+
+// The frame is uploaded once as a texture and the display only redraws
+//  when it took a new result.  These versions belong to the display.
+unsigned int shownVersion = 0, uploadedVersion = 0, drawnVersion = 0;
+GLuint frameTexture = 0;
+unsigned int textureCols = 0, textureRows = 0;
+
+// 8-bit grey planes of both images (views when the images are already grey)
+ImageStruct oldGrey, newGrey;
+
+// Thresholded difference, one bit per pixel
+BitMask differenceMask;
+
+// Limits on the blobs kept by the labeling (set on the command line)
+LabelParams labelParams;
+
+// Frames of a ring are labeled starting from the previous frame: only the
+//  components near the rows that changed are labeled again.  The blobs then
+//  belong to the labeler, until other blobs replace them.
+IncrementalLabeler* incrementalLabeler = NULL;
+int labelerOwnsBlobs = 0;
+
+// Time allowed for each frame of a ring or of the daemon, if any (--budget):
+//  the quality of each frame is lowered when the previous ones were too slow
+double frameBudget = 0.;
+LatencyBudget* latencyBudget = NULL;
+
+// Thresholded difference of the downsampled frames
+BitMask sampledMask;
+
+// Threshold on the grey-level difference: either fixed (set on the command
+//  line) or computed for each frame from the histogram of the differences
+ThresholdMode thresholdMode = FIXED_THRESHOLD;
+unsigned int threshold = 70;
+unsigned int frameThreshold;
+
+// Optional threshold per pixel, read from a grey image of the frame's size.
+//  It replaces the threshold above (frameThreshold is then reported as 0).
+char* thresholdMapPath = NULL;
+ImageStruct thresholdMap;
+
+// Optional region of interest and/or excluded pixels, each read from a grey
+//  image of the frame's size (nonzero pixels are in the region, or excluded),
+//  combined into one mask of the pixels where blobs are looked for.  Row 0
+//  of the masks, as of the frame, is the bottom row of the picture.
+char* roiPath = NULL;
+char* exclusionPath = NULL;
+RegionMask regionMask;
+
+// How color pixels are turned into grey levels
+GreyFormula greyFormula = GREY_MEAN;
+
+// One histogram of the differences per worker, summed up after the pass
+unsigned long (*workerHistograms)[NB_GREY_LEVELS] = NULL;
+
+// Worker threads shared by the parallel stages (0 workers = one per core)
+ThreadPool* workerPool = NULL;
+unsigned int nbWorkers = 0;
+
+// With --pin, each worker is pinned to a processor, node by node, and the
+//  buffers are first written by the workers that process their rows
+int pinWorkers = 0;
+CpuTopology cpuTopology;
+
+// Without display, the program detects the blobs, writes its outputs and quits
+int headless = 0;
+
+// In streaming mode the images are never loaded whole: they are read,
+//  subtracted and labeled a band of rows at a time
+int streaming = 0;
+unsigned int bandRows = 64;
+
+// Name of the shared-memory ring the frames come from, if any
+char* sharedMemoryName = NULL;
+
+// Daemon mode: the requests come from a Unix domain socket, and the pool,
+//  the backgrounds and the buffers stay allocated from one to the next
+char* serverSocketPath = NULL;
+volatile sig_atomic_t stopServer = 0;
+
+// Backgrounds of the daemon, by camera id ("default" is the background
+//  file), kept as grey planes within a memory budget
+BackgroundRegistry* backgroundRegistry = NULL;
+char* backgroundListPath = NULL;
+size_t backgroundBudget = (size_t) 512 << 20;
+
+// Shared-memory rings the daemon is attached to, by name
+#define MAX_SERVED_RINGS    8
+typedef struct ServedRing {
+    char* name;
+    FrameRing* ring;
+} ServedRing;
+ServedRing servedRings[MAX_SERVED_RINGS];
+unsigned int nbServedRings = 0;
+
+// Grey plane of the color frames of the daemon, kept between requests
+ImageStruct servedFrameGrey;
+
+// Blobs of earlier detections, by hash of the input files and parameters
+//  (still detections without display, and FRAME requests of the daemon)
+char* resultCachePath = NULL;
+size_t resultCacheLimit = (size_t) 256 << 20;
+ResultCache* resultCache = NULL;
+
+// Times of the stages and counts, as JSON reports, if requested: "-" for
+//  the standard error, "fd:N" for descriptor N, or a file path
+char* metricsPath = NULL;
+int metricsPerFrame = 0;
+int metricsFd = -1;
+StageMetrics* stageMetrics = NULL;
+
+// Timeline of the threads, written on exit in the trace-event format, if
+//  requested
+char* tracePath = NULL;
+
+// Serialized detections, if requested.  When they go to the standard
+//  output, the text summaries are not printed.
+char* resultsPath = NULL;
+ResultFormat resultsFormat = JSON_RESULTS;
+int resultsExtents = 0;
+int resultsContours = 0, resultsChainCodes = 0;
+float resultsTolerance = 0.f;
+ResultWriter* resultWriter = NULL;
+int reportToStdout = 1;
+
+// Color statistics of the blobs of the frame, added to the results if
+//  requested
+int resultsColors = 0;
+BlobColors* blobColors = NULL;
+unsigned int blobColorsCapacity = 0;
+
+// Annotated frame written by the CPU compositor, if any
+char* overlayPath = NULL;
+OverlayParams overlayParams;
 
 // A hand-initialized list of blobs, for rendering testing
 Blob* blobList;
@@ -91,9 +275,12 @@ unsigned int nbBlobs = 0;
 #define IN_PATH     "./DataSets/Series02/"
 #define OUT_PATH    "./Output/"
 
-// You can change newImagePath to frame01 or frame02 
+// You can change newImagePath to frame01 or frame02 (or use --background=
+//  and --frame= on the command line)
 #define oldImagePath "../Data/Part I/background.tga"
 #define newImagePath "../Data/Part I/frame02.tga"
+const char* backgroundPath = oldImagePath;
+const char* framePath = newImagePath;
 
 //==================================================================================
 // These are the functions that tie the computation with the rendering.
@@ -101,35 +288,72 @@ unsigned int nbBlobs = 0;
 //  to make sure that access to critical section is properly synchronized
 //==================================================================================
 
+/*
+ *------------------------------------------------------------------------
+ * The result the display took last, without looking for a newer one.
+ *  Returns NULL until the first result arrives.
+ *------------------------------------------------------------------------
+ */
+DetectionResult* shownDetection(void) {
+    if (detectionBuffer == NULL)
+        return NULL;
+
+    DetectionResult* result = readSlot(detectionBuffer);
+    if (result->frame.raster == NULL)
+        return NULL;
+
+    #if FOUR_QUADRANT_VERSION
+        scaleX = (1.f*QUADRANT_WIDTH)/result->frame.nbCols;
+        scaleY = (1.f*QUADRANT_HEIGHT)/result->frame.nbRows;
+    #else
+        scaleX = (1.f*WINDOW_WIDTH)/result->frame.nbCols;
+        scaleY = (1.f*WINDOW_HEIGHT)/result->frame.nbRows;
+    #endif
+    return result;
+}
+
+/*
+ *------------------------------------------------------------------------
+ * Take the latest result published by the detector, if there is one the
+ *  display has not seen yet.  Never waits.  Returns NULL until the first
+ *  result arrives.
+ *------------------------------------------------------------------------
+ */
+DetectionResult* latestDetection(void) {
+    if (detectionBuffer == NULL)
+        return NULL;
+    if (updateReadSlot(detectionBuffer))
+        shownVersion++;
+    return shownDetection();
+}
+
 #if FOUR_QUADRANT_VERSION
+    // Draw an image of the shown result in the current quadrant
+    void drawQuadrantImage(const ImageStruct* image) {
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        glPixelZoom(scaleX, scaleY);
+        //==============================================
+        // This is OpenGL/glut magic. Replace, if you
+        //  want, but don't modify
+        //==============================================
+        setPixelUnpacking(image);
+        glDrawPixels(image->nbCols, image->nbRows,
+                      (image->type == RGBA32_RASTER) ? GL_RGBA : GL_LUMINANCE,
+                      GL_UNSIGNED_BYTE,
+                      image->raster);
+    }
+
     // In four-quadrant mode, we need a different rendering function for each
-    //  quadrant
+    //  quadrant.  The upper-left one is drawn first at each redraw: it takes
+    //  the latest result, and the other quadrants draw the same one.
     void displayUpperLeft(void) {
-	printf("\t displayUpperLeft \n");
-
         glutSetWindow(gSubwindow[UPPER_LEFT]);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        if (initDone) {
-            glMatrixMode(GL_MODELVIEW);
-            glLoadIdentity();
-            glPixelZoom(scaleX, scaleY);
-            //==============================================
-            // This is OpenGL/glut magic. Replace, if you
-            //  want, but don't modify
-            //==============================================
-            if (oldImage.type == RGBA32_RASTER) {
-                glDrawPixels(oldImage.nbCols, oldImage.nbRows,
-                              GL_RGBA,
-                              GL_UNSIGNED_BYTE,
-                              oldImage.raster);
-            }
-            else if (newImage.type == GRAY_RASTER) {
-                glDrawPixels(oldImage.nbCols, oldImage.nbRows,
-                              GL_LUMINANCE,
-                              GL_UNSIGNED_BYTE,
-                              oldImage.raster);
-            }
+        DetectionResult* result = latestDetection();
+        if (result != NULL) {
+            drawQuadrantImage(&result->background);
+            drawnVersion = shownVersion;
         }
         glutSetWindow(gMainWindow);
     }
@@ -137,66 +361,28 @@ unsigned int nbBlobs = 0;
     void displayUpperRight(void) {
         glutSetWindow(gSubwindow[UPPER_RIGHT]);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        if (initDone) {
-            glMatrixMode(GL_MODELVIEW);
-            glLoadIdentity();
-            glPixelZoom(scaleX, scaleY);
-
-            //==============================================
-            // This is OpenGL/glut magic. Replace, if you
-            //  want, but don't modify
-            //==============================================
-            if (newImage.type == RGBA32_RASTER) {
-                glDrawPixels(newImage.nbCols, newImage.nbRows,
-                              GL_RGBA,
-                              GL_UNSIGNED_BYTE,
-                              newImage.raster);
-            }
-            else if (newImage.type == GRAY_RASTER) {
-                glDrawPixels(newImage.nbCols, newImage.nbRows,
-                              GL_LUMINANCE,
-                              GL_UNSIGNED_BYTE,
-                              newImage.raster);
-            }
-        }
+        DetectionResult* result = shownDetection();
+        if (result != NULL)
+            drawQuadrantImage(&result->frame);
         glutSetWindow(gMainWindow);
     }
 
     void displayLowerLeft(void) {
         glutSetWindow(gSubwindow[LOWER_LEFT]);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        if (initDone) {
-            glMatrixMode(GL_MODELVIEW);
-            glLoadIdentity();
-            glPixelZoom(scaleX, scaleY);
-
-           glDrawPixels(oldImage.nbCols, newImage.nbRows,
-                         GL_RGBA,
-                         GL_UNSIGNED_BYTE,
-                         newImage.raster);
-        }
+        DetectionResult* result = shownDetection();
+        if (result != NULL)
+            drawQuadrantImage(&result->frame);
         glutSetWindow(gMainWindow);
     }
 
     void displayLowerRight(void) {
         glutSetWindow(gSubwindow[LOWER_RIGHT]);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        if (initDone) {
-            glMatrixMode(GL_MODELVIEW);
-            glLoadIdentity();
-            glPixelZoom(scaleX, scaleY);
-
-           glDrawPixels(oldImage.nbCols, newImage.nbRows,
-                         GL_RGBA,
-                         GL_UNSIGNED_BYTE,
-                         newImage.raster);
-        }
-
+        DetectionResult* result = shownDetection();
+        if (result != NULL)
+            drawQuadrantImage(&result->frame);
         glutSetWindow(gMainWindow);
-
     }
 
 #else
@@ -208,48 +394,106 @@ unsigned int nbBlobs = 0;
         glutSetWindow(gMainWindow);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        if (initDone) {
+        DetectionResult* result = latestDetection();
+        if (result != NULL) {
+            const ImageStruct* frame = &result->frame;
             glMatrixMode(GL_MODELVIEW);
             glLoadIdentity();
-            glPixelZoom(scaleX, scaleY);
-
-            //==============================================
-            //    This is OpenGL/glut magic.  Replace, if you
-            //    want, but don't modify
-            //==============================================
-
-            if (newImage.type == RGBA32_RASTER) {
-            	// going to draw new photo with blobs on top
-            	newImage = readTGA(newImagePath);
-                glDrawPixels(newImage.nbCols, newImage.nbRows,
-                              GL_RGBA,
-                              GL_UNSIGNED_BYTE,
-                              newImage.raster);
-                
-            }
-            else if (newImage.type == GRAY_RASTER) {
-                glDrawPixels(newImage.nbCols, newImage.nbRows,
-                              GL_LUMINANCE,
-                              GL_UNSIGNED_BYTE,
-                              newImage.raster);
-            }
 
-            //--------------------------------------------------------
-            // If there are blobs, render them as well
+            // only send the frame to the GPU when a new one was published
+            if (uploadedVersion != shownVersion) {
+                uploadFrameTexture(frame);
+                uploadedVersion = shownVersion;
+            }
 
             glPushMatrix();
             glScalef(scaleX, scaleY, 1.f);
 
-            for (unsigned int k=0; k<nbBlobs; k++) {
-                renderBlob(blobList + k);
+            // going to draw new photo with blobs on top
+            glEnable(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D, frameTexture);
+            glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+            glBegin(GL_QUADS);
+                glTexCoord2f(0.f, 0.f);
+                glVertex2i(0, 0);
+                glTexCoord2f(1.f, 0.f);
+                glVertex2i(frame->nbCols, 0);
+                glTexCoord2f(1.f, 1.f);
+                glVertex2i(frame->nbCols, frame->nbRows);
+                glTexCoord2f(0.f, 1.f);
+                glVertex2i(0, frame->nbRows);
+            glEnd();
+            glDisable(GL_TEXTURE_2D);
+
+            //--------------------------------------------------------
+            // If there are blobs, render them as well
+            for (unsigned int k=0; k<result->nbBlobs; k++) {
+                renderBlob(result->blobs + k);
             }
             glPopMatrix();
+
+            drawnVersion = shownVersion;
         }
 
         glutSetWindow(gMainWindow);
     }
+
+    /*
+     *------------------------------------------------------------------------
+     * Copy a decoded image into the frame texture.  The texture storage is
+     *  only reallocated when the image dimensions change.
+     *------------------------------------------------------------------------
+     */
+    void uploadFrameTexture(const ImageStruct* image) {
+        GLenum format = (image->type == RGBA32_RASTER) ? GL_RGBA : GL_LUMINANCE;
+
+        if (frameTexture == 0) {
+            glGenTextures(1, &frameTexture);
+            glBindTexture(GL_TEXTURE_2D, frameTexture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, frameTexture);
+        setPixelUnpacking(image);
+
+        if (textureCols != image->nbCols || textureRows != image->nbRows) {
+            glTexImage2D(GL_TEXTURE_2D, 0, format, image->nbCols, image->nbRows, 0,
+                         format, GL_UNSIGNED_BYTE, image->raster);
+            textureCols = image->nbCols;
+            textureRows = image->nbRows;
+        }
+        else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->nbCols, image->nbRows,
+                            format, GL_UNSIGNED_BYTE, image->raster);
+        }
+    }
+
 #endif
 
+/*
+ *------------------------------------------------------------------------
+ * Tell OpenGL how the rows of an image are laid out, so that padded
+ *  rows can be sent as they are
+ *------------------------------------------------------------------------
+ */
+void setPixelUnpacking(const ImageStruct* image) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image->bytesPerRow / image->bytesPerPixel);
+}
+
+/*
+ *------------------------------------------------------------------------
+ * Tells the front end whether the detector published a result since the
+ *  display last drew one
+ *------------------------------------------------------------------------
+ */
+int displayNeedsRedraw(void) {
+    return detectionBuffer != NULL &&
+           (tripleBufferHasNews(detectionBuffer) || drawnVersion != shownVersion);
+}
+
 /*
  *------------------------------------------------------------------------
  * This callback function is called when a keyboard event occurs
@@ -262,7 +506,14 @@ void myKeyboard(unsigned char c, int x, int y) {
     switch (c) {
         // 'esc' to quit
         case 27:
-        	writeTGA("../Data/Part I/outImg.tga", &differenceImage);
+            // a still frame is published after its difference image was
+            //  computed and its results written; a ring keeps the detector
+            //  busy until exit, so its state is left alone
+            if (sharedMemoryName == NULL && shownVersion > 0) {
+                writeTGA("../Data/Part I/outImg.tga", &differenceImage);
+                if (resultWriter != NULL)
+                    deleteResultWriter(resultWriter);
+            }
             exit(0);
             break;
 
@@ -284,175 +535,451 @@ void myKeyboard(unsigned char c, int x, int y) {
 
 /*
  *------------------------------------------------------------------------
- * Convert each image pixel to its respective grey-level value
+ * Function to scan the difference mask and detect blobs: the runs of
+ *  each row are extracted a word at a time and connected to the runs
+ *  of the previous row
  *------------------------------------------------------------------------
  */
-void convertRGBToGreyscale(ImageStruct oldImage, int** pixel2D, int row) {
-    int color = 0;
-    for(int j = 0; j < oldImage.nbCols; j++) {
-        color = pixel2D[row][j];
-        unsigned char red = color & 0x000000FF;
-        unsigned char green = (color & 0x0000FF00) >> 8;
-        unsigned char blue = (color & 0x00FF0000) >> 16;
+void detectBlobs(const BitMask* mask) {
+    double traceStart = traceClock();
+    startStage(stageMetrics, LABEL_STAGE);
+    if (incrementalLabeler != NULL) {
+        replaceBlobList(NULL, 0);
+        nbBlobs = relabelBitMask(incrementalLabeler, mask, &blobList);
+        labelerOwnsBlobs = 1;
+    }
+    else {
+        Blob* blobs;
+        unsigned int count = labelBitMask(mask, &labelParams, &blobs);
+        replaceBlobList(blobs, count);
+    }
+    stopStage(stageMetrics, LABEL_STAGE);
+    traceSpan("label", "label", traceStart);
+    countMask(stageMetrics, mask, mask->nbRows);
+}
+
 
-        int greyScaleValue = (red + green + blue) / 3;
-        red = green = blue = greyScaleValue;
+/*
+ *------------------------------------------------------------------------
+ * Subtract and label the frame.  When the threshold is known beforehand,
+ *  the labeling follows the workers band by band instead of waiting for
+ *  the whole mask.  The incremental labeler needs the whole mask, and
+ *  pinned workers keep their own rows, so both do the stages one after
+ *  the other.
+ *------------------------------------------------------------------------
+ */
+void detectFrameBlobs(void) {
+    if (incrementalLabeler != NULL || pinWorkers ||
+        (thresholdMode != FIXED_THRESHOLD && thresholdMapPath == NULL)) {
+        subtractBackground();
+        detectBlobs(&differenceMask);
+        return;
+    }
 
-        pixel2D[row][j] = red | (green <<8) | (blue<<16) | 0xFF000000;
-	}
+    SubtractionJob job;
+    prepareSubtraction(&job);
+    Blob* blobs;
+    unsigned int count = detectBlobsPipelined(&job, bandRows, &labelParams, workerPool,
+                                              stageMetrics, &blobs);
+    replaceBlobList(blobs, count);
+    countMask(stageMetrics, &differenceMask, differenceMask.nbRows);
 }
 
 
 /*
  *------------------------------------------------------------------------
- * Converts a copy of a TGA and overwrite it with the array of difference
- *  pixels computed by comparing the grey-level image absolute values 
+ * Limit on the blobs of a downsampled mask: rounded up, so that a limit
+ *  that is set (nonzero) stays set
  *------------------------------------------------------------------------
  */
-void overrideImage(ImageStruct imageIn, int** pixel2D, int row) {
-	for(int j = 0; j < imageIn.nbCols; j++) {
-		differencePixel = (int**) imageIn.raster2D;
-		differencePixel[row][j] = pixel2D[row][j];
-	}
+unsigned int scaleDownLimit(unsigned int limit, unsigned int divisor) {
+    return (limit == 0) ? 0 : (limit - 1) / divisor + 1;
 }
 
 
 /*
  *------------------------------------------------------------------------
- * compute the absolute value of the difference between these two 
- *  gray-level images
+ * Downsampled detection: subtract and label one pixel out of
+ *  DOWNSAMPLE_FACTOR in each direction, then scale the blobs back to the
+ *  frame.  The limits on the blobs are scaled down to match.
  *------------------------------------------------------------------------
  */
-void computeAbsoluteValue(int** pixel2DOld, int** pixel2DNew, int** pixel2DDifference, int row) {
-	int pixelOld;
-	int pixelNew;
-	int difference;
-	int threshhold = 70;
+void detectSampledBlobs(void) {
+    const unsigned int factor = DOWNSAMPLE_FACTOR;
+    const unsigned int nbRows = newImage.nbRows, nbCols = newImage.nbCols;
+    const unsigned int nbSampledRows = (nbRows + factor - 1) / factor;
+    const unsigned int nbSampledCols = (nbCols + factor - 1) / factor;
+    if (sampledMask.bits == NULL || sampledMask.nbRows != nbSampledRows || sampledMask.nbCols != nbSampledCols) {
+        if (sampledMask.bits != NULL)
+            deleteBitMask(&sampledMask);
+        sampledMask = newBitMask(nbSampledRows, nbSampledCols);
+    }
+
+    SampledSubtractionJob job;
+    job.background = &oldImage;
+    job.frame = &newImage;
+    job.formula = greyFormula;
+    job.thresholdMap = (thresholdMapPath != NULL) ? &thresholdMap : NULL;
+    job.region = (regionMask.rowSpans != NULL) ? &regionMask : NULL;
+    job.factor = factor;
+    job.mask = &sampledMask;
+
+    // no histogram here: an automatic threshold is the last one computed
+    if (job.thresholdMap != NULL)
+        frameThreshold = 0;
+    else if (thresholdMode == FIXED_THRESHOLD || frameThreshold == 0)
+        frameThreshold = threshold;
+    job.threshold = (job.thresholdMap != NULL) ? threshold : frameThreshold;
+
+    double traceStart = traceClock();
+    startStage(stageMetrics, ABSDIFF_STAGE);
+    runParallelRange(workerPool, nbSampledRows, subtractSampledRows, &job);
+    stopStage(stageMetrics, ABSDIFF_STAGE);
+    traceSpan("subtract sampled", "subtract", traceStart);
+
+    LabelParams params = labelParams;
+    params.minArea = scaleDownLimit(params.minArea, factor * factor);
+    params.maxArea = scaleDownLimit(params.maxArea, factor * factor);
+    params.minWidth = scaleDownLimit(params.minWidth, factor);
+    params.minHeight = scaleDownLimit(params.minHeight, factor);
+
+    traceStart = traceClock();
+    startStage(stageMetrics, LABEL_STAGE);
+    Blob* sampledBlobs;
+    unsigned int count = labelBitMask(&sampledMask, &params, &sampledBlobs);
+    Blob* blobs = (count > 0) ? (Blob*) blobMalloc(count * sizeof(Blob)) : NULL;
+    if (count > 0 && blobs == NULL) {
+        printf("Failed to allocate blob list in detectSampledBlobs\n");
+        exit(231);
+    }
+    for (unsigned int k = 0; k < count; k++) {
+        blobs[k] = upscaleBlob(sampledBlobs + k, factor, nbRows, nbCols);
+        deleteBlob(sampledBlobs + k);
+    }
+    free(sampledBlobs);
+    replaceBlobList(blobs, count);
+    stopStage(stageMetrics, LABEL_STAGE);
+    traceSpan("label sampled", "label", traceStart);
+    countMask(stageMetrics, &sampledMask, sampledMask.nbRows);
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Color statistics of the blobs of the current frame, computed on the
+ *  pool and handed to the result writers (and to the formatter of the
+ *  daemon, if any), if requested
+ *------------------------------------------------------------------------
+ */
+void measureBlobColors(const ImageStruct* frame, ResultWriter* formatter) {
+    if (!resultsColors)
+        return;
+    if (nbBlobs > blobColorsCapacity) {
+        free(blobColors);
+        blobColorsCapacity = 2 * nbBlobs;
+        blobColors = (BlobColors*) malloc(blobColorsCapacity * sizeof(BlobColors));
+        if (blobColors == NULL) {
+            printf("Unable to allocate the colors of the blobs\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double traceStart = traceClock();
+    startStage(stageMetrics, COLOR_STAGE);
+    computeAllBlobColors(workerPool, blobList, nbBlobs, frame, blobColors);
+    stopStage(stageMetrics, COLOR_STAGE);
+    traceSpan("colors", "features", traceStart);
+
+    if (resultWriter != NULL)
+        setResultColors(resultWriter, blobColors);
+    if (formatter != NULL)
+        setResultColors(formatter, blobColors);
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Replace the blobs of the current frame (by blobs from the result cache,
+ *  or just labeled).  Blobs of the incremental labeler are left to it.
+ *------------------------------------------------------------------------
+ */
+void replaceBlobList(Blob* blobs, unsigned int count) {
+    if (!labelerOwnsBlobs) {
+        for (unsigned int k = 0; k < nbBlobs; k++)
+            deleteBlob(blobList + k);
+        free(blobList);
+    }
+    labelerOwnsBlobs = 0;
+    blobList = blobs;
+    nbBlobs = count;
+}
 
-	// images are both the same size so we can use either one
-	for(int j = 0; j < oldImage.nbCols; j++) {
-		pixelOld = pixel2DOld[row][j];
-		pixelNew = pixel2DNew[row][j];
 
-        // doing the actual comparison 
-		unsigned char oldImagePixel = pixelOld & 0x000000FF;
-		unsigned char newImagePixel = pixelNew & 0x000000FF;
-		difference = abs(oldImagePixel - newImagePixel);
+/*
+ *------------------------------------------------------------------------
+ * Latency budget: pick the quality of the next frame and tell it to the
+ *  result writers (the formatter of the daemon, if any), and start the
+ *  clock of the frame.  Without a budget, every frame is at full quality.
+ *------------------------------------------------------------------------
+ */
+double monotonicSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1.e-9 * now.tv_nsec;
+}
 
-		if(difference < threshhold)
-			difference = 0;
-		else 
-			difference = 255;
-		
-		pixel2DDifference[row][j] = difference;
-	}
+QualityLevel startBudgetedFrame(ResultWriter* formatter, double* startTime) {
+    if (latencyBudget == NULL)
+        return FULL_QUALITY;
+    QualityLevel quality = chooseQuality(latencyBudget);
+    if (resultWriter != NULL)
+        setResultQuality(resultWriter, quality);
+    if (formatter != NULL)
+        setResultQuality(formatter, quality);
+    *startTime = monotonicSeconds();
+    return quality;
+}
 
+void endBudgetedFrame(QualityLevel quality, double startTime) {
+    if (latencyBudget != NULL)
+        recordFrameTime(latencyBudget, quality, monotonicSeconds() - startTime);
 }
 
 
 /*
  *------------------------------------------------------------------------
- * Function to scan the image and detect blobs based off the blob
- *  detection algorithm
+ * Hash of everything besides the images that changes the blobs detected,
+ *  the start of every key of the result cache (0 if the threshold map
+ *  cannot be read)
  *------------------------------------------------------------------------
  */
-void detectBlobs(ImageStruct blobImage, int** imagePixels) {
-    // 2D array to track whether or not each pixel has been checked, and given their respective blob label
-    int** isChecked = (int**) malloc(blobImage.nbRows * sizeof(int*));
+uint64_t detectionParamsHash(void) {
+    struct {
+        unsigned int version, formula, mode, threshold;
+        LabelParams label;
+    } params;
+    memset(&params, 0, sizeof(params));
+    params.version = 1;
+    params.formula = greyFormula;
+    params.mode = thresholdMode;
+    params.threshold = threshold;
+    params.label = labelParams;
+
+    uint64_t hash = hashBytes(&params, sizeof(params), 0);
+    if (thresholdMapPath != NULL && hashFileBytes(thresholdMapPath, hash, &hash) != 0)
+        return 0;
+    if (roiPath != NULL && hashFileBytes(roiPath, hash ^ 1, &hash) != 0)
+        return 0;
+    if (exclusionPath != NULL && hashFileBytes(exclusionPath, hash ^ 2, &hash) != 0)
+        return 0;
+    return hash;
+}
 
-    for(int i=0; i < blobImage.nbRows; i++) {
-        isChecked[i] = (int*) malloc(blobImage.nbCols * sizeof(int));
+
+/*
+ *------------------------------------------------------------------------
+ * Hand a copy of the frame and the blobs just detected to the display.
+ *  The blobs move to the published slot (blobList is left empty), or are
+ *  copied when they belong to the incremental labeler; the slot given
+ *  back by the triple buffer is recycled for the next frame.
+ *  Without display, nothing is published.
+ *------------------------------------------------------------------------
+ */
+void publishDetection(const ImageStruct* frame, uint64_t frameIndex) {
+    if (detectionBuffer == NULL)
+        return;
+
+    DetectionResult* result = writeSlot(detectionBuffer);
+
+    // the display is done with whatever this slot held before
+    for (unsigned int k = 0; k < result->nbBlobs; k++)
+        deleteBlob(result->blobs + k);
+    free(result->blobs);
+
+    if (result->frame.raster == NULL || result->frame.type != frame->type ||
+        result->frame.nbRows != frame->nbRows || result->frame.nbCols != frame->nbCols) {
+        if (result->frame.raster != NULL)
+            deleteImageStruct(&result->frame);
+        result->frame = newImageStruct(frame->type, frame->nbRows, frame->nbCols);
+    }
+    const size_t rowBytes = (size_t) frame->nbCols * frame->bytesPerPixel;
+    for (unsigned int i = 0; i < frame->nbRows; i++)
+        memcpy(imageRow(&result->frame, i), imageRow(frame, i), rowBytes);
+
+    // the background does not change, so a slot converts it only once
+    if (result->background.raster == NULL || result->background.nbRows != oldImage.nbRows ||
+        result->background.nbCols != oldImage.nbCols) {
+        if (result->background.raster != NULL)
+            deleteImageStruct(&result->background);
+        result->background = newImageStruct(GRAY_RASTER, oldImage.nbRows, oldImage.nbCols);
+        for (unsigned int i = 0; i < oldImage.nbRows; i++)
+            convertRowToGrey(oldImage.type, greyFormula, imageRow(&oldImage, i), oldImage.nbCols,
+                             imageRow(&result->background, i));
     }
 
-    int prevRow = 0;
-    for(int i=0; i < blobImage.nbRows; i++) {
-        for(int j=0; j < blobImage.nbCols; j++) {
-            // if the current pixel has a valid difference
-            if((imagePixels[i][j] & 0xFF) != 0) {
-                isChecked[i][j] = 1;                                                        
-                int left = findLeft(j, i, imagePixels, isChecked);                          
-                int right = findRight(j, i, blobImage.nbCols-1, imagePixels, isChecked);
-                // if current row/blob is not connected to previous (or first)
-                if(abs(i - prevRow) > 1 || (nbBlobs) == 0) {
-                    nbBlobs += 1;                                               
-                    // reallocate memory for longer list
-                    blobList = (Blob*) realloc(blobList, nbBlobs*sizeof(Blob));
-                    // create a new blob
-                    blobList[nbBlobs-1] = newBlob();
-                    // set color of new blob (red)
-                    blobList[nbBlobs-1].red = 0xFF;
-                }
-                // add the new segment to blob
-                addSegmentToBlob(blobList + (nbBlobs-1), left, right, i);
-                // set "previous" row to current row
-                prevRow = i; 
-            }
+    result->nbBlobs = nbBlobs;
+    result->frameIndex = frameIndex;
+    if (labelerOwnsBlobs) {
+        result->blobs = (nbBlobs > 0) ? (Blob*) malloc(nbBlobs * sizeof(Blob)) : NULL;
+        if (nbBlobs > 0 && result->blobs == NULL) {
+            printf("Unable to allocate the published blobs\n");
+            exit(EXIT_FAILURE);
         }
+        for (unsigned int k = 0; k < nbBlobs; k++)
+            result->blobs[k] = copyBlob(blobList + k);
+    }
+    else {
+        result->blobs = blobList;
+        blobList = NULL;
+        nbBlobs = 0;
     }
 
-    // free memory from isChecked array
-    for (unsigned int i=0; i< blobImage.nbRows; i++)
-        free(isChecked[i]);
+    publishWriteSlot(detectionBuffer);
+}
+
 
-    free(isChecked);
+/*
+ *------------------------------------------------------------------------
+ * Subtraction of the whole frame against the background, with the
+ *  threshold of the frame when it is known beforehand
+ *------------------------------------------------------------------------
+ */
+void prepareSubtraction(SubtractionJob* job) {
+    job->background = &oldImage;
+    job->frame = &newImage;
+    job->backgroundGrey = &oldGrey;
+    job->frameGrey = &newGrey;
+    job->mask = &differenceMask;
+    job->difference = &differenceImage;
+    job->histograms = NULL;
+    job->formula = greyFormula;
+    job->thresholdMap = (thresholdMapPath != NULL) ? &thresholdMap : NULL;
+    job->region = (regionMask.rowSpans != NULL) ? &regionMask : NULL;
+    job->kernelTimes = subtractionKernelTimes(stageMetrics, threadPoolSize(workerPool));
+    job->threshold = threshold;
+    frameThreshold = (job->thresholdMap != NULL) ? 0 : threshold;
 }
 
 
 /*
  *------------------------------------------------------------------------
- * Function to find the farthest left (first) valid difference pixel in blobs current row
+ * Background subtraction of the whole frame on the worker pool.  In
+ *  automatic mode the per-worker histograms are reduced, Otsu's threshold
+ *  is computed and a second (cheap) pass thresholds the stored differences.
  *------------------------------------------------------------------------
  */
-int findLeft(int x, int y, int** imagePixels, int** isChecked) {
-    int counter = x - 1;
-    if(counter < 0)
-        return x;
-    while(counter > 0) {
-        if((imagePixels[y][counter] & 0xFF) != 0) {
-            isChecked[y][counter] = 1;
-            counter -= 1;
+void subtractBackground(void) {
+    unsigned int nbThreads = threadPoolSize(workerPool);
+
+    SubtractionJob job;
+    prepareSubtraction(&job);
+
+    if (job.thresholdMap == NULL && thresholdMode != FIXED_THRESHOLD) {
+        if (workerHistograms == NULL) {
+            workerHistograms = calloc(nbThreads, sizeof(*workerHistograms));
+            if (workerHistograms == NULL) {
+                printf("Unable to allocate histograms\n");
+                exit(EXIT_FAILURE);
+            }
         }
         else
-            break;
+            memset(workerHistograms, 0, nbThreads * sizeof(*workerHistograms));
+        job.histograms = workerHistograms;
+    }
+
+    double traceStart = traceClock();
+    startStage(stageMetrics, ABSDIFF_STAGE);
+    runParallelRange(workerPool, oldImage.nbRows, subtractRows, &job);
+    stopSubtractionStages(stageMetrics);
+    traceSpan("subtract", "subtract", traceStart);
+
+    if (job.histograms != NULL) {
+        startStage(stageMetrics, THRESHOLD_STAGE);
+        traceStart = traceClock();
+        unsigned long histogram[NB_GREY_LEVELS] = {0};
+        for (unsigned int k = 0; k < nbThreads; k++)
+            addHistogram(histogram, workerHistograms[k]);
+        frameThreshold = job.threshold = otsuThreshold(histogram);
+        traceSpan("merge histograms", "merge", traceStart);
+
+        traceStart = traceClock();
+        runParallelRange(workerPool, oldImage.nbRows, thresholdRows, &job);
+        stopStage(stageMetrics, THRESHOLD_STAGE);
+        traceSpan("threshold", "subtract", traceStart);
     }
-    return counter;
 }
 
 
 /*
  *------------------------------------------------------------------------
- * Function to find the farthest right (last) valid difference pixel in blobs current row
+ * Read an image that must have the size of the frames (a threshold map or
+ *  a region) as a grey plane.  Returns 0 if all went well.
  *------------------------------------------------------------------------
  */
-int findRight(int x, int y, int maxCol, int** imagePixels, int** isChecked) {
-    int counter = x + 1;
-    if(counter > maxCol)
-        return maxCol;
-    while(counter < maxCol) {
-        if((imagePixels[y][counter] & 0xFF) != 0) {
-            isChecked[y][counter] = 1;
-            counter += 1;
-        }
-        else
-            break;
+int readGreyPlane(const char* path, const char* what, unsigned int nbRows, unsigned int nbCols,
+                  ImageStruct* plane) {
+    ImageStruct image = readImageFile(path, workerPool);
+    if (image.nbRows != nbRows || image.nbCols != nbCols) {
+        printf("The %s %s does not have the size of the images\n", what, path);
+        deleteImageStruct(&image);
+        return 17;
+    }
+    if (image.type == GRAY_RASTER) {
+        *plane = image;
+        return 0;
     }
-    return counter;
+
+    *plane = newImageStruct(GRAY_RASTER, nbRows, nbCols);
+    for (unsigned int i = 0; i < nbRows; i++)
+        convertRowToGrey(image.type, greyFormula, imageRow(&image, i), nbCols, imageRow(plane, i));
+    deleteImageStruct(&image);
+    return 0;
 }
 
+
 /*
  *------------------------------------------------------------------------
- * Each thread will run background subtraction on their respective rows
+ * Read the threshold map, if any, and turn it into a grey plane of the
+ *  size of the images.  Returns 0 if all went well.
  *------------------------------------------------------------------------
  */
-void* threadFunc(void* arg) {
-	ThreadInfo* info = (ThreadInfo *) arg;
-	int row = info->row;
-	convertRGBToGreyscale(oldImage, pixel2DOld, row);
-	convertRGBToGreyscale(newImage, pixel2DNew, row);
-    computeAbsoluteValue(pixel2DOld, pixel2DNew, pixel2DDifference, row);
-    overrideImage(differenceImage, pixel2DDifference, row);
-    convertRGBToGreyscale(differenceImage, differencePixel, row);
-    return NULL;
+int loadThresholdMap(unsigned int nbRows, unsigned int nbCols) {
+    if (thresholdMapPath == NULL)
+        return 0;
+    return readGreyPlane(thresholdMapPath, "threshold map", nbRows, nbCols, &thresholdMap);
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Read the region of interest and the exclusion image, if any, and
+ *  combine them into the region mask.  Returns 0 if all went well.
+ *------------------------------------------------------------------------
+ */
+int loadRegionMask(unsigned int nbRows, unsigned int nbCols) {
+    if (roiPath == NULL && exclusionPath == NULL)
+        return 0;
+
+    ImageStruct roi, exclusion;
+    if (roiPath != NULL && readGreyPlane(roiPath, "region of interest", nbRows, nbCols, &roi) != 0)
+        return 18;
+    if (exclusionPath != NULL &&
+        readGreyPlane(exclusionPath, "exclusion image", nbRows, nbCols, &exclusion) != 0) {
+        if (roiPath != NULL)
+            deleteImageStruct(&roi);
+        return 18;
+    }
+
+    regionMask = newRegionMask((roiPath != NULL) ? &roi : NULL, (exclusionPath != NULL) ? &exclusion : NULL,
+                               nbRows, nbCols);
+    if (roiPath != NULL)
+        deleteImageStruct(&roi);
+    if (exclusionPath != NULL)
+        deleteImageStruct(&exclusion);
+    if (reportToStdout)
+        printf("Region mask: %lu of %lu pixels kept, %u spans\n", regionMask.nbKept,
+               (unsigned long) nbRows * nbCols, regionMask.rowSpans[nbRows]);
+    return 0;
 }
 
 
@@ -464,36 +991,72 @@ void* threadFunc(void* arg) {
 int main(int argc, char** argv) {
     srand((unsigned int) time(NULL));
 
-    initializeFrontEnd(argc, argv);
+    parseCommandLine(argc, argv);
+    if (tracePath != NULL) {
+        startTracing();
+        nameTraceThread("main");
+    }
 
-    // Now we can do application-level initialization
-    initializeApplication();
+    if (!headless)
+        initializeFrontEnd(argc, argv);
 
-    int numThreads = oldImage.nbRows;
-    pixel2DOld = (int**) oldImage.raster2D;
-    pixel2DNew = (int**) newImage.raster2D;
-    // allocating output file to the same size as the two images compared
-    pixel2DDifference = (int**) oldImage.raster2D;
-    // array for all the threads for easy access
-    ThreadInfo threads[numThreads];
-    int errCode;
-
-    // create a thread to background subtract the pixels - one for each row
-    for(int i = 0; i < numThreads; i++) {
-    	threads[i].index = i+1;
-    	threads[i].row = i;
-	    errCode = pthread_create(&threads[i].threadID, NULL, threadFunc, threads + i);
-	      // stop if we could not create a thread
-        if (errCode != 0) {
-            exit (EXIT_FAILURE);
+    if (resultsPath != NULL) {
+        resultWriter = newResultWriter(resultsPath, resultsFormat, resultsExtents);
+        if (resultWriter == NULL) {
+            printf("Cannot create the result file %s\n", resultsPath);
+            exit(EXIT_FAILURE);
         }
+        reportToStdout = (strcmp(resultsPath, "-") != 0);
+        if (resultsContours)
+            setResultContours(resultWriter, resultsChainCodes, resultsTolerance);
     }
-    // threads have finished background subtracting their respective rows
-    for(int i=0; i < numThreads; i++) {
-        pthread_join(threads[i].threadID, NULL);
+
+    if (pinWorkers) {
+        cpuTopology = readCpuTopology();
+        if (reportToStdout)
+            printCpuTopology(&cpuTopology);
+        workerPool = newPinnedThreadPool(nbWorkers, &cpuTopology);
     }
+    else
+        workerPool = newThreadPool(nbWorkers);
+
+    if (metricsPath != NULL) {
+        if (strcmp(metricsPath, "-") == 0)
+            metricsFd = STDERR_FILENO;
+        else if (strncmp(metricsPath, "fd:", 3) == 0)
+            metricsFd = atoi(metricsPath + 3);
+        else
+            metricsFd = open(metricsPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (metricsFd < 0) {
+            printf("Cannot write the metrics to %s\n", metricsPath);
+            exit(EXIT_FAILURE);
+        }
+        stageMetrics = newStageMetrics(metricsFd, metricsPerFrame);
+    }
+
+    if (frameBudget > 0. && (sharedMemoryName != NULL || serverSocketPath != NULL))
+        latencyBudget = newLatencyBudget(frameBudget);
 
-    detectBlobs(newImage, pixel2DDifference);
+    if (resultCachePath != NULL && headless && !streaming && sharedMemoryName == NULL) {
+        resultCache = openResultCache(resultCachePath, resultCacheLimit);
+        if (resultCache == NULL)
+            printf("Cannot use %s as a result cache\n", resultCachePath);
+    }
+
+    if (serverSocketPath != NULL)
+        return runDetectionServer();
+    if (streaming)
+        return runStreamingDetection();
+    if (headless)
+        return (sharedMemoryName != NULL) ? runSharedMemoryDetection() : runStillDetection();
+
+    // The detection runs on its own thread and publishes its results; the
+    //  display picks up the latest one at each redraw
+    detectionBuffer = newTripleBuffer(detectionSlots, detectionSlots + 1, detectionSlots + 2);
+    if (pthread_create(&detectorThread, NULL, detectorThreadFunc, NULL) != 0) {
+        printf("Could not create the detector thread\n");
+        exit(EXIT_FAILURE);
+    }
 
     //==============================================
     //    This is OpenGL/glut magic.  Don't touch
@@ -508,24 +1071,950 @@ int main(int argc, char** argv) {
 
 /*
  *------------------------------------------------------------------------
- * Read the TGA files and build the visual application
+ * Function run by the detector thread when there is a display
  *------------------------------------------------------------------------
  */
-void initializeApplication(void) {
-    oldImage = readTGA(oldImagePath);
-    newImage = readTGA(newImagePath);
-    differenceImage = readTGA(oldImagePath);
+void* detectorThreadFunc(void* arg) {
+    (void) arg;
+    nameTraceThread("detector");
+    if (sharedMemoryName != NULL)
+        runSharedMemoryDetection();
+    else
+        runStillDetection();
+    return NULL;
+}
 
-    blobList = (Blob*) malloc(nbBlobs*sizeof(Blob));
 
-    #if FOUR_QUADRANT_VERSION
-        scaleX = (1.f*QUADRANT_WIDTH)/newImage.nbCols;
-        scaleY = (1.f*QUADRANT_HEIGHT)/newImage.nbRows;
-    #else
-        scaleX = (1.f*WINDOW_WIDTH)/newImage.nbCols;
-        scaleY = (1.f*WINDOW_HEIGHT)/newImage.nbRows;
-    #endif
+/*
+ *------------------------------------------------------------------------
+ * Detect the blobs of the frame file against the background file.  With
+ *  a display, the result is published and the images are kept (the
+ *  difference image is saved on exit); otherwise everything is freed.
+ *------------------------------------------------------------------------
+ */
+int runStillDetection(void) {
+    // the key covers the bytes of both files, so a hit needs no decoding
+    uint64_t cacheKey = 0;
+    if (resultCache != NULL) {
+        cacheKey = detectionParamsHash();
+        if (cacheKey == 0 || hashFileBytes(backgroundPath, cacheKey, &cacheKey) != 0 ||
+            hashFileBytes(framePath, cacheKey, &cacheKey) != 0)
+            cacheKey = 0;
+    }
+    Blob* cachedBlobs;
+    unsigned int nbCachedBlobs;
+    if (cacheKey != 0 &&
+        lookupResults(resultCache, cacheKey, &cachedBlobs, &nbCachedBlobs, &frameThreshold))
+        return finishCachedDetection(cachedBlobs, nbCachedBlobs);
+
+    initializeApplication();
+
+    if (oldImage.nbRows != newImage.nbRows || oldImage.nbCols != newImage.nbCols) {
+        printf("The background and the frame do not have the same size\n");
+        exit(EXIT_FAILURE);
+    }
+    // the frame keeps its colors for display; the kernels work on grey planes
+    oldGrey = newGreyPlane(&oldImage);
+    newGrey = newGreyPlane(&newImage);
+    differenceImage = newImageStruct(MASK_RASTER, oldImage.nbRows, oldImage.nbCols);
+    if (oldGrey.raster != oldImage.raster)
+        placeImageRows(&oldGrey, workerPool);
+    if (newGrey.raster != newImage.raster)
+        placeImageRows(&newGrey, workerPool);
+    placeImageRows(&differenceImage, workerPool);
+    differenceMask = newBitMask(oldImage.nbRows, oldImage.nbCols);
+    if (loadThresholdMap(oldImage.nbRows, oldImage.nbCols) != 0 ||
+        loadRegionMask(oldImage.nbRows, oldImage.nbCols) != 0)
+        exit(EXIT_FAILURE);
+
+    detectFrameBlobs();
+    if (cacheKey != 0)
+        storeResults(resultCache, cacheKey, blobList, nbBlobs, frameThreshold);
+    measureBlobColors(&newImage, NULL);
+    writeResults(0);
+
+    if (overlayPath != NULL)
+        writeOverlay();
+    endFrame(0);
+    finishReports();
+
+    if (!headless) {
+        publishDetection(&newImage, 0);
+        deleteCpuTopology(&cpuTopology);
+        return 0;
+    }
+
+    if (reportToStdout) {
+        if (thresholdMode == OTSU_THRESHOLD)
+            printf("Automatic threshold: %u\n", frameThreshold);
+        printf("%u blobs detected\n", nbBlobs);
+        if (pinWorkers)
+            printThreadPoolStats(workerPool);
+        if (resultCache != NULL)
+            printResultCacheStats(resultCache);
+    }
+    deleteImageStruct(&newGrey);
+    deleteImageStruct(&oldGrey);
+    deleteImageStruct(&newImage);
+    deleteImageStruct(&oldImage);
+    deleteImageStruct(&differenceImage);
+    deleteBitMask(&differenceMask);
+    replaceBlobList(NULL, 0);
+    if (resultCache != NULL)
+        closeResultCache(resultCache);
+    if (thresholdMapPath != NULL)
+        deleteImageStruct(&thresholdMap);
+    if (regionMask.rowSpans != NULL)
+        deleteRegionMask(&regionMask);
+    free(blobColors);
+    free(workerHistograms);
+    if (resultWriter != NULL)
+        deleteResultWriter(resultWriter);
+    deleteThreadPool(workerPool);
+    deleteCpuTopology(&cpuTopology);
+    return 0;
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * End of a still detection found in the result cache: the frame is only
+ *  decoded for the overlay and the colors of the blobs
+ *------------------------------------------------------------------------
+ */
+int finishCachedDetection(Blob* blobs, unsigned int count) {
+    replaceBlobList(blobs, count);
+    if (overlayPath != NULL || resultsColors) {
+        startStage(stageMetrics, DECODE_STAGE);
+        newImage = readImageFile(framePath, workerPool);
+        stopStage(stageMetrics, DECODE_STAGE);
+    }
+    measureBlobColors(&newImage, NULL);
+    writeResults(0);
+
+    if (overlayPath != NULL)
+        writeOverlay();
+    if (overlayPath != NULL || resultsColors)
+        deleteImageStruct(&newImage);
+    endFrame(0);
+    finishReports();
+
+    if (reportToStdout) {
+        if (thresholdMode == OTSU_THRESHOLD)
+            printf("Automatic threshold: %u\n", frameThreshold);
+        printf("%u blobs detected\n", nbBlobs);
+        printResultCacheStats(resultCache);
+    }
+    replaceBlobList(NULL, 0);
+    free(blobColors);
+    closeResultCache(resultCache);
+    if (resultWriter != NULL)
+        deleteResultWriter(resultWriter);
+    deleteThreadPool(workerPool);
+    deleteCpuTopology(&cpuTopology);
+    return 0;
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Read the application's options.  Arguments that are not ours are left
+ *  for glut to interpret.
+ *   --min-area=N     reject blobs with fewer than N pixels
+ *   --max-area=N     reject blobs with more than N pixels
+ *   --min-size=WxH   reject blobs whose bounding box is narrower than W
+ *                    or shorter than H
+ *   --max-blobs=N    only keep the N largest blobs
+ *   --threshold=N    threshold on the grey-level difference (default 70)
+ *   --threshold=auto compute the threshold of each frame (Otsu's method)
+ *   --threshold-map=PATH
+ *                    threshold of each pixel, read from a grey image of the
+ *                    size of the frame (color images are made grey); it
+ *                    replaces --threshold (not in streaming mode)
+ *   --roi=PATH       only look for blobs where the grey image PATH, of the
+ *                    size of the frame, is not 0 (not in streaming mode)
+ *   --exclude=PATH   never look for blobs where the grey image PATH is not 0
+ *                    (not in streaming mode)
+ *                    The images of --threshold-map, --roi and --exclude are
+ *                    laid over the frame as pictures, so row 0 is the
+ *                    bottom row as in TGA files (a PGM file is stored top
+ *                    row first and read accordingly); the blob coordinates
+ *                    count rows from the bottom too
+ *   --grey=mean|luma grey level of color pixels: mean of red, green and blue
+ *                    (default) or weighted luma (Rec. 601)
+ *   --threads=N      number of worker threads (default: one per core)
+ *   --pin            pin the workers to the processors, node by node, and
+ *                    place the buffers on the nodes of the workers that
+ *                    process them; prints the topology, and the work done on
+ *                    each node at the end
+ *   --no-display     run without window, write the outputs and quit
+ *   --stream         read and process the images a band of rows at a time
+ *                    (implies --no-display)
+ *   --band-rows=N    number of rows of a band in streaming mode, and of the
+ *                    bands labeled while the next ones are subtracted
+ *                    (default 64)
+ *   --overlay=PATH   write the frame with the blobs drawn on it (TGA)
+ *   --overlay-boxes  also draw the bounding boxes in the overlay
+ *   --overlay-ids    also write the blob indices in the overlay
+ *   --background=PATH, --frame=PATH
+ *                    images to compare (TGA, or binary PGM/PPM by extension)
+ *   --metrics[=DEST] write the wall and CPU times of the stages of the
+ *                    detection and the counts of pixels, runs, blobs,
+ *                    extents and blob allocations as JSON, to DEST: a file,
+ *                    fd:N for descriptor N, or - (the default) for the
+ *                    standard error
+ *   --metrics-per-frame
+ *                    write one report per frame instead of one per run
+ *   --trace=PATH     record what each thread does (bands of rows, labeling,
+ *                    merges, file I/O, waits for work) and write it to PATH
+ *                    in the trace-event format of Chrome and Perfetto
+ *   --huge-pages     allocate the large images on huge pages
+ *   --results=PATH   write the blobs of each frame to PATH ("-" for the
+ *                    standard output)
+ *   --results-format=json|binary
+ *                    JSON lines of blob features (default) or binary records
+ *   --results-extents
+ *                    add the delta-encoded extents to the binary records
+ *   --results-contours[=TOL]
+ *                    add the outer contour and the holes of each blob, as
+ *                    polygons simplified within TOL pixels (default 0: every
+ *                    corner of the pixel boundary)
+ *   --results-contours=chain
+ *                    add the contours as chain codes instead
+ *   --results-colors add the mean and variance of red, green and blue and
+ *                    a 64-bin color histogram of each blob (not in
+ *                    streaming mode)
+ *   --serve=PATH     run as a daemon that detects the blobs of the frames
+ *                    requested on the Unix domain socket PATH (see
+ *                    DetectionServer.h and detectClient.c); implies
+ *                    --no-display
+ *   --backgrounds=PATH
+ *                    daemon: backgrounds of the cameras, one "ID PATH" line
+ *                    per camera (read when first used)
+ *   --background-budget=MB
+ *                    daemon: memory kept for the grey backgrounds (default
+ *                    512); the least recently used ones are unloaded
+ *   --result-cache=DIR
+ *                    keep the blobs detected in DIR, by hash of the input
+ *                    files and parameters, and reuse them when the same
+ *                    detection comes again (without display, and for the
+ *                    FRAME requests of the daemon)
+ *   --result-cache-size=MB
+ *                    size limit of the result cache (default 256); the
+ *                    results used least recently are removed
+ *   --shm=NAME       detect the blobs of the frames published in the
+ *                    shared-memory ring NAME (see frameProducer.c), against
+ *                    the background file (with a display, the latest frame
+ *                    and its blobs are shown while the detection goes on)
+ *   --budget=MS      shared-memory ring and daemon: time allowed for each
+ *                    frame; the quality of the next frames is lowered
+ *                    (no extents nor contours, then downsampled detection)
+ *                    while the frames take longer
+ *------------------------------------------------------------------------
+ */
+void parseCommandLine(int argc, char** argv) {
+    labelParams = defaultLabelParams();
+    overlayParams = defaultOverlayParams();
+
+    for (int i = 1; i < argc; i++) {
+        char* arg = argv[i];
+        int ok = 1;
+
+        if (strncmp(arg, "--min-area=", 11) == 0)
+            labelParams.minArea = (unsigned int) strtoul(arg + 11, NULL, 10);
+        else if (strncmp(arg, "--max-area=", 11) == 0)
+            labelParams.maxArea = (unsigned int) strtoul(arg + 11, NULL, 10);
+        else if (strncmp(arg, "--min-size=", 11) == 0)
+            ok = (sscanf(arg + 11, "%ux%u", &labelParams.minWidth, &labelParams.minHeight) == 2);
+        else if (strncmp(arg, "--max-blobs=", 12) == 0)
+            labelParams.maxBlobs = (unsigned int) strtoul(arg + 12, NULL, 10);
+        else if (strcmp(arg, "--threshold=auto") == 0)
+            thresholdMode = OTSU_THRESHOLD;
+        else if (strncmp(arg, "--threshold=", 12) == 0) {
+            thresholdMode = FIXED_THRESHOLD;
+            threshold = (unsigned int) strtoul(arg + 12, NULL, 10);
+        }
+        else if (strncmp(arg, "--threshold-map=", 16) == 0)
+            thresholdMapPath = arg + 16;
+        else if (strcmp(arg, "--grey=mean") == 0)
+            greyFormula = GREY_MEAN;
+        else if (strcmp(arg, "--grey=luma") == 0)
+            greyFormula = GREY_LUMA;
+        else if (strncmp(arg, "--grey=", 7) == 0)
+            ok = 0;
+        else if (strncmp(arg, "--roi=", 6) == 0)
+            roiPath = arg + 6;
+        else if (strncmp(arg, "--exclude=", 10) == 0)
+            exclusionPath = arg + 10;
+        else if (strncmp(arg, "--threads=", 10) == 0)
+            nbWorkers = (unsigned int) strtoul(arg + 10, NULL, 10);
+        else if (strcmp(arg, "--pin") == 0)
+            pinWorkers = 1;
+        else if (strcmp(arg, "--no-display") == 0)
+            headless = 1;
+        else if (strcmp(arg, "--stream") == 0)
+            streaming = headless = 1;
+        else if (strncmp(arg, "--band-rows=", 12) == 0)
+            bandRows = (unsigned int) strtoul(arg + 12, NULL, 10);
+        else if (strncmp(arg, "--overlay=", 10) == 0)
+            overlayPath = arg + 10;
+        else if (strcmp(arg, "--overlay-boxes") == 0)
+            overlayParams.drawBoxes = 1;
+        else if (strcmp(arg, "--overlay-ids") == 0)
+            overlayParams.drawIds = 1;
+        else if (strncmp(arg, "--background=", 13) == 0)
+            backgroundPath = arg + 13;
+        else if (strncmp(arg, "--frame=", 8) == 0)
+            framePath = arg + 8;
+        else if (strncmp(arg, "--results=", 10) == 0)
+            resultsPath = arg + 10;
+        else if (strcmp(arg, "--results-format=json") == 0)
+            resultsFormat = JSON_RESULTS;
+        else if (strcmp(arg, "--results-format=binary") == 0)
+            resultsFormat = BINARY_RESULTS;
+        else if (strncmp(arg, "--results-format=", 17) == 0)
+            ok = 0;
+        else if (strcmp(arg, "--results-extents") == 0)
+            resultsExtents = 1;
+        else if (strcmp(arg, "--results-contours") == 0)
+            resultsContours = 1;
+        else if (strcmp(arg, "--results-contours=chain") == 0)
+            resultsContours = resultsChainCodes = 1;
+        else if (strcmp(arg, "--results-colors") == 0)
+            resultsColors = 1;
+        else if (strncmp(arg, "--results-contours=", 19) == 0) {
+            char* end;
+            resultsContours = 1;
+            resultsTolerance = strtof(arg + 19, &end);
+            ok = (*end == '\0' && end != arg + 19 && resultsTolerance >= 0.f);
+        }
+        else if (strcmp(arg, "--metrics") == 0)
+            metricsPath = "-";
+        else if (strncmp(arg, "--metrics=", 10) == 0)
+            metricsPath = arg + 10;
+        else if (strcmp(arg, "--metrics-per-frame") == 0)
+            metricsPerFrame = 1;
+        else if (strncmp(arg, "--trace=", 8) == 0)
+            tracePath = arg + 8;
+        else if (strcmp(arg, "--huge-pages") == 0)
+            setImageAllocationFlags(IMAGE_HUGE_PAGES);
+        else if (strncmp(arg, "--budget=", 9) == 0) {
+            char* end;
+            frameBudget = 1.e-3 * strtod(arg + 9, &end);
+            ok = (*end == '\0' && end != arg + 9 && frameBudget > 0.);
+        }
+        else if (strncmp(arg, "--shm=", 6) == 0)
+            sharedMemoryName = arg + 6;
+        else if (strncmp(arg, "--backgrounds=", 14) == 0)
+            backgroundListPath = arg + 14;
+        else if (strncmp(arg, "--background-budget=", 20) == 0)
+            backgroundBudget = (size_t) strtoul(arg + 20, NULL, 10) << 20;
+        else if (strncmp(arg, "--result-cache=", 15) == 0)
+            resultCachePath = arg + 15;
+        else if (strncmp(arg, "--result-cache-size=", 20) == 0)
+            resultCacheLimit = (size_t) strtoul(arg + 20, NULL, 10) << 20;
+        else if (strncmp(arg, "--serve=", 8) == 0) {
+            serverSocketPath = arg + 8;
+            headless = 1;
+        }
+
+        if (!ok) {
+            printf("Invalid option %s\n", arg);
+            exit(EXIT_FAILURE);
+        }
+    }
+    // the map gives every threshold, there is none to compute
+    if (thresholdMapPath != NULL)
+        thresholdMode = FIXED_THRESHOLD;
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Serialize the blobs of the current frame, if requested
+ *------------------------------------------------------------------------
+ */
+void writeResults(uint64_t frameIndex) {
+    if (resultWriter == NULL)
+        return;
+    startStage(stageMetrics, ENCODE_STAGE);
+    if (writeFrameResults(resultWriter, frameIndex, frameThreshold, blobList, nbBlobs) != 0)
+        printf("Could not write the results of frame %llu\n", (unsigned long long) frameIndex);
+    stopStage(stageMetrics, ENCODE_STAGE);
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * End of the metrics of a frame, with the blobs it ended with
+ *------------------------------------------------------------------------
+ */
+void endFrame(uint64_t frameIndex) {
+    countBlobs(stageMetrics, blobList, nbBlobs);
+    endFrameMetrics(stageMetrics, frameIndex);
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Write the metrics report and the trace of the run, if requested
+ *------------------------------------------------------------------------
+ */
+void finishReports(void) {
+    if (tracePath != NULL && writeTrace(tracePath) != 0)
+        printf("Could not write the trace %s\n", tracePath);
+    tracePath = NULL;
+    if (stageMetrics == NULL)
+        return;
+    writeMetricsReport(stageMetrics);
+    deleteStageMetrics(stageMetrics);
+    stageMetrics = NULL;
+    if (metricsFd > 2)
+        close(metricsFd);
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Draw the blobs into a copy of the frame on the CPU and save it
+ *------------------------------------------------------------------------
+ */
+void writeOverlay(void) {
+    double traceStart = traceClock();
+    startStage(stageMetrics, RENDER_STAGE);
+    ImageStruct overlay = composeOverlay(&newImage, blobList, nbBlobs, &overlayParams, workerPool);
+    stopStage(stageMetrics, RENDER_STAGE);
+    traceSpan("overlay", "render", traceStart);
+    startStage(stageMetrics, ENCODE_STAGE);
+    if (writeImageFile(overlayPath, &overlay) != 0)
+        printf("Could not write overlay image %s\n", overlayPath);
+    stopStage(stageMetrics, ENCODE_STAGE);
+    deleteOverlay(&overlay);
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Detect the blobs without ever loading the images whole.  Nothing is
+ *  displayed and no overlay can be composited.
+ *------------------------------------------------------------------------
+ */
+int runStreamingDetection(void) {
+    StreamParams params;
+    params.bandRows = bandRows;
+    params.thresholdMode = thresholdMode;
+    params.threshold = threshold;
+    params.formula = greyFormula;
+    params.labelParams = labelParams;
+    params.metrics = stageMetrics;
+
+    if (overlayPath != NULL)
+        printf("No overlay in streaming mode, ignoring %s\n", overlayPath);
+    if (thresholdMapPath != NULL)
+        printf("No threshold map in streaming mode, ignoring %s\n", thresholdMapPath);
+    if (roiPath != NULL || exclusionPath != NULL)
+        printf("No region mask in streaming mode, ignoring it\n");
+    if (resultsColors)
+        printf("No blob colors in streaming mode\n");
+
+    if (isPNMFile(backgroundPath) || isPNMFile(framePath)) {
+        printf("Streaming mode only reads TGA files\n");
+        deleteThreadPool(workerPool);
+        deleteCpuTopology(&cpuTopology);
+        return 12;
+    }
+
+    int err = detectBlobsStreaming(backgroundPath, framePath, &params, workerPool,
+                                   &blobList, &nbBlobs, &frameThreshold);
+    if (err != 0) {
+        deleteThreadPool(workerPool);
+        deleteCpuTopology(&cpuTopology);
+        return err;
+    }
+
+    writeResults(0);
+    endFrame(0);
+    finishReports();
+    if (reportToStdout) {
+        if (thresholdMode == OTSU_THRESHOLD)
+            printf("Automatic threshold: %u\n", frameThreshold);
+        printf("%u blobs detected\n", nbBlobs);
+    }
+
+    for (unsigned int k = 0; k < nbBlobs; k++)
+        deleteBlob(blobList + k);
+    free(blobList);
+    if (resultWriter != NULL)
+        deleteResultWriter(resultWriter);
+    deleteThreadPool(workerPool);
+    deleteCpuTopology(&cpuTopology);
+    return 0;
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Detect the blobs of each frame of a shared-memory ring.  The frames are
+ *  processed where the producer wrote them; the background is read from
+ *  its file and converted to grey once.  Each frame is labeled
+ *  starting from the previous one.  With a display, each frame is
+ *  published and the last one stays on screen after the ring is closed.
+ *------------------------------------------------------------------------
+ */
+int runSharedMemoryDetection(void) {
+    const struct timespec delay = {0, 1000000L};
+    FrameRing* ring = NULL;
+
+    // give the producer a few seconds to create the ring
+    for (int attempt = 0; attempt < 5000 && ring == NULL; attempt++) {
+        ring = attachFrameRing(sharedMemoryName);
+        if (ring == NULL)
+            nanosleep(&delay, NULL);
+    }
+    if (ring == NULL) {
+        printf("Cannot attach to the shared-memory ring %s\n", sharedMemoryName);
+        deleteThreadPool(workerPool);
+        deleteCpuTopology(&cpuTopology);
+        return 16;
+    }
+
+    ImageStruct format = frameRingFormat(ring);
+    startStage(stageMetrics, DECODE_STAGE);
+    oldImage = readImageFile(backgroundPath, workerPool);
+    stopStage(stageMetrics, DECODE_STAGE);
+    if (oldImage.nbRows != format.nbRows || oldImage.nbCols != format.nbCols) {
+        printf("The frames of %s do not have the size of the background\n", sharedMemoryName);
+        detachFrameRing(ring);
+        deleteThreadPool(workerPool);
+        deleteCpuTopology(&cpuTopology);
+        return 15;
+    }
+
+    // from now on the background is its own grey plane
+    oldGrey = newGreyPlane(&oldImage);
+    if (oldGrey.raster != oldImage.raster) {
+        placeImageRows(&oldGrey, workerPool);
+        for (unsigned int i = 0; i < oldImage.nbRows; i++)
+            convertRowToGrey(oldImage.type, greyFormula, imageRow(&oldImage, i), oldImage.nbCols,
+                             imageRow(&oldGrey, i));
+        deleteImageStruct(&oldImage);
+        oldImage = imageView(GRAY_RASTER, oldGrey.nbRows, oldGrey.nbCols, oldGrey.bytesPerRow, oldGrey.raster);
+    }
 
-    initDone = 1;
+    ImageStruct frameGrey = newGreyPlane(&format);
+    differenceImage = newImageStruct(MASK_RASTER, format.nbRows, format.nbCols);
+    placeImageRows(&frameGrey, workerPool);
+    placeImageRows(&differenceImage, workerPool);
+    differenceMask = newBitMask(format.nbRows, format.nbCols);
+    incrementalLabeler = newIncrementalLabeler(format.nbRows, &labelParams);
+    if (loadThresholdMap(format.nbRows, format.nbCols) != 0 || loadRegionMask(format.nbRows, format.nbCols) != 0) {
+        detachFrameRing(ring);
+        deleteThreadPool(workerPool);
+        deleteCpuTopology(&cpuTopology);
+        return 17;
+    }
+
+    unsigned long nbFrames = 0;
+    while (!frameRingFinished(ring)) {
+        uint64_t sequence;
+        if (!peekFrame(ring, &newImage, &sequence)) {
+            nanosleep(&delay, NULL);
+            continue;
+        }
+        // a grey frame is used where it is, without copy
+        newGrey = (newImage.type == GRAY_RASTER) ? newGreyPlane(&newImage) : frameGrey;
+
+        double startTime = 0.;
+        QualityLevel quality = startBudgetedFrame(NULL, &startTime);
+        if (quality == DOWNSAMPLED_QUALITY)
+            detectSampledBlobs();
+        else {
+            detectFrameBlobs();
+        }
+        measureBlobColors(&newImage, NULL);
+
+        writeResults(sequence);
+        endBudgetedFrame(quality, startTime);
+        endFrame(sequence);
+        if (reportToStdout)
+            printf("Frame %llu: %u blobs detected\n", (unsigned long long) sequence, nbBlobs);
+
+        // the frame is copied for the display before its slot is given back
+        publishDetection(&newImage, sequence);
+        releaseFrame(ring);
+        nbFrames++;
+    }
+    finishReports();
+    if (reportToStdout) {
+        printf("%lu frames processed\n", nbFrames);
+        if (latencyBudget != NULL)
+            printLatencyBudgetStats(latencyBudget);
+        if (pinWorkers)
+            printThreadPoolStats(workerPool);
+    }
+
+    detachFrameRing(ring);
+    deleteImageStruct(&frameGrey);
+    deleteImageStruct(&oldGrey);
+    deleteImageStruct(&oldImage);
+    deleteImageStruct(&differenceImage);
+    deleteBitMask(&differenceMask);
+    if (sampledMask.bits != NULL)
+        deleteBitMask(&sampledMask);
+    replaceBlobList(NULL, 0);
+    deleteIncrementalLabeler(incrementalLabeler);
+    incrementalLabeler = NULL;
+    if (latencyBudget != NULL)
+        deleteLatencyBudget(latencyBudget);
+    if (thresholdMapPath != NULL)
+        deleteImageStruct(&thresholdMap);
+    if (regionMask.rowSpans != NULL)
+        deleteRegionMask(&regionMask);
+    free(blobColors);
+    free(workerHistograms);
+    if (resultWriter != NULL)
+        deleteResultWriter(resultWriter);
+    deleteThreadPool(workerPool);
+    deleteCpuTopology(&cpuTopology);
+    return 0;
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Daemon: the ring of a name, attached the first time it is used
+ *------------------------------------------------------------------------
+ */
+ServedRing* findServedRing(const char* name) {
+    for (unsigned int k = 0; k < nbServedRings; k++)
+        if (strcmp(servedRings[k].name, name) == 0)
+            return servedRings + k;
+    if (nbServedRings == MAX_SERVED_RINGS)
+        return NULL;
+
+    FrameRing* ring = attachFrameRing(name);
+    if (ring == NULL)
+        return NULL;
+    ServedRing* served = servedRings + nbServedRings++;
+    served->name = strdup(name);
+    served->ring = ring;
+    if (served->name == NULL) {
+        printf("Unable to allocate a ring name\n");
+        exit(EXIT_FAILURE);
+    }
+    return served;
+}
+
+void forgetServedRing(ServedRing* served) {
+    detachFrameRing(served->ring);
+    free(served->name);
+    *served = servedRings[--nbServedRings];
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Daemon: detect the blobs of a frame and send them as the reply.  The
+ *  buffers of the previous request are reused when the size is the same.
+ *  Returns the quality the frame was detected at (-1 if it was not).
+ *------------------------------------------------------------------------
+ */
+int serveDetection(DetectionServer* server, ResultWriter* formatter, const ImageStruct* background,
+                   const ImageStruct* frame, uint64_t frameIndex) {
+    const unsigned int nbRows = frame->nbRows, nbCols = frame->nbCols;
+    if (background->nbRows != nbRows || background->nbCols != nbCols) {
+        sendError(server, "the frame does not have the size of the background");
+        return -1;
+    }
+    if (thresholdMapPath != NULL && thresholdMap.raster == NULL && loadThresholdMap(nbRows, nbCols) != 0) {
+        sendError(server, "cannot load the threshold map");
+        return -1;
+    }
+    if (thresholdMapPath != NULL && (thresholdMap.nbRows != nbRows || thresholdMap.nbCols != nbCols)) {
+        sendError(server, "the frame does not have the size of the threshold map");
+        return -1;
+    }
+    if ((roiPath != NULL || exclusionPath != NULL) && regionMask.rowSpans == NULL &&
+        loadRegionMask(nbRows, nbCols) != 0) {
+        sendError(server, "cannot load the region mask");
+        return -1;
+    }
+    if (regionMask.rowSpans != NULL && (regionMask.kept.nbRows != nbRows || regionMask.kept.nbCols != nbCols)) {
+        sendError(server, "the frame does not have the size of the region mask");
+        return -1;
+    }
+
+    if (differenceImage.raster == NULL || differenceImage.nbRows != nbRows || differenceImage.nbCols != nbCols) {
+        if (differenceImage.raster != NULL) {
+            deleteImageStruct(&differenceImage);
+            deleteImageStruct(&servedFrameGrey);
+            deleteBitMask(&differenceMask);
+        }
+        differenceImage = newImageStruct(MASK_RASTER, nbRows, nbCols);
+        servedFrameGrey = newImageStruct(GRAY_RASTER, nbRows, nbCols);
+        differenceMask = newBitMask(nbRows, nbCols);
+        placeImageRows(&differenceImage, workerPool);
+        placeImageRows(&servedFrameGrey, workerPool);
+    }
+
+    // the background is its own grey plane, and so is a grey frame
+    oldImage = oldGrey = imageView(GRAY_RASTER, nbRows, nbCols, background->bytesPerRow,
+                                   background->raster);
+    newImage = *frame;
+    newGrey = (frame->type == GRAY_RASTER) ? newGreyPlane(frame) : servedFrameGrey;
+
+    double startTime = 0.;
+    QualityLevel quality = startBudgetedFrame(formatter, &startTime);
+    if (quality == DOWNSAMPLED_QUALITY)
+        detectSampledBlobs();
+    else {
+        detectFrameBlobs();
+    }
+    measureBlobColors(frame, formatter);
+    writeResults(frameIndex);
+
+    startStage(stageMetrics, ENCODE_STAGE);
+    size_t size;
+    const unsigned char* reply = formatFrameResults(formatter, frameIndex, frameThreshold,
+                                                    blobList, nbBlobs, &size);
+    stopStage(stageMetrics, ENCODE_STAGE);
+    sendReply(server, reply, size);
+    endBudgetedFrame(quality, startTime);
+    endFrame(frameIndex);
+    return quality;
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Daemon: FRAME and SHM requests
+ *------------------------------------------------------------------------
+ */
+void serveFrameRequest(DetectionServer* server, ResultWriter* formatter, const DetectionRequest* request,
+                       uint64_t frameIndex) {
+    const ImageStruct* background = acquireBackground(backgroundRegistry, request->backgroundId);
+    if (background == NULL) {
+        sendError(server, "unknown or unreadable background");
+        return;
+    }
+
+    // the background is at hand decoded only: its grey plane goes in the key
+    uint64_t cacheKey = 0;
+    if (resultCache != NULL) {
+        cacheKey = detectionParamsHash();
+        for (unsigned int i = 0; i < background->nbRows && cacheKey != 0; i++)
+            cacheKey = hashBytes(imageRow(background, i), background->nbCols, cacheKey);
+        if (cacheKey != 0 && hashFileBytes(request->argument, cacheKey, &cacheKey) != 0)
+            cacheKey = 0;
+    }
+    Blob* cachedBlobs;
+    unsigned int nbCachedBlobs;
+    if (cacheKey != 0 &&
+        lookupResults(resultCache, cacheKey, &cachedBlobs, &nbCachedBlobs, &frameThreshold)) {
+        // only full-quality detections are stored
+        if (latencyBudget != NULL) {
+            setResultQuality(formatter, FULL_QUALITY);
+            if (resultWriter != NULL)
+                setResultQuality(resultWriter, FULL_QUALITY);
+        }
+        replaceBlobList(cachedBlobs, nbCachedBlobs);
+        if (resultsColors) {
+            ImageStruct frame;
+            startStage(stageMetrics, DECODE_STAGE);
+            int err = tryReadImageFile(request->argument, workerPool, &frame);
+            stopStage(stageMetrics, DECODE_STAGE);
+            if (err != 0) {
+                sendError(server, "cannot read the image file");
+                return;
+            }
+            measureBlobColors(&frame, formatter);
+            deleteImageStruct(&frame);
+        }
+        writeResults(frameIndex);
+        startStage(stageMetrics, ENCODE_STAGE);
+        size_t size;
+        const unsigned char* reply = formatFrameResults(formatter, frameIndex, frameThreshold,
+                                                        blobList, nbBlobs, &size);
+        stopStage(stageMetrics, ENCODE_STAGE);
+        sendReply(server, reply, size);
+        endFrame(frameIndex);
+        return;
+    }
+
+    ImageStruct frame;
+    startStage(stageMetrics, DECODE_STAGE);
+    int err = tryReadImageFile(request->argument, workerPool, &frame);
+    stopStage(stageMetrics, DECODE_STAGE);
+    if (err != 0) {
+        sendError(server, "cannot read the image file");
+        return;
+    }
+    int quality = serveDetection(server, formatter, background, &frame, frameIndex);
+    deleteImageStruct(&frame);
+    if (cacheKey != 0 && quality == FULL_QUALITY)
+        storeResults(resultCache, cacheKey, blobList, nbBlobs, frameThreshold);
+}
+
+void serveSharedMemoryRequest(DetectionServer* server, ResultWriter* formatter,
+                              const DetectionRequest* request) {
+    const struct timespec delay = {0, 1000000L};
+
+    const ImageStruct* background = acquireBackground(backgroundRegistry, request->backgroundId);
+    if (background == NULL) {
+        sendError(server, "unknown or unreadable background");
+        return;
+    }
+    ServedRing* served = findServedRing(request->argument);
+    if (served == NULL) {
+        sendError(server, "cannot attach to the shared-memory ring");
+        return;
+    }
+
+    // wait up to a second for the producer
+    ImageStruct frame;
+    uint64_t sequence;
+    int found = 0;
+    for (int attempt = 0; attempt < 1000 && !found; attempt++) {
+        found = peekFrame(served->ring, &frame, &sequence);
+        if (!found) {
+            if (frameRingFinished(served->ring)) {
+                forgetServedRing(served);
+                sendError(server, "the ring was closed");
+                return;
+            }
+            nanosleep(&delay, NULL);
+        }
+    }
+    if (!found) {
+        sendError(server, "no frame in the ring");
+        return;
+    }
+    serveDetection(server, formatter, background, &frame, sequence);
+    releaseFrame(served->ring);
+}
+
+
+void stopServerHandler(int signalNumber) {
+    (void) signalNumber;
+    stopServer = 1;
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Serve the requests of the socket until QUIT, SIGINT or SIGTERM.  Each
+ *  reply is a record of the result format chosen on the command line;
+ *  the latency histograms are printed at the end.
+ *------------------------------------------------------------------------
+ */
+int runDetectionServer(void) {
+    DetectionServer* server = newDetectionServer(serverSocketPath);
+    if (server == NULL) {
+        printf("Cannot listen on the socket %s\n", serverSocketPath);
+        deleteThreadPool(workerPool);
+        deleteCpuTopology(&cpuTopology);
+        return 19;
+    }
+    backgroundRegistry = newBackgroundRegistry(backgroundBudget, greyFormula, workerPool);
+    registerBackground(backgroundRegistry, "default", backgroundPath);
+    if (backgroundListPath != NULL && registerBackgroundList(backgroundRegistry, backgroundListPath) != 0) {
+        printf("Cannot register the backgrounds of %s\n", backgroundListPath);
+        deleteDetectionServer(server);
+        deleteBackgroundRegistry(backgroundRegistry);
+        deleteThreadPool(workerPool);
+        deleteCpuTopology(&cpuTopology);
+        return 20;
+    }
+    ResultWriter* formatter = newResultWriter(NULL, resultsFormat, resultsExtents);
+    if (resultsContours)
+        setResultContours(formatter, resultsChainCodes, resultsTolerance);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServerHandler;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    if (reportToStdout)
+        printf("Serving detection requests on %s\n", serverSocketPath);
+
+    DetectionRequest request;
+    uint64_t frameIndex = 0;
+    while (nextRequest(server, &request, &stopServer)) {
+        switch (request.kind) {
+            case FRAME_REQUEST:
+                serveFrameRequest(server, formatter, &request, frameIndex++);
+                break;
+
+            case SHM_REQUEST:
+                serveSharedMemoryRequest(server, formatter, &request);
+                break;
+
+            case BACKGROUND_REQUEST:
+                if (registerBackground(backgroundRegistry, request.backgroundId, request.argument) == 0)
+                    sendReply(server, NULL, 0);
+                else
+                    sendError(server, "no such background file");
+                break;
+
+            default:
+                sendReply(server, NULL, 0);
+                stopServer = 1;
+                break;
+        }
+    }
+    if (reportToStdout) {
+        printServerStats(server);
+        printBackgroundRegistryStats(backgroundRegistry);
+        if (resultCache != NULL)
+            printResultCacheStats(resultCache);
+        if (latencyBudget != NULL)
+            printLatencyBudgetStats(latencyBudget);
+        if (pinWorkers)
+            printThreadPoolStats(workerPool);
+    }
+
+    finishReports();
+    deleteDetectionServer(server);
+    deleteResultWriter(formatter);
+    deleteBackgroundRegistry(backgroundRegistry);
+    if (resultCache != NULL)
+        closeResultCache(resultCache);
+    while (nbServedRings > 0)
+        forgetServedRing(servedRings);
+    if (differenceImage.raster != NULL) {
+        deleteImageStruct(&differenceImage);
+        deleteImageStruct(&servedFrameGrey);
+        deleteBitMask(&differenceMask);
+    }
+    if (thresholdMap.raster != NULL)
+        deleteImageStruct(&thresholdMap);
+    if (regionMask.rowSpans != NULL)
+        deleteRegionMask(&regionMask);
+    free(blobColors);
+    free(workerHistograms);
+    if (sampledMask.bits != NULL)
+        deleteBitMask(&sampledMask);
+    if (latencyBudget != NULL)
+        deleteLatencyBudget(latencyBudget);
+    replaceBlobList(NULL, 0);
+    if (resultWriter != NULL)
+        deleteResultWriter(resultWriter);
+    deleteThreadPool(workerPool);
+    deleteCpuTopology(&cpuTopology);
+    return 0;
+}
+
+
+/*
+ *------------------------------------------------------------------------
+ * Read the TGA files and build the visual application
+ *------------------------------------------------------------------------
+ */
+void initializeApplication(void) {
+    startStage(stageMetrics, DECODE_STAGE);
+    oldImage = readImageFile(backgroundPath, workerPool);
+    newImage = readImageFile(framePath, workerPool);
+    stopStage(stageMetrics, DECODE_STAGE);
 
+    blobList = NULL;
 }
\ No newline at end of file